@@ -0,0 +1,403 @@
+#include "hal.h"
+#include "hallinux.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#define HAL_SIM_GPIO_COUNT 32
+#define HAL_SIM_ADC_CHANNELS 4
+#define HAL_SIM_STORAGE_SIZE 4096
+
+struct HalTimer
+{
+  const char *name;
+  uint32_t periodMs;
+  bool autoReload;
+  HalTimerCallback callback;
+  bool active;
+  uint64_t expiryUs;
+};
+
+struct HalQueue
+{
+  std::vector<uint8_t> storage;
+  size_t itemSize;
+  size_t length;
+  size_t head;
+  size_t count;
+};
+
+struct HalSignal
+{
+  bool given;
+};
+
+static uint64_t nowUs = 0;
+static bool inTimerCallback = false;
+
+static HalSimClockHook clockHook = NULL;
+static void *clockHookContext = NULL;
+
+static std::vector<HalTimer *> timers;
+static std::vector<HalQueue *> queues;
+static std::vector<HalSignal *> signals;
+
+static bool gpioValues[HAL_SIM_GPIO_COUNT];
+static uint32_t gpioIrqEvents[HAL_SIM_GPIO_COUNT];
+static HalGpioIrqCallback gpioIrqCallbacks[HAL_SIM_GPIO_COUNT];
+
+static uint16_t adcCounts[HAL_SIM_ADC_CHANNELS];
+
+// Erased flash reads back as 0xFF
+static uint8_t storage[HAL_SIM_STORAGE_SIZE];
+
+void halSimReset()
+{
+  for (HalTimer *timer : timers)
+  {
+    delete timer;
+  }
+  for (HalQueue *queue : queues)
+  {
+    delete queue;
+  }
+  for (HalSignal *signal : signals)
+  {
+    delete signal;
+  }
+  timers.clear();
+  queues.clear();
+  signals.clear();
+
+  nowUs = 0;
+  inTimerCallback = false;
+  clockHook = NULL;
+  clockHookContext = NULL;
+  memset(gpioValues, 0, sizeof(gpioValues));
+  memset(gpioIrqEvents, 0, sizeof(gpioIrqEvents));
+  memset(gpioIrqCallbacks, 0, sizeof(gpioIrqCallbacks));
+  memset(adcCounts, 0, sizeof(adcCounts));
+  memset(storage, 0xFF, sizeof(storage));
+}
+
+static void advanceClockTo(uint64_t targetUs)
+{
+  if (targetUs <= nowUs)
+  {
+    return;
+  }
+  uint64_t elapsedUs = targetUs - nowUs;
+  nowUs = targetUs;
+  if (clockHook != NULL)
+  {
+    clockHook((uint32_t)(elapsedUs / 1000), clockHookContext);
+  }
+}
+
+void halSimAdvanceMs(uint32_t ms)
+{
+  uint64_t targetUs = nowUs + (uint64_t)ms * 1000;
+
+  while (true)
+  {
+    HalTimer *next = NULL;
+    for (HalTimer *timer : timers)
+    {
+      if (timer->active && timer->expiryUs <= targetUs && (next == NULL || timer->expiryUs < next->expiryUs))
+      {
+        next = timer;
+      }
+    }
+    if (next == NULL)
+    {
+      break;
+    }
+
+    advanceClockTo(next->expiryUs);
+    if (next->autoReload)
+    {
+      next->expiryUs += (uint64_t)next->periodMs * 1000;
+    }
+    else
+    {
+      next->active = false;
+    }
+
+    // Like the FreeRTOS timer daemon, callbacks run one at a time and a
+    // callback that blocks holds up the others
+    inTimerCallback = true;
+    next->callback(next);
+    inTimerCallback = false;
+  }
+
+  advanceClockTo(targetUs);
+}
+
+void halSimSetInput(unsigned int gpio, bool value)
+{
+  if (gpio >= HAL_SIM_GPIO_COUNT || gpioValues[gpio] == value)
+  {
+    return;
+  }
+  gpioValues[gpio] = value;
+
+  uint32_t edge = value ? HAL_GPIO_IRQ_EDGE_RISE : HAL_GPIO_IRQ_EDGE_FALL;
+  if ((gpioIrqEvents[gpio] & edge) && gpioIrqCallbacks[gpio] != NULL)
+  {
+    gpioIrqCallbacks[gpio](gpio, edge);
+  }
+}
+
+void halSimSetAdc(unsigned int channel, uint16_t counts)
+{
+  if (channel < HAL_SIM_ADC_CHANNELS)
+  {
+    adcCounts[channel] = counts;
+  }
+}
+
+size_t halSimQueueCount(HalQueueHandle queue)
+{
+  return queue->count;
+}
+
+void halSimSetClockHook(HalSimClockHook hook, void *context)
+{
+  clockHook = hook;
+  clockHookContext = context;
+}
+
+// GPIO
+
+void halGpioInitInput(unsigned int gpio)
+{
+}
+
+void halGpioInitOutput(unsigned int gpio, bool value)
+{
+  halGpioPut(gpio, value);
+}
+
+void halGpioPut(unsigned int gpio, bool value)
+{
+  if (gpio < HAL_SIM_GPIO_COUNT)
+  {
+    gpioValues[gpio] = value;
+  }
+}
+
+bool halGpioGet(unsigned int gpio)
+{
+  return gpio < HAL_SIM_GPIO_COUNT && gpioValues[gpio];
+}
+
+void halGpioEnableIrq(unsigned int gpio, uint32_t events, HalGpioIrqCallback callback)
+{
+  if (gpio < HAL_SIM_GPIO_COUNT)
+  {
+    gpioIrqEvents[gpio] = events;
+    gpioIrqCallbacks[gpio] = callback;
+  }
+}
+
+// ADC
+
+void halAdcInit()
+{
+}
+
+void halAdcInitGpio(unsigned int gpio)
+{
+}
+
+uint16_t halAdcRead(unsigned int channel)
+{
+  return channel < HAL_SIM_ADC_CHANNELS ? adcCounts[channel] : 0;
+}
+
+// Clock
+
+uint64_t halTimeUs()
+{
+  return nowUs;
+}
+
+void halDelayMs(uint32_t ms)
+{
+  if (inTimerCallback)
+  {
+    // The timer daemon itself is blocked, nothing else fires meanwhile
+    advanceClockTo(nowUs + (uint64_t)ms * 1000);
+  }
+  else
+  {
+    halSimAdvanceMs(ms);
+  }
+}
+
+void halEnterCritical()
+{
+}
+
+void halExitCritical()
+{
+}
+
+uint32_t halEnterCriticalFromISR()
+{
+  return 0;
+}
+
+void halExitCriticalFromISR(uint32_t saved)
+{
+}
+
+// Timers
+
+HalTimerHandle halTimerCreate(const char *name, uint32_t periodMs, bool autoReload, HalTimerCallback callback)
+{
+  HalTimer *timer = new HalTimer{name, periodMs, autoReload, callback, false, 0};
+  timers.push_back(timer);
+  return timer;
+}
+
+bool halTimerStart(HalTimerHandle timer)
+{
+  timer->active = true;
+  timer->expiryUs = nowUs + (uint64_t)timer->periodMs * 1000;
+  return true;
+}
+
+bool halTimerStop(HalTimerHandle timer)
+{
+  timer->active = false;
+  return true;
+}
+
+bool halTimerReset(HalTimerHandle timer)
+{
+  return halTimerStart(timer);
+}
+
+bool halTimerChangePeriod(HalTimerHandle timer, uint32_t periodMs)
+{
+  // As in FreeRTOS, changing the period also starts a dormant timer
+  timer->periodMs = periodMs;
+  return halTimerStart(timer);
+}
+
+bool halTimerStartFromISR(HalTimerHandle timer)
+{
+  return halTimerStart(timer);
+}
+
+bool halTimerStopFromISR(HalTimerHandle timer)
+{
+  return halTimerStop(timer);
+}
+
+uint32_t halTimerRemainingMs(HalTimerHandle timer)
+{
+  if (!timer->active || timer->expiryUs <= nowUs)
+  {
+    return 0;
+  }
+  return (uint32_t)((timer->expiryUs - nowUs) / 1000);
+}
+
+// Queues, never block: there is no other task to make room or send
+
+HalQueueHandle halQueueCreate(size_t length, size_t itemSize)
+{
+  HalQueue *queue = new HalQueue{std::vector<uint8_t>(length * itemSize), itemSize, length, 0, 0};
+  queues.push_back(queue);
+  return queue;
+}
+
+bool halQueueSend(HalQueueHandle queue, const void *item, uint32_t timeoutMs)
+{
+  if (queue->count == queue->length)
+  {
+    return false;
+  }
+  size_t tail = (queue->head + queue->count) % queue->length;
+  memcpy(&queue->storage[tail * queue->itemSize], item, queue->itemSize);
+  queue->count++;
+  return true;
+}
+
+bool halQueueSendFromISR(HalQueueHandle queue, const void *item)
+{
+  return halQueueSend(queue, item, 0);
+}
+
+bool halQueueReceive(HalQueueHandle queue, void *item, uint32_t timeoutMs)
+{
+  if (queue->count == 0)
+  {
+    return false;
+  }
+  memcpy(item, &queue->storage[queue->head * queue->itemSize], queue->itemSize);
+  queue->head = (queue->head + 1) % queue->length;
+  queue->count--;
+  return true;
+}
+
+void halQueueDelete(HalQueueHandle queue)
+{
+  for (size_t i = 0; i < queues.size(); i++)
+  {
+    if (queues[i] == queue)
+    {
+      queues.erase(queues.begin() + i);
+      break;
+    }
+  }
+  delete queue;
+}
+
+// Signals
+
+HalSignalHandle halSignalCreate()
+{
+  HalSignal *signal = new HalSignal{false};
+  signals.push_back(signal);
+  return signal;
+}
+
+void halSignalGive(HalSignalHandle signal)
+{
+  signal->given = true;
+}
+
+bool halSignalWait(HalSignalHandle signal, uint32_t timeoutMs)
+{
+  bool given = signal->given;
+  signal->given = false;
+  return given;
+}
+
+// Storage
+
+bool halStorageRead(void *data, size_t size)
+{
+  if (size > sizeof(storage))
+  {
+    return false;
+  }
+  memcpy(data, storage, size);
+  return true;
+}
+
+bool halStorageWrite(const void *data, size_t size)
+{
+  if (size > sizeof(storage))
+  {
+    return false;
+  }
+  memset(storage, 0xFF, sizeof(storage));
+  memcpy(storage, data, size);
+  return true;
+}
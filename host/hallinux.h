@@ -0,0 +1,33 @@
+// hallinux.h
+#ifndef HALLINUX_H
+#define HALLINUX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+
+// Simulation controls for the Linux HAL backend. Time only moves when a test
+// advances it; timers fire in expiry order as it does.
+
+// Forget all timers, queues, pins and storage and restart the clock at zero
+void halSimReset();
+
+// Advance simulated time, firing every timer that expires on the way
+void halSimAdvanceMs(uint32_t ms);
+
+// Drive an input pin and deliver the matching edge interrupt
+void halSimSetInput(unsigned int gpio, bool value);
+
+// Fixed raw count returned by halAdcRead for a channel
+void halSimSetAdc(unsigned int channel, uint16_t counts);
+
+// Items currently waiting in a queue
+size_t halSimQueueCount(HalQueueHandle queue);
+
+// Called whenever simulated time moves, including inside blocking delays, so
+// a plant model can advance in step with the firmware. Cleared by reset.
+typedef void (*HalSimClockHook)(uint32_t elapsedMs, void *context);
+void halSimSetClockHook(HalSimClockHook hook, void *context);
+
+#endif // HALLINUX_H
@@ -0,0 +1,157 @@
+#include "tanksim.h"
+#include "hallinux.h"
+#include "constants.h"
+
+#include <math.h>
+
+#define ATMOSPHERE_PSI 14.696f
+#define ADC_REFERENCE_V 3.3f
+#define ADC_COUNTS 4096.0f
+
+TankSimConfig tankSimDefaultConfig()
+{
+  TankSimConfig config;
+  // Scaled to the 300 kPa (43.5 psi) range of the pressure sensor
+  config.tankLitres = 100.0f;
+  config.freeAirLitresPerS = 3.3f;
+  config.maxPressurePsi = 50.0f;
+  config.cutInPsi = 28.0f;
+  config.cutOutPsi = 38.0f;
+  config.runCurrentAmps = 8.0f;
+  config.currentPerPsi = 0.1f;
+  config.inrushMultiplier = 6.0f;
+  config.inrushTauS = 0.15f;
+  config.leakLitresPerSPerPsi = 0.0002f;
+  config.releaseLitresPerSPerPsi = 1.0f;
+  config.stepMs = 10.0f;
+  return config;
+}
+
+void tankSimInit(TankSim *sim, const TankSimConfig *config)
+{
+  sim->config = *config;
+  sim->pressurePsi = 0.0f;
+  sim->currentAmps = 0.0f;
+  sim->consumerLitresPerS = 0.0f;
+  sim->switchClosed = true;
+  sim->motorRunning = false;
+  sim->secondsSinceStart = 0.0f;
+  sim->motorStarts = 0;
+  sim->motorRunSeconds = 0.0f;
+  sim->peakPressurePsi = 0.0f;
+  tankSimStep(sim, 0);
+}
+
+static void integrate(TankSim *sim, float dt)
+{
+  const TankSimConfig &c = sim->config;
+  float p = sim->pressurePsi;
+
+  if (p >= c.cutOutPsi)
+  {
+    sim->switchClosed = false;
+  }
+  else if (p <= c.cutInPsi)
+  {
+    sim->switchClosed = true;
+  }
+
+  bool running = halGpioGet(RELAY_GPIO) && sim->switchClosed;
+  if (running && !sim->motorRunning)
+  {
+    sim->motorStarts++;
+    sim->secondsSinceStart = 0.0f;
+  }
+  sim->motorRunning = running;
+
+  float inflow = 0.0f;
+  if (running)
+  {
+    float runCurrent = c.runCurrentAmps + c.currentPerPsi * p;
+    float inrush = (c.inrushMultiplier - 1.0f) * expf(-sim->secondsSinceStart / c.inrushTauS);
+    sim->currentAmps = runCurrent * (1.0f + inrush);
+    sim->secondsSinceStart += dt;
+    sim->motorRunSeconds += dt;
+
+    inflow = c.freeAirLitresPerS * (1.0f - p / c.maxPressurePsi);
+    if (inflow < 0.0f)
+    {
+      inflow = 0.0f;
+    }
+  }
+  else
+  {
+    sim->currentAmps = 0.0f;
+  }
+
+  float outflow = c.leakLitresPerSPerPsi * p;
+  if (p > 0.0f)
+  {
+    outflow += sim->consumerLitresPerS;
+  }
+  if (halGpioGet(SOLENOID_GPIO))
+  {
+    outflow += c.releaseLitresPerSPerPsi * p;
+  }
+
+  // Free air in litres raises gauge pressure by one atmosphere per tank volume
+  p += (inflow - outflow) * ATMOSPHERE_PSI / c.tankLitres * dt;
+  sim->pressurePsi = p < 0.0f ? 0.0f : p;
+  if (sim->pressurePsi > sim->peakPressurePsi)
+  {
+    sim->peakPressurePsi = sim->pressurePsi;
+  }
+}
+
+void tankSimStep(TankSim *sim, uint32_t ms)
+{
+  float remaining = (float)ms;
+  while (remaining > 0.0f)
+  {
+    float step = remaining < sim->config.stepMs ? remaining : sim->config.stepMs;
+    integrate(sim, step / 1000.0f);
+    remaining -= step;
+  }
+
+  halSimSetAdc(PRESSURE_SENSOR_ADC_CHANNEL, tankSimPressureCounts(sim->pressurePsi));
+  halSimSetAdc(CURRENT_SENSOR_ADC_CHANNEL, tankSimCurrentCounts(sim->currentAmps));
+}
+
+static void clockHook(uint32_t elapsedMs, void *context)
+{
+  tankSimStep((TankSim *)context, elapsedMs);
+}
+
+void tankSimAttach(TankSim *sim)
+{
+  halSimSetClockHook(clockHook, sim);
+}
+
+static uint16_t voltageToCounts(float voltage)
+{
+  float counts = roundf(voltage * ADC_COUNTS / ADC_REFERENCE_V);
+  if (counts < 0.0f)
+  {
+    return 0;
+  }
+  if (counts > ADC_COUNTS - 1.0f)
+  {
+    return (uint16_t)(ADC_COUNTS - 1.0f);
+  }
+  return (uint16_t)counts;
+}
+
+uint16_t tankSimPressureCounts(float psi)
+{
+  // 0.5-4.5 V sensor spanning -100..300 kPa, divided down to 0.333-3.0 V
+  float kPa = psi / 0.14503773779f;
+  float sensorVoltage = (kPa + 100.0f) * 4.0f / 400.0f + 0.5f;
+  float voltage = (sensorVoltage - 0.5f) * (3.0f - 0.333f) / (4.5f - 0.5f) + 0.333f;
+  return voltageToCounts(voltage);
+}
+
+uint16_t tankSimCurrentCounts(float amps)
+{
+  // Hall sensor, 1.65 V quiescent, 26.4 mV/A
+  return voltageToCounts(1.65f + amps * 0.0264f);
+}
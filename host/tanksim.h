@@ -0,0 +1,55 @@
+// tanksim.h
+#ifndef TANKSIM_H
+#define TANKSIM_H
+
+#include <stdint.h>
+
+// Plant model for closed-loop host tests: a receiver tank filled by a
+// compressor behind its own pressure switch, drained by leakage, a consumer
+// and the release solenoid. It reads the relay/solenoid outputs and feeds
+// the pressure/current sensors through the Linux HAL's ADC.
+
+typedef struct
+{
+  float tankLitres;           // Receiver volume
+  float freeAirLitresPerS;    // Compressor delivery at 0 psi
+  float maxPressurePsi;       // Delivery falls linearly to zero here
+  float cutInPsi;             // Pressure switch closes at or below
+  float cutOutPsi;            // Pressure switch opens at or above
+  float runCurrentAmps;       // Motor current at 0 psi
+  float currentPerPsi;        // Extra motor current per psi of head
+  float inrushMultiplier;     // Starting current relative to running current
+  float inrushTauS;           // Inrush decay time constant
+  float leakLitresPerSPerPsi; // Leakage, proportional to pressure
+  float releaseLitresPerSPerPsi;
+  float stepMs;               // Integration step
+} TankSimConfig;
+
+typedef struct
+{
+  TankSimConfig config;
+  float pressurePsi;
+  float currentAmps;
+  float consumerLitresPerS; // Set by the test
+  bool switchClosed;
+  bool motorRunning;
+  float secondsSinceStart;
+  uint32_t motorStarts;
+  float motorRunSeconds;
+  float peakPressurePsi;
+} TankSim;
+
+TankSimConfig tankSimDefaultConfig();
+void tankSimInit(TankSim *sim, const TankSimConfig *config);
+
+// Advance the plant by ms, then publish ADC counts for the sensors
+void tankSimStep(TankSim *sim, uint32_t ms);
+
+// Step the plant whenever simulated time moves, until the next halSimReset
+void tankSimAttach(TankSim *sim);
+
+// Sensor transfer functions, inverse of the conversions in sensors.cpp
+uint16_t tankSimPressureCounts(float psi);
+uint16_t tankSimCurrentCounts(float amps);
+
+#endif // TANKSIM_H
@@ -0,0 +1,9 @@
+#include "wifi.h"
+#include "settings.h"
+
+// Host builds have no network stack; forgetting Wi-Fi only clears the
+// stored credentials.
+void disconnectAndForgetWifi()
+{
+  requestSettingsReset();
+}
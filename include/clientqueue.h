@@ -0,0 +1,49 @@
+// clientqueue.h
+#ifndef CLIENTQUEUE_H
+#define CLIENTQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "message.h"
+
+#define CLIENT_QUEUE_LENGTH 32 // Info messages waiting for one client
+#define CLIENT_QUEUE_SLOTS 4   // Clients served at once, each slot keeps its own counters
+
+// One client's backlog of info messages. Bounded, and when full the oldest
+// message makes way for the newest, so a client that falls behind sees the
+// latest state late rather than stale state forever, and it never makes
+// anyone wait. Not locked, its owner serialises access; the counters are
+// kept per slot in the module, like the outbox's.
+typedef struct
+{
+  Message messages[CLIENT_QUEUE_LENGTH];
+  size_t head; // Oldest message
+  size_t count;
+  int slot;
+} ClientQueue;
+
+typedef struct
+{
+  bool connected;
+  uint32_t depth;     // Messages waiting now
+  uint32_t highWater; // Most ever waiting
+  uint32_t queued;
+  uint32_t sent;
+  uint32_t dropped;   // Pushed out unsent by newer messages
+} ClientQueueStats;
+
+// Empties the queue and starts the slot's counters over for a new client
+void clientQueueInit(ClientQueue &queue, int slot);
+void clientQueueClose(ClientQueue &queue);
+
+// Never fails, false when it dropped the oldest message to make room
+bool clientQueuePush(ClientQueue &queue, const Message &msg);
+
+// The oldest message, NULL when empty; pop it once it was sent
+const Message *clientQueuePeek(const ClientQueue &queue);
+void clientQueuePop(ClientQueue &queue);
+
+void clientQueueGetStats(ClientQueueStats out[CLIENT_QUEUE_SLOTS]);
+
+#endif // CLIENTQUEUE_H
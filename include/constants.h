@@ -4,14 +4,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#ifndef HAL_HOST
 #include "pico/stdlib.h"
 #include "pico/cyw43_arch.h"
+#endif
 
 #define SSID_MAX_LEN 32
 #define PASSWORD_MAX_LEN 64
 #define WIFI_SSID "Pico-Compressor"
 #define WIFI_PASSWORD "password"
 #define SOCKET_SERVER_IP "192.168.10.44"
+#define MQTT_BROKER_IP "192.168.10.44"
+#define MQTT_TOPIC_PREFIX "compressor"
+#define TELEMETRY_GROUP "239.255.67.84"
+#define SOCKET_TLS_SERVER_NAME "compressor-server" // Must match the server certificate
+#define SOCKET_TLS_CA_PEM ""                       // PEM of the CA that signed it, required unless SOCKET_TLS_INSECURE
 
 const int PRESSURE_SENSOR_GPIO = 26;
 const int PRESSURE_SENSOR_ADC_CHANNEL = 0;
@@ -23,8 +30,36 @@ const int SOLENOID_GPIO = 15;
 
 const int TEMPERATURE_SENSOR_GPIO = 12;
 
+#ifndef HAL_HOST
 const int LED_GPIO = CYW43_WL_GPIO_LED_PIN;
+#endif
 const int SOCKET_SERVER_PORT = 3000;
+const int SOCKET_MAX_BATCH = 16; // Outgoing messages sent per socket task wake-up
+const int SOCKET_HEARTBEAT_INTERVAL_MS = 5000;
+const int SOCKET_HEARTBEAT_TIMEOUT_MS = 15000; // Nothing from the server this long and it is gone, 0 to never check
+const int SOCKET_KEEPALIVE_IDLE_S = 10;        // TCP keepalive, for a peer that vanished without a FIN
+const int SOCKET_KEEPALIVE_INTERVAL_S = 2;
+const int SOCKET_KEEPALIVE_COUNT = 3;
+const int SOCKET_RETRY_BASE_MS = 1000; // First reconnect within this, doubling to the max
+const int SOCKET_RETRY_MAX_MS = 60000;
+const bool SOCKET_TLS = false;          // Wrap the control socket in TLS, see tlsclient.h
+const bool SOCKET_TLS_INSECURE = false; // Accept any server certificate when no CA is set, test servers only
+const int SOCKET_TLS_HANDSHAKE_TIMEOUT_MS = 10000;
+const int SOCKET_TLS_WRITE_TIMEOUT_MS = 10000; // A write waiting on the server this long fails
+
+const int WEBSOCKET_MAX_CLIENTS = 2; // Browsers connected to /ws at once
+
+const bool CONTROL_SERVER = false; // Also accept control clients on CONTROL_SERVER_PORT, each fed every info message
+const int CONTROL_SERVER_PORT = 3001;
+
+const bool CONTROL_OVER_MQTT = false; // Talk to MQTT_BROKER_IP instead of the control socket server
+const int MQTT_BROKER_PORT = 1883;
+const int MQTT_KEEP_ALIVE_S = 30;
+
+const bool TELEMETRY_STREAM = false; // Multicast raw pressure and current samples to TELEMETRY_GROUP
+const int TELEMETRY_PORT = 5684;
+const int TELEMETRY_SAMPLE_RATE_HZ = 1000; // At most the tick rate, and dividing it
+const int TELEMETRY_BLOCK_SAMPLES = 100;   // Per channel, so ten blocks a second at 1 kHz
 
 const int SHUT_DOWN_BUTTON_GPIO = 6;
 const int FORGET_WIFI_BUTTON_GPIO = 4;
@@ -2,62 +2,38 @@
 #ifndef CONTROL_H
 #define CONTROL_H
 
-#include <string>
+#include <stddef.h>
 
-#include "FreeRTOS.h"
-#include "queue.h"
-#include "timers.h"
-#include "cJSON.h"
+#include "hal.h"
+#include "message.h"
 
 #define LONG_PRESS_THRESHOLD 500
 
 typedef enum
 {
-  COMMAND,
-  INFO
-} MessageType;
-
-typedef enum
-{
-  ON,
-  OFF,
-  OFF_RELEASE,
-  SET_COMPRESSION_TIMEOUT,
-  SET_RELEASE_TIMEOUT,
-  SET_MOTOR_TIMEOUT,
-} CommandType;
-
-typedef enum
-{
-  TURNED_ON,
-  TURNED_OFF,
-  RELEASING,
-  RELEASED,
-  PRESSURE_CHANGE,
-  MOTOR_START,
-  MOTOR_STOP,
-  COMPRESSION_COUNTOWN_END,
-  RELEASE_COUNTDOWN_END,
-  MOTOR_COUNTDOWN_END,
-  COMPRESSION_COUNTDOWN_UPDATED,
-  RELEASE_COUNTDOWN_UPDATE,
-  MOTOR_COUNTDOWN_UPDATE,
-  SUPPLY_START,
-  SUPPLY_STOP
-} InfoType;
+  CONTROL_IDLE,
+  CONTROL_COMPRESSING, // Relay on
+  CONTROL_RELEASING,   // Solenoid open
+  CONTROL_OVERHEATED,  // Stopped until the motor model cools down
+} ControlState;
 
+// Everything a server needs to catch up after connecting
 typedef struct
 {
-  MessageType messageType;
-
-  // Command-specific fields
-  CommandType commandType;
-  int timeout; // For SET_SHUTDOWN_TIMEOUT
-
-  // Info-specific fields
-  InfoType infoType;
-  float pressure; // For PRESSURE_CHANGE
-} Message;
+  ControlState state;
+  bool relay;
+  bool solenoid;
+  float pressure;
+  float current;
+  float motorTemperature;
+  uint32_t compressionRemaining; // Seconds, 0 when the countdown is not running
+  uint32_t supplyRemaining;
+  uint32_t motorRemaining;
+  int compressionTimeout; // Settings in effect
+  int supplyTimeout;
+  int motorTimeout;
+  int motorTemperatureLimit;
+} ControlSnapshot;
 
 // Initialize control queues
 void initControl();
@@ -78,20 +54,38 @@ void sendSupplyCountdownEndInfo();
 void sendMotorCountdownEndInfo();
 void sendSupplyStartInfo();
 void sendSupplyStopInfo();
+void sendScheduleTriggeredInfo(int scheduleId);
+void sendMotorTemperatureInfo(float temperature);
+void sendMotorOverheatInfo(float temperature);
+void sendMotorStartBlockedInfo(int timeout);
+
+// Live controller state, taken by the control task for GET_STATE. The socket
+// sender takes the pending snapshot and sends it ahead of the queued info
+// messages, which are all older than it.
+void controlGetSnapshot(ControlSnapshot *out);
+bool controlTakeStateSnapshot(ControlSnapshot *out);
+size_t controlSnapshotToBuffer(const ControlSnapshot &snapshot, char *buffer, size_t size);
 
 // Queue handles for receiving commands and sending info
-extern QueueHandle_t incommingMessageQueue;
+extern HalQueueHandle incommingMessageQueue;
+extern HalQueueHandle outgoingMessageQueue;
+extern HalSignalHandle outgoingMessageSignal; // Given whenever there is something for the socket to send
+extern HalQueueHandle localMessageQueue;      // Copies for clients of the device's own servers, NULL until one starts
+extern HalQueueHandle serverMessageQueue;     // Copies for the control server's clients, NULL unless it runs
 
 bool bufferToMessage(const char *buffer, Message &msg);
-std::string messageToString(const Message &msg);
 
 // Functions to process incoming commands
+void handleMessage(const Message &command);
+bool controlTaskStep(uint32_t timeoutMs);
+bool interactionTaskStep(uint32_t timeoutMs);
 void controlTask(void *params);
 void interactionTask(void *params);
 
 void handleSetCompressionTimeout(int timeout);
 void handleSetSupplyTimeout(int timeout);
 void handleSetMotorTimeout(int timeout);
+void handleSetMotorTemperatureLimit(int limit);
 void handleSupplyAndOff();
 void handleOff();
 void handleOn();
@@ -101,7 +95,7 @@ void handleSupplyStop();
 void handleMotorStart();
 void handleMotorStop();
 
-void handleTimerWatch(TimerHandle_t xTimer);
-void longPressCallback(TimerHandle_t xTimer);
+void handleButtonISR(unsigned int gpio, uint32_t events);
+void longPressCallback(HalTimerHandle xTimer);
 
 #endif // CONTROL_H
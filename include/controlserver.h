@@ -0,0 +1,34 @@
+// controlserver.h
+#ifndef CONTROLSERVER_H
+#define CONTROLSERVER_H
+
+#include <stdint.h>
+
+#define CONTROL_SERVER_QUEUE_LENGTH 32 // Info messages waiting to be fanned out to the clients
+
+// With CONTROL_SERVER set the device also listens on CONTROL_SERVER_PORT for
+// up to CLIENT_QUEUE_SLOTS TCP clients. They speak the control socket's JSON
+// lines, without the HELLO: each gets a STATE snapshot when it connects and
+// on GET_STATE, then every info message live, and may send commands. ACK and
+// HEARTBEAT_ACK are ignored, nothing is retransmitted to them. GET_STATE is
+// the only query served locally: GET_RECORDER, GET_LATENCY, GET_HISTORY and
+// GET_STATS are answered by the control socket sender, so a client's is
+// dropped with a log line rather than answered to the upstream server.
+//
+// Every client has its own queue (see clientqueue.h) drained as its TCP
+// window allows, so a slow client only loses its own oldest messages. Its
+// depth and drops are in the GET_STATS report.
+
+typedef struct
+{
+  uint32_t connected; // Clients connected now
+  uint32_t accepted;
+  uint32_t refused;   // Connections turned away with every slot taken
+} ControlServerStats;
+
+// Starts listening and the task that fans messages out, once
+void startControlServer();
+
+void controlServerGetStats(ControlServerStats *out);
+
+#endif // CONTROLSERVER_H
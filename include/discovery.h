@@ -0,0 +1,36 @@
+// discovery.h
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include <stdint.h>
+
+#include "lwip/sockets.h"
+
+#define DISCOVERY_DEVICE_SERVICE "_compressor"                   // Advertised, with the HTTP port and the /ws path
+#define DISCOVERY_SERVER_SERVICE "_compressor-server._tcp.local" // Browsed for the control server
+#define DISCOVERY_TIMEOUT_MS 3000                                // Spent browsing before falling back
+#define DISCOVERY_QUERY_INTERVAL_MS 1000
+
+// "pico-" and the last three bytes of the MAC, the mDNS host name and MQTT client id
+const char *deviceName();
+
+// Answers mDNS for <device name>.local and advertises the device's own
+// servers. Safe to call on every Wi-Fi connection: once advertising, it only
+// probes and announces again after advertisingLinkLost.
+void startAdvertising();
+
+// The station link went down, the next startAdvertising restarts the responder
+void advertisingLinkLost();
+
+// Where the next control connection goes. The endpoint kept in settings
+// comes first; after it fails, the network is browsed for the server; if no
+// server answers, the kept endpoint is tried again, or SOCKET_SERVER_IP
+// without one. Blocks for up to DISCOVERY_TIMEOUT_MS while browsing.
+void discoveryServerEndpoint(struct sockaddr_in *address);
+
+// The outcome of connecting to the endpoint last handed out. A browsed
+// endpoint that answers is kept in settings, so reconnects skip browsing.
+void discoveryConnected();
+void discoveryConnectFailed();
+
+#endif // DISCOVERY_H
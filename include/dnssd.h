@@ -0,0 +1,43 @@
+// dnssd.h
+#ifndef DNSSD_H
+#define DNSSD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DNSSD_PORT 5353
+#define DNSSD_GROUP "224.0.0.251"
+#define DNSSD_MAX_MESSAGE 512 // A legacy unicast reply never exceeds it
+#define DNSSD_NAME_MAX 128    // Dotted, without the trailing dot
+
+#define DNS_TYPE_A 1
+#define DNS_TYPE_PTR 12
+#define DNS_TYPE_SRV 33
+
+// DNS service discovery over multicast DNS, the browsing half. The device
+// sends one-shot queries from an ordinary port, which responders answer by
+// unicast with the query's id (RFC 6762 section 6.7), and takes what it needs
+// from the answers and additional records. No network code, so it runs on the
+// host.
+
+// One question for name, class IN. Returns the length, 0 if it does not fit.
+size_t dnssdQuery(uint8_t *buffer, size_t size, uint16_t id, const char *name, uint16_t type);
+
+// What is known about one instance of a service, filled in across responses
+typedef struct
+{
+  char instance[DNSSD_NAME_MAX]; // From the PTR record, e.g. "server._compressor-server._tcp.local"
+  char host[DNSSD_NAME_MAX];     // From the SRV record
+  uint16_t port;                 // From the SRV record, 0 until one is seen
+  uint32_t address;              // From the A record, network byte order, 0 until one is seen
+} DnssdService;
+
+void dnssdServiceInit(DnssdService &service);
+bool dnssdResolved(const DnssdService &service);
+
+// Takes the records of a response that concern serviceType ("_x._tcp.local")
+// into service. Names compare without regard to case. False if the message is
+// not a well-formed response.
+bool dnssdParseResponse(const uint8_t *message, size_t length, const char *serviceType, DnssdService &service);
+
+#endif // DNSSD_H
@@ -0,0 +1,50 @@
+// framing.h
+#ifndef FRAMING_H
+#define FRAMING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "messagebinary.h"
+
+#define FRAME_BUFFER_SIZE 1024 // Power of two, bytes received but not yet framed
+#define FRAME_MAX_LENGTH 512   // Longest frame handed out, including the NUL added to JSON
+
+// Splits the control socket byte stream into frames, whatever way TCP cut it
+// into reads. JSON frames are lines ended by '\n' (a trailing '\r' is removed,
+// blank lines are skipped); binary frames carry their own length. The encoding
+// can change between frames, as it does after the HELLO reply.
+
+typedef enum
+{
+  FRAME_NONE,    // Need more bytes
+  FRAME_READY,   // A frame was copied out
+  FRAME_DROPPED, // A JSON line too long to deliver was skipped
+  FRAME_CORRUPT, // Binary length larger than any frame, the stream cannot be resynchronised
+} FrameResult;
+
+typedef struct
+{
+  uint8_t ring[FRAME_BUFFER_SIZE];
+  uint32_t head;    // Total bytes written
+  uint32_t tail;    // Total bytes consumed
+  uint32_t scanned; // Bytes after tail already searched for '\n'
+  bool discarding;  // Skipping the rest of an overlong line
+  WireEncoding encoding;
+} FrameAssembler;
+
+void frameAssemblerInit(FrameAssembler &assembler, WireEncoding encoding);
+void frameAssemblerSetEncoding(FrameAssembler &assembler, WireEncoding encoding);
+
+// Copies in as much of data as fits, returns the bytes taken
+size_t frameAssemblerPush(FrameAssembler &assembler, const void *data, size_t length);
+
+// Contiguous free space to receive into directly, then commit what was written
+uint8_t *frameAssemblerWritePointer(FrameAssembler &assembler, size_t *contiguous);
+void frameAssemblerCommit(FrameAssembler &assembler, size_t length);
+
+// Copies the next frame into out. JSON frames are NUL-terminated, length
+// excludes the NUL.
+FrameResult frameAssemblerNext(FrameAssembler &assembler, uint8_t *out, size_t outSize, size_t *length);
+
+#endif // FRAMING_H
@@ -0,0 +1,81 @@
+// hal.h
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Thin hardware abstraction used by the control logic. The Pico backend
+// (src/halpico.cpp) maps this onto the SDK and FreeRTOS; the Linux backend
+// (host/hallinux.cpp) runs on simulated time for host tests.
+
+#define HAL_WAIT_FOREVER 0xFFFFFFFFu
+
+#define HAL_GPIO_IRQ_EDGE_FALL 0x4u
+#define HAL_GPIO_IRQ_EDGE_RISE 0x8u
+
+// Static storage the runtime leaves alone on a soft reset, same section as
+// the SDK's __uninitialized_ram(). Contents are garbage after power-up.
+#ifdef HAL_HOST
+#define HAL_NOINIT(name) name
+#else
+#define HAL_NOINIT(name) __attribute__((section(".uninitialized_data." #name))) name
+#endif
+
+typedef struct HalTimer *HalTimerHandle;
+typedef struct HalQueue *HalQueueHandle;
+typedef struct HalSignal *HalSignalHandle;
+
+typedef void (*HalGpioIrqCallback)(unsigned int gpio, uint32_t events);
+typedef void (*HalTimerCallback)(HalTimerHandle timer);
+
+// GPIO
+void halGpioInitInput(unsigned int gpio);
+void halGpioInitOutput(unsigned int gpio, bool value);
+void halGpioPut(unsigned int gpio, bool value);
+bool halGpioGet(unsigned int gpio);
+void halGpioEnableIrq(unsigned int gpio, uint32_t events, HalGpioIrqCallback callback);
+
+// ADC, raw 12-bit counts
+void halAdcInit();
+void halAdcInitGpio(unsigned int gpio);
+uint16_t halAdcRead(unsigned int channel);
+
+// Clock
+uint64_t halTimeUs();
+void halDelayMs(uint32_t ms);
+
+// Critical sections, exclusive across both cores. Tasks use the first pair,
+// ISRs the FromISR pair, handing back what enter returned.
+void halEnterCritical();
+void halExitCritical();
+uint32_t halEnterCriticalFromISR();
+void halExitCriticalFromISR(uint32_t saved);
+
+// One-shot or auto-reload software timers, callbacks run in timer context
+HalTimerHandle halTimerCreate(const char *name, uint32_t periodMs, bool autoReload, HalTimerCallback callback);
+bool halTimerStart(HalTimerHandle timer);
+bool halTimerStop(HalTimerHandle timer);
+bool halTimerReset(HalTimerHandle timer);
+bool halTimerChangePeriod(HalTimerHandle timer, uint32_t periodMs);
+bool halTimerStartFromISR(HalTimerHandle timer);
+bool halTimerStopFromISR(HalTimerHandle timer);
+uint32_t halTimerRemainingMs(HalTimerHandle timer); // 0 when the timer is not running
+
+// Fixed-size item queues
+HalQueueHandle halQueueCreate(size_t length, size_t itemSize);
+bool halQueueSend(HalQueueHandle queue, const void *item, uint32_t timeoutMs);
+bool halQueueSendFromISR(HalQueueHandle queue, const void *item);
+bool halQueueReceive(HalQueueHandle queue, void *item, uint32_t timeoutMs);
+void halQueueDelete(HalQueueHandle queue); // Only once nothing can reach it any more
+
+// Binary signal for waking a waiting task
+HalSignalHandle halSignalCreate();
+void halSignalGive(HalSignalHandle signal);
+bool halSignalWait(HalSignalHandle signal, uint32_t timeoutMs);
+
+// Persistent storage for one settings blob
+bool halStorageRead(void *data, size_t size);
+bool halStorageWrite(const void *data, size_t size);
+
+#endif // HAL_H
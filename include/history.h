@@ -0,0 +1,93 @@
+// history.h
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HISTORY_PERIOD_S 10       // Finest resolution kept
+#define HISTORY_SLOTS 1024        // Power of two, ten-second slots keep the last 2.8 hours
+#define HISTORY_MAX_RESOLUTION_S 86400
+#define HISTORY_CHUNK_BUCKETS 16  // Buckets per HISTORY document, see HISTORY_WRITER_MAX_LENGTH
+
+// Pressure and current the sensor task measured, reduced to one slot per
+// HISTORY_PERIOD_S of uptime so a server that restarted can fill its gap.
+// Readings are tenths, as the recorder keeps them. Times are seconds since
+// boot; every HISTORY document carries "now" to map them to the wall clock.
+typedef struct
+{
+  uint32_t slot;    // Uptime / HISTORY_PERIOD_S, tells a live slot from a stale one
+  uint16_t samples; // 0 for a slot never written
+  int16_t pressureMin;
+  int16_t pressureMax;
+  int16_t pressureMean;
+  int16_t currentMean;
+  int16_t currentMax;
+} HistorySlot;
+
+// One row of a reply, the slots of [start, start + seconds) merged
+typedef struct
+{
+  uint32_t start;
+  uint32_t seconds;
+  uint32_t samples;
+  int16_t pressureMin;
+  int16_t pressureMax;
+  int16_t pressureMean;
+  int16_t currentMean;
+  int16_t currentMax;
+} HistoryBucket;
+
+// Walks a time range bucket by bucket. next and to are absolute, seconds
+// since boot, and make the resume token: a GET_HISTORY with from = next, to =
+// to and the same resolution carries on where an interrupted reply stopped,
+// with the same end even when the original to was relative to now.
+typedef struct
+{
+  uint32_t next;
+  uint32_t to; // Exclusive
+  uint32_t resolution;
+} HistoryQuery;
+
+// The buckets of one HISTORY document, written out by historyChunkToBuffer
+typedef struct
+{
+  uint32_t now;
+  uint32_t resolution;
+  uint32_t to;   // Absolute end of the whole reply
+  uint32_t next; // Resume token with to, unless done
+  bool done;
+  size_t count;
+  HistoryBucket buckets[HISTORY_CHUNK_BUCKETS];
+} HistoryChunk;
+
+void historyClear();
+
+// Adds one reading to the slot of its time, safe against concurrent readers
+void historyAddSample(uint64_t timeUs, float pressure, float currentDraw);
+
+// Seconds since boot the history is kept in
+uint32_t historyNow();
+
+// A negative from or a to <= 0 is relative to now. The resolution is rounded
+// up to a whole number of periods, and a range starting before the oldest
+// slot still held starts there.
+void historyQueryInit(HistoryQuery &query, int from, int to, int resolution, uint32_t nowS);
+
+// Next bucket holding samples, empty stretches are skipped. False at the end.
+bool historyNextBucket(HistoryQuery &query, HistoryBucket &bucket);
+
+// Ask for a range to be sent, replacing any reply still in progress
+void historyRequest(int from, int to, int resolution);
+
+// Next HISTORY document of a requested reply, false when none is pending.
+// done is set with the last one, which has "done":true; every other one has
+// the "next" to resume from.
+bool historyNextChunk(HistoryChunk &chunk);
+
+// JSON of a chunk in the caller's buffer, 0 with an empty string when it does
+// not fit. Rows are start, samples, pressure min, max and mean, current mean
+// and max. Implemented in messagewriter.cpp.
+size_t historyChunkToBuffer(const HistoryChunk &chunk, char *buffer, size_t size);
+
+#endif // HISTORY_H
@@ -0,0 +1,70 @@
+// httpparser.h
+#ifndef HTTPPARSER_H
+#define HTTPPARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HTTP_LINE_MAX 256      // Request line or one header line, CRLF excluded
+#define HTTP_HEADER_BUDGET 1024 // Request line and every header line together
+#define HTTP_METHOD_MAX 7
+#define HTTP_PATH_MAX 63
+#define HTTP_KEY_MAX 32        // Sec-WebSocket-Key, 24 base64 characters in practice
+#define HTTP_BODY_MAX 512      // Largest Content-Length accepted, the body is kept whole
+
+// HTTP/1.1 request parsing with no network code, so it runs on the host. The
+// parser takes received bytes segment by segment, as they sit in a pbuf
+// chain, and keeps only what the server routes on: method, path, the headers
+// below, and a Content-Length body. Other headers are skipped but count
+// against HTTP_HEADER_BUDGET, so a client cannot make a connection hold more
+// than a fixed amount however it splits or pads its request.
+
+typedef enum
+{
+  HTTP_NEED_MORE, // Everything given was consumed, the request is not complete
+  HTTP_COMPLETE,  // The request is in the parser, bytes after it were not consumed
+  HTTP_ERROR,     // Malformed or over a limit, answer parser.errorStatus and close
+} HttpResult;
+
+typedef enum
+{
+  HTTP_REQUEST_LINE,
+  HTTP_HEADER_LINE,
+  HTTP_BODY,
+  HTTP_DONE,
+  HTTP_FAILED,
+} HttpParserState;
+
+typedef struct
+{
+  HttpParserState state;
+  char line[HTTP_LINE_MAX + 1]; // The line being collected
+  size_t lineLength;
+  bool lineTooLong;             // Rest of the line is discarded, the request fails at its end
+  size_t headerBytes;           // Request line and headers so far, CRLFs included
+
+  char method[HTTP_METHOD_MAX + 1];
+  char path[HTTP_PATH_MAX + 1];
+  bool hasContentLength;
+  size_t contentLength;
+  bool upgradeWebSocket;        // Upgrade: websocket
+  bool closeRequested;          // Connection: close, or an HTTP/1.0 request
+  char websocketKey[HTTP_KEY_MAX + 1];
+
+  char body[HTTP_BODY_MAX + 1]; // NUL-terminated
+  size_t bodyLength;
+
+  int errorStatus;              // With HTTP_ERROR: 400, 413, 414, 431, 501 or 505
+} HttpParser;
+
+void httpParserInit(HttpParser &parser);
+
+// Consumes bytes from data until the request is complete or data runs out.
+// After HTTP_COMPLETE, httpParserInit() readies the parser for the next
+// request on the connection. Once it has returned HTTP_ERROR it always does.
+HttpResult httpParse(HttpParser &parser, const uint8_t *data, size_t length, size_t *consumed);
+
+// Reason phrase for a status the server sends
+const char *httpReason(int status);
+
+#endif // HTTPPARSER_H
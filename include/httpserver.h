@@ -7,7 +7,8 @@
 #include <vector>
 
 // Function prototypes
-void startHttpServer();
+// The WebSocket endpoint is always served, the Wi-Fi setup pages only with configuration
+void startHttpServer(bool configuration);
 void stopHttpServer();
 
 #endif // HTTPSERVER_H
\ No newline at end of file
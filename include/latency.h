@@ -0,0 +1,42 @@
+// latency.h
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+#include <string>
+
+#define LATENCY_BUCKETS 24 // Bucket n counts samples in [2^n, 2^(n+1)) us, the last is open-ended
+
+// Stages of a network command, each measured from the end of the previous one
+typedef enum
+{
+  LATENCY_PARSE,   // lwip_recv returned -> bufferToMessage done
+  LATENCY_ENQUEUE, // Parsed -> accepted by the incoming queue
+  LATENCY_QUEUE,   // Enqueued -> dequeued by the control task
+  LATENCY_ACTUATE, // Dequeued -> first relay/solenoid write
+  LATENCY_TOTAL,   // lwip_recv returned -> first relay/solenoid write
+  LATENCY_STAGES
+} LatencyStage;
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t maxUs;
+  uint64_t totalUs;
+  uint32_t buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+// Low 32 bits of halTimeUs(), differences are valid across wrap
+uint32_t latencyNowUs();
+
+void latencyRecord(LatencyStage stage, uint32_t elapsedUs);
+void latencyReset();
+void latencyGetStage(LatencyStage stage, LatencyHistogram *out);
+
+// GET_LATENCY sets a flag the socket task takes and answers
+void latencyRequestReport();
+bool latencyTakeReportRequest();
+std::string latencyReportToString();
+
+#endif // LATENCY_H
@@ -5,6 +5,7 @@
 #define NO_SYS 0
 #define LWIP_NETCONN 1
 #define LWIP_SOCKET 1
+#define LWIP_SO_RCVTIMEO 1 // Lets the control socket wake to check the heartbeat
 
 // Memory and buffer configurations
 #define MEM_LIBC_MALLOC 0
@@ -12,6 +13,7 @@
 #define MEM_SIZE (32 * 1024)
 #define MEMP_NUM_TCP_SEG 64
 #define MEMP_NUM_ARP_QUEUE 10
+#define MEMP_NUM_TCP_PCB 12 // HTTP, WebSocket and control server clients, and the control socket
 #define PBUF_POOL_SIZE 32
 #define PBUF_POOL_BUFSIZE 1024
 
@@ -57,7 +59,7 @@
 #define LWIP_NUM_NETIF_CLIENT_DATA 1
 
 // System settings
-#define MEMP_NUM_SYS_TIMEOUT 10
+#define MEMP_NUM_SYS_TIMEOUT 12 // Two more for mDNS probing and announcing
 #define LWIP_TCPIP_CORE_LOCKING 0
 #define TCPIP_MBOX_SIZE 16
 #define TCPIP_THREAD_STACKSIZE 4096
@@ -0,0 +1,252 @@
+// message.h
+#ifndef MESSAGE_H
+#define MESSAGE_H
+
+#include <stdint.h>
+
+typedef enum
+{
+  COMMAND,
+  INFO
+} MessageType;
+
+typedef enum
+{
+  ON,
+  OFF,
+  OFF_RELEASE,
+  SET_COMPRESSION_TIMEOUT,
+  SET_RELEASE_TIMEOUT,
+  SET_MOTOR_TIMEOUT,
+  SCHEDULE,
+  UNSCHEDULE,
+  SET_CLOCK,
+  SET_MOTOR_TEMPERATURE_LIMIT,
+  GET_RECORDER,
+  GET_LATENCY,
+  RESET_LATENCY,
+  GET_STATE,
+  ACK,           // Server received every critical event up to sequence
+  HEARTBEAT_ACK, // Server is alive, the answer to a HEARTBEAT info
+  GET_HISTORY,   // Retained pressure and current over a time range, see history.h
+  GET_STATS,     // Connection counters, see stats.h
+  RESET_STATS,
+} CommandType;
+
+typedef enum
+{
+  SCHEDULE_IN,    // One-shot, time is seconds from now
+  SCHEDULE_AT,    // One-shot, time is seconds since midnight
+  SCHEDULE_DAILY, // Recurring, time is seconds since midnight
+} ScheduleMode;
+
+typedef enum
+{
+  TURNED_ON,
+  TURNED_OFF,
+  RELEASING,
+  RELEASED,
+  PRESSURE_CHANGE,
+  MOTOR_START,
+  MOTOR_STOP,
+  COMPRESSION_COUNTOWN_END,
+  RELEASE_COUNTDOWN_END,
+  MOTOR_COUNTDOWN_END,
+  COMPRESSION_COUNTDOWN_UPDATED,
+  RELEASE_COUNTDOWN_UPDATE,
+  MOTOR_COUNTDOWN_UPDATE,
+  SUPPLY_START,
+  SUPPLY_STOP,
+  SCHEDULE_TRIGGERED,
+  MOTOR_TEMPERATURE,
+  MOTOR_OVERHEAT,
+  MOTOR_START_BLOCKED,
+  HEARTBEAT // Sent every SOCKET_HEARTBEAT_INTERVAL_MS, the server answers HEARTBEAT_ACK
+} InfoType;
+
+typedef struct
+{
+  int id;
+  int time;       // Meaning depends on mode
+  uint8_t action; // CommandType, ON, OFF or OFF_RELEASE
+  uint8_t mode;   // ScheduleMode
+} SchedulePayload;
+
+typedef struct
+{
+  int from;       // Seconds since boot, negative for seconds before now
+  int to;         // Exclusive, 0 or negative relative to now
+  int resolution; // Seconds per bucket
+} HistoryPayload;
+
+// What follows the type, only the member for that type is meaningful. A new
+// message type adds a member here and costs nothing unless it outgrows the
+// largest one.
+typedef union
+{
+  int timeout;              // SET_*_TIMEOUT, *_COUNTDOWN_UPDATE(D) and MOTOR_START_BLOCKED
+  int scheduleId;           // UNSCHEDULE and SCHEDULE_TRIGGERED
+  int time;                 // SET_CLOCK
+  int limit;                // SET_MOTOR_TEMPERATURE_LIMIT
+  int since;                // GET_RECORDER, first sequence wanted
+  float pressure;           // PRESSURE_CHANGE
+  float temperature;        // MOTOR_TEMPERATURE and MOTOR_OVERHEAT
+  SchedulePayload schedule; // SCHEDULE
+  HistoryPayload history;   // GET_HISTORY
+} MessagePayload;
+
+// What goes through the control queues, copied whole on every send and
+// receive. Build one with the constructors below, which zero the bytes a
+// payload does not use.
+typedef struct
+{
+  uint8_t messageType; // MessageType
+  uint8_t type;        // CommandType or InfoType, depending on messageType
+  uint16_t sequence;   // Critical events and ACK, 0 when not sequenced
+  MessagePayload payload;
+
+  // Latency stamps (latencyNowUs) of network commands, zero for local ones
+  uint32_t receivedUs;
+  uint32_t enqueuedUs;
+} Message;
+
+static_assert(sizeof(Message) <= 24, "Message is copied through every queue, keep it small");
+
+inline bool isCommand(const Message &msg, CommandType commandType)
+{
+  return msg.messageType == MessageType::COMMAND && msg.type == commandType;
+}
+
+// Queries answered by the control socket or MQTT sender, so only the upstream
+// connection gets their reply. Local clients get GET_STATE only.
+inline bool isUpstreamQuery(const Message &msg)
+{
+  return isCommand(msg, CommandType::GET_RECORDER) || isCommand(msg, CommandType::GET_LATENCY) ||
+         isCommand(msg, CommandType::GET_HISTORY) || isCommand(msg, CommandType::GET_STATS);
+}
+
+inline bool isInfo(const Message &msg, InfoType infoType)
+{
+  return msg.messageType == MessageType::INFO && msg.type == infoType;
+}
+
+// The type as its enum, only meaningful for the matching messageType
+inline CommandType commandTypeOf(const Message &msg)
+{
+  return (CommandType)msg.type;
+}
+
+inline InfoType infoTypeOf(const Message &msg)
+{
+  return (InfoType)msg.type;
+}
+
+inline Message commandMessage(CommandType commandType)
+{
+  Message msg = {};
+  msg.messageType = MessageType::COMMAND;
+  msg.type = (uint8_t)commandType;
+  return msg;
+}
+
+inline Message infoMessage(InfoType infoType)
+{
+  Message msg = {};
+  msg.messageType = MessageType::INFO;
+  msg.type = (uint8_t)infoType;
+  return msg;
+}
+
+// SET_COMPRESSION_TIMEOUT, SET_RELEASE_TIMEOUT or SET_MOTOR_TIMEOUT
+inline Message timeoutCommand(CommandType commandType, int timeout)
+{
+  Message msg = commandMessage(commandType);
+  msg.payload.timeout = timeout;
+  return msg;
+}
+
+inline Message scheduleCommand(int id, CommandType action, ScheduleMode mode, int time)
+{
+  Message msg = commandMessage(CommandType::SCHEDULE);
+  msg.payload.schedule.id = id;
+  msg.payload.schedule.time = time;
+  msg.payload.schedule.action = (uint8_t)action;
+  msg.payload.schedule.mode = (uint8_t)mode;
+  return msg;
+}
+
+inline Message unscheduleCommand(int id)
+{
+  Message msg = commandMessage(CommandType::UNSCHEDULE);
+  msg.payload.scheduleId = id;
+  return msg;
+}
+
+inline Message clockCommand(int time)
+{
+  Message msg = commandMessage(CommandType::SET_CLOCK);
+  msg.payload.time = time;
+  return msg;
+}
+
+inline Message temperatureLimitCommand(int limit)
+{
+  Message msg = commandMessage(CommandType::SET_MOTOR_TEMPERATURE_LIMIT);
+  msg.payload.limit = limit;
+  return msg;
+}
+
+inline Message recorderCommand(int since)
+{
+  Message msg = commandMessage(CommandType::GET_RECORDER);
+  msg.payload.since = since;
+  return msg;
+}
+
+inline Message historyCommand(int from, int to, int resolution)
+{
+  Message msg = commandMessage(CommandType::GET_HISTORY);
+  msg.payload.history.from = from;
+  msg.payload.history.to = to;
+  msg.payload.history.resolution = resolution;
+  return msg;
+}
+
+// A countdown update or MOTOR_START_BLOCKED
+inline Message timeoutInfo(InfoType infoType, int timeout)
+{
+  Message msg = infoMessage(infoType);
+  msg.payload.timeout = timeout;
+  return msg;
+}
+
+inline Message pressureInfo(float pressure)
+{
+  Message msg = infoMessage(InfoType::PRESSURE_CHANGE);
+  msg.payload.pressure = pressure;
+  return msg;
+}
+
+// MOTOR_TEMPERATURE or MOTOR_OVERHEAT
+inline Message temperatureInfo(InfoType infoType, float temperature)
+{
+  Message msg = infoMessage(infoType);
+  msg.payload.temperature = temperature;
+  return msg;
+}
+
+inline Message scheduleTriggeredInfo(int id)
+{
+  Message msg = infoMessage(InfoType::SCHEDULE_TRIGGERED);
+  msg.payload.scheduleId = id;
+  return msg;
+}
+
+inline Message ackCommand(uint16_t sequence)
+{
+  Message msg = commandMessage(CommandType::ACK);
+  msg.sequence = sequence;
+  return msg;
+}
+
+#endif // MESSAGE_H
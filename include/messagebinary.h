@@ -0,0 +1,63 @@
+// messagebinary.h
+#ifndef MESSAGEBINARY_H
+#define MESSAGEBINARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "control.h"
+
+#define MESSAGE_BINARY_MAX_LENGTH 32   // Largest message frame, a SCHEDULE command is 25 bytes, 29 sequenced
+#define MESSAGE_BINARY_HEADER 3        // Length and kind
+#define MESSAGE_BINARY_STATE 0x02      // Kind of a STATE frame
+#define MESSAGE_BINARY_STATE_LENGTH 72 // A STATE frame, its length is fixed
+#define MESSAGE_BINARY_TEXT 0xFF       // Kind of a frame carrying a JSON document
+
+// Binary frame, all multi-byte values little-endian:
+//   [length:2][kind] then for kind COMMAND or INFO: [type] then per field [tag][size][value]
+// length counts the bytes after itself, kind is the MessageType, type the
+// CommandType or InfoType value, tags are SchemaTag. int and float fields are
+// 4 bytes, action and mode are 1. Fields follow the message schema; unknown
+// tags are skipped and fields the schema marks required must be present. A
+// sequenced message ends with TAG_SEQUENCE and a 2-byte value.
+// A STATE frame is [length:2][MESSAGE_BINARY_STATE] then every field of the
+// STATE schema the same way, with no type byte; bool and state fields are 1
+// byte, the state a ControlState value.
+// Replies with no binary form (recorder dumps, latency reports) go out as
+// kind MESSAGE_BINARY_TEXT with the JSON document as the rest of the frame.
+
+typedef enum
+{
+  WIRE_JSON,   // Default until the server agrees to something else
+  WIRE_BINARY,
+} WireEncoding;
+
+// Sent by the controller as its first line after connecting. A server that
+// wants binary replies with the line {"messageType":"HELLO","encoding":"BINARY"};
+// from then on both directions use binary frames. A server that never replies
+// keeps JSON.
+#define WIRE_HELLO "{\"messageType\":\"HELLO\",\"encodings\":[\"JSON\",\"BINARY\"]}"
+
+// The controller's last JSON line before it starts sending binary frames,
+// anything it sent between the reply and this line is still JSON
+#define WIRE_HELLO_BINARY_ACK "{\"messageType\":\"HELLO\",\"encoding\":\"BINARY\"}"
+
+// Returns the frame length, or 0 if msg has no schema entry or does not fit
+size_t messageToBinary(const Message &msg, uint8_t *buffer, size_t size);
+
+// Returns the frame length, MESSAGE_BINARY_STATE_LENGTH, or 0 if it does not fit
+size_t controlSnapshotToBinary(const ControlSnapshot &snapshot, uint8_t *buffer, size_t size);
+
+// Decodes exactly one frame of length bytes. A rejected frame leaves msg untouched.
+bool binaryToMessage(const uint8_t *buffer, size_t length, Message &msg);
+
+// Total length of the frame starting at buffer, 0 until the length is complete
+size_t binaryFrameLength(const uint8_t *buffer, size_t available);
+
+// Header to send ahead of a JSON document of textLength bytes
+void binaryTextHeader(uint8_t *header, size_t textLength);
+
+// True if buffer is the server's HELLO reply, implemented by the JSON parser
+bool bufferToHello(const char *buffer, WireEncoding &encoding);
+
+#endif // MESSAGEBINARY_H
@@ -0,0 +1,22 @@
+// messageparser.h
+#ifndef MESSAGEPARSER_H
+#define MESSAGEPARSER_H
+
+#include "control.h"
+
+#define MESSAGE_PARSER_NESTING_LIMIT 1000 // Same as CJSON_NESTING_LIMIT
+#define MESSAGE_PARSER_MAX_WORD 32        // Longest key or enum string that can match
+
+// bufferToMessage() is implemented here: a single pass over the text with no
+// heap use. It accepts and rejects exactly what cJSON_Parse() plus
+// cJSON_GetObjectItem() did:
+//  - any single JSON value, leading BOM and trailing garbage allowed
+//  - keys compared case-insensitively, the first occurrence wins
+//  - strings compared after unescaping, up to the first NUL
+//  - numbers converted with strtod(), valueint saturating at INT_MIN/INT_MAX
+//  - nesting limited to MESSAGE_PARSER_NESTING_LIMIT containers
+// except that a document without a known command or info type is rejected,
+// where cJSON left such a Message with its type unset. An accepted Message
+// always has a schema entry. A rejected document leaves msg untouched.
+
+#endif // MESSAGEPARSER_H
@@ -0,0 +1,91 @@
+// messageschema.h
+#ifndef MESSAGESCHEMA_H
+#define MESSAGESCHEMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "control.h"
+
+// One entry per CommandType and InfoType, listing the Message fields it
+// carries in the order they go on the wire. The JSON writer and the binary
+// codec both walk this table, so for them a new message or field is added
+// here once.
+//
+// The JSON parser does not: its keys and command names are perfect-hashed at
+// compile time, which needs them as constant strings in messageparser.cpp. A
+// new command or field also needs its Key or Word there and a case in
+// applyCommand(). parser-test writes every command in this table and parses
+// it back, so a missing parser change fails the tests.
+
+typedef enum
+{
+  FIELD_INT,    // int
+  FIELD_FLOAT,  // float
+  FIELD_ACTION, // uint8_t CommandType of a scheduled command, ON/OFF/OFF_RELEASE
+  FIELD_MODE,   // uint8_t ScheduleMode
+  FIELD_BOOL,   // bool, STATE only
+  FIELD_STATE,  // ControlState, STATE only
+} SchemaFieldKind;
+
+// Binary tags, never reuse or renumber one
+typedef enum
+{
+  TAG_TIMEOUT = 1,
+  TAG_ID = 2,
+  TAG_ACTION = 3,
+  TAG_MODE = 4,
+  TAG_TIME = 5,
+  TAG_LIMIT = 6,
+  TAG_SINCE = 7,
+  TAG_PRESSURE = 8,
+  TAG_TEMPERATURE = 9,
+  TAG_SEQUENCE = 10, // Message::sequence, any message, 2 bytes
+  TAG_FROM = 11,
+  TAG_TO = 12,
+  TAG_RESOLUTION = 13,
+  TAG_STATE = 14,
+  TAG_RELAY = 15,
+  TAG_SOLENOID = 16,
+  TAG_CURRENT = 17,
+  TAG_COMPRESSION_REMAINING = 18,
+  TAG_SUPPLY_REMAINING = 19,
+  TAG_MOTOR_REMAINING = 20,
+  TAG_COMPRESSION_TIMEOUT = 21,
+  TAG_SUPPLY_TIMEOUT = 22,
+  TAG_MOTOR_TIMEOUT = 23,
+} SchemaTag;
+
+typedef struct
+{
+  uint8_t tag;           // SchemaTag
+  uint8_t kind;          // SchemaFieldKind
+  bool required;         // Message is rejected without it
+  uint16_t offset;       // Of the payload member in Message, or the ControlSnapshot member
+  const char *jsonKey;   // ,"key": fragment
+  uint8_t jsonKeyLength;
+} SchemaField;
+
+typedef struct
+{
+  MessageType messageType;
+  int type;              // CommandType or InfoType
+  const char *name;      // As the JSON spells it, e.g. "TURNED_ON"
+  const char *json;      // {"messageType":...,"commandType":"NAME" fragment
+  uint8_t jsonLength;
+  const SchemaField *fields;
+  uint8_t fieldCount;
+} MessageSchema;
+
+// NULL for a type the table does not know
+const MessageSchema *messageSchemaFind(MessageType messageType, int type);
+const MessageSchema *messageSchemaFor(const Message &msg);
+
+// STATE is not a Message: its field offsets are into ControlSnapshot and its
+// messageType and type are unused. The first key of the nested countdowns and
+// settings objects opens them in its fragment, the one after closes the
+// previous, and STATE_JSON_END closes the last along with the document.
+#define STATE_JSON_END "}}"
+extern const MessageSchema stateSchema;
+
+#endif // MESSAGESCHEMA_H
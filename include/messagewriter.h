@@ -0,0 +1,26 @@
+// messagewriter.h
+#ifndef MESSAGEWRITER_H
+#define MESSAGEWRITER_H
+
+#include "control.h"
+#include "history.h"
+
+#define MESSAGE_WRITER_MAX_LENGTH 160  // Longest message plus the terminating NUL
+#define STATE_WRITER_MAX_LENGTH 384    // Longest STATE document plus the terminating NUL
+#define HISTORY_WRITER_MAX_LENGTH 1152 // Longest HISTORY document plus the terminating NUL
+#define MESSAGE_WRITER_MAX_DECIMALS 9  // Fraction digits tried for a float, also enough significant ones
+
+// Converts a Message into JSON in the caller's buffer. The JSON is assembled
+// from the literal fragments in the message schema and integer formatting,
+// with no heap use. Keys, order and strings are what cJSON_PrintUnformatted()
+// gave for the same Message, plus the infoType it left out for INFO types
+// without fields. Integers print the same; pressure and temperature print as
+// the shortest fixed-point decimal that reads back as the same float ("31.4",
+// where cJSON gave "31.399999618530273"), or in exponent form when that would
+// take more than MESSAGE_WRITER_MAX_DECIMALS fraction digits.
+// Returns the length written, or 0 with an empty string when it does not fit.
+// The same writer backs controlSnapshotToBuffer() (control.h), which writes
+// STATE from its schema entry, and historyChunkToBuffer() (history.h).
+size_t messageToBuffer(const Message &msg, char *buffer, size_t size);
+
+#endif // MESSAGEWRITER_H
@@ -0,0 +1,93 @@
+// mqtt.h
+#ifndef MQTT_H
+#define MQTT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MQTT_INFLIGHT_WINDOW 8     // QoS 1 publishes sent and not yet acknowledged
+#define MQTT_MALFORMED ((size_t)-1) // mqttPacketLength() on a length no broker sends
+
+// MQTT 3.1.1 packets the controller sends and receives, with no network code
+// so it runs on the host. Encoders write one whole packet and return its
+// length, or 0 if it does not fit.
+
+typedef enum
+{
+  MQTT_CONNECT = 1,
+  MQTT_CONNACK = 2,
+  MQTT_PUBLISH = 3,
+  MQTT_PUBACK = 4,
+  MQTT_SUBSCRIBE = 8,
+  MQTT_SUBACK = 9,
+  MQTT_PINGREQ = 12,
+  MQTT_PINGRESP = 13,
+  MQTT_DISCONNECT = 14,
+} MqttPacketType;
+
+typedef struct
+{
+  MqttPacketType type;
+  uint16_t packetId;   // PUBLISH at QoS 1, PUBACK and SUBACK
+  uint8_t returnCode;  // CONNACK, and the granted QoS (0x80 on failure) of a SUBACK
+  bool sessionPresent; // CONNACK
+  uint8_t qos;         // PUBLISH
+  bool retain;
+  const char *topic;   // PUBLISH, into the packet and not NUL-terminated
+  size_t topicLength;
+  const uint8_t *payload;
+  size_t payloadLength;
+} MqttPacket;
+
+// Clean session, no will, no credentials
+size_t mqttConnect(uint8_t *buffer, size_t size, const char *clientId, uint16_t keepAliveS);
+size_t mqttPublish(uint8_t *buffer, size_t size, const char *topic, const void *payload, size_t payloadLength,
+                   uint8_t qos, uint16_t packetId, bool retain);
+size_t mqttSubscribe(uint8_t *buffer, size_t size, uint16_t packetId, const char *topicFilter, uint8_t qos);
+size_t mqttPubAck(uint8_t *buffer, size_t size, uint16_t packetId);
+size_t mqttPingReq(uint8_t *buffer, size_t size);
+size_t mqttDisconnect(uint8_t *buffer, size_t size);
+
+// Total length of the packet starting at buffer, 0 until its fixed header is
+// complete, MQTT_MALFORMED if the remaining length is invalid
+size_t mqttPacketLength(const uint8_t *buffer, size_t available);
+
+// Decodes one whole packet of a type a broker sends to a client
+bool mqttParse(const uint8_t *buffer, size_t length, MqttPacket *packet);
+
+// QoS 1 publishes in flight, in the order they were sent. Each carries the
+// retransmit sequence of the event it published.
+typedef struct
+{
+  uint16_t packetId;
+  uint16_t sequence;
+  bool acknowledged;
+} MqttInFlight;
+
+typedef struct
+{
+  MqttInFlight entries[MQTT_INFLIGHT_WINDOW];
+  size_t count;
+  uint16_t nextPacketId;
+} MqttWindow;
+
+void mqttWindowInit(MqttWindow &window);
+bool mqttWindowFull(const MqttWindow &window);
+
+// Packet identifiers are never 0 and never one still in flight
+uint16_t mqttNextPacketId(MqttWindow &window);
+
+// Records a publish, returns its packet identifier. The window must not be full.
+uint16_t mqttWindowAdd(MqttWindow &window, uint16_t sequence);
+
+// Records a publish already written with a packetId from mqttNextPacketId(),
+// so one that could not be written never holds a slot. The window must not be
+// full.
+void mqttWindowRecord(MqttWindow &window, uint16_t packetId, uint16_t sequence);
+
+// Marks packetId acknowledged. Brokers acknowledge in order, but should one
+// not, only the unbroken run from the oldest publish leaves the window.
+// Returns true with the last sequence of that run when the window moved.
+bool mqttWindowAck(MqttWindow &window, uint16_t packetId, uint16_t *sequence);
+
+#endif // MQTT_H
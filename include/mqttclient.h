@@ -0,0 +1,23 @@
+// mqttclient.h
+#ifndef MQTTCLIENT_H
+#define MQTTCLIENT_H
+
+#define MQTT_RECEIVE_BUFFER 1024 // Largest packet taken from the broker, commands are far smaller
+#define MQTT_TOPIC_MAX 96
+
+// The control transport over MQTT, used instead of the control socket when
+// CONTROL_OVER_MQTT is set. Topics, under MQTT_TOPIC_PREFIX/<client id>:
+//   command            subscribed at QoS 1, one JSON command per publish
+//   event/<INFO_TYPE>  critical events at QoS 1, retried until acknowledged
+//   telemetry/<TYPE>   pressure, countdowns and temperature at QoS 0
+//   state              STATE snapshots, retained
+//   reply              recorder dumps and latency reports
+// Payloads are the JSON the control socket carries. Events are published
+// from the retransmit ring with up to MQTT_INFLIGHT_WINDOW awaiting PUBACK.
+// A PUBACK acknowledges the event, and whatever is unacknowledged when the
+// connection drops is published again on the next one, with the same seq.
+
+// Runs one broker connection, sets the socket disconnected bit when it ends
+void mqttTask(void *params);
+
+#endif // MQTTCLIENT_H
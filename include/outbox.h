@@ -0,0 +1,59 @@
+// outbox.h
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hal.h"
+#include "history.h"
+#include "messagebinary.h"
+
+#define OUTBOX_BUFFER_SIZE 2048 // Framed bytes handed to one lwip_send(), a full batch of JSON lines fits
+
+// Everything the socket task has to send on one wake-up, framed for the
+// connection's encoding and laid out contiguously so it goes out in one send.
+typedef struct
+{
+  uint8_t buffer[OUTBOX_BUFFER_SIZE];
+  size_t length;
+  size_t messages;
+} Outbox;
+
+typedef struct
+{
+  uint32_t flushes;      // lwip_send() calls
+  uint32_t messages;     // Messages and documents sent
+  uint64_t bytes;
+  uint32_t largestBatch; // Most messages in one flush
+  uint32_t failures;     // Flushes lwip_send() refused
+  uint32_t rejected;     // Dequeued messages the encoder could not write, dropped
+} OutboxStats;
+
+void outboxClear(Outbox &outbox);
+
+// Moves up to maxMessages from queue into the outbox, stopping early while a
+// message of the largest size would no longer fit. Returns the number moved;
+// limitReached is set when it stopped on a limit rather than an empty queue.
+// A message the encoder rejects is dropped and counted in OutboxStats.rejected.
+size_t outboxDrainQueue(Outbox &outbox, HalQueueHandle queue, WireEncoding encoding, size_t maxMessages,
+                        bool *limitReached);
+
+// Appends one message framed for encoding, false if it does not fit
+bool outboxAppendMessage(Outbox &outbox, WireEncoding encoding, const Message &msg);
+
+// Appends a STATE snapshot framed for encoding, false if it does not fit
+bool outboxAppendSnapshot(Outbox &outbox, WireEncoding encoding, const ControlSnapshot &snapshot);
+
+// Appends a HISTORY document framed for encoding, written in place, false if it does not fit
+bool outboxAppendHistory(Outbox &outbox, WireEncoding encoding, const HistoryChunk &chunk);
+
+// Appends a JSON document framed for encoding, false if it does not fit
+bool outboxAppendText(Outbox &outbox, WireEncoding encoding, const char *text, size_t length);
+
+// Counts a flush of the outbox's contents
+void outboxRecordFlush(const Outbox &outbox, bool sent);
+void outboxGetStats(OutboxStats *out);
+void outboxResetStats();
+
+#endif // OUTBOX_H
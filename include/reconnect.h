@@ -0,0 +1,59 @@
+// reconnect.h
+#ifndef RECONNECT_H
+#define RECONNECT_H
+
+#include <stdint.h>
+
+// Keeping the control connection up: telling a dead server from a quiet one,
+// spacing out reconnect attempts, and how long the unit was without a server.
+
+// Application-level liveness. The device sends a HEARTBEAT info every
+// interval; the server answers, and anything it sends counts. Nothing heard
+// for the timeout means the connection is dead even if TCP has not noticed.
+typedef struct
+{
+  uint32_t intervalMs;
+  uint32_t timeoutMs; // 0 turns liveness checking off
+  uint32_t lastSentMs;
+  uint32_t lastHeardMs;
+} Heartbeat;
+
+void heartbeatInit(Heartbeat &heartbeat, uint32_t intervalMs, uint32_t timeoutMs, uint32_t nowMs);
+void heartbeatSent(Heartbeat &heartbeat, uint32_t nowMs);
+void heartbeatHeard(Heartbeat &heartbeat, uint32_t nowMs);
+bool heartbeatDue(const Heartbeat &heartbeat, uint32_t nowMs);
+bool heartbeatExpired(const Heartbeat &heartbeat, uint32_t nowMs);
+
+// Exponential backoff with jitter. Attempt n waits half of min(max, base * 2^n)
+// plus a random share of the other half, so units that lost the server
+// together do not all come back at the same moment.
+typedef struct
+{
+  uint32_t baseMs;
+  uint32_t maxMs;
+  uint32_t attempts; // Since the last success
+  uint32_t randomState;
+} Backoff;
+
+void backoffInit(Backoff &backoff, uint32_t baseMs, uint32_t maxMs, uint32_t seed);
+uint32_t backoffNextDelay(Backoff &backoff);
+void backoffReset(Backoff &backoff);
+
+// From losing the server to being connected again, reported with GET_STATS
+typedef struct
+{
+  uint32_t disconnects;
+  uint32_t reconnects;
+  uint32_t heartbeatTimeouts; // Disconnects the heartbeat found before TCP did
+  uint32_t lastReconnectMs;
+  uint32_t maxReconnectMs;
+  uint64_t totalReconnectMs;
+} ReconnectStats;
+
+// Only the first disconnect of an outage starts its clock
+void reconnectRecordDisconnect(uint64_t nowUs, bool heartbeatTimeout);
+void reconnectRecordConnect(uint64_t nowUs);
+void reconnectGetStats(ReconnectStats *out);
+void reconnectResetStats();
+
+#endif // RECONNECT_H
@@ -0,0 +1,62 @@
+// recorder.h
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdint.h>
+
+#include <string>
+
+#define RECORDER_ENTRIES 128 // Power of two, entries are indexed by sequence
+#define RECORDER_MAGIC 0x52454331
+#define RECORDER_DUMP_BATCH 8 // Entries sent per socket task pass
+
+typedef enum
+{
+  RECORD_BOOT,       // value: boots since the ring was last cleared
+  RECORD_COMMAND,    // code: CommandType, value: its argument
+  RECORD_TRANSITION, // code: InfoType of the new state
+  RECORD_TIMER,      // code: RecorderTimer that expired
+  RECORD_GPIO,       // code: pin, value: new level
+  RECORD_SENSOR,     // code: InfoType of the threshold, value: reading x10
+} RecorderEvent;
+
+typedef enum
+{
+  RECORDER_TIMER_COMPRESSION,
+  RECORDER_TIMER_SUPPLY,
+  RECORDER_TIMER_MOTOR,
+} RecorderTimer;
+
+typedef struct
+{
+  uint64_t timeUs;   // halTimeUs() at the event, restarts from zero on boot
+  uint32_t sequence; // Monotonic across soft resets
+  uint8_t event;     // RecorderEvent
+  uint8_t code;
+  int16_t value;
+} RecorderEntry;
+
+// Keep the ring if it survived a soft reset, clear it otherwise, then log the boot
+void initRecorder();
+void recorderClear();
+
+// Append an entry, from a task or from an ISR
+void recorderLog(RecorderEvent event, uint8_t code, int32_t value);
+void recorderLogFromISR(RecorderEvent event, uint8_t code, int32_t value);
+
+// Sequence number the next entry will get
+uint32_t recorderNextSequence();
+
+// Oldest entry still held with sequence >= from, false if none
+bool recorderRead(uint32_t from, RecorderEntry *entry);
+
+// Ask for the ring to be sent, from the given sequence on
+void recorderRequestDump(uint32_t from);
+
+// Next entry of a requested dump; end is set once, after the last entry
+bool recorderNextDumpEntry(RecorderEntry *entry, bool *end);
+
+std::string recorderEntryToString(const RecorderEntry &entry);
+std::string recorderEndToString();
+
+#endif // RECORDER_H
@@ -0,0 +1,51 @@
+// retransmit.h
+#ifndef RETRANSMIT_H
+#define RETRANSMIT_H
+
+#include <stdint.h>
+
+#include "message.h"
+
+#define RETRANSMIT_ENTRIES 32 // Critical events held until the server acknowledges them
+
+// Critical events (state transitions, countdown ends, overheating) are not
+// put on the outgoing queue where a full queue or a dropped connection loses
+// them. They get a sequence number and stay in this ring until the server
+// sends {"messageType":"COMMAND","commandType":"ACK","seq":N}, which
+// acknowledges N and everything before it. After a reconnect everything not
+// acknowledged is sent again, so the server must ignore sequences it has
+// already seen. Sequences are 16 bits, skip 0 and restart at 1 on boot.
+// Telemetry such as pressure and countdown updates stays best-effort.
+
+typedef struct
+{
+  uint32_t appended;
+  uint32_t acknowledged;
+  uint32_t resent; // Sent again after a reconnect
+  uint32_t lost;   // Overwritten before the server acknowledged them
+} RetransmitStats;
+
+void retransmitClear();
+
+// True for the info types delivered through the ring
+bool retransmitIsCritical(InfoType infoType);
+
+// Gives msg the next sequence number and holds it, overwriting the oldest
+// unacknowledged event when the ring is full. Returns the sequence.
+uint16_t retransmitAppend(Message &msg);
+
+// The server has every event up to and including sequence
+void retransmitAcknowledge(uint16_t sequence);
+
+// Next event not yet sent on this connection. Peek, then advance once it is
+// handed to the socket.
+bool retransmitPeek(Message *msg);
+void retransmitAdvance();
+
+// A new connection: send everything not acknowledged again
+void retransmitRewind();
+
+uint32_t retransmitPending();
+void retransmitGetStats(RetransmitStats *out);
+
+#endif // RETRANSMIT_H
@@ -0,0 +1,42 @@
+// scheduler.h
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+#include "control.h"
+
+#define SCHEDULER_MAX_ENTRIES 16
+#define SECONDS_PER_DAY 86400
+
+// Scheduled command, kept in a binary min-heap ordered by due time
+typedef struct
+{
+  uint32_t due;    // Seconds since boot at which the command runs
+  int32_t time;    // Seconds from now (SCHEDULE_IN) or seconds since midnight
+  int32_t id;      // Server-assigned identifier
+  uint8_t command; // CommandType to run
+  uint8_t mode;    // ScheduleMode
+} ScheduleEntry;
+
+// Initialize the scheduler
+void initScheduler();
+
+// Set the local time of day (seconds since midnight)
+void schedulerSetClock(int secondsOfDay);
+bool schedulerHasClock();
+
+// Add (or replace) a scheduled command, returns false if it could not be scheduled
+bool schedulerAdd(int id, CommandType command, ScheduleMode mode, int time);
+bool schedulerRemove(int id);
+
+// Number of pending entries and seconds until the next one runs (-1 if none)
+int schedulerCount();
+int schedulerSecondsUntilNext();
+
+// Runs every entry that is due, returns the number of commands dispatched
+int schedulerRunDue();
+
+void schedulerTask(void *params);
+
+#endif // SCHEDULER_H
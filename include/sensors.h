@@ -2,9 +2,11 @@
 #define SENSORS_H
 
 #include "constants.h"
-#include "FreeRTOS.h"
+
+#define SENSOR_SAMPLE_INTERVAL_MS 500
 
 void initSensors(void);
+void sensorTaskStep();
 void sensorTask(void *params);
 
 // External variables (declarations only)
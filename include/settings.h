@@ -2,12 +2,8 @@
 #define SETTINGS_H
 
 #include <stdint.h>
-#include "FreeRTOS.h"
-#include "queue.h"
+#include "hal.h"
 
-// Flash memory constants
-#define FLASH_TARGET_OFFSET 0x100000
-#define FLASH_SECTOR_SIZE (4 * 1024)
 #define SETTINGS_MAGIC 0x1234ABCD
 
 // Structure to store settings
@@ -20,6 +16,11 @@ typedef struct
   int supplyTimeout;
   int motorTimeout;
   uint32_t magic; // Magic number for validity check
+  // Added after the first release, so they follow magic: a record saved
+  // without them still loads, and they read back as erased flash (all ones)
+  int motorTemperatureLimit;
+  uint32_t serverAddress; // Control server found by discovery, network byte order, 0 for none
+  uint16_t serverPort;
 } Settings;
 
 // Commands for the settings queue
@@ -37,13 +38,14 @@ typedef struct
 } SettingsCommand;
 
 // Queue and global settings
-extern QueueHandle_t settingsQueue;
+extern HalQueueHandle settingsQueue;
 extern volatile Settings currentSettings;
 
 // Function declarations
 void initSettings();
 void requestSettingsValidation();
 void requestSettingsReset();
+bool settingsTaskStep(uint32_t timeoutMs);
 void settingsTask(void *params);
 
 #endif // SETTINGS_H
@@ -0,0 +1,20 @@
+// stats.h
+#ifndef STATS_H
+#define STATS_H
+
+#include <string>
+
+// Counters the connection modules keep about themselves: the outbox, the
+// reconnect clock, the control server's client queues and TLS. GET_STATS
+// sets a flag the socket task takes and answers with one STATS document
+// composed from each module's getter. RESET_STATS zeroes the outbox, reconnect
+// and TLS counters; a client slot's restart with each new client. Command
+// latency has its own report, GET_LATENCY.
+
+void statsRequestReport();
+bool statsTakeReportRequest();
+std::string statsReportToString();
+
+void statsReset();
+
+#endif // STATS_H
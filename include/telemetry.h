@@ -0,0 +1,74 @@
+// telemetry.h
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_HEADER 22
+#define TELEMETRY_MAX_PACKET 1472 // One unfragmented UDP datagram on Ethernet
+#define TELEMETRY_MAGIC_0 'C'
+#define TELEMETRY_MAGIC_1 'T'
+#define TELEMETRY_VERSION 1
+
+// Blocks of raw sensor samples for the multicast telemetry stream. Big-endian:
+//    0  'C' 'T'
+//    2  version
+//    3  channel count
+//    4  samples per channel, u16
+//    6  sequence, u32, one more for every block sent, wrapping
+//   10  time of the first sample, u64 microseconds since boot
+//   18  sample interval, u32 microseconds
+//   22  samples, u16 each, all of channel 0 then all of channel 1 and so on
+// A listener sees loss as a gap in the sequence.
+
+// A block being filled, then the packet it became
+typedef struct
+{
+  uint8_t channels;
+  uint16_t samplesPerChannel;
+  uint32_t intervalUs;
+  uint32_t sequence; // Of the block being filled
+  uint16_t count;    // Samples taken for it so far
+  uint64_t firstUs;
+  uint8_t packet[TELEMETRY_MAX_PACKET];
+  size_t length; // Of the finished packet, valid until the next sample
+} TelemetryBlock;
+
+// False if a block of that shape does not fit in one packet
+bool telemetryBlockInit(TelemetryBlock &block, uint8_t channels, uint16_t samplesPerChannel, uint32_t intervalUs);
+
+// Adds one sample of every channel. Returns true when that finished the
+// block, which is then in packet and length.
+bool telemetryBlockAdd(TelemetryBlock &block, const uint16_t *values, uint64_t timeUs);
+
+// A received block, samples pointing into the packet
+typedef struct
+{
+  uint8_t channels;
+  uint16_t samplesPerChannel;
+  uint32_t sequence;
+  uint64_t firstUs;
+  uint32_t intervalUs;
+  const uint8_t *samples;
+} TelemetryBlockView;
+
+bool telemetryParseBlock(const uint8_t *packet, size_t length, TelemetryBlockView &view);
+uint16_t telemetrySample(const TelemetryBlockView &view, uint8_t channel, uint16_t index);
+
+// Loss accounting on the listening side
+typedef struct
+{
+  bool started;
+  uint32_t expected;   // Next sequence in order
+  uint32_t received;
+  uint32_t lost;       // Sequences skipped and not seen since
+  uint32_t late;       // Skipped ones that turned up after all, within the last 32
+  uint32_t duplicates; // Sequences already counted, or older than that
+  uint32_t missing;    // Bit n set when expected - 1 - n was skipped
+} TelemetryLossCounter;
+
+void telemetryLossInit(TelemetryLossCounter &counter);
+void telemetryLossRecord(TelemetryLossCounter &counter, uint32_t sequence);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,26 @@
+// telemetrysender.h
+#ifndef TELEMETRYSENDER_H
+#define TELEMETRYSENDER_H
+
+#include <stdint.h>
+
+#define TELEMETRY_CHANNELS 2 // Raw 12-bit ADC readings: 0 pressure, 1 current
+
+// Samples pressure and current at TELEMETRY_SAMPLE_RATE_HZ and multicasts
+// them to TELEMETRY_GROUP:TELEMETRY_PORT in blocks of TELEMETRY_BLOCK_SAMPLES
+// (see telemetry.h). One datagram reaches every listener that joined the
+// group, so the device's cost does not grow with them. Nothing is resent.
+
+typedef struct
+{
+  uint32_t sent;    // Blocks handed to the network
+  uint32_t failed;  // Blocks lwIP refused, counted in the sequence all the same
+  uint32_t overrun; // Sample periods missed because the task ran late
+} TelemetryStats;
+
+// Starts the sampling task, once. Blocks while Wi-Fi is down are lost.
+void startTelemetryStream();
+
+void telemetryGetStats(TelemetryStats *out);
+
+#endif // TELEMETRYSENDER_H
@@ -0,0 +1,35 @@
+// thermal.h
+#ifndef THERMAL_H
+#define THERMAL_H
+
+#include <stdint.h>
+
+// Motor thermal model parameters
+#define THERMAL_RATED_CURRENT_DA 150           // Rated motor current in deci-amps (15.0 A)
+#define THERMAL_RATED_RISE_C 80                // Steady-state winding rise at rated current
+#define THERMAL_TIME_CONSTANT_S 600            // Winding thermal time constant
+#define THERMAL_AMBIENT_C 25                   // Assumed ambient temperature
+#define THERMAL_RESTART_HYSTERESIS_C 10        // Must cool this far below the limit to restart
+#define THERMAL_DEFAULT_LIMIT_C 105            // Default winding temperature limit
+#define THERMAL_DELAYED_START_ID -1            // Schedule id used for a delayed start
+#define THERMAL_REPORT_STEP_MC 1000            // Report the estimate every 1 C change
+
+typedef struct
+{
+  int32_t temperatureMilliC; // Estimated winding temperature
+  int32_t limitMilliC;       // Configured limit
+  bool overheated;           // Tripped and not yet cooled below the restart threshold
+} ThermalState;
+
+// Initialize the model at ambient temperature
+void initThermal();
+
+// Advance the model by one current sample taken elapsedMs after the previous one
+void thermalUpdate(int currentDeciAmps, uint32_t elapsedMs);
+
+// Seconds the motor must cool before a start is allowed (0 if allowed now)
+int thermalSecondsUntilStartAllowed();
+
+void thermalGetState(ThermalState *state);
+
+#endif // THERMAL_H
@@ -0,0 +1,37 @@
+// tlsclient.h
+#ifndef TLSCLIENT_H
+#define TLSCLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// TLS 1.2 over the control socket with mbedTLS, for SOCKET_TLS. The session
+// of the last connection is kept, so a reconnect offers its ticket or ID and
+// a server that still knows it skips the certificate exchange and key
+// agreement. The server certificate is checked against SOCKET_TLS_CA_PEM and
+// SOCKET_TLS_SERVER_NAME; without a CA every handshake is refused, unless
+// SOCKET_TLS_INSECURE is set to accept the certificate unchecked. That is
+// only meant for a local test server, e.g.
+//
+//   openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes
+//     -keyout key.pem -out cert.pem -subj /CN=compressor-server -days 365
+//   openssl s_server -accept 3000 -cert cert.pem -key key.pem -tls1_2
+//
+// One task may send while another receives: both take the session lock, and
+// either waits for data without holding it. A send that needs the server to
+// answer first fails after SOCKET_TLS_WRITE_TIMEOUT_MS.
+
+// Handshake on a connected socket, false if it failed
+bool tlsConnect(int socket);
+
+// Like lwip_send(): length sent or -1
+int tlsSend(const void *data, size_t length);
+
+// Like lwip_recv(): bytes read, 0 once the server closed, -1 on error. After
+// timeoutMs without data it returns -1 with errno set to EWOULDBLOCK.
+int tlsRecv(void *buffer, size_t length, uint32_t timeoutMs);
+
+// Sends close_notify and frees the connection, the saved session stays
+void tlsClose();
+
+#endif // TLSCLIENT_H
@@ -0,0 +1,39 @@
+// tlsstats.h
+#ifndef TLSSTATS_H
+#define TLSSTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// What TLS costs the control connection, reported with GET_STATS. mbedTLS
+// allocates through tlsCalloc() and tlsFree(), which keep the heap figures.
+
+typedef struct
+{
+  uint32_t fullHandshakes;
+  uint32_t resumedHandshakes; // Abbreviated with a saved session, no certificate exchanged
+  uint32_t failedHandshakes;
+  uint32_t lastHandshakeMs;
+  uint32_t maxFullMs;
+  uint64_t totalFullMs;
+  uint64_t totalResumedMs;
+  uint32_t heapNow;  // Bytes mbedTLS holds
+  uint32_t heapPeak; // Most it held at once
+  uint32_t writes;   // Records of application data, one per flush
+  uint64_t plainBytes;
+  uint64_t wireBytes; // The same writes as they went out, headers, IVs and tags included
+} TlsStats;
+
+void tlsRecordHandshake(uint32_t elapsedUs, bool resumed, bool succeeded);
+void tlsRecordWrite(size_t plainBytes, size_t wireBytes);
+
+// Counting allocator for mbedtls_platform_set_calloc_free()
+void *tlsCalloc(size_t count, size_t size);
+void tlsFree(void *pointer);
+
+void tlsGetStats(TlsStats *out);
+
+// Keeps heapNow, which is still held, and restarts the peak from it
+void tlsResetStats();
+
+#endif // TLSSTATS_H
@@ -0,0 +1,88 @@
+// websocket.h
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WEBSOCKET_ACCEPT_LENGTH 28      // Base64 of a SHA-1 digest
+#define WEBSOCKET_MAX_HEADER 10         // Server frames are never masked
+#define WEBSOCKET_MAX_CONTROL_PAYLOAD 125
+
+// RFC 6455 server side: the handshake key and the frame format, with no
+// network code so it runs on the host. The decoder takes received bytes
+// segment by segment, as they sit in a pbuf chain, and unmasks payload in
+// place; nothing is copied except the payload of control frames, which may be
+// split across segments and is at most 125 bytes.
+
+typedef enum
+{
+  WEBSOCKET_CONTINUATION = 0x0,
+  WEBSOCKET_TEXT = 0x1,
+  WEBSOCKET_BINARY = 0x2,
+  WEBSOCKET_CLOSE = 0x8,
+  WEBSOCKET_PING = 0x9,
+  WEBSOCKET_PONG = 0xA,
+} WebSocketOpcode;
+
+typedef enum
+{
+  WEBSOCKET_NEED_MORE, // Everything given was consumed, nothing to hand out
+  WEBSOCKET_DATA,      // chunk holds payload of a text or binary message
+  WEBSOCKET_CONTROL,   // A complete close, ping or pong, payload in the decoder
+  WEBSOCKET_ERROR,     // Protocol violation, the connection must be failed
+} WebSocketResult;
+
+typedef enum
+{
+  WS_HEADER,
+  WS_LENGTH,
+  WS_MASK,
+  WS_PAYLOAD,
+  WS_FAILED,
+} WebSocketDecoderState;
+
+typedef struct
+{
+  WebSocketDecoderState state;
+  uint8_t header[2];
+  uint8_t headerBytes;
+  uint8_t lengthBytes;  // Extended length bytes still expected
+  uint8_t mask[4];
+  uint8_t maskBytes;
+  uint64_t remaining;   // Payload bytes of the current frame still to come
+  uint64_t maskOffset;  // Payload bytes of the current frame seen so far
+  WebSocketOpcode frameOpcode;
+  WebSocketOpcode messageOpcode; // TEXT or BINARY while a fragmented message is open
+  bool messageOpen;
+  bool final;
+
+  // Control frame being collected
+  uint8_t control[WEBSOCKET_MAX_CONTROL_PAYLOAD];
+  uint8_t controlLength;
+} WebSocketDecoder;
+
+typedef struct
+{
+  WebSocketOpcode opcode; // TEXT or BINARY, the opcode of the message, not the frame
+  const uint8_t *data;    // Into the buffer given to websocketDecode(), unmasked
+  size_t length;
+  bool messageEnd;        // Last bytes of the message
+} WebSocketChunk;
+
+// Sec-WebSocket-Accept for the client's Sec-WebSocket-Key, NUL-terminated
+void websocketAcceptKey(const char *clientKey, size_t keyLength, char accept[WEBSOCKET_ACCEPT_LENGTH + 1]);
+
+void websocketDecoderInit(WebSocketDecoder &decoder);
+
+// Consumes bytes from data, stopping after the first thing to hand out.
+// Call again with the rest until it returns WEBSOCKET_NEED_MORE. For
+// WEBSOCKET_CONTROL the opcode is decoder.frameOpcode and the payload
+// decoder.control. Once it has returned WEBSOCKET_ERROR it always does.
+WebSocketResult websocketDecode(WebSocketDecoder &decoder, uint8_t *data, size_t length, size_t *consumed,
+                                WebSocketChunk *chunk);
+
+// Writes the header of a single, unfragmented server frame, returns its length
+size_t websocketFrameHeader(uint8_t *header, WebSocketOpcode opcode, size_t payloadLength);
+
+#endif // WEBSOCKET_H
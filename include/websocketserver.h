@@ -0,0 +1,43 @@
+// websocketserver.h
+#ifndef WEBSOCKETSERVER_H
+#define WEBSOCKETSERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lwip/tcp.h"
+
+#define WEBSOCKET_PATH "/ws"
+#define WEBSOCKET_QUEUE_LENGTH 32 // Info messages waiting for the WebSocket task
+
+// Browsers on the LAN control the unit through ws://<device>/ws, upgraded
+// from the HTTP server. Each text message is one JSON Message, in both
+// directions, the same JSON the control socket carries. A client gets a STATE
+// snapshot when it connects and on GET_STATE; after that it sees every info
+// message live. Nothing is replayed to it and ACK is ignored. GET_STATE is the
+// only query served locally: the control socket sender builds the replies to
+// GET_RECORDER, GET_LATENCY, GET_HISTORY and GET_STATS, so a browser's is
+// dropped with a log line rather than answered to the control server.
+//
+// A client that cannot take a batch loses it, it never holds up control or
+// the other clients.
+
+typedef struct
+{
+  uint32_t connected; // Clients connected now
+  uint32_t accepted;
+  uint32_t refused;   // Upgrades turned away with every slot taken
+  uint32_t dropped;   // Messages not sent to a client whose send buffer was full
+} WebSocketStats;
+
+// Creates the local message queue and the task that sends it to clients, once
+void startWebSocketServer();
+
+// Answers the upgrade request on pcb and takes the connection over from the
+// HTTP server. Runs in the lwIP thread. False if every slot is taken, the
+// caller then answers the request itself.
+bool websocketUpgrade(struct tcp_pcb *pcb, const char *key, size_t keyLength);
+
+void websocketGetStats(WebSocketStats *out);
+
+#endif // WEBSOCKETSERVER_H
@@ -2,9 +2,9 @@
 #define WIFI_H
 
 #include <string>
-#include "FreeRTOS.h"
-#include "task.h"
-#include "queue.h"
+#include <stdint.h>
+
+#include "message.h"
 
 // Wi-Fi-related constants
 #define WIFI_MAX_RETRY 3
@@ -25,13 +25,17 @@ typedef struct
 
 extern WifiScanResult topScanResults[MAX_SCAN_RESULTS];
 extern int scanResultCount;
-extern QueueHandle_t outgoingMessageQueue;
 
 void initWifi();
 void disconnectAndForgetWifi();
-bool sendMessage(const std::string &message);
 void wifiTask(void *params);
 void ledTask(void *params);
 void socketTask(void *params);
 
+// For other control transports: a received command goes to the control task,
+// and a connection's start and end feed the same reconnect backoff and timing
+void enqueueCommand(Message &msg, uint32_t receivedUs);
+void notifySocketConnected();
+void notifySocketDisconnected();
+
 #endif // WIFI_H
@@ -6,6 +6,10 @@
 #include "wifi.h"
 #include "settings.h"
 #include "control.h"
+#include "scheduler.h"
+#include "sensors.h"
+#include "thermal.h"
+#include "recorder.h"
 
 #define WATCHDOG_TIMEOUT_MS 5000 // Watchdog timeout in milliseconds
 
@@ -45,8 +49,12 @@ int main()
     // Initialize the watchdog with a timeout, this will reset the system if not regularly kicked
     watchdog_enable(WATCHDOG_TIMEOUT_MS, 1);
 
+    initRecorder();
     initSettings();
     initControl();
+    initScheduler();
+    initThermal();
+    initSensors();
     initWifi();
 
     xTaskCreate(wifiTask, "WiFiTask", 4096, NULL, configMAX_PRIORITIES - 1, NULL);
@@ -54,6 +62,8 @@ int main()
     xTaskCreate(ledTask, "LedTask", 256, NULL, tskIDLE_PRIORITY, NULL);
     xTaskCreate(controlTask, "ControlTask", 256, NULL, tskIDLE_PRIORITY + 2, NULL);
     xTaskCreate(interactionTask, "InteractionTask", 256, NULL, tskIDLE_PRIORITY + 1, NULL);
+    xTaskCreate(schedulerTask, "SchedulerTask", 256, NULL, tskIDLE_PRIORITY + 2, NULL);
+    xTaskCreate(sensorTask, "SensorTask", 1024, NULL, tskIDLE_PRIORITY + 1, NULL);
 
     vTaskStartScheduler();
 
@@ -0,0 +1,87 @@
+#include "clientqueue.h"
+#include "hal.h"
+
+#include <string.h>
+
+static ClientQueueStats stats[CLIENT_QUEUE_SLOTS];
+
+static void updateDepth(const ClientQueue &queue)
+{
+  ClientQueueStats &slot = stats[queue.slot];
+  slot.depth = (uint32_t)queue.count;
+  if (slot.depth > slot.highWater)
+  {
+    slot.highWater = slot.depth;
+  }
+}
+
+void clientQueueInit(ClientQueue &queue, int slot)
+{
+  queue.head = 0;
+  queue.count = 0;
+  queue.slot = slot;
+
+  halEnterCritical();
+  memset(&stats[slot], 0, sizeof(stats[slot]));
+  stats[slot].connected = true;
+  halExitCritical();
+}
+
+void clientQueueClose(ClientQueue &queue)
+{
+  queue.count = 0;
+
+  halEnterCritical();
+  stats[queue.slot].connected = false;
+  stats[queue.slot].depth = 0;
+  halExitCritical();
+}
+
+bool clientQueuePush(ClientQueue &queue, const Message &msg)
+{
+  bool dropped = queue.count == CLIENT_QUEUE_LENGTH;
+  if (dropped)
+  {
+    queue.head = (queue.head + 1) % CLIENT_QUEUE_LENGTH;
+    queue.count--;
+  }
+  queue.messages[(queue.head + queue.count) % CLIENT_QUEUE_LENGTH] = msg;
+  queue.count++;
+
+  halEnterCritical();
+  stats[queue.slot].queued++;
+  if (dropped)
+  {
+    stats[queue.slot].dropped++;
+  }
+  updateDepth(queue);
+  halExitCritical();
+  return !dropped;
+}
+
+const Message *clientQueuePeek(const ClientQueue &queue)
+{
+  return queue.count > 0 ? &queue.messages[queue.head] : NULL;
+}
+
+void clientQueuePop(ClientQueue &queue)
+{
+  if (queue.count == 0)
+  {
+    return;
+  }
+  queue.head = (queue.head + 1) % CLIENT_QUEUE_LENGTH;
+  queue.count--;
+
+  halEnterCritical();
+  stats[queue.slot].sent++;
+  updateDepth(queue);
+  halExitCritical();
+}
+
+void clientQueueGetStats(ClientQueueStats out[CLIENT_QUEUE_SLOTS])
+{
+  halEnterCritical();
+  memcpy(out, stats, sizeof(stats));
+  halExitCritical();
+}
@@ -2,36 +2,43 @@
 #include "constants.h"
 #include "wifi.h"
 #include "settings.h"
+#include "sensors.h"
+#include "scheduler.h"
+#include "thermal.h"
+#include "recorder.h"
+#include "history.h"
+#include "latency.h"
+#include "stats.h"
+#include "retransmit.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <string>
 #include <cstring>
 
-#include "cJSON.h"
-#include "pico/stdlib.h"
-#include "FreeRTOS.h"
-#include "queue.h"
-#include "timers.h"
+#include "hal.h"
 
 // TODO: pressure drops more than 5 mins sound alarm, pressure drops more than 10 mins shut down compressor
 // motor runs for more than 2 mins sound alarms and shut down comrpresor
 // must be settable
 
 // Queue handles
-QueueHandle_t incommingMessageQueue = NULL;
-QueueHandle_t interactionQueue = NULL;
+HalQueueHandle incommingMessageQueue = NULL;
+HalQueueHandle outgoingMessageQueue = NULL;
+HalSignalHandle outgoingMessageSignal = NULL;
+HalQueueHandle localMessageQueue = NULL;
+HalQueueHandle serverMessageQueue = NULL;
+HalQueueHandle interactionQueue = NULL;
 
-TimerHandle_t longPressTimer = NULL;
+HalTimerHandle longPressTimer = NULL;
 
-TimerHandle_t compressionTimer;
-TimerHandle_t supplyTimer;
-TimerHandle_t motorTimer;
+HalTimerHandle compressionTimer;
+HalTimerHandle supplyTimer;
+HalTimerHandle motorTimer;
 
-TimerHandle_t compressionWatchTimer;
-TimerHandle_t supplyWatchTimer;
-TimerHandle_t motorWatchTimer;
+HalTimerHandle compressionWatchTimer;
+HalTimerHandle supplyWatchTimer;
+HalTimerHandle motorWatchTimer;
 
 volatile static int compressionTimeElapsed = 0;
 volatile static int supplyTimeElapsed = 0;
@@ -48,7 +55,7 @@ typedef enum
   FORGET_WIFI,
 } Interaction;
 
-void handleWatchTimerChange(TimerHandle_t xTimer)
+void handleWatchTimerChange(HalTimerHandle xTimer)
 {
   if (xTimer == compressionWatchTimer)
   {
@@ -67,16 +74,17 @@ void handleWatchTimerChange(TimerHandle_t xTimer)
   }
 }
 
-void handleTimerReached(TimerHandle_t xTimer)
+void handleTimerReached(HalTimerHandle xTimer)
 {
 
   if (xTimer == compressionTimer)
   {
     printf("Timer expired\n");
+    recorderLog(RECORD_TIMER, RECORDER_TIMER_COMPRESSION, 0);
     sendCompressionCountdownUpdatedInfo(0);
     sendCompressionCountdownEndInfo();
     handleSupplyAndOff();
-    if (xTimerStop(compressionWatchTimer, 0) != pdPASS)
+    if (!halTimerStop(compressionWatchTimer))
     {
       printf("Failed to stop watch timer \n");
     }
@@ -85,10 +93,11 @@ void handleTimerReached(TimerHandle_t xTimer)
   else if (xTimer == supplyTimer)
   {
     printf("Timer expired\n");
+    recorderLog(RECORD_TIMER, RECORDER_TIMER_SUPPLY, 0);
     sendSupplyCountdownUpdatedInfo(0);
     sendSupplyCountdownEndInfo();
     handleSupplyAndOff();
-    if (xTimerStop(supplyWatchTimer, 0) != pdPASS)
+    if (!halTimerStop(supplyWatchTimer))
     {
       printf("Failed to stop watch timer \n");
     }
@@ -97,10 +106,11 @@ void handleTimerReached(TimerHandle_t xTimer)
   else if (xTimer == motorTimer)
   {
     printf("Timer expired\n");
+    recorderLog(RECORD_TIMER, RECORDER_TIMER_MOTOR, 0);
     sendMotorCountdownUpdatedInfo(0);
     sendMotorCountdownEndInfo();
     handleSupplyAndOff();
-    if (xTimerStop(motorTimer, 0) != pdPASS)
+    if (!halTimerStop(motorTimer))
     {
       printf("Failed to stop watch timer \n");
     }
@@ -108,12 +118,12 @@ void handleTimerReached(TimerHandle_t xTimer)
   }
 }
 
-void changeTimerPreiod(TimerHandle_t xTimer, TickType_t newPeriod)
+void changeTimerPreiod(HalTimerHandle xTimer, uint32_t newPeriod)
 {
   if (xTimer == compressionTimer)
   {
     sendCompressionCountdownUpdatedInfo(newPeriod);
-    if (xTimerReset(compressionWatchTimer, 0) != pdPASS)
+    if (!halTimerReset(compressionWatchTimer))
     {
       printf("Failed to reset watch timer \n");
     }
@@ -122,7 +132,7 @@ void changeTimerPreiod(TimerHandle_t xTimer, TickType_t newPeriod)
   else if (xTimer == supplyTimer)
   {
     sendCompressionCountdownUpdatedInfo(newPeriod);
-    if (xTimerReset(supplyWatchTimer, 0) != pdPASS)
+    if (!halTimerReset(supplyWatchTimer))
     {
       printf("Failed to reset watch timer \n");
     }
@@ -131,25 +141,25 @@ void changeTimerPreiod(TimerHandle_t xTimer, TickType_t newPeriod)
   else if (xTimer == motorTimer)
   {
     sendCompressionCountdownUpdatedInfo(newPeriod);
-    if (xTimerReset(motorWatchTimer, 0) != pdPASS)
+    if (!halTimerReset(motorWatchTimer))
     {
       printf("Failed to reset watch timer \n");
     }
     motorTimeElapsed = 0;
   }
-  if (xTimerChangePeriod(xTimer, pdMS_TO_TICKS(newPeriod * 1000 * 60), 0) != pdPASS)
+  if (!halTimerChangePeriod(xTimer, newPeriod * 1000 * 60))
   {
     // Failed to change the period
     printf("Failed to change shutdown timer \n");
   }
 }
 
-void startTimer(TimerHandle_t xTimer)
+void startTimer(HalTimerHandle xTimer)
 {
   if (xTimer == compressionTimer)
   {
     sendCompressionCountdownUpdatedInfo(currentSettings.compressionTimeout);
-    if (xTimerStart(compressionWatchTimer, 0) != pdPASS)
+    if (!halTimerStart(compressionWatchTimer))
     {
       printf("Failed to reset watch timer \n");
     }
@@ -158,7 +168,7 @@ void startTimer(TimerHandle_t xTimer)
   else if (xTimer == supplyTimer)
   {
     sendCompressionCountdownUpdatedInfo(currentSettings.supplyTimeout);
-    if (xTimerStart(supplyWatchTimer, 0) != pdPASS)
+    if (!halTimerStart(supplyWatchTimer))
     {
       printf("Failed to reset watch timer \n");
     }
@@ -167,25 +177,25 @@ void startTimer(TimerHandle_t xTimer)
   else if (xTimer == motorTimer)
   {
     sendCompressionCountdownUpdatedInfo(currentSettings.motorTimeout);
-    if (xTimerStart(motorWatchTimer, 0) != pdPASS)
+    if (!halTimerStart(motorWatchTimer))
     {
       printf("Failed to reset watch timer \n");
     }
     motorTimeElapsed = 0;
   }
-  if (xTimerStart(xTimer, 0) != pdPASS)
+  if (!halTimerStart(xTimer))
   {
     // Failed to start the timer
     printf("Failed to start shutdown timer \n");
   }
 }
 
-void stopTimer(TimerHandle_t xTimer)
+void stopTimer(HalTimerHandle xTimer)
 {
   if (xTimer == compressionTimer)
   {
     sendCompressionCountdownUpdatedInfo(0);
-    if (xTimerStop(compressionWatchTimer, 0) != pdPASS)
+    if (!halTimerStop(compressionWatchTimer))
     {
       printf("Failed to reset watch timer \n");
     }
@@ -194,7 +204,7 @@ void stopTimer(TimerHandle_t xTimer)
   else if (xTimer == supplyTimer)
   {
     sendCompressionCountdownUpdatedInfo(0);
-    if (xTimerStop(supplyWatchTimer, 0) != pdPASS)
+    if (!halTimerStop(supplyWatchTimer))
     {
       printf("Failed to reset watch timer \n");
     }
@@ -203,24 +213,24 @@ void stopTimer(TimerHandle_t xTimer)
   else if (xTimer == motorTimer)
   {
     sendCompressionCountdownUpdatedInfo(0);
-    if (xTimerStop(motorWatchTimer, 0) != pdPASS)
+    if (!halTimerStop(motorWatchTimer))
     {
       printf("Failed to reset watch timer \n");
     }
     motorTimeElapsed = 0;
   }
-  if (xTimerStop(xTimer, 0) != pdPASS)
+  if (!halTimerStop(xTimer))
   {
     printf("Failed to stop watch timer \n");
   }
 }
 
-void handleRestartTimer(TimerHandle_t xTimer)
+void handleRestartTimer(HalTimerHandle xTimer)
 {
   if (xTimer == compressionTimer)
   {
     sendCompressionCountdownUpdatedInfo(currentSettings.compressionTimeout);
-    if (xTimerReset(compressionWatchTimer, 0) != pdPASS)
+    if (!halTimerReset(compressionWatchTimer))
     {
       printf("Failed to reset watch timer \n");
     }
@@ -229,7 +239,7 @@ void handleRestartTimer(TimerHandle_t xTimer)
   else if (xTimer == supplyTimer)
   {
     sendCompressionCountdownUpdatedInfo(currentSettings.supplyTimeout);
-    if (xTimerReset(supplyWatchTimer, 0) != pdPASS)
+    if (!halTimerReset(supplyWatchTimer))
     {
       printf("Failed to reset watch timer \n");
     }
@@ -238,61 +248,63 @@ void handleRestartTimer(TimerHandle_t xTimer)
   else if (xTimer == motorTimer)
   {
     sendCompressionCountdownUpdatedInfo(currentSettings.motorTimeout);
-    if (xTimerReset(motorWatchTimer, 0) != pdPASS)
+    if (!halTimerReset(motorWatchTimer))
     {
       printf("Failed to reset watch timer \n");
     }
     motorTimeElapsed = 0;
   }
-  if (xTimerReset(xTimer, 0) != pdPASS)
+  if (!halTimerReset(xTimer))
   {
     printf("Failed to restart watch timer \n");
   }
   compressionTimeElapsed = 0;
 }
 
-void longPressCallback(TimerHandle_t xTimer)
+void longPressCallback(HalTimerHandle xTimer)
 {
   // TODO:
   // printf("SHUT DOWN BUTTON PRESSED\n");
   // Interaction interaction = Interaction::SHUT_DOWN;
-  // xQueueSendToBackFromISR(interactionQueue, &interaction, NULL);
+  // halQueueSendFromISR(interactionQueue, &interaction);
 }
 
-void handleButtonISR(uint gpio, uint32_t events)
+void handleButtonISR(unsigned int gpio, uint32_t events)
 {
+  recorderLogFromISR(RECORD_GPIO, (uint8_t)gpio, (events & HAL_GPIO_IRQ_EDGE_RISE) ? 1 : 0);
+
   if (gpio == SHUT_DOWN_BUTTON_GPIO)
   {
-    if (events & GPIO_IRQ_EDGE_FALL && shutDownButtonDown == 0)
+    if (events & HAL_GPIO_IRQ_EDGE_FALL && shutDownButtonDown == 0)
     {
       printf("SHUT DOWN BUTTON DOWN\n");
       shutDownButtonDown = 1;
-      buttonPressStartTime = xTaskGetTickCount(); // Get current tick count as the start time
+      buttonPressStartTime = halTimeUs() / 1000; // Get current time as the start time
       longPressHandled = false;
-      xTimerStartFromISR(longPressTimer, 0);
+      halTimerStartFromISR(longPressTimer);
     }
-    else if (events & GPIO_IRQ_EDGE_RISE && shutDownButtonDown == 1)
+    else if (events & HAL_GPIO_IRQ_EDGE_RISE && shutDownButtonDown == 1)
     {
       printf("SHUT DOWN BUTTON UP\n");
       shutDownButtonDown = 0;
-      xTimerStopFromISR(longPressTimer, 0);
+      halTimerStopFromISR(longPressTimer);
       if (!longPressHandled)
       {
         printf("SHUT DOWN BUTTON PRESSED\n");
         Interaction interaction = Interaction::SHUT_DOWN;
-        xQueueSendToBackFromISR(interactionQueue, &interaction, NULL);
+        halQueueSendFromISR(interactionQueue, &interaction);
       }
     }
   }
-  else if (events & GPIO_IRQ_EDGE_FALL && gpio == FORGET_WIFI_BUTTON_GPIO)
+  else if (events & HAL_GPIO_IRQ_EDGE_FALL && gpio == FORGET_WIFI_BUTTON_GPIO)
   {
     printf("FORGET WIFI BUTTON PRESSED\n");
     Interaction interaction = Interaction::FORGET_WIFI;
-    xQueueSendToBackFromISR(interactionQueue, &interaction, NULL);
+    halQueueSendFromISR(interactionQueue, &interaction);
   }
 }
 
-void sharedISR(uint gpio, uint32_t events)
+void sharedISR(unsigned int gpio, uint32_t events)
 {
   handleButtonISR(gpio, events);
 }
@@ -300,28 +312,19 @@ void sharedISR(uint gpio, uint32_t events)
 // Initialize control queues
 void initControl()
 {
-  gpio_init(SHUT_DOWN_BUTTON_GPIO);
-  gpio_set_dir(SHUT_DOWN_BUTTON_GPIO, GPIO_IN);
-  gpio_init(FORGET_WIFI_BUTTON_GPIO);
-  gpio_set_dir(FORGET_WIFI_BUTTON_GPIO, GPIO_IN);
-
-  gpio_set_irq_enabled_with_callback(SHUT_DOWN_BUTTON_GPIO, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true, &sharedISR);
-  gpio_set_irq_enabled(FORGET_WIFI_BUTTON_GPIO, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
+  halGpioInitInput(SHUT_DOWN_BUTTON_GPIO);
+  halGpioInitInput(FORGET_WIFI_BUTTON_GPIO);
 
-  gpio_init(RELAY_GPIO);
-  gpio_set_dir(RELAY_GPIO, GPIO_OUT);
-  gpio_put(RELAY_GPIO, 0);
+  halGpioEnableIrq(SHUT_DOWN_BUTTON_GPIO, HAL_GPIO_IRQ_EDGE_FALL | HAL_GPIO_IRQ_EDGE_RISE, &sharedISR);
+  halGpioEnableIrq(FORGET_WIFI_BUTTON_GPIO, HAL_GPIO_IRQ_EDGE_FALL | HAL_GPIO_IRQ_EDGE_RISE, &sharedISR);
 
-  gpio_init(SOLENOID_GPIO);
-  gpio_set_dir(SOLENOID_GPIO, GPIO_OUT);
-  gpio_put(SOLENOID_GPIO, 0);
+  halGpioInitOutput(RELAY_GPIO, 0);
+  halGpioInitOutput(SOLENOID_GPIO, 0);
 
-  const TickType_t compressionTimerPeriod = pdMS_TO_TICKS(currentSettings.compressionTimeout * 1000 * 60); // 1000 ms timer period
-  compressionTimer = xTimerCreate("compressionTimer",                                                      // Just a text name, not used by the kernel.
-                                  compressionTimerPeriod,
-                                  pdFALSE,             // The timer will auto-reload itself when it expires.
-                                  (void *)0,           // Assign each timer a unique id equal to its array index.
-                                  handleTimerReached); // Pointer to the timer callback function
+  compressionTimer = halTimerCreate("compressionTimer",
+                                   (uint32_t)currentSettings.compressionTimeout * 1000 * 60,
+                                   false, // One-shot, restarted explicitly
+                                   handleTimerReached);
 
   if (compressionTimer == NULL)
   {
@@ -329,12 +332,10 @@ void initControl()
     printf("Failed to create shutdown timer \n");
   }
 
-  const TickType_t supplyTimerPeriod = pdMS_TO_TICKS(currentSettings.supplyTimeout * 1000 * 60); // 1000 ms timer period
-  supplyTimer = xTimerCreate("supplyTimer",                                                      // Just a text name, not used by the kernel.
-                             supplyTimerPeriod,
-                             pdFALSE,             // The timer will auto-reload itself when it expires.
-                             (void *)0,           // Assign each timer a unique id equal to its array index.
-                             handleTimerReached); // Pointer to the timer callback function
+  supplyTimer = halTimerCreate("supplyTimer",
+                              (uint32_t)currentSettings.supplyTimeout * 1000 * 60,
+                              false, // One-shot, restarted explicitly
+                              handleTimerReached);
 
   if (supplyTimer == NULL)
   {
@@ -342,12 +343,10 @@ void initControl()
     printf("Failed to create shutdown timer \n");
   }
 
-  const TickType_t motorTimerPeriod = pdMS_TO_TICKS(currentSettings.motorTimeout * 1000 * 60); // 1000 ms timer period
-  motorTimer = xTimerCreate("motorTimer",                                                      // Just a text name, not used by the kernel.
-                            motorTimerPeriod,
-                            pdFALSE,             // The timer will auto-reload itself when it expires.
-                            (void *)0,           // Assign each timer a unique id equal to its array index.
-                            handleTimerReached); // Pointer to the timer callback function
+  motorTimer = halTimerCreate("motorTimer",
+                             (uint32_t)currentSettings.motorTimeout * 1000 * 60,
+                             false, // One-shot, restarted explicitly
+                             handleTimerReached);
 
   if (motorTimer == NULL)
   {
@@ -355,54 +354,60 @@ void initControl()
     printf("Failed to create shutdown timer \n");
   }
 
-  compressionWatchTimer = xTimerCreate("compressionWatchTimer",
-                                       pdMS_TO_TICKS(60000),
-                                       pdTRUE,
-                                       (void *)0,
-                                       handleWatchTimerChange);
+  compressionWatchTimer = halTimerCreate("compressionWatchTimer",
+                                      60000,
+                                      true,
+                                      handleWatchTimerChange);
   if (compressionWatchTimer == NULL)
   {
     printf("Failed to create the timer.\n");
   }
 
-  supplyWatchTimer = xTimerCreate("supplyWatchTimer",
-                                  pdMS_TO_TICKS(60000),
-                                  pdTRUE,
-                                  (void *)0,
-                                  handleWatchTimerChange);
+  supplyWatchTimer = halTimerCreate("supplyWatchTimer",
+                                 60000,
+                                 true,
+                                 handleWatchTimerChange);
   if (supplyWatchTimer == NULL)
   {
     printf("Failed to create the timer.\n");
   }
 
-  motorWatchTimer = xTimerCreate("motorWatchTimer",
-                                 pdMS_TO_TICKS(60000),
-                                 pdTRUE,
-                                 (void *)0,
-                                 handleWatchTimerChange);
+  motorWatchTimer = halTimerCreate("motorWatchTimer",
+                                60000,
+                                true,
+                                handleWatchTimerChange);
   if (motorWatchTimer == NULL)
   {
     printf("Failed to create the timer.\n");
   }
 
-  longPressTimer = xTimerCreate("LongPressTimer",
-                                pdMS_TO_TICKS(LONG_PRESS_THRESHOLD),
-                                pdFALSE,
-                                0,
-                                longPressCallback);
+  longPressTimer = halTimerCreate("LongPressTimer",
+                                  LONG_PRESS_THRESHOLD,
+                                  false,
+                                  longPressCallback);
   if (longPressTimer == NULL)
   {
     printf("Failed to create the timer.\n");
   }
 
-  incommingMessageQueue = xQueueCreate(10, sizeof(Message));
+  incommingMessageQueue = halQueueCreate(10, sizeof(Message));
 
   if (!incommingMessageQueue)
   {
     printf("Failed to create incoming message queues.\n");
   }
 
-  interactionQueue = xQueueCreate(10, sizeof(Interaction));
+  outgoingMessageQueue = halQueueCreate(SOCKET_MAX_BATCH, sizeof(Message));
+
+  if (!outgoingMessageQueue)
+  {
+    printf("Failed to create outgoing message queue.\n");
+  }
+
+  outgoingMessageSignal = halSignalCreate();
+  retransmitClear();
+
+  interactionQueue = halQueueCreate(10, sizeof(Interaction));
 
   if (!interactionQueue)
   {
@@ -411,423 +416,192 @@ void initControl()
 }
 
 // Functions to send specific info types
-void sendPressureChangeInfo(float pressure)
+// Queues an info message for the socket and wakes the sender. Critical
+// events go to the retransmit ring instead, where they wait for an ACK.
+// Local clients get a copy if there is room, they are never waited for.
+static void sendInfo(Message msg)
 {
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = PRESSURE_CHANGE;
-  msg.pressure = pressure;
-
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
+  if (retransmitIsCritical(infoTypeOf(msg)))
+  {
+    retransmitAppend(msg);
+  }
+  else if (!halQueueSend(outgoingMessageQueue, &msg, 100))
   {
     printf("Failed to enqueue info message.\n");
   }
+  halSignalGive(outgoingMessageSignal);
+
+  if (localMessageQueue != NULL)
+  {
+    halQueueSend(localMessageQueue, &msg, 0);
+  }
+  if (serverMessageQueue != NULL)
+  {
+    halQueueSend(serverMessageQueue, &msg, 0);
+  }
 }
 
-void sendTurnedOnInfo()
+void sendPressureChangeInfo(float pressure)
 {
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = TURNED_ON;
+  sendInfo(pressureInfo(pressure));
+}
 
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-  {
-    printf("Failed to enqueue info message.\n");
-  }
+void sendTurnedOnInfo()
+{
+  sendInfo(infoMessage(TURNED_ON));
 }
 
 void sendTurnedOffInfo()
 {
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = TURNED_OFF;
-
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-  {
-    printf("Failed to enqueue info message.\n");
-  }
+  sendInfo(infoMessage(TURNED_OFF));
 }
 
 void sendReleasingInfo()
 {
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = RELEASING;
-
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-  {
-    printf("Failed to enqueue info message.\n");
-  }
+  sendInfo(infoMessage(RELEASING));
 }
 
 void sendSupplydInfo()
 {
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = RELEASED;
-
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-  {
-    printf("Failed to enqueue info message.\n");
-  }
+  sendInfo(infoMessage(RELEASED));
 }
 
 void sendMotorStartInfo()
 {
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = MOTOR_START;
-
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-  {
-    printf("Failed to enqueue info message.\n");
-  }
+  sendInfo(infoMessage(MOTOR_START));
 }
 
 void sendMotorStopInfo()
 {
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = MOTOR_STOP;
-
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-  {
-    printf("Failed to enqueue info message.\n");
-  }
+  sendInfo(infoMessage(MOTOR_STOP));
 }
 
 void sendCompressionCountdownUpdatedInfo(int timeout)
 {
-
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = COMPRESSION_COUNTDOWN_UPDATED;
-  msg.timeout = timeout;
-
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-  {
-    printf("Failed to enqueue info message.\n");
-  }
+  sendInfo(timeoutInfo(COMPRESSION_COUNTDOWN_UPDATED, timeout));
 }
 
 void sendSupplyCountdownUpdatedInfo(int timeout)
 {
-
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = RELEASE_COUNTDOWN_UPDATE;
-  msg.timeout = timeout;
-
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-  {
-    printf("Failed to enqueue info message.\n");
-  }
+  sendInfo(timeoutInfo(RELEASE_COUNTDOWN_UPDATE, timeout));
 }
 
 void sendMotorCountdownUpdatedInfo(int timeout)
 {
-
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = MOTOR_COUNTDOWN_UPDATE;
-  msg.timeout = timeout;
-
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-  {
-    printf("Failed to enqueue info message.\n");
-  }
+  sendInfo(timeoutInfo(MOTOR_COUNTDOWN_UPDATE, timeout));
 }
 
 void sendCompressionCountdownEndInfo()
 {
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = COMPRESSION_COUNTOWN_END;
-
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-  {
-    printf("Failed to enqueue info message.\n");
-  }
+  sendInfo(infoMessage(COMPRESSION_COUNTOWN_END));
 }
 
 void sendSupplyCountdownEndInfo()
 {
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = RELEASE_COUNTDOWN_END;
-
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-  {
-    printf("Failed to enqueue info message.\n");
-  }
+  sendInfo(infoMessage(RELEASE_COUNTDOWN_END));
 }
 
 void sendMotorCountdownEndInfo()
 {
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = MOTOR_COUNTDOWN_END;
-
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-  {
-    printf("Failed to enqueue info message.\n");
-  }
+  sendInfo(infoMessage(MOTOR_COUNTDOWN_END));
 }
 
 void sendSupplyStartInfo()
 {
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = SUPPLY_START;
-
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-  {
-    printf("Failed to enqueue info message.\n");
-  }
+  sendInfo(infoMessage(SUPPLY_START));
 }
 
 void sendSupplyStopInfo()
 {
-  Message msg;
-  msg.messageType = MessageType::INFO;
-  msg.infoType = SUPPLY_STOP;
-
-  if (xQueueSend(outgoingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-  {
-    printf("Failed to enqueue info message.\n");
-  }
+  sendInfo(infoMessage(SUPPLY_STOP));
 }
 
-// Converts a buffer (JSON string) into a Message struct
-bool bufferToMessage(const char *buffer, Message &msg)
+void sendScheduleTriggeredInfo(int scheduleId)
 {
-  // Parse JSON
-  cJSON *json = cJSON_Parse(buffer);
-  if (!json)
-  {
-    printf("Failed to parse JSON: %s\n", buffer);
-    return false;
-  }
-
-  // Parse messageType
-  cJSON *messageType = cJSON_GetObjectItem(json, "messageType");
-  if (cJSON_IsString(messageType))
-  {
-    if (strcmp(messageType->valuestring, "COMMAND") == 0)
-    {
-      msg.messageType = MessageType::COMMAND;
-
-      // Parse commandType
-      cJSON *commandType = cJSON_GetObjectItem(json, "commandType");
-      if (cJSON_IsString(commandType))
-      {
-        if (strcmp(commandType->valuestring, "ON") == 0)
-        {
-          msg.commandType = CommandType::ON;
-        }
-        else if (strcmp(commandType->valuestring, "OFF") == 0)
-        {
-          msg.commandType = CommandType::OFF;
-        }
-        else if (strcmp(commandType->valuestring, "OFF_RELEASE") == 0)
-        {
-          msg.commandType = CommandType::OFF_RELEASE;
-        }
-        else if (strcmp(commandType->valuestring, "SET_COMPRESSION_TIMEOUT") == 0)
-        {
-          msg.commandType = CommandType::SET_COMPRESSION_TIMEOUT;
-
-          // Parse timeout
-          cJSON *timeout = cJSON_GetObjectItem(json, "timeout");
-          if (cJSON_IsNumber(timeout))
-          {
-            msg.timeout = timeout->valueint;
-          }
-        }
-        else if (strcmp(commandType->valuestring, "SET_RELEASE_TIMEOUT") == 0)
-        {
-          msg.commandType = CommandType::SET_RELEASE_TIMEOUT;
-
-          // Parse timeout
-          cJSON *timeout = cJSON_GetObjectItem(json, "timeout");
-          if (cJSON_IsNumber(timeout))
-          {
-            msg.timeout = timeout->valueint;
-          }
-        }
-        else if (strcmp(commandType->valuestring, "SET_MOTOR_TIMEOUT") == 0)
-        {
-          msg.commandType = CommandType::SET_MOTOR_TIMEOUT;
-
-          // Parse timeout
-          cJSON *timeout = cJSON_GetObjectItem(json, "timeout");
-          if (cJSON_IsNumber(timeout))
-          {
-            msg.timeout = timeout->valueint;
-          }
-        }
-      }
-    }
-    else if (strcmp(messageType->valuestring, "INFO") == 0)
-    {
-      msg.messageType = MessageType::INFO;
+  sendInfo(scheduleTriggeredInfo(scheduleId));
+}
 
-      // Parse infoType
-      cJSON *infoType = cJSON_GetObjectItem(json, "infoType");
-      if (cJSON_IsString(infoType))
-      {
-        if (strcmp(infoType->valuestring, "PRESSURE_CHANGE") == 0)
-        {
-          msg.infoType = InfoType::PRESSURE_CHANGE;
-
-          // Parse pressure
-          cJSON *pressure = cJSON_GetObjectItem(json, "pressure");
-          if (cJSON_IsNumber(pressure))
-          {
-            msg.pressure = static_cast<float>(pressure->valuedouble);
-          }
-        }
-        else if (strcmp(infoType->valuestring, "COMPRESSION_COUNTDOWN_UPDATED") == 0)
-        {
-          msg.infoType = InfoType::COMPRESSION_COUNTDOWN_UPDATED;
-
-          // Parse timeout
-          cJSON *timeout = cJSON_GetObjectItem(json, "timeout");
-          if (cJSON_IsNumber(timeout))
-          {
-            msg.timeout = timeout->valueint;
-          }
-        }
-        else if (strcmp(infoType->valuestring, "RELEASE_COUNTDOWN_UPDATED") == 0)
-        {
-          msg.infoType = InfoType::RELEASE_COUNTDOWN_UPDATE;
-
-          // Parse timeout
-          cJSON *timeout = cJSON_GetObjectItem(json, "timeout");
-          if (cJSON_IsNumber(timeout))
-          {
-            msg.timeout = timeout->valueint;
-          }
-        }
-        else if (strcmp(infoType->valuestring, "RELEASE_COUNTDOWN_UPDATED") == 0)
-        {
-          msg.infoType = InfoType::MOTOR_COUNTDOWN_UPDATE;
-
-          // Parse timeout
-          cJSON *timeout = cJSON_GetObjectItem(json, "timeout");
-          if (cJSON_IsNumber(timeout))
-          {
-            msg.timeout = timeout->valueint;
-          }
-        }
-      }
-    }
-  }
+void sendMotorTemperatureInfo(float temperature)
+{
+  sendInfo(temperatureInfo(MOTOR_TEMPERATURE, temperature));
+}
 
-  cJSON_Delete(json); // Free the JSON object
-  return true;
+void sendMotorOverheatInfo(float temperature)
+{
+  sendInfo(temperatureInfo(MOTOR_OVERHEAT, temperature));
 }
 
-// Converts a Message struct into a JSON string
-std::string messageToString(const Message &msg)
+void sendMotorStartBlockedInfo(int timeout)
 {
-  cJSON *json = cJSON_CreateObject();
+  sendInfo(timeoutInfo(MOTOR_START_BLOCKED, timeout));
+}
 
-  // Add messageType
-  if (msg.messageType == MessageType::COMMAND)
-  {
-    cJSON_AddStringToObject(json, "messageType", "COMMAND");
+// Network command being handled, for the actuation latency stages
+static bool commandTimed = false;
+static uint32_t commandReceivedUs = 0;
+static uint32_t commandDequeuedUs = 0;
 
-    // Add commandType
-    switch (msg.commandType)
-    {
-    case CommandType::ON:
-      cJSON_AddStringToObject(json, "commandType", "ON");
-      break;
-    case CommandType::OFF:
-      cJSON_AddStringToObject(json, "commandType", "OFF");
-      break;
-    case CommandType::OFF_RELEASE:
-      cJSON_AddStringToObject(json, "commandType", "OFF_RELEASE");
-      break;
-    case CommandType::SET_COMPRESSION_TIMEOUT:
-      cJSON_AddStringToObject(json, "commandType", "SET_COMPRESSION_TIMEOUT");
-      cJSON_AddNumberToObject(json, "timeout", msg.timeout);
-      break;
-    case CommandType::SET_RELEASE_TIMEOUT:
-      cJSON_AddStringToObject(json, "commandType", "SET_RELEASE_TIMEOUT");
-      cJSON_AddNumberToObject(json, "timeout", msg.timeout);
-      break;
-    case CommandType::SET_MOTOR_TIMEOUT:
-      cJSON_AddStringToObject(json, "commandType", "SET_MOTOR_TIMEOUT");
-      cJSON_AddNumberToObject(json, "timeout", msg.timeout);
-      break;
-    default:
-      break;
-    }
-  }
-  else if (msg.messageType == MessageType::INFO)
+// Drive a relay or solenoid output and record the change
+static void setOutput(unsigned int gpio, bool value)
+{
+  if (commandTimed)
   {
-    cJSON_AddStringToObject(json, "messageType", "INFO");
-
-    // Add infoType
-    switch (msg.infoType)
-    {
-    case InfoType::PRESSURE_CHANGE:
-      cJSON_AddStringToObject(json, "infoType", "PRESSURE_CHANGE");
-      cJSON_AddNumberToObject(json, "pressure", msg.pressure);
-      break;
-    case InfoType::COMPRESSION_COUNTDOWN_UPDATED:
-      cJSON_AddStringToObject(json, "infoType", "COMPRESSION_COUNTDOWN_UPDATED");
-      cJSON_AddNumberToObject(json, "timeout", msg.timeout);
-      break;
-    case InfoType::RELEASE_COUNTDOWN_UPDATE:
-      cJSON_AddStringToObject(json, "infoType", "RELEASE_COUNTDOWN_UPDATE");
-      cJSON_AddNumberToObject(json, "timeout", msg.timeout);
-      break;
-    case InfoType::MOTOR_COUNTDOWN_UPDATE:
-      cJSON_AddStringToObject(json, "infoType", "MOTOR_COUNTDOWN_UPDATE");
-      cJSON_AddNumberToObject(json, "timeout", msg.timeout);
-      break;
-    default:
-      break;
-    }
+    // Only the first write a command causes counts
+    uint32_t now = latencyNowUs();
+    latencyRecord(LATENCY_ACTUATE, now - commandDequeuedUs);
+    latencyRecord(LATENCY_TOTAL, now - commandReceivedUs);
+    commandTimed = false;
   }
 
-  // Convert JSON to string
-  char *jsonString = cJSON_PrintUnformatted(json);
-  std::string result(jsonString);
-  cJSON_free(jsonString);
-  cJSON_Delete(json); // Free the JSON object
-
-  return result;
+  if (halGpioGet(gpio) != value)
+  {
+    recorderLog(RECORD_GPIO, (uint8_t)gpio, value);
+  }
+  halGpioPut(gpio, value);
 }
 
 void handleOn()
 {
-  gpio_put(RELAY_GPIO, 1);
+  int coolDown = thermalSecondsUntilStartAllowed();
+  if (coolDown > 0)
+  {
+    // Too hot to start: retry once the model says the winding has cooled
+    printf("Motor too hot, delaying start by %d seconds.\n", coolDown);
+    sendMotorStartBlockedInfo(coolDown);
+    schedulerAdd(THERMAL_DELAYED_START_ID, CommandType::ON, ScheduleMode::SCHEDULE_IN, coolDown);
+    return;
+  }
+
+  setOutput(RELAY_GPIO, 1);
+  recorderLog(RECORD_TRANSITION, TURNED_ON, 0);
   sendTurnedOnInfo();
-  gpio_put(SOLENOID_GPIO, 0);
+  setOutput(SOLENOID_GPIO, 0);
   startTimer(compressionTimer); // TODO: change to read pressure
 }
 
 void handleOff()
 {
-  gpio_put(RELAY_GPIO, 0);
+  schedulerRemove(THERMAL_DELAYED_START_ID);
+  setOutput(RELAY_GPIO, 0);
+  recorderLog(RECORD_TRANSITION, TURNED_OFF, 0);
   sendTurnedOffInfo();
-  gpio_put(SOLENOID_GPIO, 0);
+  setOutput(SOLENOID_GPIO, 0);
   stopTimer(compressionTimer); // TODO: change to read pressure
 }
 
 void handleSupplyAndOff()
 {
-  gpio_put(RELAY_GPIO, 0);
+  schedulerRemove(THERMAL_DELAYED_START_ID);
+  setOutput(RELAY_GPIO, 0);
+  recorderLog(RECORD_TRANSITION, TURNED_OFF, 0);
   sendTurnedOffInfo();
-  gpio_put(SOLENOID_GPIO, 1);
+  setOutput(SOLENOID_GPIO, 1);
+  recorderLog(RECORD_TRANSITION, RELEASING, 0);
   sendReleasingInfo();
   // TODO: read pressure
-  vTaskDelay(pdMS_TO_TICKS(20000));
-  gpio_put(SOLENOID_GPIO, 0);
+  halDelayMs(20000);
+  setOutput(SOLENOID_GPIO, 0);
+  recorderLog(RECORD_TRANSITION, RELEASED, 0);
   sendSupplydInfo();
   stopTimer(compressionTimer); // TODO: change to read pressure
 }
@@ -853,6 +627,17 @@ void handleSetMotorTimeout(int timeout)
   changeTimerPreiod(motorTimer, timeout);
 }
 
+void handleSetMotorTemperatureLimit(int limit)
+{
+  if (limit <= THERMAL_AMBIENT_C + THERMAL_RESTART_HYSTERESIS_C || limit > 200)
+  {
+    printf("Invalid motor temperature limit: %d\n", limit);
+    return;
+  }
+  currentSettings.motorTemperatureLimit = limit;
+  requestSettingsValidation();
+}
+
 void handleSupplyStart()
 {
   sendSupplyStartInfo();
@@ -874,63 +659,250 @@ void handleMotorStop()
   stopTimer(motorTimer);
 }
 
-// Process incoming commands
-void controlTask(void *params)
+static uint32_t remainingSeconds(HalTimerHandle timer)
 {
-  Message command;
-  while (xQueueReceive(incommingMessageQueue, &command, portMAX_DELAY) == pdPASS)
+  return (halTimerRemainingMs(timer) + 999) / 1000;
+}
+
+void controlGetSnapshot(ControlSnapshot *out)
+{
+  ThermalState thermal;
+  thermalGetState(&thermal);
+
+  out->relay = halGpioGet(RELAY_GPIO);
+  out->solenoid = halGpioGet(SOLENOID_GPIO);
+  if (out->solenoid)
   {
-    if (command.messageType == MessageType::COMMAND)
-    {
-      switch (command.commandType)
-      {
-      case CommandType::ON:
-        printf("Received ON command.\n");
-        handleOn();
-        break;
-      case CommandType::OFF:
-        printf("Received OFF command.\n");
-        handleOff();
-        break;
-      case CommandType::OFF_RELEASE:
-        printf("Received OFF_RELEASE command.\n");
-        handleSupplyAndOff();
-        break;
-      case CommandType::SET_COMPRESSION_TIMEOUT:
-        printf("Set pressure timeout to %d minutes.\n", command.timeout);
-        handleSetCompressionTimeout(command.timeout);
-        break;
-      case CommandType::SET_RELEASE_TIMEOUT:
-        printf("Set supply timeout to %d minutes.\n", command.timeout);
-        handleSetCompressionTimeout(command.timeout);
-        break;
-      case CommandType::SET_MOTOR_TIMEOUT:
-        printf("Set motor timeout to %d minutes.\n", command.timeout);
-        handleSetCompressionTimeout(command.timeout);
-        break;
-      default:
-        printf("Unknown command received.\n");
-        break;
-      }
-    }
+    out->state = CONTROL_RELEASING;
+  }
+  else if (out->relay)
+  {
+    out->state = CONTROL_COMPRESSING;
+  }
+  else if (thermal.overheated)
+  {
+    out->state = CONTROL_OVERHEATED;
   }
+  else
+  {
+    out->state = CONTROL_IDLE;
+  }
+
+  out->pressure = pressure;
+  out->current = currentDraw;
+  out->motorTemperature = thermal.temperatureMilliC / 1000.0f;
+  out->compressionRemaining = remainingSeconds(compressionTimer);
+  out->supplyRemaining = remainingSeconds(supplyTimer);
+  out->motorRemaining = remainingSeconds(motorTimer);
+  out->compressionTimeout = currentSettings.compressionTimeout;
+  out->supplyTimeout = currentSettings.supplyTimeout;
+  out->motorTimeout = currentSettings.motorTimeout;
+  out->motorTemperatureLimit = currentSettings.motorTemperatureLimit;
 }
 
-void interactionTask(void *params)
+// Snapshot taken for GET_STATE, waiting for the socket sender
+static ControlSnapshot pendingSnapshot;
+static bool snapshotPending = false;
+
+static void requestStateSnapshot()
 {
-  Interaction interaction;
-  while (xQueueReceive(interactionQueue, &interaction, portMAX_DELAY) == pdPASS)
+  ControlSnapshot snapshot;
+  controlGetSnapshot(&snapshot);
+
+  halEnterCritical();
+  pendingSnapshot = snapshot;
+  snapshotPending = true;
+  halExitCritical();
+  halSignalGive(outgoingMessageSignal);
+}
+
+bool controlTakeStateSnapshot(ControlSnapshot *out)
+{
+  halEnterCritical();
+  bool pending = snapshotPending;
+  if (pending)
+  {
+    *out = pendingSnapshot;
+    snapshotPending = false;
+  }
+  halExitCritical();
+  return pending;
+}
+
+// The one number worth keeping about a command in the recorder
+static int32_t commandArgument(const Message &command)
+{
+  switch (commandTypeOf(command))
   {
-    switch (interaction)
+  case CommandType::SET_COMPRESSION_TIMEOUT:
+  case CommandType::SET_RELEASE_TIMEOUT:
+  case CommandType::SET_MOTOR_TIMEOUT:
+    return command.payload.timeout;
+  case CommandType::SCHEDULE:
+    return command.payload.schedule.id;
+  case CommandType::UNSCHEDULE:
+    return command.payload.scheduleId;
+  case CommandType::SET_CLOCK:
+    return command.payload.time / 60;
+  case CommandType::SET_MOTOR_TEMPERATURE_LIMIT:
+    return command.payload.limit;
+  case CommandType::GET_RECORDER:
+    return command.payload.since;
+  case CommandType::GET_HISTORY:
+    return command.payload.history.resolution;
+  default:
+    return 0;
+  }
+}
+
+// Process one incoming command
+void handleMessage(const Message &command)
+{
+  if (command.messageType == MessageType::COMMAND)
+  {
+    recorderLog(RECORD_COMMAND, command.type, commandArgument(command));
+
+    switch (commandTypeOf(command))
     {
-    case Interaction::SHUT_DOWN:
+    case CommandType::ON:
+      printf("Received ON command.\n");
+      handleOn();
+      break;
+    case CommandType::OFF:
+      printf("Received OFF command.\n");
+      handleOff();
+      break;
+    case CommandType::OFF_RELEASE:
+      printf("Received OFF_RELEASE command.\n");
       handleSupplyAndOff();
       break;
-    case Interaction::FORGET_WIFI:
-      disconnectAndForgetWifi();
+    case CommandType::SET_COMPRESSION_TIMEOUT:
+      printf("Set pressure timeout to %d minutes.\n", command.payload.timeout);
+      handleSetCompressionTimeout(command.payload.timeout);
+      break;
+    case CommandType::SET_RELEASE_TIMEOUT:
+      printf("Set supply timeout to %d minutes.\n", command.payload.timeout);
+      handleSetCompressionTimeout(command.payload.timeout);
+      break;
+    case CommandType::SET_MOTOR_TIMEOUT:
+      printf("Set motor timeout to %d minutes.\n", command.payload.timeout);
+      handleSetCompressionTimeout(command.payload.timeout);
+      break;
+    case CommandType::SCHEDULE:
+    {
+      const SchedulePayload &schedule = command.payload.schedule;
+      printf("Schedule command %d (id %d).\n", schedule.action, schedule.id);
+      schedulerAdd(schedule.id, (CommandType)schedule.action, (ScheduleMode)schedule.mode, schedule.time);
+      break;
+    }
+    case CommandType::UNSCHEDULE:
+      printf("Unschedule id %d.\n", command.payload.scheduleId);
+      if (!schedulerRemove(command.payload.scheduleId))
+      {
+        printf("No schedule with id %d.\n", command.payload.scheduleId);
+      }
+      break;
+    case CommandType::SET_CLOCK:
+      schedulerSetClock(command.payload.time);
+      break;
+    case CommandType::SET_MOTOR_TEMPERATURE_LIMIT:
+      printf("Set motor temperature limit to %d C.\n", command.payload.limit);
+      handleSetMotorTemperatureLimit(command.payload.limit);
+      break;
+    case CommandType::GET_RECORDER:
+      printf("Recorder requested from sequence %d.\n", command.payload.since);
+      recorderRequestDump(command.payload.since > 0 ? command.payload.since : 0);
+      halSignalGive(outgoingMessageSignal);
+      break;
+    case CommandType::GET_HISTORY:
+      printf("History requested from %d to %d every %d s.\n", command.payload.history.from, command.payload.history.to,
+             command.payload.history.resolution);
+      historyRequest(command.payload.history.from, command.payload.history.to, command.payload.history.resolution);
+      halSignalGive(outgoingMessageSignal);
+      break;
+    case CommandType::GET_LATENCY:
+      latencyRequestReport();
+      halSignalGive(outgoingMessageSignal);
+      break;
+    case CommandType::RESET_LATENCY:
+      printf("Latency histograms reset.\n");
+      latencyReset();
+      break;
+    case CommandType::GET_STATS:
+      statsRequestReport();
+      halSignalGive(outgoingMessageSignal);
+      break;
+    case CommandType::RESET_STATS:
+      printf("Connection stats reset.\n");
+      statsReset();
+      break;
+    case CommandType::GET_STATE:
+      requestStateSnapshot();
       break;
     default:
+      printf("Unknown command received.\n");
       break;
     }
   }
 }
+
+// Wait up to timeoutMs for a command and process it
+bool controlTaskStep(uint32_t timeoutMs)
+{
+  Message command;
+  if (!halQueueReceive(incommingMessageQueue, &command, timeoutMs))
+  {
+    return false;
+  }
+
+  if (command.receivedUs != 0)
+  {
+    commandDequeuedUs = latencyNowUs();
+    commandReceivedUs = command.receivedUs;
+    commandTimed = true;
+    latencyRecord(LATENCY_QUEUE, commandDequeuedUs - command.enqueuedUs);
+  }
+  handleMessage(command);
+  commandTimed = false;
+  return true;
+}
+
+// Process incoming commands
+void controlTask(void *params)
+{
+  while (true)
+  {
+    controlTaskStep(HAL_WAIT_FOREVER);
+  }
+}
+
+// Wait up to timeoutMs for a button interaction and process it
+bool interactionTaskStep(uint32_t timeoutMs)
+{
+  Interaction interaction;
+  if (!halQueueReceive(interactionQueue, &interaction, timeoutMs))
+  {
+    return false;
+  }
+
+  switch (interaction)
+  {
+  case Interaction::SHUT_DOWN:
+    handleSupplyAndOff();
+    break;
+  case Interaction::FORGET_WIFI:
+    disconnectAndForgetWifi();
+    break;
+  default:
+    break;
+  }
+  return true;
+}
+
+void interactionTask(void *params)
+{
+  while (true)
+  {
+    interactionTaskStep(HAL_WAIT_FOREVER);
+  }
+}
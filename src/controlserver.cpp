@@ -0,0 +1,389 @@
+#include "controlserver.h"
+#include "clientqueue.h"
+#include "constants.h"
+#include "control.h"
+#include "framing.h"
+#include "latency.h"
+#include "messagewriter.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "lwip/tcp.h"
+#include "lwip/tcpip.h"
+#include "lwip/priv/tcpip_priv.h"
+
+// Only touched in the lwIP thread
+typedef struct
+{
+  struct tcp_pcb *pcb; // NULL when the slot is free
+  ClientQueue queue;
+  FrameAssembler inbound;
+} ControlClient;
+
+static ControlClient clients[CLIENT_QUEUE_SLOTS];
+static struct tcp_pcb *listener = NULL;
+static ControlServerStats stats;
+static bool started = false;
+
+// Info messages taken by the server task, pushed to every client in the lwIP thread
+typedef struct
+{
+  struct tcpip_api_call_data call;
+  Message messages[SOCKET_MAX_BATCH];
+  size_t count;
+} FanOutBatch;
+
+static FanOutBatch batch;
+
+// ERR_ABRT if the pcb had to be aborted, a recv callback must then return it
+static err_t releaseClient(ControlClient *client)
+{
+  struct tcp_pcb *pcb = client->pcb;
+  if (pcb == NULL)
+  {
+    return ERR_OK;
+  }
+  client->pcb = NULL;
+  tcp_arg(pcb, NULL);
+  tcp_recv(pcb, NULL);
+  tcp_sent(pcb, NULL);
+  tcp_err(pcb, NULL);
+  clientQueueClose(client->queue);
+
+  halEnterCritical();
+  stats.connected--;
+  halExitCritical();
+  printf("Control client %d disconnected\n", client->queue.slot);
+
+  if (tcp_close(pcb) != ERR_OK)
+  {
+    tcp_abort(pcb);
+    return ERR_ABRT;
+  }
+  return ERR_OK;
+}
+
+// Writes queued messages while the send buffer takes them whole, the rest
+// waits for the client to acknowledge what it has
+static void flushClient(ControlClient *client)
+{
+  char line[MESSAGE_WRITER_MAX_LENGTH];
+  bool wrote = false;
+  const Message *msg;
+  while ((msg = clientQueuePeek(client->queue)) != NULL)
+  {
+    size_t length = messageToBuffer(*msg, line, sizeof(line));
+    if (length > 0)
+    {
+      line[length++] = '\n';
+      if (tcp_sndbuf(client->pcb) < length || tcp_write(client->pcb, line, length, TCP_WRITE_FLAG_COPY) != ERR_OK)
+      {
+        break;
+      }
+      wrote = true;
+    }
+    clientQueuePop(client->queue);
+  }
+  if (wrote)
+  {
+    tcp_output(client->pcb);
+  }
+}
+
+// Ahead of anything still queued for the client, which is older than it
+static void sendSnapshot(ControlClient *client)
+{
+  ControlSnapshot snapshot;
+  controlGetSnapshot(&snapshot);
+  char text[STATE_WRITER_MAX_LENGTH];
+  size_t length = controlSnapshotToBuffer(snapshot, text, sizeof(text) - 1);
+  text[length++] = '\n';
+  if (length == 1 || tcp_sndbuf(client->pcb) < length ||
+      tcp_write(client->pcb, text, length, TCP_WRITE_FLAG_COPY) != ERR_OK)
+  {
+    printf("Control client %d: no room for the state snapshot\n", client->queue.slot);
+    return;
+  }
+  tcp_output(client->pcb);
+}
+
+static void handleLine(ControlClient *client, const char *text, uint32_t receivedUs)
+{
+  Message msg = {};
+  if (!bufferToMessage(text, msg) || msg.messageType != MessageType::COMMAND)
+  {
+    printf("Control client %d: failed to convert buffer to Message\n", client->queue.slot);
+    return;
+  }
+  if (isCommand(msg, CommandType::GET_STATE))
+  {
+    sendSnapshot(client);
+    return;
+  }
+  if (isCommand(msg, CommandType::ACK) || isCommand(msg, CommandType::HEARTBEAT_ACK))
+  {
+    return;
+  }
+  if (isUpstreamQuery(msg))
+  {
+    printf("Control client %d: queries other than GET_STATE are answered upstream only, ignored\n",
+           client->queue.slot);
+    return;
+  }
+
+  // Never wait in the lwIP thread
+  msg.receivedUs = receivedUs;
+  msg.enqueuedUs = latencyNowUs();
+  if (!halQueueSend(incommingMessageQueue, &msg, 0))
+  {
+    printf("Control client %d: failed to enqueue command.\n", client->queue.slot);
+  }
+}
+
+static void deliverLines(ControlClient *client, uint32_t receivedUs)
+{
+  uint8_t frame[FRAME_MAX_LENGTH];
+  size_t length;
+  FrameResult result;
+  while ((result = frameAssemblerNext(client->inbound, frame, sizeof(frame), &length)) != FRAME_NONE)
+  {
+    if (result == FRAME_READY)
+    {
+      handleLine(client, (const char *)frame, receivedUs);
+    }
+    else
+    {
+      printf("Control client %d: dropped a line longer than %d bytes\n", client->queue.slot, FRAME_MAX_LENGTH);
+    }
+  }
+}
+
+static err_t clientRecv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  ControlClient *client = (ControlClient *)arg;
+  if (p == NULL || client == NULL)
+  {
+    if (p != NULL)
+    {
+      tcp_recved(pcb, p->tot_len);
+      pbuf_free(p);
+    }
+    return client != NULL ? releaseClient(client) : ERR_OK;
+  }
+
+  uint32_t receivedUs = latencyNowUs();
+  for (struct pbuf *segment = p; segment != NULL; segment = segment->next)
+  {
+    const uint8_t *data = (const uint8_t *)segment->payload;
+    size_t length = segment->len;
+    while (length > 0)
+    {
+      size_t pushed = frameAssemblerPush(client->inbound, data, length);
+      data += pushed;
+      length -= pushed;
+      deliverLines(client, receivedUs);
+    }
+  }
+
+  tcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+static err_t clientSent(void *arg, struct tcp_pcb *pcb, uint16_t length)
+{
+  ControlClient *client = (ControlClient *)arg;
+  if (client != NULL && client->pcb != NULL)
+  {
+    flushClient(client);
+  }
+  return ERR_OK;
+}
+
+// The pcb is already freed when this is called
+static void clientError(void *arg, err_t err)
+{
+  ControlClient *client = (ControlClient *)arg;
+  if (client != NULL && client->pcb != NULL)
+  {
+    client->pcb = NULL;
+    clientQueueClose(client->queue);
+    halEnterCritical();
+    stats.connected--;
+    halExitCritical();
+    printf("Control client %d failed: %d\n", client->queue.slot, err);
+  }
+}
+
+static err_t acceptClient(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  if (err != ERR_OK || pcb == NULL)
+  {
+    return ERR_VAL;
+  }
+  int slot = -1;
+  for (int i = 0; i < CLIENT_QUEUE_SLOTS; i++)
+  {
+    if (clients[i].pcb == NULL)
+    {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0)
+  {
+    halEnterCritical();
+    stats.refused++;
+    halExitCritical();
+    tcp_abort(pcb);
+    return ERR_ABRT;
+  }
+
+  ControlClient *client = &clients[slot];
+  client->pcb = pcb;
+  clientQueueInit(client->queue, slot);
+  frameAssemblerInit(client->inbound, WIRE_JSON);
+  tcp_arg(pcb, client);
+  tcp_recv(pcb, clientRecv);
+  tcp_sent(pcb, clientSent);
+  tcp_err(pcb, clientError);
+
+  halEnterCritical();
+  stats.connected++;
+  stats.accepted++;
+  halExitCritical();
+  printf("Control client %d connected\n", slot);
+
+  sendSnapshot(client);
+  return ERR_OK;
+}
+
+// Runs in the lwIP thread, the server task waits for it
+static err_t fanOut(struct tcpip_api_call_data *call)
+{
+  FanOutBatch *pending = (FanOutBatch *)call;
+  for (ControlClient &client : clients)
+  {
+    if (client.pcb == NULL)
+    {
+      continue;
+    }
+    for (size_t i = 0; i < pending->count; i++)
+    {
+      clientQueuePush(client.queue, pending->messages[i]);
+    }
+    flushClient(&client);
+  }
+  return ERR_OK;
+}
+
+static err_t startListening(struct tcpip_api_call_data *call)
+{
+  struct tcp_pcb *pcb = tcp_new();
+  if (pcb == NULL)
+  {
+    return ERR_MEM;
+  }
+  err_t err = tcp_bind(pcb, IP_ADDR_ANY, CONTROL_SERVER_PORT);
+  if (err != ERR_OK)
+  {
+    tcp_close(pcb);
+    return err;
+  }
+  listener = tcp_listen(pcb);
+  if (listener == NULL)
+  {
+    tcp_close(pcb);
+    return ERR_MEM;
+  }
+  tcp_accept(listener, acceptClient);
+  return ERR_OK;
+}
+
+// Undoes startListening(), dropping anyone who connected in the meantime
+static err_t stopListening(struct tcpip_api_call_data *call)
+{
+  if (listener != NULL)
+  {
+    tcp_close(listener);
+    listener = NULL;
+  }
+  for (ControlClient &client : clients)
+  {
+    releaseClient(&client);
+  }
+  return ERR_OK;
+}
+
+// Takes the server's copies of info messages in batches and hands each to
+// the lwIP thread, which queues it for every client and sends what fits
+static void controlServerTask(void *params)
+{
+  HalQueueHandle queue = (HalQueueHandle)params;
+  while (true)
+  {
+    batch.count = 0;
+    if (!halQueueReceive(queue, &batch.messages[0], HAL_WAIT_FOREVER))
+    {
+      continue;
+    }
+    batch.count = 1;
+    while (batch.count < (size_t)SOCKET_MAX_BATCH && halQueueReceive(queue, &batch.messages[batch.count], 0))
+    {
+      batch.count++;
+    }
+
+    halEnterCritical();
+    bool anyone = stats.connected > 0;
+    halExitCritical();
+    if (anyone)
+    {
+      tcpip_api_call(fanOut, &batch.call);
+    }
+  }
+}
+
+void startControlServer()
+{
+  if (started)
+  {
+    return;
+  }
+  HalQueueHandle queue = halQueueCreate(CONTROL_SERVER_QUEUE_LENGTH, sizeof(Message));
+  if (queue == NULL)
+  {
+    printf("Failed to create control server message queue.\n");
+    return;
+  }
+  struct tcpip_api_call_data call;
+  err_t err = tcpip_api_call(startListening, &call);
+  if (err != ERR_OK)
+  {
+    printf("Control server: failed to listen on port %d, error %d\n", CONTROL_SERVER_PORT, err);
+    halQueueDelete(queue);
+    return;
+  }
+  if (xTaskCreate(controlServerTask, "ControlServerTask", 1024, queue, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
+  {
+    printf("Failed to create control server task.\n");
+    tcpip_api_call(stopListening, &call);
+    halQueueDelete(queue);
+    return;
+  }
+  // Control only copies info messages here once everything above is in place,
+  // so a failed start leaves nothing behind and can be tried again
+  serverMessageQueue = queue;
+  started = true;
+  printf("Control server listening on port %d for %d clients\n", CONTROL_SERVER_PORT, CLIENT_QUEUE_SLOTS);
+}
+
+void controlServerGetStats(ControlServerStats *out)
+{
+  halEnterCritical();
+  *out = stats;
+  halExitCritical();
+}
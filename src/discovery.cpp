@@ -0,0 +1,271 @@
+#include "discovery.h"
+#include "dnssd.h"
+#include "constants.h"
+#include "settings.h"
+#include "websocketserver.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "lwip/tcpip.h"
+#include "lwip/priv/tcpip_priv.h"
+#include "lwip/apps/mdns.h"
+
+#include "pico/cyw43_arch.h"
+
+#define HTTP_PORT 80
+
+typedef enum
+{
+  ENDPOINT_KEPT,    // From settings
+  ENDPOINT_BROWSED, // Found just now, not yet in settings
+  ENDPOINT_BUILT_IN,
+} EndpointSource;
+
+static char name[16];
+static bool responderStarted = false;
+static bool advertising = false;
+static volatile bool linkLost = false; // Set by the Wi-Fi task, cleared by advertise
+
+static EndpointSource lastSource = ENDPOINT_BUILT_IN;
+static uint32_t lastAddress = 0;
+static uint16_t lastPort = 0;
+static bool keptFailed = false; // Browse before trying the kept endpoint again
+
+const char *deviceName()
+{
+  if (name[0] == '\0')
+  {
+    const uint8_t *mac = cyw43_state.mac;
+    snprintf(name, sizeof(name), "pico-%02x%02x%02x", mac[3], mac[4], mac[5]);
+  }
+  return name;
+}
+
+static void serviceTxt(struct mdns_service *service, void *userdata)
+{
+  static const char path[] = "path=" WEBSOCKET_PATH;
+  if (mdns_resp_add_service_txtitem(service, path, sizeof(path) - 1) != ERR_OK)
+  {
+    printf("mDNS: failed to add TXT record\n");
+  }
+}
+
+// Runs in the lwIP thread, the responder is not thread safe
+static err_t advertise(struct tcpip_api_call_data *call)
+{
+  struct netif *netif = &cyw43_state.netif[CYW43_ITF_STA];
+  if (!responderStarted)
+  {
+    mdns_resp_init();
+    responderStarted = true;
+  }
+  if (advertising)
+  {
+    // Probes and announces again after the link came back
+    mdns_resp_restart(netif);
+    linkLost = false;
+    return ERR_OK;
+  }
+  err_t err = mdns_resp_add_netif(netif, deviceName());
+  if (err != ERR_OK)
+  {
+    return err;
+  }
+  if (mdns_resp_add_service(netif, deviceName(), DISCOVERY_DEVICE_SERVICE, DNSSD_PROTO_TCP, HTTP_PORT, serviceTxt,
+                            NULL) < 0)
+  {
+    mdns_resp_remove_netif(netif);
+    return ERR_MEM;
+  }
+  advertising = true;
+  return ERR_OK;
+}
+
+void startAdvertising()
+{
+  if (advertising && !linkLost)
+  {
+    return; // Still announced, a restart would only probe again
+  }
+  struct tcpip_api_call_data call;
+  err_t err = tcpip_api_call(advertise, &call);
+  if (err != ERR_OK)
+  {
+    printf("mDNS: failed to advertise, error %d\n", err);
+    return;
+  }
+  printf("mDNS: advertising %s.local\n", deviceName());
+}
+
+void advertisingLinkLost()
+{
+  linkLost = true;
+}
+
+static bool sendQuery(int sock, uint16_t id, const char *queryName, uint16_t type)
+{
+  uint8_t query[DNSSD_MAX_MESSAGE];
+  size_t length = dnssdQuery(query, sizeof(query), id, queryName, type);
+  if (length == 0)
+  {
+    return false;
+  }
+  struct sockaddr_in group;
+  memset(&group, 0, sizeof(group));
+  group.sin_family = AF_INET;
+  group.sin_port = htons(DNSSD_PORT);
+  inet_aton(DNSSD_GROUP, &group.sin_addr);
+  return lwip_sendto(sock, query, length, 0, (struct sockaddr *)&group, sizeof(group)) >= 0;
+}
+
+// Asks for whichever link of PTR, SRV, A the answers so far are missing
+static bool queryNext(int sock, uint16_t id, const DnssdService &service)
+{
+  if (service.instance[0] == '\0')
+  {
+    return sendQuery(sock, id, DISCOVERY_SERVER_SERVICE, DNS_TYPE_PTR);
+  }
+  if (service.port == 0)
+  {
+    return sendQuery(sock, id, service.instance, DNS_TYPE_SRV);
+  }
+  return sendQuery(sock, id, service.host, DNS_TYPE_A);
+}
+
+static bool browse(uint32_t *address, uint16_t *port)
+{
+  int sock = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock < 0)
+  {
+    printf("mDNS: failed to create socket\n");
+    return false;
+  }
+
+  DnssdService service;
+  dnssdServiceInit(service);
+  uint16_t id = (uint16_t)(xTaskGetTickCount() | 1);
+  TickType_t start = xTaskGetTickCount();
+  TickType_t lastQuery = 0;
+  bool queried = false;
+  static uint8_t response[DNSSD_MAX_MESSAGE];
+
+  while (!dnssdResolved(service) && xTaskGetTickCount() - start < pdMS_TO_TICKS(DISCOVERY_TIMEOUT_MS))
+  {
+    if (!queried || xTaskGetTickCount() - lastQuery >= pdMS_TO_TICKS(DISCOVERY_QUERY_INTERVAL_MS))
+    {
+      if (!queryNext(sock, id, service))
+      {
+        printf("mDNS: failed to send query\n");
+        break;
+      }
+      queried = true;
+      lastQuery = xTaskGetTickCount();
+    }
+
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(sock, &readable);
+    struct timeval timeout = {0, 100 * 1000};
+    if (lwip_select(sock + 1, &readable, NULL, NULL, &timeout) <= 0)
+    {
+      continue;
+    }
+    int length = lwip_recvfrom(sock, response, sizeof(response), 0, NULL, NULL);
+    // Replies to a one-shot query carry its id, anything else is not for us
+    if (length < 2 || (response[0] << 8 | response[1]) != id)
+    {
+      continue;
+    }
+
+    bool hadInstance = service.instance[0] != '\0';
+    bool hadPort = service.port != 0;
+    if (!dnssdParseResponse(response, (size_t)length, DISCOVERY_SERVER_SERVICE, service))
+    {
+      continue;
+    }
+    if ((service.instance[0] != '\0') != hadInstance || (service.port != 0) != hadPort)
+    {
+      // A link was found without the next one, ask for it straight away
+      queried = false;
+    }
+  }
+  lwip_close(sock);
+
+  if (!dnssdResolved(service))
+  {
+    printf("mDNS: no %s answered\n", DISCOVERY_SERVER_SERVICE);
+    return false;
+  }
+  *address = service.address;
+  *port = service.port;
+  printf("mDNS: found %s on port %u\n", service.host, service.port);
+  return true;
+}
+
+void discoveryServerEndpoint(struct sockaddr_in *address)
+{
+  memset(address, 0, sizeof(*address));
+  address->sin_family = AF_INET;
+
+  uint32_t keptAddress = currentSettings.serverAddress;
+  uint16_t keptPort = currentSettings.serverPort;
+  bool kept = keptAddress != 0 && keptPort != 0;
+
+  uint32_t browsedAddress;
+  uint16_t browsedPort;
+  if (kept && !keptFailed)
+  {
+    lastSource = ENDPOINT_KEPT;
+    lastAddress = keptAddress;
+    lastPort = keptPort;
+  }
+  else if (browse(&browsedAddress, &browsedPort))
+  {
+    lastSource = ENDPOINT_BROWSED;
+    lastAddress = browsedAddress;
+    lastPort = browsedPort;
+  }
+  else if (kept)
+  {
+    lastSource = ENDPOINT_KEPT;
+    lastAddress = keptAddress;
+    lastPort = keptPort;
+  }
+  else
+  {
+    lastSource = ENDPOINT_BUILT_IN;
+    struct in_addr builtIn;
+    inet_aton(SOCKET_SERVER_IP, &builtIn);
+    lastAddress = builtIn.s_addr;
+    lastPort = SOCKET_SERVER_PORT;
+  }
+
+  address->sin_addr.s_addr = lastAddress;
+  address->sin_port = htons(lastPort);
+}
+
+void discoveryConnected()
+{
+  keptFailed = false;
+  if (lastSource != ENDPOINT_BROWSED ||
+      (currentSettings.serverAddress == lastAddress && currentSettings.serverPort == lastPort))
+  {
+    return;
+  }
+  printf("Keeping the discovered server endpoint in settings\n");
+  currentSettings.serverAddress = lastAddress;
+  currentSettings.serverPort = lastPort;
+  requestSettingsValidation();
+}
+
+void discoveryConnectFailed()
+{
+  if (lastSource == ENDPOINT_KEPT)
+  {
+    keptFailed = true;
+  }
+}
@@ -0,0 +1,243 @@
+#include "dnssd.h"
+
+#include <string.h>
+#include <strings.h>
+
+#define DNS_HEADER_LENGTH 12
+#define DNS_CLASS_IN 1
+#define DNS_FLAG_RESPONSE 0x8000
+#define DNS_MAX_POINTERS 16 // Compression pointers followed in one name
+
+static uint16_t readShort(const uint8_t *data)
+{
+  return (uint16_t)(data[0] << 8 | data[1]);
+}
+
+static void writeShort(uint8_t *data, uint16_t value)
+{
+  data[0] = (uint8_t)(value >> 8);
+  data[1] = (uint8_t)value;
+}
+
+size_t dnssdQuery(uint8_t *buffer, size_t size, uint16_t id, const char *name, uint16_t type)
+{
+  size_t nameLength = strlen(name);
+  // Each dot becomes a length byte, plus the first length and the root
+  size_t length = DNS_HEADER_LENGTH + nameLength + 2 + 4;
+  if (nameLength == 0 || length > size)
+  {
+    return 0;
+  }
+
+  memset(buffer, 0, DNS_HEADER_LENGTH);
+  writeShort(buffer, id);
+  writeShort(buffer + 4, 1); // One question
+
+  uint8_t *out = buffer + DNS_HEADER_LENGTH;
+  const char *label = name;
+  while (true)
+  {
+    const char *dot = strchr(label, '.');
+    size_t labelLength = dot != NULL ? (size_t)(dot - label) : strlen(label);
+    if (labelLength == 0 || labelLength > 63)
+    {
+      return 0;
+    }
+    *out++ = (uint8_t)labelLength;
+    memcpy(out, label, labelLength);
+    out += labelLength;
+    if (dot == NULL)
+    {
+      break;
+    }
+    label = dot + 1;
+  }
+  *out++ = 0;
+  writeShort(out, type);
+  writeShort(out + 2, DNS_CLASS_IN);
+  return length;
+}
+
+// Reads the name at offset, following compression pointers, as dotted text.
+// Sets *next to just past the name where it started.
+static bool readName(const uint8_t *message, size_t length, size_t offset, char *out, size_t size, size_t *next)
+{
+  size_t written = 0;
+  int pointers = 0;
+  bool jumped = false;
+  while (true)
+  {
+    if (offset >= length)
+    {
+      return false;
+    }
+    uint8_t labelLength = message[offset];
+    if ((labelLength & 0xC0) == 0xC0)
+    {
+      if (offset + 1 >= length || ++pointers > DNS_MAX_POINTERS)
+      {
+        return false;
+      }
+      if (!jumped)
+      {
+        *next = offset + 2;
+        jumped = true;
+      }
+      offset = (size_t)(readShort(message + offset) & 0x3FFF);
+      continue;
+    }
+    if (labelLength & 0xC0)
+    {
+      return false; // Extended label types are not used by mDNS
+    }
+    offset++;
+    if (labelLength == 0)
+    {
+      break;
+    }
+    // The dot before it, the label, and room for the NUL
+    if (offset + labelLength > length || written + labelLength + 2 > size)
+    {
+      return false;
+    }
+    if (written > 0)
+    {
+      out[written++] = '.';
+    }
+    memcpy(out + written, message + offset, labelLength);
+    written += labelLength;
+    offset += labelLength;
+  }
+  if (!jumped)
+  {
+    *next = offset;
+  }
+  out[written] = '\0';
+  return true;
+}
+
+typedef struct
+{
+  char name[DNSSD_NAME_MAX];
+  uint16_t type;
+  const uint8_t *data;
+  size_t dataOffset; // Of data, names inside it point back into the message
+  size_t dataLength;
+} DnsRecord;
+
+// Walks every resource record after the questions
+typedef struct
+{
+  const uint8_t *message;
+  size_t length;
+  size_t offset;
+  size_t remaining;
+} RecordReader;
+
+static bool startRecords(const uint8_t *message, size_t length, RecordReader &reader)
+{
+  if (length < DNS_HEADER_LENGTH || (readShort(message + 2) & DNS_FLAG_RESPONSE) == 0)
+  {
+    return false;
+  }
+  reader.message = message;
+  reader.length = length;
+  reader.offset = DNS_HEADER_LENGTH;
+  reader.remaining = (size_t)readShort(message + 6) + readShort(message + 8) + readShort(message + 10);
+
+  char name[DNSSD_NAME_MAX];
+  for (uint16_t questions = readShort(message + 4); questions > 0; questions--)
+  {
+    if (!readName(message, length, reader.offset, name, sizeof(name), &reader.offset) ||
+        reader.offset + 4 > length)
+    {
+      return false;
+    }
+    reader.offset += 4;
+  }
+  return true;
+}
+
+// Returns 1 with the next record, 0 at the end, -1 if the message is malformed
+static int nextRecord(RecordReader &reader, DnsRecord &record)
+{
+  if (reader.remaining == 0)
+  {
+    return 0;
+  }
+  reader.remaining--;
+  if (!readName(reader.message, reader.length, reader.offset, record.name, sizeof(record.name), &reader.offset) ||
+      reader.offset + 10 > reader.length)
+  {
+    return -1;
+  }
+  const uint8_t *fixed = reader.message + reader.offset;
+  record.type = readShort(fixed);
+  record.dataLength = readShort(fixed + 8);
+  record.dataOffset = reader.offset + 10;
+  if (record.dataOffset + record.dataLength > reader.length)
+  {
+    return -1;
+  }
+  record.data = reader.message + record.dataOffset;
+  reader.offset = record.dataOffset + record.dataLength;
+  return 1;
+}
+
+void dnssdServiceInit(DnssdService &service)
+{
+  memset(&service, 0, sizeof(service));
+}
+
+bool dnssdResolved(const DnssdService &service)
+{
+  return service.port != 0 && service.address != 0;
+}
+
+// One pass over the records for each link of the chain, as a responder may
+// put them in any order: PTR to the instance, SRV to host and port, A to the address
+bool dnssdParseResponse(const uint8_t *message, size_t length, const char *serviceType, DnssdService &service)
+{
+  for (int pass = 0; pass < 3; pass++)
+  {
+    RecordReader reader;
+    if (!startRecords(message, length, reader))
+    {
+      return false;
+    }
+    DnsRecord record;
+    int result;
+    while ((result = nextRecord(reader, record)) == 1)
+    {
+      size_t ignored;
+      if (pass == 0 && record.type == DNS_TYPE_PTR && service.instance[0] == '\0' &&
+          strcasecmp(record.name, serviceType) == 0)
+      {
+        if (!readName(message, length, record.dataOffset, service.instance, sizeof(service.instance), &ignored))
+        {
+          return false;
+        }
+      }
+      else if (pass == 1 && record.type == DNS_TYPE_SRV && service.instance[0] != '\0' &&
+               strcasecmp(record.name, service.instance) == 0)
+      {
+        if (record.dataLength < 7 ||
+            !readName(message, length, record.dataOffset + 6, service.host, sizeof(service.host), &ignored))
+        {
+          return false;
+        }
+        service.port = readShort(record.data + 4);
+      }
+      else if (pass == 2 && record.type == DNS_TYPE_A && record.dataLength == 4 && service.host[0] != '\0' &&
+               strcasecmp(record.name, service.host) == 0)
+      {
+        memcpy(&service.address, record.data, 4);
+      }
+    }
+    if (result < 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,158 @@
+#include "framing.h"
+
+#include <string.h>
+
+#define FRAME_MASK (FRAME_BUFFER_SIZE - 1)
+
+static_assert((FRAME_BUFFER_SIZE & FRAME_MASK) == 0, "FRAME_BUFFER_SIZE must be a power of two");
+
+void frameAssemblerInit(FrameAssembler &assembler, WireEncoding encoding)
+{
+  assembler.head = 0;
+  assembler.tail = 0;
+  assembler.scanned = 0;
+  assembler.discarding = false;
+  assembler.encoding = encoding;
+}
+
+void frameAssemblerSetEncoding(FrameAssembler &assembler, WireEncoding encoding)
+{
+  assembler.encoding = encoding;
+  assembler.scanned = 0;
+  assembler.discarding = false;
+}
+
+size_t frameAssemblerPush(FrameAssembler &assembler, const void *data, size_t length)
+{
+  const uint8_t *bytes = (const uint8_t *)data;
+  size_t taken = 0;
+  while (taken < length)
+  {
+    size_t contiguous;
+    uint8_t *destination = frameAssemblerWritePointer(assembler, &contiguous);
+    if (contiguous == 0)
+    {
+      break;
+    }
+    size_t chunk = length - taken < contiguous ? length - taken : contiguous;
+    memcpy(destination, bytes + taken, chunk);
+    frameAssemblerCommit(assembler, chunk);
+    taken += chunk;
+  }
+  return taken;
+}
+
+uint8_t *frameAssemblerWritePointer(FrameAssembler &assembler, size_t *contiguous)
+{
+  size_t used = assembler.head - assembler.tail;
+  size_t offset = assembler.head & FRAME_MASK;
+  size_t toEnd = FRAME_BUFFER_SIZE - offset;
+  size_t space = FRAME_BUFFER_SIZE - used;
+  *contiguous = space < toEnd ? space : toEnd;
+  return &assembler.ring[offset];
+}
+
+void frameAssemblerCommit(FrameAssembler &assembler, size_t length)
+{
+  assembler.head += length;
+}
+
+// Copies length bytes from the ring starting at tail, wrapping as needed
+static void copyOut(const FrameAssembler &assembler, uint8_t *out, size_t length)
+{
+  size_t offset = assembler.tail & FRAME_MASK;
+  size_t first = FRAME_BUFFER_SIZE - offset < length ? FRAME_BUFFER_SIZE - offset : length;
+  memcpy(out, &assembler.ring[offset], first);
+  memcpy(out + first, &assembler.ring[0], length - first);
+}
+
+static FrameResult nextLine(FrameAssembler &assembler, uint8_t *out, size_t outSize, size_t *length)
+{
+  size_t used = assembler.head - assembler.tail;
+  while (assembler.scanned < used)
+  {
+    if (assembler.ring[(assembler.tail + assembler.scanned) & FRAME_MASK] != '\n')
+    {
+      assembler.scanned++;
+      continue;
+    }
+
+    size_t lineLength = assembler.scanned;
+    bool discarding = assembler.discarding;
+    bool fits = lineLength < outSize;
+    if (!discarding && fits)
+    {
+      copyOut(assembler, out, lineLength);
+    }
+    assembler.tail += lineLength + 1;
+    assembler.scanned = 0;
+    assembler.discarding = false;
+    used = assembler.head - assembler.tail;
+
+    if (discarding)
+    {
+      continue; // Already reported when the ring filled
+    }
+    if (!fits)
+    {
+      return FRAME_DROPPED;
+    }
+    if (lineLength > 0 && out[lineLength - 1] == '\r')
+    {
+      lineLength--;
+    }
+    if (lineLength == 0)
+    {
+      continue;
+    }
+    out[lineLength] = '\0';
+    *length = lineLength;
+    return FRAME_READY;
+  }
+
+  // A full ring without a newline can never complete, skip to the next line
+  if (used == FRAME_BUFFER_SIZE)
+  {
+    assembler.tail = assembler.head;
+    assembler.scanned = 0;
+    bool reported = assembler.discarding;
+    assembler.discarding = true;
+    return reported ? FRAME_NONE : FRAME_DROPPED;
+  }
+  return FRAME_NONE;
+}
+
+static FrameResult nextBinary(FrameAssembler &assembler, uint8_t *out, size_t outSize, size_t *length)
+{
+  size_t used = assembler.head - assembler.tail;
+  if (used < 2)
+  {
+    return FRAME_NONE;
+  }
+
+  uint8_t prefix[2];
+  copyOut(assembler, prefix, sizeof(prefix));
+  size_t frameLength = binaryFrameLength(prefix, sizeof(prefix));
+  if (frameLength > outSize || frameLength > FRAME_BUFFER_SIZE)
+  {
+    return FRAME_CORRUPT;
+  }
+  if (used < frameLength)
+  {
+    return FRAME_NONE;
+  }
+
+  copyOut(assembler, out, frameLength);
+  assembler.tail += frameLength;
+  *length = frameLength;
+  return FRAME_READY;
+}
+
+FrameResult frameAssemblerNext(FrameAssembler &assembler, uint8_t *out, size_t outSize, size_t *length)
+{
+  if (assembler.encoding == WIRE_BINARY)
+  {
+    return nextBinary(assembler, out, outSize, length);
+  }
+  return nextLine(assembler, out, outSize, length);
+}
@@ -0,0 +1,268 @@
+#include "hal.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/adc.h"
+#include "hardware/flash.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "timers.h"
+
+// Flash memory constants
+#define FLASH_TARGET_OFFSET 0x100000
+
+static TickType_t toTicks(uint32_t timeoutMs)
+{
+  return timeoutMs == HAL_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+}
+
+// GPIO
+
+void halGpioInitInput(unsigned int gpio)
+{
+  gpio_init(gpio);
+  gpio_set_dir(gpio, GPIO_IN);
+}
+
+void halGpioInitOutput(unsigned int gpio, bool value)
+{
+  gpio_init(gpio);
+  gpio_set_dir(gpio, GPIO_OUT);
+  gpio_put(gpio, value);
+}
+
+void halGpioPut(unsigned int gpio, bool value)
+{
+  gpio_put(gpio, value);
+}
+
+bool halGpioGet(unsigned int gpio)
+{
+  return gpio_get(gpio);
+}
+
+void halGpioEnableIrq(unsigned int gpio, uint32_t events, HalGpioIrqCallback callback)
+{
+  // The SDK has a single GPIO callback per core, every pin shares it
+  gpio_set_irq_enabled_with_callback(gpio, events, true, callback);
+}
+
+// ADC
+
+void halAdcInit()
+{
+  adc_init();
+}
+
+void halAdcInitGpio(unsigned int gpio)
+{
+  adc_gpio_init(gpio);
+}
+
+// The sensor and telemetry tasks share the one converter, the input must not
+// change between selecting it and reading it
+uint16_t halAdcRead(unsigned int channel)
+{
+  halEnterCritical();
+  adc_select_input(channel);
+  uint16_t value = adc_read();
+  halExitCritical();
+  return value;
+}
+
+// Clock
+
+uint64_t halTimeUs()
+{
+  return time_us_64();
+}
+
+void halDelayMs(uint32_t ms)
+{
+  vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+void halEnterCritical()
+{
+  taskENTER_CRITICAL();
+}
+
+void halExitCritical()
+{
+  taskEXIT_CRITICAL();
+}
+
+uint32_t halEnterCriticalFromISR()
+{
+  return taskENTER_CRITICAL_FROM_ISR();
+}
+
+void halExitCriticalFromISR(uint32_t saved)
+{
+  taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+// Timers, the HAL callback rides in the FreeRTOS timer ID
+
+static void timerTrampoline(TimerHandle_t xTimer)
+{
+  HalTimerCallback callback = (HalTimerCallback)pvTimerGetTimerID(xTimer);
+  callback((HalTimerHandle)xTimer);
+}
+
+HalTimerHandle halTimerCreate(const char *name, uint32_t periodMs, bool autoReload, HalTimerCallback callback)
+{
+  return (HalTimerHandle)xTimerCreate(name, pdMS_TO_TICKS(periodMs), autoReload ? pdTRUE : pdFALSE, (void *)callback, timerTrampoline);
+}
+
+bool halTimerStart(HalTimerHandle timer)
+{
+  return xTimerStart((TimerHandle_t)timer, 0) == pdPASS;
+}
+
+bool halTimerStop(HalTimerHandle timer)
+{
+  return xTimerStop((TimerHandle_t)timer, 0) == pdPASS;
+}
+
+bool halTimerReset(HalTimerHandle timer)
+{
+  return xTimerReset((TimerHandle_t)timer, 0) == pdPASS;
+}
+
+bool halTimerChangePeriod(HalTimerHandle timer, uint32_t periodMs)
+{
+  return xTimerChangePeriod((TimerHandle_t)timer, pdMS_TO_TICKS(periodMs), 0) == pdPASS;
+}
+
+bool halTimerStartFromISR(HalTimerHandle timer)
+{
+  return xTimerStartFromISR((TimerHandle_t)timer, 0) == pdPASS;
+}
+
+bool halTimerStopFromISR(HalTimerHandle timer)
+{
+  return xTimerStopFromISR((TimerHandle_t)timer, 0) == pdPASS;
+}
+
+uint32_t halTimerRemainingMs(HalTimerHandle timer)
+{
+  if (xTimerIsTimerActive((TimerHandle_t)timer) == pdFALSE)
+  {
+    return 0;
+  }
+  TickType_t remaining = xTimerGetExpiryTime((TimerHandle_t)timer) - xTaskGetTickCount();
+  return (uint32_t)remaining * portTICK_PERIOD_MS;
+}
+
+// Queues
+
+HalQueueHandle halQueueCreate(size_t length, size_t itemSize)
+{
+  return (HalQueueHandle)xQueueCreate(length, itemSize);
+}
+
+bool halQueueSend(HalQueueHandle queue, const void *item, uint32_t timeoutMs)
+{
+  return xQueueSend((QueueHandle_t)queue, item, toTicks(timeoutMs)) == pdPASS;
+}
+
+bool halQueueSendFromISR(HalQueueHandle queue, const void *item)
+{
+  return xQueueSendToBackFromISR((QueueHandle_t)queue, item, NULL) == pdPASS;
+}
+
+bool halQueueReceive(HalQueueHandle queue, void *item, uint32_t timeoutMs)
+{
+  return xQueueReceive((QueueHandle_t)queue, item, toTicks(timeoutMs)) == pdPASS;
+}
+
+void halQueueDelete(HalQueueHandle queue)
+{
+  vQueueDelete((QueueHandle_t)queue);
+}
+
+// Signals
+
+HalSignalHandle halSignalCreate()
+{
+  return (HalSignalHandle)xSemaphoreCreateBinary();
+}
+
+void halSignalGive(HalSignalHandle signal)
+{
+  xSemaphoreGive((SemaphoreHandle_t)signal);
+}
+
+bool halSignalWait(HalSignalHandle signal, uint32_t timeoutMs)
+{
+  return xSemaphoreTake((SemaphoreHandle_t)signal, toTicks(timeoutMs)) == pdPASS;
+}
+
+// Storage, one flash sector
+
+// Flash erase helper
+static void callFlashRangeErase(void *param)
+{
+  uint32_t offset = (uint32_t)param;
+  flash_range_erase(offset, FLASH_SECTOR_SIZE);
+}
+
+// Flash program helper
+static void callFlashRangeProgram(void *param)
+{
+  uint32_t offset = ((uintptr_t *)param)[0];
+  const uint8_t *data = (const uint8_t *)((uintptr_t *)param)[1];
+  flash_range_program(offset, data, FLASH_SECTOR_SIZE);
+}
+
+bool halStorageRead(void *data, size_t size)
+{
+  if (size > FLASH_SECTOR_SIZE)
+  {
+    return false;
+  }
+  memcpy(data, (const uint8_t *)(XIP_BASE + FLASH_TARGET_OFFSET), size);
+  return true;
+}
+
+bool halStorageWrite(const void *data, size_t size)
+{
+  if (size > FLASH_SECTOR_SIZE)
+  {
+    return false;
+  }
+
+  // Prepare buffer for writing, programming always covers the whole sector
+  static uint8_t buffer[FLASH_SECTOR_SIZE];
+  memset(buffer, 0xFF, sizeof(buffer));
+  memcpy(buffer, data, size);
+
+  // Safely erase flash
+  int rc = flash_safe_execute(callFlashRangeErase, (void *)FLASH_TARGET_OFFSET, UINT32_MAX);
+  if (rc != PICO_OK)
+  {
+    printf("Error erasing flash sector: %d\n", rc);
+    return false;
+  }
+
+  printf("Flash sector erased successfully.\n");
+
+  // Safely write to flash
+  uintptr_t params[] = {FLASH_TARGET_OFFSET, (uintptr_t)buffer};
+  rc = flash_safe_execute(callFlashRangeProgram, params, UINT32_MAX);
+  if (rc != PICO_OK)
+  {
+    printf("Error programming flash: %d\n", rc);
+    return false;
+  }
+
+  // Verify the written data
+  const uint8_t *flashMemory = (const uint8_t *)(XIP_BASE + FLASH_TARGET_OFFSET);
+  return memcmp(buffer, flashMemory, size) == 0;
+}
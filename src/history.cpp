@@ -0,0 +1,200 @@
+#include "history.h"
+
+#include "hal.h"
+
+#include <math.h>
+#include <string.h>
+
+static_assert((HISTORY_SLOTS & (HISTORY_SLOTS - 1)) == 0, "HISTORY_SLOTS must be a power of two");
+
+static HistorySlot slots[HISTORY_SLOTS];
+
+// Sums of the slot being filled, its means are written back with every sample
+typedef struct
+{
+  uint32_t slot;
+  uint32_t samples;
+  int32_t pressureSum;
+  int32_t currentSum;
+} HistoryAccumulator;
+
+static HistoryAccumulator open;
+
+// Handed from the control task to the sender
+static HistoryQuery requested;
+static volatile bool requestPending = false;
+static HistoryQuery active;
+static bool activePending = false;
+
+static int16_t tenths(float value)
+{
+  long scaled = lroundf(value * 10.0f);
+  return (int16_t)(scaled > INT16_MAX ? INT16_MAX : scaled < INT16_MIN ? INT16_MIN : scaled);
+}
+
+void historyClear()
+{
+  halEnterCritical();
+  memset(slots, 0, sizeof(slots));
+  memset(&open, 0, sizeof(open));
+  requestPending = false;
+  halExitCritical();
+  activePending = false;
+}
+
+void historyAddSample(uint64_t timeUs, float pressure, float currentDraw)
+{
+  uint32_t slot = (uint32_t)(timeUs / 1000000 / HISTORY_PERIOD_S);
+  int16_t pressureTenths = tenths(pressure);
+  int16_t currentTenths = tenths(currentDraw);
+
+  if (open.samples == 0 || open.slot != slot)
+  {
+    open.slot = slot;
+    open.samples = 0;
+    open.pressureSum = 0;
+    open.currentSum = 0;
+  }
+  open.samples++;
+  open.pressureSum += pressureTenths;
+  open.currentSum += currentTenths;
+
+  halEnterCritical();
+  HistorySlot &entry = slots[slot % HISTORY_SLOTS];
+  if (open.samples == 1)
+  {
+    entry.slot = slot;
+    entry.pressureMin = pressureTenths;
+    entry.pressureMax = pressureTenths;
+    entry.currentMax = currentTenths;
+  }
+  entry.samples = (uint16_t)(open.samples > UINT16_MAX ? UINT16_MAX : open.samples);
+  entry.pressureMin = pressureTenths < entry.pressureMin ? pressureTenths : entry.pressureMin;
+  entry.pressureMax = pressureTenths > entry.pressureMax ? pressureTenths : entry.pressureMax;
+  entry.currentMax = currentTenths > entry.currentMax ? currentTenths : entry.currentMax;
+  entry.pressureMean = (int16_t)(open.pressureSum / (int32_t)open.samples);
+  entry.currentMean = (int16_t)(open.currentSum / (int32_t)open.samples);
+  halExitCritical();
+}
+
+uint32_t historyNow()
+{
+  return (uint32_t)(halTimeUs() / 1000000);
+}
+
+void historyQueryInit(HistoryQuery &query, int from, int to, int resolution, uint32_t nowS)
+{
+  uint32_t nowSlot = nowS / HISTORY_PERIOD_S;
+  uint32_t oldest = nowSlot >= HISTORY_SLOTS ? (nowSlot - HISTORY_SLOTS + 1) * HISTORY_PERIOD_S : 0;
+  uint32_t limit = (nowSlot + 1) * HISTORY_PERIOD_S; // The end of the slot being filled
+
+  int64_t start = from < 0 ? (int64_t)nowS + from : from;
+  int64_t end = to <= 0 ? (int64_t)nowS + to : to;
+  start = start < oldest ? oldest : start;
+  end = end > limit ? limit : end;
+
+  query.next = (uint32_t)start / HISTORY_PERIOD_S * HISTORY_PERIOD_S;
+  query.to = end > (int64_t)query.next ? (uint32_t)end : query.next;
+  if (resolution <= HISTORY_PERIOD_S)
+  {
+    query.resolution = HISTORY_PERIOD_S;
+  }
+  else if (resolution >= HISTORY_MAX_RESOLUTION_S)
+  {
+    query.resolution = HISTORY_MAX_RESOLUTION_S;
+  }
+  else
+  {
+    query.resolution = (resolution + HISTORY_PERIOD_S - 1) / HISTORY_PERIOD_S * HISTORY_PERIOD_S;
+  }
+}
+
+bool historyNextBucket(HistoryQuery &query, HistoryBucket &bucket)
+{
+  while (query.next < query.to)
+  {
+    uint32_t start = query.next;
+    uint32_t end = query.to - start > query.resolution ? start + query.resolution : query.to;
+    query.next = end;
+
+    int64_t pressureSum = 0;
+    int64_t currentSum = 0;
+    bucket.samples = 0;
+    for (uint32_t slot = start / HISTORY_PERIOD_S; slot * HISTORY_PERIOD_S < end; slot++)
+    {
+      halEnterCritical();
+      HistorySlot entry = slots[slot % HISTORY_SLOTS];
+      halExitCritical();
+      if (entry.slot != slot || entry.samples == 0)
+      {
+        continue;
+      }
+      if (bucket.samples == 0)
+      {
+        bucket.pressureMin = entry.pressureMin;
+        bucket.pressureMax = entry.pressureMax;
+        bucket.currentMax = entry.currentMax;
+      }
+      bucket.pressureMin = entry.pressureMin < bucket.pressureMin ? entry.pressureMin : bucket.pressureMin;
+      bucket.pressureMax = entry.pressureMax > bucket.pressureMax ? entry.pressureMax : bucket.pressureMax;
+      bucket.currentMax = entry.currentMax > bucket.currentMax ? entry.currentMax : bucket.currentMax;
+      pressureSum += (int64_t)entry.pressureMean * entry.samples;
+      currentSum += (int64_t)entry.currentMean * entry.samples;
+      bucket.samples += entry.samples;
+    }
+
+    if (bucket.samples > 0)
+    {
+      bucket.start = start;
+      bucket.seconds = end - start;
+      bucket.pressureMean = (int16_t)(pressureSum / bucket.samples);
+      bucket.currentMean = (int16_t)(currentSum / bucket.samples);
+      return true;
+    }
+  }
+  return false;
+}
+
+void historyRequest(int from, int to, int resolution)
+{
+  HistoryQuery query;
+  historyQueryInit(query, from, to, resolution, historyNow());
+
+  halEnterCritical();
+  requested = query;
+  requestPending = true;
+  halExitCritical();
+}
+
+bool historyNextChunk(HistoryChunk &chunk)
+{
+  halEnterCritical();
+  if (requestPending)
+  {
+    active = requested;
+    activePending = true;
+    requestPending = false;
+  }
+  halExitCritical();
+  if (!activePending)
+  {
+    return false;
+  }
+
+  chunk.now = historyNow();
+  chunk.resolution = active.resolution;
+  chunk.to = active.to;
+  chunk.count = 0;
+  while (chunk.count < HISTORY_CHUNK_BUCKETS && historyNextBucket(active, chunk.buckets[chunk.count]))
+  {
+    chunk.count++;
+  }
+
+  chunk.next = active.next;
+  chunk.done = active.next >= active.to;
+  if (chunk.done)
+  {
+    activePending = false;
+  }
+  return true;
+}
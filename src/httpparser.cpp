@@ -0,0 +1,286 @@
+#include "httpparser.h"
+
+#include <string.h>
+#include <strings.h>
+
+static HttpResult fail(HttpParser &parser, int status)
+{
+  parser.state = HTTP_FAILED;
+  parser.errorStatus = status;
+  return HTTP_ERROR;
+}
+
+static bool isSpace(char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+// True if the comma-separated list value holds token, ignoring case
+static bool listHasToken(const char *value, const char *token)
+{
+  size_t tokenLength = strlen(token);
+  while (*value != '\0')
+  {
+    while (isSpace(*value) || *value == ',')
+    {
+      value++;
+    }
+    size_t length = strcspn(value, ",");
+    size_t trimmed = length;
+    while (trimmed > 0 && isSpace(value[trimmed - 1]))
+    {
+      trimmed--;
+    }
+    if (trimmed == tokenLength && strncasecmp(value, token, tokenLength) == 0)
+    {
+      return true;
+    }
+    value += length;
+  }
+  return false;
+}
+
+// METHOD SP path SP HTTP/1.x
+static HttpResult requestLine(HttpParser &parser)
+{
+  const char *line = parser.line;
+  size_t methodLength = strcspn(line, " ");
+  if (methodLength == 0 || line[methodLength] != ' ')
+  {
+    return fail(parser, 400);
+  }
+  if (methodLength > HTTP_METHOD_MAX)
+  {
+    return fail(parser, 501);
+  }
+  const char *path = line + methodLength + 1;
+  size_t pathLength = strcspn(path, " ");
+  if (pathLength == 0 || path[pathLength] != ' ')
+  {
+    return fail(parser, 400);
+  }
+  if (pathLength > HTTP_PATH_MAX)
+  {
+    return fail(parser, 414);
+  }
+  const char *version = path + pathLength + 1;
+  if (strncmp(version, "HTTP/1.", 7) != 0 || version[7] < '0' || version[7] > '9' || version[8] != '\0')
+  {
+    return fail(parser, strncmp(version, "HTTP/", 5) == 0 ? 505 : 400);
+  }
+
+  memcpy(parser.method, line, methodLength);
+  parser.method[methodLength] = '\0';
+  memcpy(parser.path, path, pathLength);
+  parser.path[pathLength] = '\0';
+  parser.closeRequested = version[7] == '0';
+  parser.state = HTTP_HEADER_LINE;
+  return HTTP_NEED_MORE;
+}
+
+static HttpResult endOfHeaders(HttpParser &parser)
+{
+  if (parser.hasContentLength && parser.contentLength > 0)
+  {
+    parser.state = HTTP_BODY;
+    return HTTP_NEED_MORE;
+  }
+  parser.state = HTTP_DONE;
+  return HTTP_COMPLETE;
+}
+
+static HttpResult headerLine(HttpParser &parser)
+{
+  if (parser.lineLength == 0)
+  {
+    return endOfHeaders(parser);
+  }
+  const char *line = parser.line;
+  size_t nameLength = strcspn(line, ":");
+  // No folded lines, and no space before the colon (RFC 9112 5.1)
+  if (isSpace(line[0]) || line[nameLength] != ':' || nameLength == 0 || isSpace(line[nameLength - 1]))
+  {
+    return fail(parser, 400);
+  }
+  char *value = parser.line + nameLength + 1;
+  while (isSpace(*value))
+  {
+    value++;
+  }
+  size_t valueLength = strlen(value);
+  while (valueLength > 0 && isSpace(value[valueLength - 1]))
+  {
+    valueLength--;
+  }
+  value[valueLength] = '\0';
+
+  if (nameLength == 14 && strncasecmp(line, "Content-Length", nameLength) == 0)
+  {
+    size_t contentLength = 0;
+    if (valueLength == 0)
+    {
+      return fail(parser, 400);
+    }
+    for (size_t i = 0; i < valueLength; i++)
+    {
+      if (value[i] < '0' || value[i] > '9')
+      {
+        return fail(parser, 400);
+      }
+      if (contentLength > HTTP_BODY_MAX)
+      {
+        break; // Too large already, no need to read on into an overflow
+      }
+      contentLength = contentLength * 10 + (size_t)(value[i] - '0');
+    }
+    // A repeat is only allowed with the same value
+    if (parser.hasContentLength && parser.contentLength != contentLength)
+    {
+      return fail(parser, 400);
+    }
+    if (contentLength > HTTP_BODY_MAX)
+    {
+      return fail(parser, 413);
+    }
+    parser.hasContentLength = true;
+    parser.contentLength = contentLength;
+  }
+  else if (nameLength == 17 && strncasecmp(line, "Transfer-Encoding", nameLength) == 0)
+  {
+    return fail(parser, 501); // No chunked bodies
+  }
+  else if (nameLength == 10 && strncasecmp(line, "Connection", nameLength) == 0)
+  {
+    if (listHasToken(value, "close"))
+    {
+      parser.closeRequested = true;
+    }
+  }
+  else if (nameLength == 7 && strncasecmp(line, "Upgrade", nameLength) == 0)
+  {
+    parser.upgradeWebSocket = listHasToken(value, "websocket");
+  }
+  else if (nameLength == 17 && strncasecmp(line, "Sec-WebSocket-Key", nameLength) == 0)
+  {
+    if (valueLength > HTTP_KEY_MAX)
+    {
+      return fail(parser, 400);
+    }
+    memcpy(parser.websocketKey, value, valueLength + 1);
+  }
+  return HTTP_NEED_MORE;
+}
+
+void httpParserInit(HttpParser &parser)
+{
+  memset(&parser, 0, sizeof(parser));
+  parser.state = HTTP_REQUEST_LINE;
+}
+
+HttpResult httpParse(HttpParser &parser, const uint8_t *data, size_t length, size_t *consumed)
+{
+  size_t used = 0;
+  HttpResult result = HTTP_NEED_MORE;
+
+  while (used < length && (parser.state == HTTP_REQUEST_LINE || parser.state == HTTP_HEADER_LINE))
+  {
+    char c = (char)data[used++];
+    if (++parser.headerBytes > HTTP_HEADER_BUDGET)
+    {
+      result = fail(parser, 431);
+      break;
+    }
+    if (c != '\n')
+    {
+      if (parser.lineLength < HTTP_LINE_MAX)
+      {
+        parser.line[parser.lineLength++] = c;
+      }
+      else
+      {
+        parser.lineTooLong = true;
+      }
+      continue;
+    }
+
+    // A bare LF ends a line as well as CRLF
+    if (parser.lineLength > 0 && parser.line[parser.lineLength - 1] == '\r')
+    {
+      parser.lineLength--;
+    }
+    parser.line[parser.lineLength] = '\0';
+    if (parser.lineTooLong)
+    {
+      result = fail(parser, parser.state == HTTP_REQUEST_LINE ? 414 : 431);
+    }
+    else if (parser.state == HTTP_REQUEST_LINE)
+    {
+      // Empty lines ahead of a request are skipped (RFC 9112 2.2)
+      result = parser.lineLength == 0 ? HTTP_NEED_MORE : requestLine(parser);
+    }
+    else
+    {
+      result = headerLine(parser);
+    }
+    parser.lineLength = 0;
+    parser.lineTooLong = false;
+    if (result != HTTP_NEED_MORE)
+    {
+      break;
+    }
+  }
+
+  if (parser.state == HTTP_BODY && used < length)
+  {
+    size_t wanted = parser.contentLength - parser.bodyLength;
+    size_t available = length - used;
+    size_t take = available < wanted ? available : wanted;
+    memcpy(parser.body + parser.bodyLength, data + used, take);
+    parser.bodyLength += take;
+    used += take;
+    if (parser.bodyLength == parser.contentLength)
+    {
+      parser.body[parser.bodyLength] = '\0';
+      parser.state = HTTP_DONE;
+      result = HTTP_COMPLETE;
+    }
+  }
+
+  if (parser.state == HTTP_DONE)
+  {
+    result = HTTP_COMPLETE;
+  }
+  else if (parser.state == HTTP_FAILED)
+  {
+    result = HTTP_ERROR;
+  }
+  *consumed = used;
+  return result;
+}
+
+const char *httpReason(int status)
+{
+  switch (status)
+  {
+  case 200:
+    return "OK";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 413:
+    return "Content Too Large";
+  case 414:
+    return "URI Too Long";
+  case 431:
+    return "Request Header Fields Too Large";
+  case 501:
+    return "Not Implemented";
+  case 503:
+    return "Service Unavailable";
+  case 505:
+    return "HTTP Version Not Supported";
+  default:
+    return "Error";
+  }
+}
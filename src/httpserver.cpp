@@ -3,68 +3,77 @@
 #include "fsdata.h"
 #include <string.h>
 #include <stdio.h>
-#include <sstream>
+#include "httpparser.h"
 #include "wifi.h"
 #include "cJSON.h"
 #include "settings.h"
+#include "websocketserver.h"
 
-static struct tcp_pcb *http_pcb = NULL;
+#define HTTP_MAX_CONNECTIONS 4 // Requests in progress at once, past this a connection is refused
+#define HTTP_POLL_INTERVAL 2   // tcp_poll() units of the 500 ms TCP timer
+#define HTTP_IDLE_POLLS 10     // Polls without data before a kept-alive connection gives its slot back
 
-static std::string fullRequest;
+// Only touched in the lwIP thread
+typedef struct
+{
+  struct tcp_pcb *pcb; // NULL when the slot is free
+  HttpParser parser;
+  uint8_t idlePolls; // Since the last data received
+} HttpConnection;
 
-static err_t handle_post_request(struct tcp_pcb *pcb, const char *request)
+typedef enum
 {
-  char *body = strstr(request, "\r\n\r\n");
-  if (body)
-  {
-    body += 4; // Move past the "\r\n\r\n" delimiter
-    printf("Received POST data: %s\n", body);
+  HTTP_KEEP_OPEN,
+  HTTP_CLOSE,
+  HTTP_HANDED_OVER, // Upgraded to a WebSocket
+} HttpOutcome;
 
-    // Parse JSON
-    cJSON *json = cJSON_Parse(body);
-    if (json)
-    {
-      // Extract fields
-      cJSON *ssid = cJSON_GetObjectItem(json, "ssid");
-      cJSON *password = cJSON_GetObjectItem(json, "password");
-      cJSON *authMode = cJSON_GetObjectItem(json, "authMode");
+static struct tcp_pcb *http_pcb = NULL;
+static bool configurationEnabled = false; // Wi-Fi setup pages, only in AP mode
+static HttpConnection connections[HTTP_MAX_CONNECTIONS];
 
-      if (cJSON_IsString(ssid) && cJSON_IsString(password) && cJSON_IsNumber(authMode))
-      {
-        // Save to settings
-        strncpy((char *)currentSettings.ssid, ssid->valuestring, sizeof(currentSettings.ssid) - 1);
-        currentSettings.ssid[sizeof(currentSettings.ssid) - 1] = '\0';
+// body is the complete Content-Length body, NUL-terminated
+static void handle_post_request(const char *body)
+{
+  printf("Received POST data: %s\n", body);
 
-        strncpy((char *)currentSettings.password, password->valuestring, sizeof(currentSettings.password) - 1);
-        currentSettings.password[sizeof(currentSettings.password) - 1] = '\0';
+  // Parse JSON
+  cJSON *json = cJSON_Parse(body);
+  if (json)
+  {
+    // Extract fields
+    cJSON *ssid = cJSON_GetObjectItem(json, "ssid");
+    cJSON *password = cJSON_GetObjectItem(json, "password");
+    cJSON *authMode = cJSON_GetObjectItem(json, "authMode");
 
-        currentSettings.authMode = authMode->valueint;
+    if (cJSON_IsString(ssid) && cJSON_IsString(password) && cJSON_IsNumber(authMode))
+    {
+      // Save to settings
+      strncpy((char *)currentSettings.ssid, ssid->valuestring, sizeof(currentSettings.ssid) - 1);
+      currentSettings.ssid[sizeof(currentSettings.ssid) - 1] = '\0';
 
-        // Trigger a settings validation to save the updated settings
-        requestSettingsValidation();
+      strncpy((char *)currentSettings.password, password->valuestring, sizeof(currentSettings.password) - 1);
+      currentSettings.password[sizeof(currentSettings.password) - 1] = '\0';
 
-        printf("Saved credentials: SSID='%s', Password='%s', AuthMode=%d\n",
-               currentSettings.ssid, currentSettings.password, currentSettings.authMode);
-      }
-      else
-      {
-        printf("Invalid JSON fields.\n");
-      }
+      currentSettings.authMode = authMode->valueint;
+
+      // Trigger a settings validation to save the updated settings
+      requestSettingsValidation();
 
-      cJSON_Delete(json); // Free memory allocated for JSON parsing
+      printf("Saved credentials: SSID='%s', Password='%s', AuthMode=%d\n",
+             currentSettings.ssid, currentSettings.password, currentSettings.authMode);
     }
     else
     {
-      printf("Failed to parse JSON.\n");
+      printf("Invalid JSON fields.\n");
     }
-    const char *response = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
-    tcp_write(pcb, response, strlen(response), TCP_WRITE_FLAG_COPY);
+
+    cJSON_Delete(json); // Free memory allocated for JSON parsing
   }
   else
   {
-    printf("Incomplete POST request received.\n");
+    printf("Failed to parse JSON.\n");
   }
-  return ERR_OK;
 }
 
 static const char *generateScanResultsJson()
@@ -111,81 +120,232 @@ static const char *generateScanResultsJson()
   return jsonBuffer;
 }
 
-static err_t http_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+// Answers with a complete response, the body copied so it may be temporary
+static void sendResponse(struct tcp_pcb *pcb, int status, const char *contentType, const char *body, size_t length,
+                         bool close)
 {
-  if (!p)
+  char header[192];
+  int headerLength = snprintf(header, sizeof(header),
+                              "HTTP/1.1 %d %s\r\n"
+                              "%s%s%s"
+                              "Content-Length: %u\r\n"
+                              "%s"
+                              "\r\n",
+                              status, httpReason(status),
+                              contentType != NULL ? "Content-Type: " : "", contentType != NULL ? contentType : "",
+                              contentType != NULL ? "\r\n" : "", (unsigned int)length,
+                              close ? "Connection: close\r\n" : "");
+  tcp_write(pcb, header, headerLength, length > 0 ? TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE : TCP_WRITE_FLAG_COPY);
+  if (length > 0)
+  {
+    tcp_write(pcb, body, length, TCP_WRITE_FLAG_COPY);
+  }
+  tcp_output(pcb);
+}
+
+// Frees the slot and closes the connection. ERR_ABRT if it had to be aborted,
+// which a receive or poll callback must then return.
+static err_t releaseConnection(HttpConnection *connection)
+{
+  struct tcp_pcb *pcb = connection->pcb;
+  if (pcb == NULL)
   {
-    tcp_close(pcb);
     return ERR_OK;
   }
+  connection->pcb = NULL;
+  tcp_arg(pcb, NULL);
+  tcp_recv(pcb, NULL);
+  tcp_err(pcb, NULL);
+  tcp_poll(pcb, NULL, 0);
+  if (tcp_close(pcb) != ERR_OK)
+  {
+    tcp_abort(pcb);
+    return ERR_ABRT;
+  }
+  return ERR_OK;
+}
+
+// Hands the connection to the WebSocket server, or answers why not
+static HttpOutcome handleUpgrade(HttpConnection *connection)
+{
+  const HttpParser &parser = connection->parser;
+  size_t keyLength = strlen(parser.websocketKey);
+  if (!parser.upgradeWebSocket || keyLength == 0)
+  {
+    sendResponse(connection->pcb, 400, NULL, NULL, 0, true);
+    return HTTP_CLOSE;
+  }
+  if (!websocketUpgrade(connection->pcb, parser.websocketKey, keyLength))
+  {
+    sendResponse(connection->pcb, 503, NULL, NULL, 0, true);
+    return HTTP_CLOSE;
+  }
+  // The WebSocket server owns the pcb and its callbacks now
+  tcp_poll(connection->pcb, NULL, 0);
+  connection->pcb = NULL;
+  return HTTP_HANDED_OVER;
+}
 
-  char *request = (char *)p->payload;
+static HttpOutcome handleRequest(HttpConnection *connection)
+{
+  const HttpParser &parser = connection->parser;
+  struct tcp_pcb *pcb = connection->pcb;
+  bool get = strcmp(parser.method, "GET") == 0;
 
-  if (strncmp(request, "GET /scan.json", 14) == 0)
+  if (get && strcmp(parser.path, WEBSOCKET_PATH) == 0)
+  {
+    return handleUpgrade(connection);
+  }
+  if (!configurationEnabled)
+  {
+    sendResponse(pcb, 404, NULL, NULL, 0, parser.closeRequested);
+  }
+  else if (get && strcmp(parser.path, "/scan.json") == 0)
   {
     printf("HIT SCAN!\n");
     const char *jsonResponse = generateScanResultsJson();
-    char header[128];
-    snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n", strlen(jsonResponse));
-    tcp_write(pcb, header, strlen(header), TCP_WRITE_FLAG_COPY);
-    tcp_write(pcb, jsonResponse, strlen(jsonResponse), TCP_WRITE_FLAG_COPY);
-  }
-  else if (strncmp(request, "GET /", 5) == 0)
-  {
-    char header[256];
-    snprintf(header, sizeof(header),
-             "HTTP/1.1 200 OK\r\n"
-             "Content-Type: text/html\r\n"
-             "Content-Length: %d\r\n"
-             "Connection: close\r\n"
-             "\r\n",
-             strlen(index_html_markup));
-    tcp_write(pcb, header, strlen(header), TCP_WRITE_FLAG_COPY);
-    tcp_write(pcb, index_html_markup, strlen(index_html_markup), TCP_WRITE_FLAG_COPY);
-  }
-  else if (strncmp(request, "POST /configure", 15) == 0)
+    sendResponse(pcb, 200, "application/json", jsonResponse, strlen(jsonResponse), parser.closeRequested);
+  }
+  else if (get)
+  {
+    // Every other path gets the setup page, as a captive portal would
+    sendResponse(pcb, 200, "text/html", index_html_markup, strlen(index_html_markup), true);
+    return HTTP_CLOSE;
+  }
+  else if (strcmp(parser.method, "POST") == 0 && strcmp(parser.path, "/configure") == 0)
   {
     printf("IN CONFIGURE\n");
-    if (!p)
+    handle_post_request(parser.body);
+    sendResponse(pcb, 200, NULL, NULL, 0, parser.closeRequested);
+  }
+  else
+  {
+    sendResponse(pcb, 404, NULL, NULL, 0, parser.closeRequested);
+  }
+  return parser.closeRequested ? HTTP_CLOSE : HTTP_KEEP_OPEN;
+}
+
+static err_t http_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  HttpConnection *connection = (HttpConnection *)arg;
+  if (p == NULL || connection == NULL)
+  {
+    if (p != NULL)
     {
-      tcp_close(pcb);
-      return ERR_OK;
+      tcp_recved(pcb, p->tot_len);
+      pbuf_free(p);
     }
-
-    // Append received data to the fullRequest buffer
-    fullRequest.append(static_cast<const char *>(p->payload), p->len);
-
-    // Check if the request is complete (headers and body separated by \r\n\r\n)
-    size_t headerEnd = fullRequest.find("\r\n\r\n");
-    if (headerEnd != std::string::npos)
+    if (connection != NULL)
     {
-      // Process the complete request
-      handle_post_request(pcb, fullRequest.c_str());
-
-      // Clear the buffer for the next request
-      fullRequest.clear();
+      return releaseConnection(connection);
     }
-    else
+    tcp_close(pcb);
+    return ERR_OK;
+  }
+
+  // Requests may span segments and pbufs, or share one with the next request
+  connection->idlePolls = 0;
+  HttpOutcome outcome = HTTP_KEEP_OPEN;
+  for (struct pbuf *segment = p; segment != NULL && outcome == HTTP_KEEP_OPEN; segment = segment->next)
+  {
+    const uint8_t *data = (const uint8_t *)segment->payload;
+    size_t length = segment->len;
+    while (length > 0 && outcome == HTTP_KEEP_OPEN)
     {
-      // Wait for more data
-      return ERR_OK;
+      size_t consumed;
+      HttpResult result = httpParse(connection->parser, data, length, &consumed);
+      data += consumed;
+      length -= consumed;
+      if (result == HTTP_NEED_MORE)
+      {
+        break;
+      }
+      if (result == HTTP_ERROR)
+      {
+        printf("HTTP: bad request, answering %d\n", connection->parser.errorStatus);
+        sendResponse(pcb, connection->parser.errorStatus, NULL, NULL, 0, true);
+        outcome = HTTP_CLOSE;
+      }
+      else
+      {
+        outcome = handleRequest(connection);
+        httpParserInit(connection->parser);
+      }
     }
   }
 
-  tcp_recved(pcb, p->len);
+  // The whole chain is acknowledged whatever became of it, so the window reopens
+  tcp_recved(pcb, p->tot_len);
   pbuf_free(p);
+  if (outcome == HTTP_CLOSE)
+  {
+    return releaseConnection(connection);
+  }
   return ERR_OK;
 }
 
+// Closes a connection that sent nothing for HTTP_IDLE_POLLS polls, so clients
+// that keep connections alive cannot hold every slot
+static err_t http_poll(void *arg, struct tcp_pcb *pcb)
+{
+  HttpConnection *connection = (HttpConnection *)arg;
+  if (connection == NULL || ++connection->idlePolls < HTTP_IDLE_POLLS)
+  {
+    return ERR_OK;
+  }
+  printf("HTTP: connection idle, closing\n");
+  return releaseConnection(connection);
+}
+
+// The pcb is already freed when this is called
+static void http_err(void *arg, err_t err)
+{
+  HttpConnection *connection = (HttpConnection *)arg;
+  if (connection != NULL)
+  {
+    connection->pcb = NULL;
+  }
+}
+
 static err_t http_accept(void *arg, struct tcp_pcb *pcb, err_t err)
 {
-  printf("IN http_accept\n");
+  if (err != ERR_OK || pcb == NULL)
+  {
+    return ERR_VAL;
+  }
+  HttpConnection *connection = NULL;
+  for (HttpConnection &slot : connections)
+  {
+    if (slot.pcb == NULL)
+    {
+      connection = &slot;
+      break;
+    }
+  }
+  if (connection == NULL)
+  {
+    printf("HTTP: every connection slot taken, refusing\n");
+    tcp_abort(pcb);
+    return ERR_ABRT;
+  }
+
+  connection->pcb = pcb;
+  connection->idlePolls = 0;
+  httpParserInit(connection->parser);
+  tcp_arg(pcb, connection);
   tcp_recv(pcb, http_recv);
+  tcp_err(pcb, http_err);
+  tcp_poll(pcb, http_poll, HTTP_POLL_INTERVAL);
   return ERR_OK;
 }
 
-void startHttpServer()
+void startHttpServer(bool configuration)
 {
+  configurationEnabled = configuration;
+  if (http_pcb)
+  {
+    return;
+  }
   http_pcb = tcp_new();
   if (!http_pcb)
   {
@@ -0,0 +1,114 @@
+#include "latency.h"
+
+#include "hal.h"
+
+#include "cJSON.h"
+
+#include <string.h>
+
+static LatencyHistogram histograms[LATENCY_STAGES];
+static volatile bool reportRequested = false;
+
+static const char *stageNames[LATENCY_STAGES] = {"PARSE", "ENQUEUE", "QUEUE", "ACTUATE", "TOTAL"};
+
+uint32_t latencyNowUs()
+{
+  return (uint32_t)halTimeUs();
+}
+
+static int bucketFor(uint32_t elapsedUs)
+{
+  int bucket = 0;
+  while (elapsedUs > 1 && bucket < LATENCY_BUCKETS - 1)
+  {
+    elapsedUs >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+void latencyRecord(LatencyStage stage, uint32_t elapsedUs)
+{
+  if (stage >= LATENCY_STAGES)
+  {
+    return;
+  }
+
+  LatencyHistogram &histogram = histograms[stage];
+  halEnterCritical();
+  histogram.count++;
+  histogram.totalUs += elapsedUs;
+  if (elapsedUs > histogram.maxUs)
+  {
+    histogram.maxUs = elapsedUs;
+  }
+  histogram.buckets[bucketFor(elapsedUs)]++;
+  halExitCritical();
+}
+
+void latencyReset()
+{
+  halEnterCritical();
+  memset(histograms, 0, sizeof(histograms));
+  halExitCritical();
+}
+
+void latencyGetStage(LatencyStage stage, LatencyHistogram *out)
+{
+  halEnterCritical();
+  *out = histograms[stage];
+  halExitCritical();
+}
+
+void latencyRequestReport()
+{
+  reportRequested = true;
+}
+
+bool latencyTakeReportRequest()
+{
+  if (!reportRequested)
+  {
+    return false;
+  }
+  reportRequested = false;
+  return true;
+}
+
+std::string latencyReportToString()
+{
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddStringToObject(json, "messageType", "LATENCY");
+  cJSON *stages = cJSON_AddArrayToObject(json, "stages");
+
+  for (int i = 0; i < LATENCY_STAGES; i++)
+  {
+    LatencyHistogram histogram;
+    latencyGetStage((LatencyStage)i, &histogram);
+
+    cJSON *stage = cJSON_CreateObject();
+    cJSON_AddStringToObject(stage, "stage", stageNames[i]);
+    cJSON_AddNumberToObject(stage, "count", histogram.count);
+    cJSON_AddNumberToObject(stage, "max", histogram.maxUs);
+    cJSON_AddNumberToObject(stage, "mean", histogram.count > 0 ? (double)(histogram.totalUs / histogram.count) : 0);
+
+    // Trailing empty buckets are left out
+    int used = LATENCY_BUCKETS;
+    while (used > 0 && histogram.buckets[used - 1] == 0)
+    {
+      used--;
+    }
+    cJSON *buckets = cJSON_AddArrayToObject(stage, "buckets");
+    for (int b = 0; b < used; b++)
+    {
+      cJSON_AddItemToArray(buckets, cJSON_CreateNumber(histogram.buckets[b]));
+    }
+    cJSON_AddItemToArray(stages, stage);
+  }
+
+  char *jsonString = cJSON_PrintUnformatted(json);
+  std::string result(jsonString);
+  cJSON_free(jsonString);
+  cJSON_Delete(json);
+  return result;
+}
@@ -0,0 +1,243 @@
+#include "messagebinary.h"
+#include "messageschema.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static size_t fieldSize(const SchemaField &field)
+{
+  return field.kind == FIELD_INT || field.kind == FIELD_FLOAT ? 4 : 1;
+}
+
+static void putUint32(uint8_t *out, uint32_t value)
+{
+  out[0] = (uint8_t)value;
+  out[1] = (uint8_t)(value >> 8);
+  out[2] = (uint8_t)(value >> 16);
+  out[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t getUint32(const uint8_t *in)
+{
+  return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+static size_t fieldsLength(const MessageSchema &schema)
+{
+  size_t length = 0;
+  for (size_t i = 0; i < schema.fieldCount; i++)
+  {
+    length += 2 + fieldSize(schema.fields[i]);
+  }
+  return length;
+}
+
+// base is the Message, or the ControlSnapshot for the STATE schema. Returns
+// the position after the last field.
+static uint8_t *encodeFields(const MessageSchema &schema, const char *base, uint8_t *out)
+{
+  for (size_t i = 0; i < schema.fieldCount; i++)
+  {
+    const SchemaField &field = schema.fields[i];
+    *out++ = field.tag;
+    *out++ = (uint8_t)fieldSize(field);
+    switch (field.kind)
+    {
+    case FIELD_INT:
+      putUint32(out, (uint32_t)*(const int *)(base + field.offset));
+      break;
+    case FIELD_FLOAT:
+    {
+      uint32_t bits;
+      memcpy(&bits, base + field.offset, sizeof(bits));
+      putUint32(out, bits);
+      break;
+    }
+    case FIELD_ACTION:
+    case FIELD_MODE:
+      *out = *(const uint8_t *)(base + field.offset);
+      break;
+    case FIELD_BOOL:
+      *out = *(const bool *)(base + field.offset) ? 1 : 0;
+      break;
+    case FIELD_STATE:
+      *out = (uint8_t)*(const ControlState *)(base + field.offset);
+      break;
+    }
+    out += fieldSize(field);
+  }
+  return out;
+}
+
+size_t messageToBinary(const Message &msg, uint8_t *buffer, size_t size)
+{
+  const MessageSchema *schema = messageSchemaFor(msg);
+  if (schema == NULL)
+  {
+    return 0;
+  }
+
+  size_t length = MESSAGE_BINARY_HEADER + 1 + fieldsLength(*schema);
+  if (msg.sequence != 0)
+  {
+    length += 2 + 2;
+  }
+  if (length > size)
+  {
+    return 0;
+  }
+
+  uint8_t *out = buffer;
+  *out++ = (uint8_t)(length - 2);
+  *out++ = (uint8_t)((length - 2) >> 8);
+  *out++ = (uint8_t)schema->messageType;
+  *out++ = (uint8_t)schema->type;
+  out = encodeFields(*schema, (const char *)&msg, out);
+  if (msg.sequence != 0)
+  {
+    *out++ = TAG_SEQUENCE;
+    *out++ = 2;
+    *out++ = (uint8_t)msg.sequence;
+    *out++ = (uint8_t)(msg.sequence >> 8);
+  }
+  return length;
+}
+
+size_t controlSnapshotToBinary(const ControlSnapshot &snapshot, uint8_t *buffer, size_t size)
+{
+  size_t length = MESSAGE_BINARY_HEADER + fieldsLength(stateSchema);
+  if (length > size)
+  {
+    return 0;
+  }
+
+  buffer[0] = (uint8_t)(length - 2);
+  buffer[1] = (uint8_t)((length - 2) >> 8);
+  buffer[2] = MESSAGE_BINARY_STATE;
+  encodeFields(stateSchema, (const char *)&snapshot, buffer + MESSAGE_BINARY_HEADER);
+  return length;
+}
+
+static bool decodeField(const SchemaField &field, const uint8_t *value, Message &msg)
+{
+  char *base = (char *)&msg;
+  switch (field.kind)
+  {
+  case FIELD_INT:
+    *(int *)(base + field.offset) = (int)getUint32(value);
+    return true;
+  case FIELD_FLOAT:
+  {
+    uint32_t bits = getUint32(value);
+    memcpy(base + field.offset, &bits, sizeof(bits));
+    return true;
+  }
+  case FIELD_ACTION:
+    if (*value != CommandType::ON && *value != CommandType::OFF && *value != CommandType::OFF_RELEASE)
+    {
+      return false;
+    }
+    *(uint8_t *)(base + field.offset) = *value;
+    return true;
+  case FIELD_MODE:
+    if (*value > ScheduleMode::SCHEDULE_DAILY)
+    {
+      return false;
+    }
+    *(uint8_t *)(base + field.offset) = *value;
+    return true;
+  case FIELD_BOOL:
+  case FIELD_STATE:
+    return false; // STATE only, never received
+  }
+  return false;
+}
+
+size_t binaryFrameLength(const uint8_t *buffer, size_t available)
+{
+  if (available < 2)
+  {
+    return 0;
+  }
+  return 2 + ((size_t)buffer[0] | (size_t)buffer[1] << 8);
+}
+
+void binaryTextHeader(uint8_t *header, size_t textLength)
+{
+  header[0] = (uint8_t)(textLength + 1);
+  header[1] = (uint8_t)((textLength + 1) >> 8);
+  header[2] = MESSAGE_BINARY_TEXT;
+}
+
+bool binaryToMessage(const uint8_t *buffer, size_t length, Message &msg)
+{
+  if (buffer == NULL || length < MESSAGE_BINARY_HEADER + 1 || binaryFrameLength(buffer, length) != length)
+  {
+    printf("Invalid binary frame length\n");
+    return false;
+  }
+
+  const MessageSchema *schema = messageSchemaFind((MessageType)buffer[2], buffer[3]);
+  if (schema == NULL)
+  {
+    printf("Unknown binary message %u/%u\n", buffer[2], buffer[3]);
+    return false;
+  }
+
+  Message decoded = schema->messageType == MessageType::COMMAND ? commandMessage((CommandType)schema->type)
+                                                                : infoMessage((InfoType)schema->type);
+
+  uint32_t seen = 0;
+  size_t position = MESSAGE_BINARY_HEADER + 1;
+  while (position < length)
+  {
+    if (length - position < 2 || length - position - 2 < buffer[position + 1])
+    {
+      printf("Truncated binary field\n");
+      return false;
+    }
+    uint8_t tag = buffer[position];
+    uint8_t size = buffer[position + 1];
+    const uint8_t *value = buffer + position + 2;
+    position += 2 + size;
+
+    if (tag == TAG_SEQUENCE)
+    {
+      if (size != 2)
+      {
+        printf("Invalid binary field %u\n", tag);
+        return false;
+      }
+      decoded.sequence = (uint16_t)(value[0] | value[1] << 8);
+      continue;
+    }
+
+    for (size_t i = 0; i < schema->fieldCount; i++)
+    {
+      const SchemaField &field = schema->fields[i];
+      if (field.tag != tag)
+      {
+        continue;
+      }
+      if (size != fieldSize(field) || !decodeField(field, value, decoded))
+      {
+        printf("Invalid binary field %u\n", tag);
+        return false;
+      }
+      seen |= 1u << i;
+      break;
+    }
+  }
+
+  for (size_t i = 0; i < schema->fieldCount; i++)
+  {
+    if (schema->fields[i].required && (seen & (1u << i)) == 0)
+    {
+      printf("Missing binary field %u\n", schema->fields[i].tag);
+      return false;
+    }
+  }
+
+  msg = decoded;
+  return true;
+}
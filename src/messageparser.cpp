@@ -0,0 +1,835 @@
+#include "messageparser.h"
+#include "messagebinary.h"
+#include "control.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+// Top-level keys the parser captures, matched case-insensitively
+typedef enum
+{
+  KEY_MESSAGE_TYPE,
+  KEY_COMMAND_TYPE,
+  KEY_INFO_TYPE,
+  KEY_TIMEOUT,
+  KEY_ID,
+  KEY_ACTION,
+  KEY_MODE,
+  KEY_TIME,
+  KEY_LIMIT,
+  KEY_SINCE,
+  KEY_PRESSURE,
+  KEY_ENCODING,
+  KEY_SEQUENCE,
+  KEY_FROM,
+  KEY_TO,
+  KEY_RESOLUTION,
+  KEY_COUNT
+} Key;
+
+static constexpr const char *keyNames[KEY_COUNT] = {
+    "messagetype", "commandtype", "infotype", "timeout", "id", "action",
+    "mode", "time", "limit", "since", "pressure", "encoding", "seq", "from", "to", "resolution"};
+
+// String values with a meaning, matched exactly
+typedef enum
+{
+  WORD_COMMAND,
+  WORD_INFO,
+  WORD_ON,
+  WORD_OFF,
+  WORD_OFF_RELEASE,
+  WORD_SET_COMPRESSION_TIMEOUT,
+  WORD_SET_RELEASE_TIMEOUT,
+  WORD_SET_MOTOR_TIMEOUT,
+  WORD_SCHEDULE,
+  WORD_UNSCHEDULE,
+  WORD_SET_CLOCK,
+  WORD_SET_MOTOR_TEMPERATURE_LIMIT,
+  WORD_GET_RECORDER,
+  WORD_GET_LATENCY,
+  WORD_RESET_LATENCY,
+  WORD_GET_STATE,
+  WORD_ACK,
+  WORD_HEARTBEAT_ACK,
+  WORD_GET_HISTORY,
+  WORD_GET_STATS,
+  WORD_RESET_STATS,
+  WORD_PRESSURE_CHANGE,
+  WORD_COMPRESSION_COUNTDOWN_UPDATED,
+  WORD_RELEASE_COUNTDOWN_UPDATED,
+  WORD_IN,
+  WORD_AT,
+  WORD_DAILY,
+  WORD_HELLO,
+  WORD_JSON,
+  WORD_BINARY,
+  WORD_COUNT
+} Word;
+
+static constexpr const char *wordNames[WORD_COUNT] = {
+    "COMMAND", "INFO", "ON", "OFF", "OFF_RELEASE", "SET_COMPRESSION_TIMEOUT",
+    "SET_RELEASE_TIMEOUT", "SET_MOTOR_TIMEOUT", "SCHEDULE", "UNSCHEDULE",
+    "SET_CLOCK", "SET_MOTOR_TEMPERATURE_LIMIT", "GET_RECORDER", "GET_LATENCY",
+    "RESET_LATENCY", "GET_STATE", "ACK", "HEARTBEAT_ACK", "GET_HISTORY", "GET_STATS", "RESET_STATS", "PRESSURE_CHANGE", "COMPRESSION_COUNTDOWN_UPDATED",
+    "RELEASE_COUNTDOWN_UPDATED", "IN", "AT", "DAILY", "HELLO", "JSON", "BINARY"};
+
+// Perfect hashing: a seeded FNV-1a whose seed is searched at compile time so
+// that every word lands in its own slot. A lookup is one hash and one compare.
+
+static constexpr size_t wordLength(const char *word)
+{
+  size_t length = 0;
+  while (word[length] != '\0')
+  {
+    length++;
+  }
+  return length;
+}
+
+static constexpr uint32_t hashWord(const char *word, size_t length, uint32_t seed)
+{
+  uint32_t hash = 2166136261u ^ seed;
+  for (size_t i = 0; i < length; i++)
+  {
+    hash ^= (uint8_t)word[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Low bits of an FNV hash only depend on the low bits of the seed, the high
+// half is folded in so that every seed gives a different spread
+template <size_t Slots>
+static constexpr size_t slotFor(uint32_t hash)
+{
+  return (hash ^ (hash >> 16)) & (Slots - 1);
+}
+
+template <size_t Slots>
+struct PerfectHash
+{
+  uint32_t seed;
+  int8_t slots[Slots]; // Word index or -1
+};
+
+template <size_t Slots, size_t Words>
+static constexpr PerfectHash<Slots> buildPerfectHash(const char *const (&words)[Words])
+{
+  static_assert((Slots & (Slots - 1)) == 0, "slot count must be a power of two");
+  static_assert(Words < Slots && Words < 128, "too many words for the table");
+
+  PerfectHash<Slots> table = {};
+  for (uint32_t seed = 0;; seed++)
+  {
+    table.seed = seed;
+    for (size_t i = 0; i < Slots; i++)
+    {
+      table.slots[i] = -1;
+    }
+
+    bool collision = false;
+    for (size_t w = 0; w < Words && !collision; w++)
+    {
+      size_t slot = slotFor<Slots>(hashWord(words[w], wordLength(words[w]), seed));
+      collision = table.slots[slot] >= 0;
+      table.slots[slot] = (int8_t)w;
+    }
+    if (!collision)
+    {
+      return table;
+    }
+  }
+}
+
+static constexpr PerfectHash<32> keyTable = buildPerfectHash<32>(keyNames);
+static constexpr PerfectHash<64> wordTable = buildPerfectHash<64>(wordNames);
+
+template <size_t Slots, size_t Words>
+static int lookup(const PerfectHash<Slots> &table, const char *const (&words)[Words], const char *text, size_t length)
+{
+  int w = table.slots[slotFor<Slots>(hashWord(text, length, table.seed))];
+  if (w < 0 || wordLength(words[w]) != length || memcmp(words[w], text, length) != 0)
+  {
+    return -1;
+  }
+  return w;
+}
+
+// Unescaped string as a C string: everything after a decoded NUL is ignored,
+// like the cJSON valuestring it stands in for
+typedef struct
+{
+  char text[MESSAGE_PARSER_MAX_WORD];
+  size_t length;
+  bool terminated;
+  bool overflow; // Longer than any word, cannot match
+} DecodedString;
+
+static void emit(DecodedString *out, unsigned char c)
+{
+  if (out == NULL || out->terminated)
+  {
+    return;
+  }
+  if (c == '\0')
+  {
+    out->terminated = true;
+  }
+  else if (out->length < sizeof(out->text))
+  {
+    out->text[out->length++] = (char)c;
+  }
+  else
+  {
+    out->overflow = true;
+  }
+}
+
+// Invalid digits read as zero, as in cJSON
+static unsigned parseHex4(const unsigned char *input)
+{
+  unsigned h = 0;
+  for (int i = 0; i < 4; i++)
+  {
+    h <<= 4;
+    if (input[i] >= '0' && input[i] <= '9')
+    {
+      h += input[i] - '0';
+    }
+    else if (input[i] >= 'A' && input[i] <= 'F')
+    {
+      h += 10 + input[i] - 'A';
+    }
+    else if (input[i] >= 'a' && input[i] <= 'f')
+    {
+      h += 10 + input[i] - 'a';
+    }
+    else
+    {
+      return 0;
+    }
+  }
+  return h;
+}
+
+// \uXXXX or a surrogate pair as UTF-8, returns the escape length or 0 if invalid
+static int decodeUtf16(const unsigned char *in, const unsigned char *end, DecodedString *out)
+{
+  if (end - in < 6)
+  {
+    return 0;
+  }
+
+  unsigned long codepoint = parseHex4(in + 2);
+  int sequenceLength = 6;
+  if (codepoint >= 0xDC00 && codepoint <= 0xDFFF)
+  {
+    return 0;
+  }
+  if (codepoint >= 0xD800 && codepoint <= 0xDBFF)
+  {
+    const unsigned char *second = in + 6;
+    if (end - second < 6 || second[0] != '\\' || second[1] != 'u')
+    {
+      return 0;
+    }
+    unsigned low = parseHex4(second + 2);
+    if (low < 0xDC00 || low > 0xDFFF)
+    {
+      return 0;
+    }
+    codepoint = 0x10000 + (((codepoint & 0x3FF) << 10) | (low & 0x3FF));
+    sequenceLength = 12;
+  }
+
+  if (codepoint < 0x80)
+  {
+    emit(out, (unsigned char)codepoint);
+  }
+  else if (codepoint < 0x800)
+  {
+    emit(out, (unsigned char)(0xC0 | (codepoint >> 6)));
+    emit(out, (unsigned char)(0x80 | (codepoint & 0x3F)));
+  }
+  else if (codepoint < 0x10000)
+  {
+    emit(out, (unsigned char)(0xE0 | (codepoint >> 12)));
+    emit(out, (unsigned char)(0x80 | ((codepoint >> 6) & 0x3F)));
+    emit(out, (unsigned char)(0x80 | (codepoint & 0x3F)));
+  }
+  else
+  {
+    emit(out, (unsigned char)(0xF0 | (codepoint >> 18)));
+    emit(out, (unsigned char)(0x80 | ((codepoint >> 12) & 0x3F)));
+    emit(out, (unsigned char)(0x80 | ((codepoint >> 6) & 0x3F)));
+    emit(out, (unsigned char)(0x80 | (codepoint & 0x3F)));
+  }
+  return sequenceLength;
+}
+
+// p is at the opening quote and is left after the closing one. The end is
+// found first, skipping one character after each backslash, then the escapes
+// are decoded within it; out may be NULL to only validate.
+static bool parseString(const unsigned char *&p, DecodedString *out)
+{
+  const unsigned char *end = p + 1;
+  while (*end != '"')
+  {
+    if (*end == '\0')
+    {
+      return false;
+    }
+    if (*end == '\\')
+    {
+      if (end[1] == '\0')
+      {
+        return false;
+      }
+      end++;
+    }
+    end++;
+  }
+
+  const unsigned char *in = p + 1;
+  while (in < end)
+  {
+    if (*in != '\\')
+    {
+      emit(out, *in++);
+      continue;
+    }
+
+    int sequenceLength = 2;
+    switch (in[1])
+    {
+    case 'b':
+      emit(out, '\b');
+      break;
+    case 'f':
+      emit(out, '\f');
+      break;
+    case 'n':
+      emit(out, '\n');
+      break;
+    case 'r':
+      emit(out, '\r');
+      break;
+    case 't':
+      emit(out, '\t');
+      break;
+    case '"':
+    case '\\':
+    case '/':
+      emit(out, in[1]);
+      break;
+    case 'u':
+      sequenceLength = decodeUtf16(in, end, out);
+      if (sequenceLength == 0)
+      {
+        return false;
+      }
+      break;
+    default:
+      return false;
+    }
+    in += sequenceLength;
+  }
+
+  p = end + 1;
+  return true;
+}
+
+// Up to 63 characters that can belong to a number, handed to strtod
+static bool parseNumber(const unsigned char *&p, double *value)
+{
+  char number[64];
+  size_t i = 0;
+  while (i < sizeof(number) - 1 && ((p[i] >= '0' && p[i] <= '9') || p[i] == '+' || p[i] == '-' ||
+                                    p[i] == 'e' || p[i] == 'E' || p[i] == '.'))
+  {
+    number[i] = (char)p[i];
+    i++;
+  }
+  number[i] = '\0';
+
+  char *after = NULL;
+  *value = strtod(number, &after);
+  if (after == number)
+  {
+    return false;
+  }
+  p += after - number;
+  return true;
+}
+
+// Anything up to a space counts as whitespace
+static const unsigned char *skipWhitespace(const unsigned char *p)
+{
+  while (*p != '\0' && *p <= 32)
+  {
+    p++;
+  }
+  return p;
+}
+
+typedef enum
+{
+  VALUE_MISSING,
+  VALUE_STRING,
+  VALUE_NUMBER,
+  VALUE_OTHER,
+} ValueKind;
+
+// First occurrence of a top-level key
+typedef struct
+{
+  ValueKind kind;
+  int word;     // For strings, Word or -1
+  int valueint; // For numbers, saturated like cJSON's
+  double valuedouble;
+} Field;
+
+static int saturate(double number)
+{
+  if (number >= INT_MAX)
+  {
+    return INT_MAX;
+  }
+  if (number <= (double)INT_MIN)
+  {
+    return INT_MIN;
+  }
+  return (int)number;
+}
+
+// p is at the key's opening quote; leaves p at the start of its value
+static bool parseKey(const unsigned char *&p, bool topLevel, Field *fields, Field **capture)
+{
+  if (*p != '"')
+  {
+    return false;
+  }
+
+  DecodedString key = {};
+  if (!parseString(p, topLevel ? &key : NULL))
+  {
+    return false;
+  }
+  p = skipWhitespace(p);
+  if (*p != ':')
+  {
+    return false;
+  }
+  p = skipWhitespace(p + 1);
+
+  *capture = NULL;
+  if (topLevel && !key.overflow)
+  {
+    for (size_t i = 0; i < key.length; i++)
+    {
+      if (key.text[i] >= 'A' && key.text[i] <= 'Z')
+      {
+        key.text[i] = (char)(key.text[i] - 'A' + 'a');
+      }
+    }
+    int k = lookup(keyTable, keyNames, key.text, key.length);
+    if (k >= 0 && fields[k].kind == VALUE_MISSING)
+    {
+      *capture = &fields[k];
+    }
+  }
+  return true;
+}
+
+// Validates the whole document without recursion, capturing the members of a
+// top-level object into fields
+static bool parseDocument(const unsigned char *p, Field *fields)
+{
+  uint8_t isObject[(MESSAGE_PARSER_NESTING_LIMIT + 7) / 8]; // Per open container
+  int level = 0;
+  Field *capture = NULL;
+
+  while (true)
+  {
+    // A value starts at p
+    bool complete = true;
+    if (strncmp((const char *)p, "null", 4) == 0 || strncmp((const char *)p, "true", 4) == 0)
+    {
+      p += 4;
+      if (capture)
+      {
+        capture->kind = VALUE_OTHER;
+      }
+    }
+    else if (strncmp((const char *)p, "false", 5) == 0)
+    {
+      p += 5;
+      if (capture)
+      {
+        capture->kind = VALUE_OTHER;
+      }
+    }
+    else if (*p == '"')
+    {
+      DecodedString value = {};
+      if (!parseString(p, capture ? &value : NULL))
+      {
+        return false;
+      }
+      if (capture)
+      {
+        capture->kind = VALUE_STRING;
+        capture->word = value.overflow ? -1 : lookup(wordTable, wordNames, value.text, value.length);
+      }
+    }
+    else if (*p == '-' || (*p >= '0' && *p <= '9'))
+    {
+      double number;
+      if (!parseNumber(p, &number))
+      {
+        return false;
+      }
+      if (capture)
+      {
+        capture->kind = VALUE_NUMBER;
+        capture->valuedouble = number;
+        capture->valueint = saturate(number);
+      }
+    }
+    else if (*p == '[' || *p == '{')
+    {
+      if (capture)
+      {
+        capture->kind = VALUE_OTHER;
+      }
+      if (level >= MESSAGE_PARSER_NESTING_LIMIT)
+      {
+        return false;
+      }
+
+      bool object = *p == '{';
+      if (object)
+      {
+        isObject[level / 8] |= (uint8_t)(1 << (level % 8));
+      }
+      else
+      {
+        isObject[level / 8] &= (uint8_t)~(1 << (level % 8));
+      }
+      level++;
+
+      p = skipWhitespace(p + 1);
+      if (*p == (object ? '}' : ']'))
+      {
+        p++;
+        level--;
+      }
+      else
+      {
+        complete = false;
+        capture = NULL;
+        if (object && !parseKey(p, level == 1, fields, &capture))
+        {
+          return false;
+        }
+      }
+    }
+    else
+    {
+      return false;
+    }
+
+    if (!complete)
+    {
+      continue;
+    }
+
+    // Close finished containers until another value is due
+    while (true)
+    {
+      if (level == 0)
+      {
+        return true;
+      }
+
+      bool object = isObject[(level - 1) / 8] & (1 << ((level - 1) % 8));
+      p = skipWhitespace(p);
+      if (*p == ',')
+      {
+        p = skipWhitespace(p + 1);
+        capture = NULL;
+        if (object && !parseKey(p, level == 1, fields, &capture))
+        {
+          return false;
+        }
+        break;
+      }
+      if (*p != (object ? '}' : ']'))
+      {
+        return false;
+      }
+      p++;
+      level--;
+    }
+  }
+}
+
+static bool isString(const Field &field, int word)
+{
+  return field.kind == VALUE_STRING && field.word == word;
+}
+
+static bool commandForWord(int word, CommandType &command)
+{
+  switch (word)
+  {
+  case WORD_ON:
+    command = CommandType::ON;
+    break;
+  case WORD_OFF:
+    command = CommandType::OFF;
+    break;
+  case WORD_OFF_RELEASE:
+    command = CommandType::OFF_RELEASE;
+    break;
+  case WORD_SET_COMPRESSION_TIMEOUT:
+    command = CommandType::SET_COMPRESSION_TIMEOUT;
+    break;
+  case WORD_SET_RELEASE_TIMEOUT:
+    command = CommandType::SET_RELEASE_TIMEOUT;
+    break;
+  case WORD_SET_MOTOR_TIMEOUT:
+    command = CommandType::SET_MOTOR_TIMEOUT;
+    break;
+  case WORD_SCHEDULE:
+    command = CommandType::SCHEDULE;
+    break;
+  case WORD_UNSCHEDULE:
+    command = CommandType::UNSCHEDULE;
+    break;
+  case WORD_SET_CLOCK:
+    command = CommandType::SET_CLOCK;
+    break;
+  case WORD_SET_MOTOR_TEMPERATURE_LIMIT:
+    command = CommandType::SET_MOTOR_TEMPERATURE_LIMIT;
+    break;
+  case WORD_GET_RECORDER:
+    command = CommandType::GET_RECORDER;
+    break;
+  case WORD_GET_LATENCY:
+    command = CommandType::GET_LATENCY;
+    break;
+  case WORD_RESET_LATENCY:
+    command = CommandType::RESET_LATENCY;
+    break;
+  case WORD_GET_STATE:
+    command = CommandType::GET_STATE;
+    break;
+  case WORD_ACK:
+    command = CommandType::ACK;
+    break;
+  case WORD_HEARTBEAT_ACK:
+    command = CommandType::HEARTBEAT_ACK;
+    break;
+  case WORD_GET_HISTORY:
+    command = CommandType::GET_HISTORY;
+    break;
+  case WORD_GET_STATS:
+    command = CommandType::GET_STATS;
+    break;
+  case WORD_RESET_STATS:
+    command = CommandType::RESET_STATS;
+    break;
+  default:
+    return false;
+  }
+  return true;
+}
+
+static bool scheduledCommandForWord(int word, CommandType &command)
+{
+  return (word == WORD_ON || word == WORD_OFF || word == WORD_OFF_RELEASE) && commandForWord(word, command);
+}
+
+static bool scheduleModeForWord(int word, ScheduleMode &mode)
+{
+  switch (word)
+  {
+  case WORD_IN:
+    mode = ScheduleMode::SCHEDULE_IN;
+    break;
+  case WORD_AT:
+    mode = ScheduleMode::SCHEDULE_AT;
+    break;
+  case WORD_DAILY:
+    mode = ScheduleMode::SCHEDULE_DAILY;
+    break;
+  default:
+    return false;
+  }
+  return true;
+}
+
+static void applyInt(const Field &field, int &target)
+{
+  if (field.kind == VALUE_NUMBER)
+  {
+    target = field.valueint;
+  }
+}
+
+// Fields are only written once the whole document has parsed
+static bool applyCommand(const Field *fields, const char *buffer, Message &msg)
+{
+  const Field &commandField = fields[KEY_COMMAND_TYPE];
+  CommandType command;
+  if (commandField.kind != VALUE_STRING || !commandForWord(commandField.word, command))
+  {
+    printf("Unknown command: %s\n", buffer);
+    return false;
+  }
+
+  CommandType scheduledCommand;
+  ScheduleMode scheduleMode;
+  if (command == CommandType::SCHEDULE &&
+      (fields[KEY_ID].kind != VALUE_NUMBER || fields[KEY_TIME].kind != VALUE_NUMBER ||
+       fields[KEY_ACTION].kind != VALUE_STRING || fields[KEY_MODE].kind != VALUE_STRING ||
+       !scheduledCommandForWord(fields[KEY_ACTION].word, scheduledCommand) ||
+       !scheduleModeForWord(fields[KEY_MODE].word, scheduleMode)))
+  {
+    printf("Invalid SCHEDULE command: %s\n", buffer);
+    return false;
+  }
+  if (command == CommandType::ACK && fields[KEY_SEQUENCE].kind != VALUE_NUMBER)
+  {
+    printf("Invalid ACK command: %s\n", buffer);
+    return false;
+  }
+
+  msg.messageType = MessageType::COMMAND;
+  msg.type = (uint8_t)command;
+  if (fields[KEY_SEQUENCE].kind == VALUE_NUMBER)
+  {
+    msg.sequence = (uint16_t)fields[KEY_SEQUENCE].valueint;
+  }
+
+  switch (command)
+  {
+  case CommandType::SET_COMPRESSION_TIMEOUT:
+  case CommandType::SET_RELEASE_TIMEOUT:
+  case CommandType::SET_MOTOR_TIMEOUT:
+    applyInt(fields[KEY_TIMEOUT], msg.payload.timeout);
+    break;
+  case CommandType::SCHEDULE:
+    msg.payload.schedule.action = (uint8_t)scheduledCommand;
+    msg.payload.schedule.mode = (uint8_t)scheduleMode;
+    msg.payload.schedule.id = fields[KEY_ID].valueint;
+    msg.payload.schedule.time = fields[KEY_TIME].valueint;
+    break;
+  case CommandType::UNSCHEDULE:
+    applyInt(fields[KEY_ID], msg.payload.scheduleId);
+    break;
+  case CommandType::SET_MOTOR_TEMPERATURE_LIMIT:
+    applyInt(fields[KEY_LIMIT], msg.payload.limit);
+    break;
+  case CommandType::GET_RECORDER:
+    msg.payload.since = fields[KEY_SINCE].kind == VALUE_NUMBER ? fields[KEY_SINCE].valueint : 0;
+    break;
+  case CommandType::SET_CLOCK:
+    applyInt(fields[KEY_TIME], msg.payload.time);
+    break;
+  case CommandType::GET_HISTORY:
+    applyInt(fields[KEY_FROM], msg.payload.history.from);
+    applyInt(fields[KEY_TO], msg.payload.history.to);
+    applyInt(fields[KEY_RESOLUTION], msg.payload.history.resolution);
+    break;
+  default:
+    break;
+  }
+  return true;
+}
+
+static bool applyInfo(const Field *fields, const char *buffer, Message &msg)
+{
+  const Field &infoField = fields[KEY_INFO_TYPE];
+  if (isString(infoField, WORD_PRESSURE_CHANGE))
+  {
+    msg.messageType = MessageType::INFO;
+    msg.type = (uint8_t)InfoType::PRESSURE_CHANGE;
+    if (fields[KEY_PRESSURE].kind == VALUE_NUMBER)
+    {
+      msg.payload.pressure = static_cast<float>(fields[KEY_PRESSURE].valuedouble);
+    }
+  }
+  else if (isString(infoField, WORD_COMPRESSION_COUNTDOWN_UPDATED))
+  {
+    msg.messageType = MessageType::INFO;
+    msg.type = (uint8_t)InfoType::COMPRESSION_COUNTDOWN_UPDATED;
+    applyInt(fields[KEY_TIMEOUT], msg.payload.timeout);
+  }
+  else if (isString(infoField, WORD_RELEASE_COUNTDOWN_UPDATED))
+  {
+    msg.messageType = MessageType::INFO;
+    msg.type = (uint8_t)InfoType::RELEASE_COUNTDOWN_UPDATE;
+    applyInt(fields[KEY_TIMEOUT], msg.payload.timeout);
+  }
+  else
+  {
+    printf("Unknown info: %s\n", buffer);
+    return false;
+  }
+  return true;
+}
+
+static bool parseBuffer(const char *buffer, Field *fields)
+{
+  const unsigned char *p = (const unsigned char *)buffer;
+  if (p[0] == 0xEF && p[1] == 0xBB && p[2] == 0xBF && p[3] != '\0')
+  {
+    p += 3;
+  }
+  return parseDocument(skipWhitespace(p), fields);
+}
+
+// Converts a buffer (JSON string) into a Message struct
+bool bufferToMessage(const char *buffer, Message &msg)
+{
+  if (buffer == NULL)
+  {
+    return false;
+  }
+
+  Field fields[KEY_COUNT] = {};
+  if (!parseBuffer(buffer, fields))
+  {
+    printf("Failed to parse JSON: %s\n", buffer);
+    return false;
+  }
+
+  const Field &messageType = fields[KEY_MESSAGE_TYPE];
+  if (isString(messageType, WORD_COMMAND))
+  {
+    return applyCommand(fields, buffer, msg);
+  }
+  if (isString(messageType, WORD_INFO))
+  {
+    return applyInfo(fields, buffer, msg);
+  }
+  printf("Unknown message type: %s\n", buffer);
+  return false;
+}
+
+bool bufferToHello(const char *buffer, WireEncoding &encoding)
+{
+  Field fields[KEY_COUNT] = {};
+  if (buffer == NULL || !parseBuffer(buffer, fields) || !isString(fields[KEY_MESSAGE_TYPE], WORD_HELLO))
+  {
+    return false;
+  }
+
+  encoding = isString(fields[KEY_ENCODING], WORD_BINARY) ? WIRE_BINARY : WIRE_JSON;
+  return true;
+}
@@ -0,0 +1,145 @@
+#include "messageschema.h"
+
+#define JSON_KEY(key) ",\"" key "\":"
+
+#define FIELD(tag, kind, member, key, required) \
+  {tag, kind, required, offsetof(Message, payload.member), JSON_KEY(key), sizeof(JSON_KEY(key)) - 1}
+
+#define STATE_FIELD(tag, kind, member, key) \
+  {tag, kind, true, offsetof(ControlSnapshot, member), key, sizeof(key) - 1}
+
+#define FIELDS(fields) fields, sizeof(fields) / sizeof(fields[0])
+#define NO_FIELDS NULL, 0
+
+#define COMMAND_JSON(name) "{\"messageType\":\"COMMAND\",\"commandType\":\"" name "\""
+#define INFO_JSON(name) "{\"messageType\":\"INFO\",\"infoType\":\"" name "\""
+
+#define COMMAND_ENTRY(type, name, fields) \
+  {MessageType::COMMAND, CommandType::type, name, COMMAND_JSON(name), sizeof(COMMAND_JSON(name)) - 1, fields}
+#define INFO_ENTRY(type, name, fields) \
+  {MessageType::INFO, InfoType::type, name, INFO_JSON(name), sizeof(INFO_JSON(name)) - 1, fields}
+
+static const SchemaField timeoutFields[] = {FIELD(TAG_TIMEOUT, FIELD_INT, timeout, "timeout", false)};
+static const SchemaField idFields[] = {FIELD(TAG_ID, FIELD_INT, scheduleId, "id", false)};
+static const SchemaField timeFields[] = {FIELD(TAG_TIME, FIELD_INT, time, "time", false)};
+static const SchemaField limitFields[] = {FIELD(TAG_LIMIT, FIELD_INT, limit, "limit", false)};
+static const SchemaField sinceFields[] = {FIELD(TAG_SINCE, FIELD_INT, since, "since", false)};
+static const SchemaField pressureFields[] = {FIELD(TAG_PRESSURE, FIELD_FLOAT, pressure, "pressure", false)};
+static const SchemaField temperatureFields[] = {FIELD(TAG_TEMPERATURE, FIELD_FLOAT, temperature, "temperature", false)};
+static const SchemaField historyFields[] = {
+    FIELD(TAG_FROM, FIELD_INT, history.from, "from", false),
+    FIELD(TAG_TO, FIELD_INT, history.to, "to", false),
+    FIELD(TAG_RESOLUTION, FIELD_INT, history.resolution, "resolution", false),
+};
+static const SchemaField scheduleFields[] = {
+    FIELD(TAG_ID, FIELD_INT, schedule.id, "id", true),
+    FIELD(TAG_ACTION, FIELD_ACTION, schedule.action, "action", true),
+    FIELD(TAG_MODE, FIELD_MODE, schedule.mode, "mode", true),
+    FIELD(TAG_TIME, FIELD_INT, schedule.time, "time", true),
+};
+
+// Indexed by CommandType
+static const MessageSchema commandSchemas[] = {
+    COMMAND_ENTRY(ON, "ON", NO_FIELDS),
+    COMMAND_ENTRY(OFF, "OFF", NO_FIELDS),
+    COMMAND_ENTRY(OFF_RELEASE, "OFF_RELEASE", NO_FIELDS),
+    COMMAND_ENTRY(SET_COMPRESSION_TIMEOUT, "SET_COMPRESSION_TIMEOUT", FIELDS(timeoutFields)),
+    COMMAND_ENTRY(SET_RELEASE_TIMEOUT, "SET_RELEASE_TIMEOUT", FIELDS(timeoutFields)),
+    COMMAND_ENTRY(SET_MOTOR_TIMEOUT, "SET_MOTOR_TIMEOUT", FIELDS(timeoutFields)),
+    COMMAND_ENTRY(SCHEDULE, "SCHEDULE", FIELDS(scheduleFields)),
+    COMMAND_ENTRY(UNSCHEDULE, "UNSCHEDULE", FIELDS(idFields)),
+    COMMAND_ENTRY(SET_CLOCK, "SET_CLOCK", FIELDS(timeFields)),
+    COMMAND_ENTRY(SET_MOTOR_TEMPERATURE_LIMIT, "SET_MOTOR_TEMPERATURE_LIMIT", FIELDS(limitFields)),
+    COMMAND_ENTRY(GET_RECORDER, "GET_RECORDER", FIELDS(sinceFields)),
+    COMMAND_ENTRY(GET_LATENCY, "GET_LATENCY", NO_FIELDS),
+    COMMAND_ENTRY(RESET_LATENCY, "RESET_LATENCY", NO_FIELDS),
+    COMMAND_ENTRY(GET_STATE, "GET_STATE", NO_FIELDS),
+    COMMAND_ENTRY(ACK, "ACK", NO_FIELDS),
+    COMMAND_ENTRY(HEARTBEAT_ACK, "HEARTBEAT_ACK", NO_FIELDS),
+    COMMAND_ENTRY(GET_HISTORY, "GET_HISTORY", FIELDS(historyFields)),
+    COMMAND_ENTRY(GET_STATS, "GET_STATS", NO_FIELDS),
+    COMMAND_ENTRY(RESET_STATS, "RESET_STATS", NO_FIELDS),
+};
+
+// Indexed by InfoType
+static const MessageSchema infoSchemas[] = {
+    INFO_ENTRY(TURNED_ON, "TURNED_ON", NO_FIELDS),
+    INFO_ENTRY(TURNED_OFF, "TURNED_OFF", NO_FIELDS),
+    INFO_ENTRY(RELEASING, "RELEASING", NO_FIELDS),
+    INFO_ENTRY(RELEASED, "RELEASED", NO_FIELDS),
+    INFO_ENTRY(PRESSURE_CHANGE, "PRESSURE_CHANGE", FIELDS(pressureFields)),
+    INFO_ENTRY(MOTOR_START, "MOTOR_START", NO_FIELDS),
+    INFO_ENTRY(MOTOR_STOP, "MOTOR_STOP", NO_FIELDS),
+    INFO_ENTRY(COMPRESSION_COUNTOWN_END, "COMPRESSION_COUNTDOWN_END", NO_FIELDS),
+    INFO_ENTRY(RELEASE_COUNTDOWN_END, "RELEASE_COUNTDOWN_END", NO_FIELDS),
+    INFO_ENTRY(MOTOR_COUNTDOWN_END, "MOTOR_COUNTDOWN_END", NO_FIELDS),
+    INFO_ENTRY(COMPRESSION_COUNTDOWN_UPDATED, "COMPRESSION_COUNTDOWN_UPDATED", FIELDS(timeoutFields)),
+    INFO_ENTRY(RELEASE_COUNTDOWN_UPDATE, "RELEASE_COUNTDOWN_UPDATE", FIELDS(timeoutFields)),
+    INFO_ENTRY(MOTOR_COUNTDOWN_UPDATE, "MOTOR_COUNTDOWN_UPDATE", FIELDS(timeoutFields)),
+    INFO_ENTRY(SUPPLY_START, "SUPPLY_START", NO_FIELDS),
+    INFO_ENTRY(SUPPLY_STOP, "SUPPLY_STOP", NO_FIELDS),
+    INFO_ENTRY(SCHEDULE_TRIGGERED, "SCHEDULE_TRIGGERED", FIELDS(idFields)),
+    INFO_ENTRY(MOTOR_TEMPERATURE, "MOTOR_TEMPERATURE", FIELDS(temperatureFields)),
+    INFO_ENTRY(MOTOR_OVERHEAT, "MOTOR_OVERHEAT", FIELDS(temperatureFields)),
+    INFO_ENTRY(MOTOR_START_BLOCKED, "MOTOR_START_BLOCKED", FIELDS(timeoutFields)),
+    INFO_ENTRY(HEARTBEAT, "HEARTBEAT", NO_FIELDS),
+};
+
+static_assert(sizeof(commandSchemas) / sizeof(commandSchemas[0]) == CommandType::RESET_STATS + 1,
+              "every CommandType needs a schema entry");
+static_assert(sizeof(infoSchemas) / sizeof(infoSchemas[0]) == InfoType::HEARTBEAT + 1,
+              "every InfoType needs a schema entry");
+
+static const SchemaField stateFields[] = {
+    STATE_FIELD(TAG_STATE, FIELD_STATE, state, JSON_KEY("state")),
+    STATE_FIELD(TAG_RELAY, FIELD_BOOL, relay, JSON_KEY("relay")),
+    STATE_FIELD(TAG_SOLENOID, FIELD_BOOL, solenoid, JSON_KEY("solenoid")),
+    STATE_FIELD(TAG_PRESSURE, FIELD_FLOAT, pressure, JSON_KEY("pressure")),
+    STATE_FIELD(TAG_CURRENT, FIELD_FLOAT, current, JSON_KEY("current")),
+    STATE_FIELD(TAG_TEMPERATURE, FIELD_FLOAT, motorTemperature, JSON_KEY("motorTemperature")),
+    STATE_FIELD(TAG_COMPRESSION_REMAINING, FIELD_INT, compressionRemaining, ",\"countdowns\":{\"compression\":"),
+    STATE_FIELD(TAG_SUPPLY_REMAINING, FIELD_INT, supplyRemaining, JSON_KEY("supply")),
+    STATE_FIELD(TAG_MOTOR_REMAINING, FIELD_INT, motorRemaining, JSON_KEY("motor")),
+    STATE_FIELD(TAG_COMPRESSION_TIMEOUT, FIELD_INT, compressionTimeout, "},\"settings\":{\"compressionTimeout\":"),
+    STATE_FIELD(TAG_SUPPLY_TIMEOUT, FIELD_INT, supplyTimeout, JSON_KEY("supplyTimeout")),
+    STATE_FIELD(TAG_MOTOR_TIMEOUT, FIELD_INT, motorTimeout, JSON_KEY("motorTimeout")),
+    STATE_FIELD(TAG_LIMIT, FIELD_INT, motorTemperatureLimit, JSON_KEY("motorTemperatureLimit")),
+};
+
+#define STATE_JSON "{\"messageType\":\"STATE\""
+
+const MessageSchema stateSchema = {MessageType::INFO, 0, "STATE", STATE_JSON, sizeof(STATE_JSON) - 1, FIELDS(stateFields)};
+
+// Remaining seconds are uint32_t, written through FIELD_INT as int
+static_assert(sizeof(ControlSnapshot::compressionRemaining) == sizeof(int), "FIELD_INT reads an int");
+
+const MessageSchema *messageSchemaFind(MessageType messageType, int type)
+{
+  const MessageSchema *table;
+  size_t count;
+  if (messageType == MessageType::COMMAND)
+  {
+    table = commandSchemas;
+    count = sizeof(commandSchemas) / sizeof(commandSchemas[0]);
+  }
+  else if (messageType == MessageType::INFO)
+  {
+    table = infoSchemas;
+    count = sizeof(infoSchemas) / sizeof(infoSchemas[0]);
+  }
+  else
+  {
+    return NULL;
+  }
+
+  if (type < 0 || (size_t)type >= count || table[type].type != type)
+  {
+    return NULL;
+  }
+  return &table[type];
+}
+
+const MessageSchema *messageSchemaFor(const Message &msg)
+{
+  return messageSchemaFind((MessageType)msg.messageType, msg.type);
+}
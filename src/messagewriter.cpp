@@ -0,0 +1,376 @@
+#include "messagewriter.h"
+#include "messageschema.h"
+#include "control.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Output position in the caller's buffer, one byte is always kept for the NUL
+typedef struct
+{
+  char *buffer;
+  size_t size;
+  size_t length;
+  bool overflow;
+} Writer;
+
+static void writeBytes(Writer &writer, const char *bytes, size_t length)
+{
+  if (writer.overflow || writer.size - writer.length <= length)
+  {
+    writer.overflow = true;
+    return;
+  }
+  memcpy(writer.buffer + writer.length, bytes, length);
+  writer.length += length;
+}
+
+// Literal fragments are measured at compile time
+#define WRITE_LITERAL(writer, literal) writeBytes(writer, literal, sizeof(literal) - 1)
+
+static void writeString(Writer &writer, const char *value)
+{
+  writeBytes(writer, value, strlen(value));
+}
+
+static void writeInteger(Writer &writer, int64_t value)
+{
+  char digits[21];
+  size_t count = 0;
+  uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  do
+  {
+    digits[sizeof(digits) - 1 - count++] = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude > 0);
+  if (value < 0)
+  {
+    digits[sizeof(digits) - 1 - count++] = '-';
+  }
+  writeBytes(writer, digits + sizeof(digits) - count, count);
+}
+
+// A reading kept in tenths, as cJSON printed it divided by ten: "50", "-0.5"
+static void writeTenths(Writer &writer, int16_t tenths)
+{
+  int32_t magnitude = tenths < 0 ? -(int32_t)tenths : tenths;
+  if (tenths < 0)
+  {
+    WRITE_LITERAL(writer, "-");
+  }
+  writeInteger(writer, magnitude / 10);
+  if (magnitude % 10 != 0)
+  {
+    char digit = (char)('0' + magnitude % 10);
+    WRITE_LITERAL(writer, ".");
+    writeBytes(writer, &digit, 1);
+  }
+}
+
+static const double powersOfTen[MESSAGE_WRITER_MAX_DECIMALS + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+static void writeDigits(Writer &writer, uint64_t value, int count)
+{
+  char digits[MESSAGE_WRITER_MAX_DECIMALS];
+  for (int i = count - 1; i >= 0; i--)
+  {
+    digits[i] = (char)('0' + value % 10);
+    value /= 10;
+  }
+  writeBytes(writer, digits, (size_t)count);
+}
+
+// Fewest fraction digits that read back as the same float, false when more
+// than MESSAGE_WRITER_MAX_DECIMALS would be needed
+static bool writeFixed(Writer &writer, float value)
+{
+  int decimals = 0;
+  int64_t scaled = llround((double)value);
+  while ((float)((double)scaled / powersOfTen[decimals]) != value)
+  {
+    if (decimals == MESSAGE_WRITER_MAX_DECIMALS)
+    {
+      return false;
+    }
+    decimals++;
+    scaled = llround((double)value * powersOfTen[decimals]);
+  }
+  if (decimals == 0)
+  {
+    writeInteger(writer, scaled);
+    return true;
+  }
+
+  uint64_t magnitude = scaled < 0 ? 0 - (uint64_t)scaled : (uint64_t)scaled;
+  uint64_t unit = (uint64_t)powersOfTen[decimals];
+  if (scaled < 0)
+  {
+    WRITE_LITERAL(writer, "-");
+  }
+  writeInteger(writer, (int64_t)(magnitude / unit));
+  WRITE_LITERAL(writer, ".");
+  writeDigits(writer, magnitude % unit, decimals);
+  return true;
+}
+
+// Fewest significant digits that read back as the same float, nine always do
+static void writeScientific(Writer &writer, float value)
+{
+  double magnitude = fabs((double)value);
+  int exponent = (int)floor(log10(magnitude));
+  if (magnitude < pow(10.0, exponent))
+  {
+    exponent--;
+  }
+  else if (magnitude >= pow(10.0, exponent + 1))
+  {
+    exponent++;
+  }
+
+  int digits = 1;
+  double scale = pow(10.0, -exponent);
+  int64_t mantissa = llround(magnitude * scale);
+  while (digits < MESSAGE_WRITER_MAX_DECIMALS && (float)((double)mantissa / scale) != fabsf(value))
+  {
+    digits++;
+    scale = pow(10.0, digits - 1 - exponent);
+    mantissa = llround(magnitude * scale);
+  }
+  if ((double)mantissa >= powersOfTen[digits]) // Rounded up to the next power of ten
+  {
+    mantissa /= 10;
+    exponent++;
+  }
+
+  if (value < 0)
+  {
+    WRITE_LITERAL(writer, "-");
+  }
+  writeInteger(writer, (int64_t)(mantissa / (int64_t)powersOfTen[digits - 1]));
+  if (digits > 1)
+  {
+    WRITE_LITERAL(writer, ".");
+    writeDigits(writer, (uint64_t)(mantissa % (int64_t)powersOfTen[digits - 1]), digits - 1);
+  }
+  WRITE_LITERAL(writer, "e");
+  writeInteger(writer, exponent);
+}
+
+static void writeFloat(Writer &writer, float value)
+{
+  if (!isfinite(value))
+  {
+    WRITE_LITERAL(writer, "null"); // As cJSON
+    return;
+  }
+  if (fabsf(value) < 1e9f && writeFixed(writer, value))
+  {
+    return;
+  }
+  writeScientific(writer, value);
+}
+
+static const char *scheduledCommandName(CommandType command)
+{
+  switch (command)
+  {
+  case CommandType::ON:
+    return "ON";
+  case CommandType::OFF:
+    return "OFF";
+  case CommandType::OFF_RELEASE:
+    return "OFF_RELEASE";
+  default:
+    return "";
+  }
+}
+
+static const char *scheduleModeName(ScheduleMode mode)
+{
+  switch (mode)
+  {
+  case ScheduleMode::SCHEDULE_IN:
+    return "IN";
+  case ScheduleMode::SCHEDULE_AT:
+    return "AT";
+  case ScheduleMode::SCHEDULE_DAILY:
+    return "DAILY";
+  default:
+    return "";
+  }
+}
+
+static const char *controlStateName(ControlState state)
+{
+  switch (state)
+  {
+  case CONTROL_IDLE:
+    return "IDLE";
+  case CONTROL_COMPRESSING:
+    return "COMPRESSING";
+  case CONTROL_RELEASING:
+    return "RELEASING";
+  case CONTROL_OVERHEATED:
+    return "OVERHEATED";
+  default:
+    return "";
+  }
+}
+
+// base is the Message, or the ControlSnapshot for the STATE schema
+static void writeFields(Writer &writer, const MessageSchema &schema, const char *base)
+{
+  for (size_t i = 0; i < schema.fieldCount; i++)
+  {
+    const SchemaField &field = schema.fields[i];
+    writeBytes(writer, field.jsonKey, field.jsonKeyLength);
+    switch (field.kind)
+    {
+    case FIELD_INT:
+      writeInteger(writer, *(const int *)(base + field.offset));
+      break;
+    case FIELD_FLOAT:
+      writeFloat(writer, *(const float *)(base + field.offset));
+      break;
+    case FIELD_ACTION:
+      WRITE_LITERAL(writer, "\"");
+      writeString(writer, scheduledCommandName((CommandType)(uint8_t)base[field.offset]));
+      WRITE_LITERAL(writer, "\"");
+      break;
+    case FIELD_MODE:
+      WRITE_LITERAL(writer, "\"");
+      writeString(writer, scheduleModeName((ScheduleMode)(uint8_t)base[field.offset]));
+      WRITE_LITERAL(writer, "\"");
+      break;
+    case FIELD_BOOL:
+      if (*(const bool *)(base + field.offset))
+      {
+        WRITE_LITERAL(writer, "true");
+      }
+      else
+      {
+        WRITE_LITERAL(writer, "false");
+      }
+      break;
+    case FIELD_STATE:
+      WRITE_LITERAL(writer, "\"");
+      writeString(writer, controlStateName(*(const ControlState *)(base + field.offset)));
+      WRITE_LITERAL(writer, "\"");
+      break;
+    }
+  }
+}
+
+// NUL-terminates what was written, or empties the buffer if it did not fit
+static size_t finish(Writer &writer)
+{
+  if (writer.overflow)
+  {
+    writer.buffer[0] = '\0';
+    return 0;
+  }
+  writer.buffer[writer.length] = '\0';
+  return writer.length;
+}
+
+// Converts a Message struct into JSON in the caller's buffer
+size_t messageToBuffer(const Message &msg, char *buffer, size_t size)
+{
+  if (size == 0)
+  {
+    return 0;
+  }
+
+  Writer writer = {buffer, size, 0, false};
+  const MessageSchema *schema = messageSchemaFor(msg);
+  if (schema != NULL)
+  {
+    writeBytes(writer, schema->json, schema->jsonLength);
+    writeFields(writer, *schema, (const char *)&msg);
+    if (msg.sequence != 0)
+    {
+      WRITE_LITERAL(writer, ",\"seq\":");
+      writeInteger(writer, msg.sequence);
+    }
+  }
+  else if (msg.messageType == MessageType::COMMAND)
+  {
+    WRITE_LITERAL(writer, "{\"messageType\":\"COMMAND\"");
+  }
+  else if (msg.messageType == MessageType::INFO)
+  {
+    WRITE_LITERAL(writer, "{\"messageType\":\"INFO\"");
+  }
+  else
+  {
+    WRITE_LITERAL(writer, "{");
+  }
+  WRITE_LITERAL(writer, "}");
+
+  return finish(writer);
+}
+
+size_t controlSnapshotToBuffer(const ControlSnapshot &snapshot, char *buffer, size_t size)
+{
+  if (size == 0)
+  {
+    return 0;
+  }
+
+  Writer writer = {buffer, size, 0, false};
+  writeBytes(writer, stateSchema.json, stateSchema.jsonLength);
+  writeFields(writer, stateSchema, (const char *)&snapshot);
+  WRITE_LITERAL(writer, STATE_JSON_END);
+  return finish(writer);
+}
+
+size_t historyChunkToBuffer(const HistoryChunk &chunk, char *buffer, size_t size)
+{
+  if (size == 0)
+  {
+    return 0;
+  }
+
+  Writer writer = {buffer, size, 0, false};
+  WRITE_LITERAL(writer, "{\"messageType\":\"HISTORY\",\"now\":");
+  writeInteger(writer, chunk.now);
+  WRITE_LITERAL(writer, ",\"resolution\":");
+  writeInteger(writer, chunk.resolution);
+  WRITE_LITERAL(writer, ",\"to\":");
+  writeInteger(writer, chunk.to);
+  WRITE_LITERAL(writer, ",\"buckets\":[");
+  for (size_t i = 0; i < chunk.count; i++)
+  {
+    const HistoryBucket &bucket = chunk.buckets[i];
+    if (i > 0)
+    {
+      WRITE_LITERAL(writer, ",");
+    }
+    WRITE_LITERAL(writer, "[");
+    writeInteger(writer, bucket.start);
+    WRITE_LITERAL(writer, ",");
+    writeInteger(writer, bucket.samples);
+    const int16_t readings[] = {bucket.pressureMin, bucket.pressureMax, bucket.pressureMean, bucket.currentMean,
+                                bucket.currentMax};
+    for (size_t j = 0; j < sizeof(readings) / sizeof(readings[0]); j++)
+    {
+      WRITE_LITERAL(writer, ",");
+      writeTenths(writer, readings[j]);
+    }
+    WRITE_LITERAL(writer, "]");
+  }
+  WRITE_LITERAL(writer, "]");
+  if (chunk.done)
+  {
+    WRITE_LITERAL(writer, ",\"done\":true");
+  }
+  else
+  {
+    WRITE_LITERAL(writer, ",\"next\":");
+    writeInteger(writer, chunk.next);
+  }
+  WRITE_LITERAL(writer, "}");
+  return finish(writer);
+}
@@ -0,0 +1,313 @@
+#include "mqtt.h"
+
+#include <string.h>
+
+#define MQTT_MAX_REMAINING 268435455u // Four length bytes of seven bits
+
+// Packet under construction, every write checks the space left
+typedef struct
+{
+  uint8_t *buffer;
+  size_t size;
+  size_t length;
+  bool overflow;
+} PacketWriter;
+
+static void writeByte(PacketWriter &writer, uint8_t value)
+{
+  if (writer.length >= writer.size)
+  {
+    writer.overflow = true;
+    return;
+  }
+  writer.buffer[writer.length++] = value;
+}
+
+static void writeBytes(PacketWriter &writer, const void *data, size_t length)
+{
+  if (writer.size - writer.length < length || writer.length > writer.size)
+  {
+    writer.overflow = true;
+    return;
+  }
+  memcpy(writer.buffer + writer.length, data, length);
+  writer.length += length;
+}
+
+static void writeShort(PacketWriter &writer, uint16_t value)
+{
+  writeByte(writer, (uint8_t)(value >> 8));
+  writeByte(writer, (uint8_t)value);
+}
+
+static void writeString(PacketWriter &writer, const char *text, size_t length)
+{
+  writeShort(writer, (uint16_t)length);
+  writeBytes(writer, text, length);
+}
+
+static void writeHeader(PacketWriter &writer, uint8_t first, size_t remaining)
+{
+  writeByte(writer, first);
+  do
+  {
+    uint8_t digit = remaining & 0x7F;
+    remaining >>= 7;
+    writeByte(writer, remaining > 0 ? digit | 0x80 : digit);
+  } while (remaining > 0);
+}
+
+static size_t finish(const PacketWriter &writer)
+{
+  return writer.overflow ? 0 : writer.length;
+}
+
+size_t mqttConnect(uint8_t *buffer, size_t size, const char *clientId, uint16_t keepAliveS)
+{
+  size_t idLength = strlen(clientId);
+  PacketWriter writer = {buffer, size, 0, false};
+  writeHeader(writer, MQTT_CONNECT << 4, 10 + 2 + idLength);
+  writeString(writer, "MQTT", 4);
+  writeByte(writer, 4);    // Protocol level 3.1.1
+  writeByte(writer, 0x02); // Clean session
+  writeShort(writer, keepAliveS);
+  writeString(writer, clientId, idLength);
+  return finish(writer);
+}
+
+size_t mqttPublish(uint8_t *buffer, size_t size, const char *topic, const void *payload, size_t payloadLength,
+                   uint8_t qos, uint16_t packetId, bool retain)
+{
+  size_t topicLength = strlen(topic);
+  size_t remaining = 2 + topicLength + (qos > 0 ? 2 : 0) + payloadLength;
+  if (remaining > MQTT_MAX_REMAINING)
+  {
+    return 0;
+  }
+  PacketWriter writer = {buffer, size, 0, false};
+  writeHeader(writer, (uint8_t)(MQTT_PUBLISH << 4 | qos << 1 | (retain ? 1 : 0)), remaining);
+  writeString(writer, topic, topicLength);
+  if (qos > 0)
+  {
+    writeShort(writer, packetId);
+  }
+  writeBytes(writer, payload, payloadLength);
+  return finish(writer);
+}
+
+size_t mqttSubscribe(uint8_t *buffer, size_t size, uint16_t packetId, const char *topicFilter, uint8_t qos)
+{
+  size_t filterLength = strlen(topicFilter);
+  PacketWriter writer = {buffer, size, 0, false};
+  writeHeader(writer, MQTT_SUBSCRIBE << 4 | 0x02, 2 + 2 + filterLength + 1);
+  writeShort(writer, packetId);
+  writeString(writer, topicFilter, filterLength);
+  writeByte(writer, qos);
+  return finish(writer);
+}
+
+size_t mqttPubAck(uint8_t *buffer, size_t size, uint16_t packetId)
+{
+  PacketWriter writer = {buffer, size, 0, false};
+  writeHeader(writer, MQTT_PUBACK << 4, 2);
+  writeShort(writer, packetId);
+  return finish(writer);
+}
+
+size_t mqttPingReq(uint8_t *buffer, size_t size)
+{
+  PacketWriter writer = {buffer, size, 0, false};
+  writeHeader(writer, MQTT_PINGREQ << 4, 0);
+  return finish(writer);
+}
+
+size_t mqttDisconnect(uint8_t *buffer, size_t size)
+{
+  PacketWriter writer = {buffer, size, 0, false};
+  writeHeader(writer, MQTT_DISCONNECT << 4, 0);
+  return finish(writer);
+}
+
+size_t mqttPacketLength(const uint8_t *buffer, size_t available)
+{
+  size_t remaining = 0;
+  for (size_t i = 1; i <= 4; i++)
+  {
+    if (i >= available)
+    {
+      return 0;
+    }
+    remaining |= (size_t)(buffer[i] & 0x7F) << (7 * (i - 1));
+    if ((buffer[i] & 0x80) == 0)
+    {
+      return 1 + i + remaining;
+    }
+  }
+  return MQTT_MALFORMED;
+}
+
+static uint16_t readShort(const uint8_t *data)
+{
+  return (uint16_t)(data[0] << 8 | data[1]);
+}
+
+bool mqttParse(const uint8_t *buffer, size_t length, MqttPacket *packet)
+{
+  size_t total = mqttPacketLength(buffer, length);
+  if (total == 0 || total == MQTT_MALFORMED || total != length)
+  {
+    return false;
+  }
+  size_t headerLength = 1;
+  while (buffer[headerLength++] & 0x80)
+  {
+  }
+  const uint8_t *body = buffer + headerLength;
+  size_t bodyLength = length - headerLength;
+  uint8_t flags = buffer[0] & 0x0F;
+
+  memset(packet, 0, sizeof(*packet));
+  packet->type = (MqttPacketType)(buffer[0] >> 4);
+  switch (packet->type)
+  {
+  case MQTT_CONNACK:
+    if (flags != 0 || bodyLength != 2 || (body[0] & 0xFE) != 0)
+    {
+      return false;
+    }
+    packet->sessionPresent = (body[0] & 0x01) != 0;
+    packet->returnCode = body[1];
+    return true;
+
+  case MQTT_PUBLISH:
+  {
+    packet->qos = (flags >> 1) & 0x03;
+    packet->retain = (flags & 0x01) != 0;
+    if (packet->qos > 1 || bodyLength < 2)
+    {
+      return false; // Only QoS 0 and 1 are subscribed to
+    }
+    size_t topicLength = readShort(body);
+    size_t position = 2 + topicLength;
+    if (topicLength == 0 || position > bodyLength)
+    {
+      return false;
+    }
+    packet->topic = (const char *)body + 2;
+    packet->topicLength = topicLength;
+    if (packet->qos > 0)
+    {
+      if (position + 2 > bodyLength)
+      {
+        return false;
+      }
+      packet->packetId = readShort(body + position);
+      position += 2;
+      if (packet->packetId == 0)
+      {
+        return false;
+      }
+    }
+    packet->payload = body + position;
+    packet->payloadLength = bodyLength - position;
+    return true;
+  }
+
+  case MQTT_PUBACK:
+    if (flags != 0 || bodyLength != 2)
+    {
+      return false;
+    }
+    packet->packetId = readShort(body);
+    return true;
+
+  case MQTT_SUBACK:
+    if (flags != 0 || bodyLength < 3)
+    {
+      return false;
+    }
+    packet->packetId = readShort(body);
+    packet->returnCode = body[2];
+    return true;
+
+  case MQTT_PINGRESP:
+    return flags == 0 && bodyLength == 0;
+
+  default:
+    return false;
+  }
+}
+
+void mqttWindowInit(MqttWindow &window)
+{
+  memset(&window, 0, sizeof(window));
+  window.nextPacketId = 1;
+}
+
+bool mqttWindowFull(const MqttWindow &window)
+{
+  return window.count == MQTT_INFLIGHT_WINDOW;
+}
+
+static bool inFlight(const MqttWindow &window, uint16_t packetId)
+{
+  for (size_t i = 0; i < window.count; i++)
+  {
+    if (window.entries[i].packetId == packetId)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint16_t mqttNextPacketId(MqttWindow &window)
+{
+  uint16_t packetId;
+  do
+  {
+    packetId = window.nextPacketId++;
+  } while (packetId == 0 || inFlight(window, packetId));
+  return packetId;
+}
+
+uint16_t mqttWindowAdd(MqttWindow &window, uint16_t sequence)
+{
+  uint16_t packetId = mqttNextPacketId(window);
+  mqttWindowRecord(window, packetId, sequence);
+  return packetId;
+}
+
+void mqttWindowRecord(MqttWindow &window, uint16_t packetId, uint16_t sequence)
+{
+  MqttInFlight &entry = window.entries[window.count++];
+  entry.packetId = packetId;
+  entry.sequence = sequence;
+  entry.acknowledged = false;
+}
+
+bool mqttWindowAck(MqttWindow &window, uint16_t packetId, uint16_t *sequence)
+{
+  for (size_t i = 0; i < window.count; i++)
+  {
+    if (window.entries[i].packetId == packetId)
+    {
+      window.entries[i].acknowledged = true;
+      break;
+    }
+  }
+
+  size_t done = 0;
+  while (done < window.count && window.entries[done].acknowledged)
+  {
+    *sequence = window.entries[done].sequence;
+    done++;
+  }
+  if (done == 0)
+  {
+    return false;
+  }
+  memmove(window.entries, window.entries + done, (window.count - done) * sizeof(MqttInFlight));
+  window.count -= done;
+  return true;
+}
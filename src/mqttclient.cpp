@@ -0,0 +1,526 @@
+#include "mqttclient.h"
+#include "mqtt.h"
+#include "discovery.h"
+#include "wifi.h"
+#include "constants.h"
+#include "control.h"
+#include "messageschema.h"
+#include "messagewriter.h"
+#include "outbox.h"
+#include "framing.h"
+#include "retransmit.h"
+#include "recorder.h"
+#include "history.h"
+#include "latency.h"
+#include "stats.h"
+#include "reconnect.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "lwip/sockets.h"
+
+static int brokerSocket = -1;
+static char topicBase[MQTT_TOPIC_MAX];
+static char commandTopic[MQTT_TOPIC_MAX];
+
+// Event publishes awaiting PUBACK, added to by the sender and acknowledged by the receiver
+static MqttWindow window;
+// Command publishes the receiver has handled, for the sender to acknowledge
+static uint16_t pendingPubAcks[MQTT_INFLIGHT_WINDOW];
+static size_t pendingPubAckCount = 0;
+
+static volatile bool mqttClosing = false;
+static volatile bool pingOutstanding = false;
+static HalSignalHandle senderStopped = NULL;
+
+// Every packet of one wake-up goes out in as few lwip_send() calls as fit
+static uint8_t sendBuffer[OUTBOX_BUFFER_SIZE];
+static size_t sendLength = 0;
+
+static bool sendAll(const uint8_t *data, size_t length)
+{
+  return lwip_send(brokerSocket, data, length, 0) >= 0;
+}
+
+static bool flushSendBuffer()
+{
+  if (sendLength == 0)
+  {
+    return true;
+  }
+  bool sent = sendAll(sendBuffer, sendLength);
+  sendLength = 0;
+  return sent;
+}
+
+// Makes room for a packet of up to needed bytes, false if the flush failed
+static bool reserve(size_t needed)
+{
+  if (sizeof(sendBuffer) - sendLength >= needed)
+  {
+    return true;
+  }
+  return flushSendBuffer();
+}
+
+// False only when the send buffer could not be flushed. A publish too large
+// for any packet is skipped with a log line, queued says whether it went in.
+static bool writePublish(const char *topic, const void *payload, size_t length, uint8_t qos, uint16_t packetId,
+                         bool retain, bool *queued)
+{
+  *queued = false;
+  size_t written = mqttPublish(sendBuffer + sendLength, sizeof(sendBuffer) - sendLength, topic, payload, length, qos,
+                               packetId, retain);
+  if (written == 0)
+  {
+    if (!flushSendBuffer())
+    {
+      return false;
+    }
+    written = mqttPublish(sendBuffer, sizeof(sendBuffer), topic, payload, length, qos, packetId, retain);
+    if (written == 0)
+    {
+      printf("MQTT: %u bytes too large to publish to %s\n", (unsigned)length, topic);
+      return true;
+    }
+  }
+  sendLength += written;
+  *queued = true;
+  return true;
+}
+
+static bool queuePublish(const char *topic, const void *payload, size_t length, uint8_t qos, uint16_t packetId,
+                         bool retain)
+{
+  bool queued;
+  return writePublish(topic, payload, length, qos, packetId, retain, &queued);
+}
+
+static bool queuePublishText(const char *subtopic, const std::string &text, bool retain)
+{
+  char topic[MQTT_TOPIC_MAX];
+  snprintf(topic, sizeof(topic), "%s/%s", topicBase, subtopic);
+  return queuePublish(topic, text.c_str(), text.length(), 0, 0, retain);
+}
+
+// An info message goes out as JSON under event/ or telemetry/ and its type name
+static void messageTopic(char *topic, size_t size, const Message &msg, const char *kind)
+{
+  const MessageSchema *schema = messageSchemaFor(msg);
+  snprintf(topic, size, "%s/%s/%s", topicBase, kind, schema != NULL ? schema->name : "UNKNOWN");
+}
+
+// Telemetry at QoS 0
+static bool queuePublishTelemetry(const Message &msg)
+{
+  char payload[FRAME_MAX_LENGTH];
+  size_t length = messageToBuffer(msg, payload, sizeof(payload));
+  if (length == 0)
+  {
+    printf("MQTT: failed to write message\n");
+    return true;
+  }
+  char topic[MQTT_TOPIC_MAX];
+  messageTopic(topic, sizeof(topic), msg, "telemetry");
+  return queuePublish(topic, payload, length, 0, 0, false);
+}
+
+// A critical event at QoS 1. It takes a window slot only once its publish is
+// in the send buffer: a slot never acknowledged would hold back every later
+// acknowledgement, the window acknowledges in order. The window must not be full.
+static bool queuePublishEvent(const Message &event)
+{
+  char payload[FRAME_MAX_LENGTH];
+  size_t length = messageToBuffer(event, payload, sizeof(payload));
+  if (length == 0)
+  {
+    printf("MQTT: failed to write event\n");
+    return true;
+  }
+  char topic[MQTT_TOPIC_MAX];
+  messageTopic(topic, sizeof(topic), event, "event");
+
+  halEnterCritical();
+  uint16_t packetId = mqttNextPacketId(window);
+  halExitCritical();
+  bool queued;
+  if (!writePublish(topic, payload, length, 1, packetId, false, &queued))
+  {
+    return false;
+  }
+  if (queued)
+  {
+    halEnterCritical();
+    mqttWindowRecord(window, packetId, event.sequence);
+    halExitCritical();
+  }
+  return true;
+}
+
+// Sending half of the connection. Wakes for control's signal, or every half
+// keep-alive to ping a broker that has heard nothing else from us.
+static void mqttSendTask(void *params)
+{
+  const uint32_t pingIntervalMs = MQTT_KEEP_ALIVE_S * 1000 / 2;
+  TickType_t lastPing = xTaskGetTickCount();
+
+  while (true)
+  {
+    halSignalWait(outgoingMessageSignal, pingIntervalMs);
+    if (mqttClosing)
+    {
+      break;
+    }
+
+    sendLength = 0;
+    bool sendFailed = false;
+
+    if (xTaskGetTickCount() - lastPing >= pdMS_TO_TICKS(pingIntervalMs))
+    {
+      if (pingOutstanding)
+      {
+        printf("MQTT: broker stopped answering. Closing connection.\n");
+        break;
+      }
+      pingOutstanding = true;
+      lastPing = xTaskGetTickCount();
+      sendLength += mqttPingReq(sendBuffer, sizeof(sendBuffer));
+    }
+
+    uint16_t pubAcks[MQTT_INFLIGHT_WINDOW];
+    halEnterCritical();
+    size_t pubAckCount = pendingPubAckCount;
+    memcpy(pubAcks, pendingPubAcks, pubAckCount * sizeof(uint16_t));
+    pendingPubAckCount = 0;
+    halExitCritical();
+    for (size_t i = 0; i < pubAckCount && !sendFailed; i++)
+    {
+      if (!reserve(4))
+      {
+        sendFailed = true;
+        break;
+      }
+      sendLength += mqttPubAck(sendBuffer + sendLength, sizeof(sendBuffer) - sendLength, pubAcks[i]);
+    }
+
+    ControlSnapshot snapshot;
+    if (!sendFailed && controlTakeStateSnapshot(&snapshot))
+    {
+      char payload[STATE_WRITER_MAX_LENGTH];
+      size_t length = controlSnapshotToBuffer(snapshot, payload, sizeof(payload));
+      char topic[MQTT_TOPIC_MAX];
+      snprintf(topic, sizeof(topic), "%s/state", topicBase);
+      sendFailed = length > 0 && !queuePublish(topic, payload, length, 0, 0, true);
+    }
+
+    // Critical events at QoS 1, as many as the window has room for. A PUBACK
+    // gives the signal, so a full window is picked up again when it opens.
+    Message event;
+    bool eventsLeft = false;
+    while (!sendFailed && (eventsLeft = retransmitPeek(&event)))
+    {
+      halEnterCritical();
+      bool full = mqttWindowFull(window);
+      halExitCritical();
+      if (full)
+      {
+        eventsLeft = false;
+        break;
+      }
+      sendFailed = !queuePublishEvent(event);
+      retransmitAdvance();
+    }
+
+    // Telemetry at QoS 0, a lost sample is replaced by the next one
+    Message msg;
+    int drained = 0;
+    while (!sendFailed && drained < SOCKET_MAX_BATCH && halQueueReceive(outgoingMessageQueue, &msg, 0))
+    {
+      sendFailed = !queuePublishTelemetry(msg);
+      drained++;
+    }
+
+    RecorderEntry entry;
+    bool dumpEnd = false;
+    int dumped = 0;
+    while (!sendFailed && dumped < RECORDER_DUMP_BATCH && !dumpEnd && recorderNextDumpEntry(&entry, &dumpEnd))
+    {
+      sendFailed = !queuePublishText("reply", dumpEnd ? recorderEndToString() : recorderEntryToString(entry), false);
+      dumped++;
+    }
+
+    // One bounded chunk of a history reply per pass
+    HistoryChunk chunk;
+    bool historyEnd = true;
+    if (!sendFailed && historyNextChunk(chunk))
+    {
+      historyEnd = chunk.done;
+      char payload[HISTORY_WRITER_MAX_LENGTH];
+      size_t length = historyChunkToBuffer(chunk, payload, sizeof(payload));
+      char topic[MQTT_TOPIC_MAX];
+      snprintf(topic, sizeof(topic), "%s/reply", topicBase);
+      sendFailed = length > 0 && !queuePublish(topic, payload, length, 0, 0, false);
+    }
+
+    if (!sendFailed && latencyTakeReportRequest())
+    {
+      sendFailed = !queuePublishText("reply", latencyReportToString(), false);
+    }
+
+    if (!sendFailed && statsTakeReportRequest())
+    {
+      sendFailed = !queuePublishText("reply", statsReportToString(), false);
+    }
+
+    if (sendFailed || !flushSendBuffer())
+    {
+      printf("MQTT: failed to send. Closing connection.\n");
+      break;
+    }
+
+    if (eventsLeft || drained == SOCKET_MAX_BATCH || (dumped == RECORDER_DUMP_BATCH && !dumpEnd) || !historyEnd)
+    {
+      halSignalGive(outgoingMessageSignal);
+    }
+  }
+
+  // Wakes the receiver if it is still blocked in lwip_recv()
+  lwip_shutdown(brokerSocket, SHUT_RDWR);
+  halSignalGive(senderStopped);
+  vTaskDelete(NULL);
+}
+
+static void handleCommandPublish(const MqttPacket &packet, uint32_t receivedUs)
+{
+  if (packet.topicLength != strlen(commandTopic) || memcmp(packet.topic, commandTopic, packet.topicLength) != 0)
+  {
+    printf("MQTT: publish to an unexpected topic ignored\n");
+  }
+  else if (packet.payloadLength >= FRAME_MAX_LENGTH)
+  {
+    printf("MQTT: dropped a command longer than %d bytes\n", FRAME_MAX_LENGTH);
+  }
+  else
+  {
+    char text[FRAME_MAX_LENGTH];
+    memcpy(text, packet.payload, packet.payloadLength);
+    text[packet.payloadLength] = '\0';
+    printf("Received: %s\n", text);
+
+    Message msg = {};
+    if (bufferToMessage(text, msg))
+    {
+      enqueueCommand(msg, receivedUs);
+    }
+    else
+    {
+      printf("Failed to convert buffer to Message\n");
+    }
+  }
+
+  // Acknowledged whether or not it parsed, a redelivery would fail the same way
+  if (packet.qos > 0)
+  {
+    halEnterCritical();
+    bool queued = pendingPubAckCount < MQTT_INFLIGHT_WINDOW;
+    if (queued)
+    {
+      pendingPubAcks[pendingPubAckCount++] = packet.packetId;
+    }
+    halExitCritical();
+    if (!queued)
+    {
+      printf("MQTT: too many unacknowledged commands, the broker will resend\n");
+    }
+    halSignalGive(outgoingMessageSignal);
+  }
+}
+
+// Handles one packet from the broker, false if the connection must close
+static bool handlePacket(const uint8_t *data, size_t length, uint32_t receivedUs)
+{
+  MqttPacket packet;
+  if (!mqttParse(data, length, &packet))
+  {
+    printf("MQTT: malformed packet of type %d\n", data[0] >> 4);
+    return false;
+  }
+  pingOutstanding = false;
+
+  switch (packet.type)
+  {
+  case MQTT_CONNACK:
+    if (packet.returnCode != 0)
+    {
+      printf("MQTT: broker refused the connection, code %d\n", packet.returnCode);
+      return false;
+    }
+    printf("MQTT: connected as %s\n", deviceName());
+    return true;
+
+  case MQTT_SUBACK:
+    if (packet.returnCode == 0x80)
+    {
+      printf("MQTT: broker refused the subscription to %s\n", commandTopic);
+    }
+    return true;
+
+  case MQTT_PUBLISH:
+    handleCommandPublish(packet, receivedUs);
+    return true;
+
+  case MQTT_PUBACK:
+  {
+    uint16_t sequence;
+    halEnterCritical();
+    bool moved = mqttWindowAck(window, packet.packetId, &sequence);
+    halExitCritical();
+    if (moved)
+    {
+      retransmitAcknowledge(sequence);
+      halSignalGive(outgoingMessageSignal);
+    }
+    return true;
+  }
+
+  default:
+    return true;
+  }
+}
+
+static bool connectToBroker()
+{
+  struct sockaddr_in brokerAddr;
+  brokerSocket = lwip_socket(AF_INET, SOCK_STREAM, 0);
+  if (brokerSocket < 0)
+  {
+    printf("MQTT: failed to create socket.\n");
+    return false;
+  }
+
+  memset(&brokerAddr, 0, sizeof(brokerAddr));
+  brokerAddr.sin_family = AF_INET;
+  brokerAddr.sin_port = htons(MQTT_BROKER_PORT);
+  inet_aton(MQTT_BROKER_IP, &brokerAddr.sin_addr);
+  if (lwip_connect(brokerSocket, (struct sockaddr *)&brokerAddr, sizeof(brokerAddr)) < 0)
+  {
+    printf("MQTT: failed to connect to broker.\n");
+    return false;
+  }
+
+  snprintf(topicBase, sizeof(topicBase), "%s/%s", MQTT_TOPIC_PREFIX, deviceName());
+  snprintf(commandTopic, sizeof(commandTopic), "%s/command", topicBase);
+
+  // CONNECT and SUBSCRIBE together, the broker handles them in order
+  uint8_t packets[2 * MQTT_TOPIC_MAX];
+  size_t length = mqttConnect(packets, sizeof(packets), deviceName(), MQTT_KEEP_ALIVE_S);
+  length += mqttSubscribe(packets + length, sizeof(packets) - length, mqttNextPacketId(window), commandTopic, 1);
+  if (!sendAll(packets, length))
+  {
+    printf("MQTT: failed to send connect.\n");
+    return false;
+  }
+  return true;
+}
+
+// Receiving half of the connection, and owner of the socket's lifetime
+void mqttTask(void *params)
+{
+  if (senderStopped == NULL)
+  {
+    senderStopped = halSignalCreate();
+  }
+  mqttWindowInit(window);
+  pendingPubAckCount = 0;
+  if (!connectToBroker())
+  {
+    if (brokerSocket >= 0)
+    {
+      lwip_close(brokerSocket);
+      brokerSocket = -1;
+    }
+    notifySocketDisconnected();
+    vTaskDelete(NULL);
+    return;
+  }
+
+  notifySocketConnected();
+
+  // Whatever the last connection left unacknowledged is published again first
+  retransmitRewind();
+  mqttClosing = false;
+  pingOutstanding = false;
+  if (xTaskCreate(mqttSendTask, "MqttSendTask", 4096, NULL, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
+  {
+    printf("MQTT: failed to create send task.\n");
+    lwip_close(brokerSocket);
+    brokerSocket = -1;
+    notifySocketDisconnected();
+    vTaskDelete(NULL);
+    return;
+  }
+  halSignalGive(outgoingMessageSignal);
+
+  // The retained state topic is brought up to date
+  Message getState = commandMessage(CommandType::GET_STATE);
+  if (!halQueueSend(incommingMessageQueue, &getState, 100))
+  {
+    printf("Failed to request state snapshot.\n");
+  }
+
+  static uint8_t receiveBuffer[MQTT_RECEIVE_BUFFER];
+  size_t received = 0;
+  bool failed = false;
+  while (!failed)
+  {
+    int bytesRead = lwip_recv(brokerSocket, receiveBuffer + received, sizeof(receiveBuffer) - received, 0);
+    if (bytesRead <= 0)
+    {
+      printf(bytesRead == 0 ? "MQTT: broker closed the connection.\n" : "MQTT: error reading from socket.\n");
+      break;
+    }
+    uint32_t receivedUs = latencyNowUs();
+    received += (size_t)bytesRead;
+
+    size_t consumed = 0;
+    while (true)
+    {
+      size_t packetLength = mqttPacketLength(receiveBuffer + consumed, received - consumed);
+      if (packetLength == MQTT_MALFORMED || packetLength > sizeof(receiveBuffer))
+      {
+        printf("MQTT: unusable packet length. Closing connection.\n");
+        failed = true;
+        break;
+      }
+      if (packetLength == 0 || packetLength > received - consumed)
+      {
+        break;
+      }
+      if (!handlePacket(receiveBuffer + consumed, packetLength, receivedUs))
+      {
+        failed = true;
+        break;
+      }
+      consumed += packetLength;
+    }
+    memmove(receiveBuffer, receiveBuffer + consumed, received - consumed);
+    received -= consumed;
+  }
+
+  // The sender must be gone before the socket is closed under it
+  mqttClosing = true;
+  halSignalGive(outgoingMessageSignal);
+  halSignalWait(senderStopped, HAL_WAIT_FOREVER);
+
+  printf("MQTT task shutting down.\n");
+  reconnectRecordDisconnect(halTimeUs(), false);
+  lwip_close(brokerSocket);
+  brokerSocket = -1;
+  notifySocketDisconnected();
+  vTaskDelete(NULL);
+}
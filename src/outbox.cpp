@@ -0,0 +1,191 @@
+#include "outbox.h"
+#include "control.h"
+#include "messagewriter.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static OutboxStats stats;
+
+void outboxClear(Outbox &outbox)
+{
+  outbox.length = 0;
+  outbox.messages = 0;
+}
+
+// Room for the longest message in either encoding, JSON lines replace the NUL with '\n'
+static size_t largestFrame(WireEncoding encoding)
+{
+  return encoding == WIRE_BINARY ? MESSAGE_BINARY_MAX_LENGTH : MESSAGE_WRITER_MAX_LENGTH;
+}
+
+bool outboxAppendMessage(Outbox &outbox, WireEncoding encoding, const Message &msg)
+{
+  uint8_t *end = outbox.buffer + outbox.length;
+  size_t space = OUTBOX_BUFFER_SIZE - outbox.length;
+  size_t length;
+  if (encoding == WIRE_BINARY)
+  {
+    length = messageToBinary(msg, end, space);
+  }
+  else
+  {
+    length = messageToBuffer(msg, (char *)end, space);
+    if (length > 0)
+    {
+      end[length++] = '\n';
+    }
+  }
+
+  if (length == 0)
+  {
+    return false;
+  }
+  outbox.length += length;
+  outbox.messages++;
+  return true;
+}
+
+bool outboxAppendSnapshot(Outbox &outbox, WireEncoding encoding, const ControlSnapshot &snapshot)
+{
+  uint8_t *end = outbox.buffer + outbox.length;
+  size_t space = OUTBOX_BUFFER_SIZE - outbox.length;
+  size_t length;
+  if (encoding == WIRE_BINARY)
+  {
+    length = controlSnapshotToBinary(snapshot, end, space);
+  }
+  else
+  {
+    length = controlSnapshotToBuffer(snapshot, (char *)end, space);
+    if (length > 0)
+    {
+      end[length++] = '\n';
+    }
+  }
+
+  if (length == 0)
+  {
+    return false;
+  }
+  outbox.length += length;
+  outbox.messages++;
+  return true;
+}
+
+size_t outboxDrainQueue(Outbox &outbox, HalQueueHandle queue, WireEncoding encoding, size_t maxMessages,
+                        bool *limitReached)
+{
+  size_t moved = 0;
+  Message msg;
+  *limitReached = false;
+  while (true)
+  {
+    if (moved == maxMessages || OUTBOX_BUFFER_SIZE - outbox.length < largestFrame(encoding))
+    {
+      *limitReached = true;
+      break;
+    }
+    if (!halQueueReceive(queue, &msg, 0))
+    {
+      break;
+    }
+    if (!outboxAppendMessage(outbox, encoding, msg))
+    {
+      halEnterCritical();
+      stats.rejected++;
+      halExitCritical();
+      printf("Outbox: dropped message %d/%d the encoder rejected\n", (int)msg.messageType, (int)msg.type);
+      continue;
+    }
+    moved++;
+  }
+  return moved;
+}
+
+bool outboxAppendHistory(Outbox &outbox, WireEncoding encoding, const HistoryChunk &chunk)
+{
+  uint8_t *end = outbox.buffer + outbox.length;
+  size_t framing = encoding == WIRE_BINARY ? MESSAGE_BINARY_HEADER : 0;
+  size_t space = OUTBOX_BUFFER_SIZE - outbox.length;
+  if (space <= framing)
+  {
+    return false;
+  }
+
+  // The NUL the writer ends with becomes the line's '\n'
+  size_t length = historyChunkToBuffer(chunk, (char *)end + framing, space - framing);
+  if (length == 0)
+  {
+    return false;
+  }
+  if (encoding == WIRE_BINARY)
+  {
+    binaryTextHeader(end, length);
+  }
+  else
+  {
+    end[length++] = '\n';
+  }
+  outbox.length += framing + length;
+  outbox.messages++;
+  return true;
+}
+
+bool outboxAppendText(Outbox &outbox, WireEncoding encoding, const char *text, size_t length)
+{
+  size_t framing = encoding == WIRE_BINARY ? MESSAGE_BINARY_HEADER : 1;
+  if (OUTBOX_BUFFER_SIZE - outbox.length < length + framing)
+  {
+    return false;
+  }
+
+  uint8_t *end = outbox.buffer + outbox.length;
+  if (encoding == WIRE_BINARY)
+  {
+    binaryTextHeader(end, length);
+    memcpy(end + MESSAGE_BINARY_HEADER, text, length);
+  }
+  else
+  {
+    memcpy(end, text, length);
+    end[length] = '\n';
+  }
+  outbox.length += length + framing;
+  outbox.messages++;
+  return true;
+}
+
+void outboxRecordFlush(const Outbox &outbox, bool sent)
+{
+  halEnterCritical();
+  stats.flushes++;
+  if (sent)
+  {
+    stats.messages += outbox.messages;
+    stats.bytes += outbox.length;
+    if (outbox.messages > stats.largestBatch)
+    {
+      stats.largestBatch = outbox.messages;
+    }
+  }
+  else
+  {
+    stats.failures++;
+  }
+  halExitCritical();
+}
+
+void outboxGetStats(OutboxStats *out)
+{
+  halEnterCritical();
+  *out = stats;
+  halExitCritical();
+}
+
+void outboxResetStats()
+{
+  halEnterCritical();
+  memset(&stats, 0, sizeof(stats));
+  halExitCritical();
+}
@@ -0,0 +1,125 @@
+#include "reconnect.h"
+#include "hal.h"
+
+#include <string.h>
+
+void heartbeatInit(Heartbeat &heartbeat, uint32_t intervalMs, uint32_t timeoutMs, uint32_t nowMs)
+{
+  heartbeat.intervalMs = intervalMs;
+  heartbeat.timeoutMs = timeoutMs;
+  heartbeat.lastSentMs = nowMs;
+  heartbeat.lastHeardMs = nowMs;
+}
+
+void heartbeatSent(Heartbeat &heartbeat, uint32_t nowMs)
+{
+  heartbeat.lastSentMs = nowMs;
+}
+
+void heartbeatHeard(Heartbeat &heartbeat, uint32_t nowMs)
+{
+  heartbeat.lastHeardMs = nowMs;
+}
+
+// Differences of the millisecond clock stay valid across its wrap
+bool heartbeatDue(const Heartbeat &heartbeat, uint32_t nowMs)
+{
+  return heartbeat.timeoutMs > 0 && nowMs - heartbeat.lastSentMs >= heartbeat.intervalMs;
+}
+
+bool heartbeatExpired(const Heartbeat &heartbeat, uint32_t nowMs)
+{
+  return heartbeat.timeoutMs > 0 && nowMs - heartbeat.lastHeardMs >= heartbeat.timeoutMs;
+}
+
+void backoffInit(Backoff &backoff, uint32_t baseMs, uint32_t maxMs, uint32_t seed)
+{
+  backoff.baseMs = baseMs;
+  backoff.maxMs = maxMs;
+  backoff.attempts = 0;
+  backoff.randomState = seed != 0 ? seed : 0x9E3779B9u; // Xorshift never leaves 0
+}
+
+static uint32_t nextRandom(Backoff &backoff)
+{
+  uint32_t x = backoff.randomState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  backoff.randomState = x;
+  return x;
+}
+
+uint32_t backoffNextDelay(Backoff &backoff)
+{
+  uint32_t ceiling = backoff.baseMs;
+  for (uint32_t i = 0; i < backoff.attempts && ceiling < backoff.maxMs; i++)
+  {
+    ceiling = ceiling > backoff.maxMs / 2 ? backoff.maxMs : ceiling * 2;
+  }
+  if (ceiling > backoff.maxMs)
+  {
+    ceiling = backoff.maxMs;
+  }
+  backoff.attempts++;
+
+  uint32_t half = ceiling / 2;
+  return half + nextRandom(backoff) % (ceiling - half + 1);
+}
+
+void backoffReset(Backoff &backoff)
+{
+  backoff.attempts = 0;
+}
+
+static ReconnectStats stats;
+static uint64_t disconnectedAtUs = 0;
+static bool disconnected = false;
+
+void reconnectRecordDisconnect(uint64_t nowUs, bool heartbeatTimeout)
+{
+  halEnterCritical();
+  stats.disconnects++;
+  if (heartbeatTimeout)
+  {
+    stats.heartbeatTimeouts++;
+  }
+  if (!disconnected)
+  {
+    disconnected = true;
+    disconnectedAtUs = nowUs;
+  }
+  halExitCritical();
+}
+
+void reconnectRecordConnect(uint64_t nowUs)
+{
+  halEnterCritical();
+  if (disconnected)
+  {
+    uint32_t elapsedMs = (uint32_t)((nowUs - disconnectedAtUs) / 1000);
+    stats.reconnects++;
+    stats.lastReconnectMs = elapsedMs;
+    stats.totalReconnectMs += elapsedMs;
+    if (elapsedMs > stats.maxReconnectMs)
+    {
+      stats.maxReconnectMs = elapsedMs;
+    }
+    disconnected = false;
+  }
+  halExitCritical();
+}
+
+void reconnectGetStats(ReconnectStats *out)
+{
+  halEnterCritical();
+  *out = stats;
+  halExitCritical();
+}
+
+void reconnectResetStats()
+{
+  halEnterCritical();
+  memset(&stats, 0, sizeof(stats));
+  halExitCritical();
+}
@@ -0,0 +1,177 @@
+#include "recorder.h"
+
+#include "hal.h"
+
+#include "cJSON.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Lives outside .bss so a watchdog or soft reset keeps the history. After
+// power-up the contents are random, which the magic and check word catch.
+typedef struct
+{
+  uint32_t magic;
+  uint32_t nextSequence;
+  uint32_t check; // ~nextSequence
+  uint32_t boots;
+  RecorderEntry entries[RECORDER_ENTRIES];
+} RecorderRing;
+
+static RecorderRing HAL_NOINIT(recorderRing);
+
+static volatile bool dumpPending = false;
+static uint32_t dumpNext = 0;
+
+static const char *eventNames[] = {"BOOT", "COMMAND", "TRANSITION", "TIMER", "GPIO", "SENSOR"};
+
+static bool ringValid()
+{
+  return recorderRing.magic == RECORDER_MAGIC && recorderRing.check == ~recorderRing.nextSequence;
+}
+
+void recorderClear()
+{
+  halEnterCritical();
+  memset(&recorderRing, 0, sizeof(recorderRing));
+  recorderRing.magic = RECORDER_MAGIC;
+  recorderRing.check = ~recorderRing.nextSequence;
+  halExitCritical();
+}
+
+void initRecorder()
+{
+  if (ringValid())
+  {
+    printf("Recorder kept %lu entries across reset.\n", (unsigned long)recorderRing.nextSequence);
+  }
+  else
+  {
+    recorderClear();
+  }
+  recorderRing.boots++;
+  dumpPending = false;
+  recorderLog(RECORD_BOOT, 0, (int32_t)recorderRing.boots);
+}
+
+// Caller holds the critical section
+static void append(RecorderEvent event, uint8_t code, int32_t value)
+{
+  if (value > INT16_MAX)
+  {
+    value = INT16_MAX;
+  }
+  else if (value < INT16_MIN)
+  {
+    value = INT16_MIN;
+  }
+
+  uint32_t sequence = recorderRing.nextSequence;
+  RecorderEntry &entry = recorderRing.entries[sequence % RECORDER_ENTRIES];
+  entry.timeUs = halTimeUs();
+  entry.sequence = sequence;
+  entry.event = (uint8_t)event;
+  entry.code = code;
+  entry.value = (int16_t)value;
+  recorderRing.nextSequence = sequence + 1;
+  recorderRing.check = ~recorderRing.nextSequence;
+}
+
+void recorderLog(RecorderEvent event, uint8_t code, int32_t value)
+{
+  halEnterCritical();
+  append(event, code, value);
+  halExitCritical();
+}
+
+void recorderLogFromISR(RecorderEvent event, uint8_t code, int32_t value)
+{
+  uint32_t saved = halEnterCriticalFromISR();
+  append(event, code, value);
+  halExitCriticalFromISR(saved);
+}
+
+uint32_t recorderNextSequence()
+{
+  return recorderRing.nextSequence;
+}
+
+bool recorderRead(uint32_t from, RecorderEntry *entry)
+{
+  bool found = false;
+
+  halEnterCritical();
+  uint32_t next = recorderRing.nextSequence;
+  uint32_t oldest = next > RECORDER_ENTRIES ? next - RECORDER_ENTRIES : 0;
+  if (from < oldest)
+  {
+    from = oldest;
+  }
+  if (from < next)
+  {
+    *entry = recorderRing.entries[from % RECORDER_ENTRIES];
+    found = true;
+  }
+  halExitCritical();
+
+  return found;
+}
+
+void recorderRequestDump(uint32_t from)
+{
+  dumpNext = from;
+  dumpPending = true;
+}
+
+bool recorderNextDumpEntry(RecorderEntry *entry, bool *end)
+{
+  if (!dumpPending)
+  {
+    return false;
+  }
+
+  // Entries logged while the dump is running are included
+  *end = !recorderRead(dumpNext, entry);
+  if (*end)
+  {
+    dumpPending = false;
+  }
+  else
+  {
+    dumpNext = entry->sequence + 1;
+  }
+  return true;
+}
+
+std::string recorderEntryToString(const RecorderEntry &entry)
+{
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddStringToObject(json, "messageType", "RECORD");
+  cJSON_AddNumberToObject(json, "sequence", entry.sequence);
+  cJSON_AddNumberToObject(json, "time", (double)entry.timeUs);
+  if (entry.event < sizeof(eventNames) / sizeof(eventNames[0]))
+  {
+    cJSON_AddStringToObject(json, "event", eventNames[entry.event]);
+  }
+  cJSON_AddNumberToObject(json, "code", entry.code);
+  cJSON_AddNumberToObject(json, "value", entry.value);
+
+  char *jsonString = cJSON_PrintUnformatted(json);
+  std::string result(jsonString);
+  cJSON_free(jsonString);
+  cJSON_Delete(json);
+  return result;
+}
+
+std::string recorderEndToString()
+{
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddStringToObject(json, "messageType", "RECORD_END");
+  cJSON_AddNumberToObject(json, "sequence", recorderNextSequence());
+
+  char *jsonString = cJSON_PrintUnformatted(json);
+  std::string result(jsonString);
+  cJSON_free(jsonString);
+  cJSON_Delete(json);
+  return result;
+}
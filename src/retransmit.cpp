@@ -0,0 +1,150 @@
+#include "retransmit.h"
+
+#include "hal.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static_assert((RETRANSMIT_ENTRIES & (RETRANSMIT_ENTRIES - 1)) == 0, "RETRANSMIT_ENTRIES must be a power of two");
+
+// Positions count every event appended since boot, an event lives at
+// entries[position % RETRANSMIT_ENTRIES]. acked <= sent <= head.
+typedef struct
+{
+  Message entries[RETRANSMIT_ENTRIES];
+  uint32_t head;      // Next position to append
+  uint32_t acked;     // First position not acknowledged, never more than a ring behind head
+  uint32_t sent;      // First position not sent on this connection
+  uint32_t resendEnd; // Positions before this were sent on an earlier connection
+  uint16_t nextSequence;
+  RetransmitStats stats;
+} RetransmitRing;
+
+static RetransmitRing ring;
+
+void retransmitClear()
+{
+  halEnterCritical();
+  memset(&ring, 0, sizeof(ring));
+  ring.nextSequence = 1;
+  halExitCritical();
+}
+
+bool retransmitIsCritical(InfoType infoType)
+{
+  switch (infoType)
+  {
+  case PRESSURE_CHANGE:
+  case COMPRESSION_COUNTDOWN_UPDATED:
+  case RELEASE_COUNTDOWN_UPDATE:
+  case MOTOR_COUNTDOWN_UPDATE:
+  case MOTOR_TEMPERATURE:
+    return false;
+  default:
+    return true;
+  }
+}
+
+uint16_t retransmitAppend(Message &msg)
+{
+  halEnterCritical();
+  if (ring.nextSequence == 0)
+  {
+    ring.nextSequence = 1;
+  }
+  msg.sequence = ring.nextSequence++;
+  if (ring.nextSequence == 0)
+  {
+    ring.nextSequence = 1;
+  }
+
+  bool overwrote = ring.head - ring.acked == RETRANSMIT_ENTRIES;
+  ring.entries[ring.head % RETRANSMIT_ENTRIES] = msg;
+  ring.head++;
+  if (overwrote)
+  {
+    ring.acked++;
+    ring.stats.lost++;
+  }
+  if (ring.sent < ring.acked)
+  {
+    ring.sent = ring.acked;
+  }
+  ring.stats.appended++;
+  halExitCritical();
+
+  if (overwrote)
+  {
+    printf("Retransmit ring full, oldest unacknowledged event lost.\n");
+  }
+  return msg.sequence;
+}
+
+void retransmitAcknowledge(uint16_t sequence)
+{
+  halEnterCritical();
+  // Sequences within the ring are less than half the 16-bit space apart
+  while (ring.acked < ring.head &&
+         (int16_t)(sequence - ring.entries[ring.acked % RETRANSMIT_ENTRIES].sequence) >= 0)
+  {
+    ring.acked++;
+    ring.stats.acknowledged++;
+  }
+  if (ring.sent < ring.acked)
+  {
+    ring.sent = ring.acked;
+  }
+  halExitCritical();
+}
+
+bool retransmitPeek(Message *msg)
+{
+  halEnterCritical();
+  bool available = ring.sent < ring.head;
+  if (available)
+  {
+    *msg = ring.entries[ring.sent % RETRANSMIT_ENTRIES];
+  }
+  halExitCritical();
+  return available;
+}
+
+void retransmitAdvance()
+{
+  halEnterCritical();
+  if (ring.sent < ring.head)
+  {
+    if (ring.sent < ring.resendEnd)
+    {
+      ring.stats.resent++;
+    }
+    ring.sent++;
+  }
+  halExitCritical();
+}
+
+void retransmitRewind()
+{
+  halEnterCritical();
+  if (ring.sent > ring.resendEnd)
+  {
+    ring.resendEnd = ring.sent;
+  }
+  ring.sent = ring.acked;
+  halExitCritical();
+}
+
+uint32_t retransmitPending()
+{
+  halEnterCritical();
+  uint32_t pending = ring.head - ring.acked;
+  halExitCritical();
+  return pending;
+}
+
+void retransmitGetStats(RetransmitStats *out)
+{
+  halEnterCritical();
+  *out = ring.stats;
+  halExitCritical();
+}
@@ -0,0 +1,337 @@
+#include "scheduler.h"
+#include "control.h"
+
+#include "hal.h"
+
+#include <stdio.h>
+
+// Pending entries as a binary min-heap on due time: the next command to run
+// is always entries[0], inserts and removals cost O(log n).
+static ScheduleEntry entries[SCHEDULER_MAX_ENTRIES];
+static int entryCount = 0;
+
+// Seconds since midnight = (uptime + clockOffset) % SECONDS_PER_DAY
+static int32_t clockOffset = 0;
+static bool clockValid = false;
+
+static HalSignalHandle schedulerWake = NULL;
+
+static uint32_t uptimeSeconds()
+{
+  return (uint32_t)(halTimeUs() / 1000000ULL);
+}
+
+static uint32_t secondsOfDay(uint32_t uptime)
+{
+  int64_t local = (int64_t)uptime + clockOffset;
+  local %= SECONDS_PER_DAY;
+  if (local < 0)
+  {
+    local += SECONDS_PER_DAY;
+  }
+  return (uint32_t)local;
+}
+
+// Next uptime at which the given time of day occurs, strictly in the future
+static uint32_t nextOccurrence(uint32_t now, int32_t timeOfDay)
+{
+  int32_t delta = timeOfDay - (int32_t)secondsOfDay(now);
+  if (delta <= 0)
+  {
+    delta += SECONDS_PER_DAY;
+  }
+  return now + delta;
+}
+
+static void swapEntries(int a, int b)
+{
+  ScheduleEntry temp = entries[a];
+  entries[a] = entries[b];
+  entries[b] = temp;
+}
+
+static void siftUp(int index)
+{
+  while (index > 0)
+  {
+    int parent = (index - 1) / 2;
+    if (entries[parent].due <= entries[index].due)
+    {
+      break;
+    }
+    swapEntries(parent, index);
+    index = parent;
+  }
+}
+
+static void siftDown(int index)
+{
+  while (true)
+  {
+    int smallest = index;
+    int left = 2 * index + 1;
+    int right = left + 1;
+    if (left < entryCount && entries[left].due < entries[smallest].due)
+    {
+      smallest = left;
+    }
+    if (right < entryCount && entries[right].due < entries[smallest].due)
+    {
+      smallest = right;
+    }
+    if (smallest == index)
+    {
+      break;
+    }
+    swapEntries(smallest, index);
+    index = smallest;
+  }
+}
+
+// After the due time at index changed
+static void resift(int index)
+{
+  siftDown(index);
+  siftUp(index);
+}
+
+static void removeAt(int index)
+{
+  entryCount--;
+  if (index == entryCount)
+  {
+    return;
+  }
+  entries[index] = entries[entryCount];
+  resift(index);
+}
+
+static int findEntry(int id)
+{
+  for (int i = 0; i < entryCount; i++)
+  {
+    if (entries[i].id == id)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void wakeScheduler()
+{
+  if (schedulerWake != NULL)
+  {
+    halSignalGive(schedulerWake);
+  }
+}
+
+void initScheduler()
+{
+  schedulerWake = halSignalCreate();
+  entryCount = 0;
+  clockValid = false;
+}
+
+void schedulerSetClock(int secondsOfDay)
+{
+  if (secondsOfDay < 0 || secondsOfDay >= SECONDS_PER_DAY)
+  {
+    printf("Invalid clock value: %d\n", secondsOfDay);
+    return;
+  }
+
+  uint32_t now = uptimeSeconds();
+
+  halEnterCritical();
+  clockOffset = secondsOfDay - (int32_t)(now % SECONDS_PER_DAY);
+  clockValid = true;
+
+  // Time-of-day entries move with the clock
+  for (int i = 0; i < entryCount; i++)
+  {
+    if (entries[i].mode != SCHEDULE_IN)
+    {
+      entries[i].due = nextOccurrence(now, entries[i].time);
+    }
+  }
+  for (int i = entryCount / 2 - 1; i >= 0; i--)
+  {
+    siftDown(i);
+  }
+  halExitCritical();
+
+  printf("Clock set to %02d:%02d:%02d\n", secondsOfDay / 3600, (secondsOfDay / 60) % 60, secondsOfDay % 60);
+  wakeScheduler();
+}
+
+bool schedulerHasClock()
+{
+  return clockValid;
+}
+
+bool schedulerAdd(int id, CommandType command, ScheduleMode mode, int time)
+{
+  if (command != CommandType::ON && command != CommandType::OFF && command != CommandType::OFF_RELEASE)
+  {
+    printf("Command %d cannot be scheduled.\n", command);
+    return false;
+  }
+
+  if (mode == SCHEDULE_IN ? time < 0 : (time < 0 || time >= SECONDS_PER_DAY))
+  {
+    printf("Invalid schedule time: %d\n", time);
+    return false;
+  }
+
+  if (mode != SCHEDULE_IN && !clockValid)
+  {
+    printf("Clock not set, cannot schedule by time of day.\n");
+    return false;
+  }
+
+  uint32_t now = uptimeSeconds();
+  ScheduleEntry entry;
+  entry.due = mode == SCHEDULE_IN ? now + time : nextOccurrence(now, time);
+  entry.time = time;
+  entry.id = id;
+  entry.command = command;
+  entry.mode = mode;
+
+  bool added = true;
+  halEnterCritical();
+  int existing = findEntry(id);
+  if (existing >= 0)
+  {
+    removeAt(existing);
+  }
+  if (entryCount < SCHEDULER_MAX_ENTRIES)
+  {
+    entries[entryCount] = entry;
+    siftUp(entryCount++);
+  }
+  else
+  {
+    added = false;
+  }
+  halExitCritical();
+
+  if (!added)
+  {
+    printf("Schedule is full.\n");
+    return false;
+  }
+
+  printf("Scheduled command %d (id %d) in %lu seconds.\n", command, id, (unsigned long)(entry.due - now));
+  wakeScheduler();
+  return true;
+}
+
+bool schedulerRemove(int id)
+{
+  halEnterCritical();
+  int index = findEntry(id);
+  if (index >= 0)
+  {
+    removeAt(index);
+  }
+  halExitCritical();
+
+  if (index < 0)
+  {
+    return false;
+  }
+  wakeScheduler();
+  return true;
+}
+
+int schedulerCount()
+{
+  return entryCount;
+}
+
+int schedulerSecondsUntilNext()
+{
+  int seconds = -1;
+  halEnterCritical();
+  if (entryCount > 0)
+  {
+    uint32_t now = uptimeSeconds();
+    seconds = entries[0].due > now ? entries[0].due - now : 0;
+  }
+  halExitCritical();
+  return seconds;
+}
+
+// An entry leaves the heap, or moves a day on, only once its command is queued.
+// If the queue is full it stays due and the next pass tries again.
+int schedulerRunDue()
+{
+  int dispatched = 0;
+  uint32_t now = uptimeSeconds();
+
+  while (true)
+  {
+    ScheduleEntry entry;
+
+    halEnterCritical();
+    bool due = entryCount > 0 && entries[0].due <= now;
+    if (due)
+    {
+      entry = entries[0];
+    }
+    halExitCritical();
+
+    if (!due)
+    {
+      break;
+    }
+
+    Message msg = commandMessage((CommandType)entry.command);
+    if (!halQueueSend(incommingMessageQueue, &msg, 100))
+    {
+      printf("Failed to enqueue scheduled command %d, retrying.\n", (int)entry.id);
+      break;
+    }
+
+    halEnterCritical();
+    // Replaced or removed while the command was being queued, leave the new one be
+    int index = findEntry(entry.id);
+    if (index >= 0 && entries[index].due == entry.due && entries[index].command == entry.command)
+    {
+      if (entry.mode == SCHEDULE_DAILY)
+      {
+        // A day ahead, or more if some were missed
+        while (entries[index].due <= now)
+        {
+          entries[index].due += SECONDS_PER_DAY;
+        }
+        resift(index);
+      }
+      else
+      {
+        removeAt(index);
+      }
+    }
+    halExitCritical();
+
+    sendScheduleTriggeredInfo(entry.id);
+    dispatched++;
+  }
+
+  return dispatched;
+}
+
+void schedulerTask(void *params)
+{
+  while (true)
+  {
+    schedulerRunDue();
+
+    // An entry left due by a full queue is retried at once, paced by the send timeout
+    int wait = schedulerSecondsUntilNext();
+
+    // Woken early whenever an entry is added/removed or the clock changes
+    halSignalWait(schedulerWake, wait < 0 ? HAL_WAIT_FOREVER : (uint32_t)wait * 1000);
+  }
+}
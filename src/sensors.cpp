@@ -1,38 +1,45 @@
 #include "sensors.h"
 #include "constants.h"
 #include "control.h"
+#include "thermal.h"
+#include "recorder.h"
+#include "history.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 
-#include "pico/stdlib.h"
-#include "hardware/adc.h"
-#include "FreeRTOS.h"
-#include "task.h"
+#include "hal.h"
 
 volatile float currentDraw = 0.0f;
 volatile float pressure = 0.0f;
 
+static float lastPressure = 0;
+static float lastCurrentDraw = 0;
+static bool isPressurized = false;
+static bool isSupplying = false; // Only so the recorder sees edges, not every falling sample
+static uint64_t lastSampleTime = 0;
+
 void initSensors(void)
 {
   // Initialize ADC
-  adc_init();
+  halAdcInit();
 
   // Assuming you use onboard ADC (GPIO 26 to 29 are ADC capable on Pico)
   // Setup GPIO for ADC usage (Check actual GPIO connection and adjust)
-  adc_gpio_init(PRESSURE_SENSOR_GPIO);
-  adc_gpio_init(CURRENT_SENSOR_GPIO);
-
-  // Configure ADC to use 12-bit resolution
-  adc_set_round_robin(1u << 0 | 1u << 1); // Enable channels 0 and 1 for round robin
-  adc_select_input(0);                    // Default to channel 0
+  halAdcInitGpio(PRESSURE_SENSOR_GPIO);
+  halAdcInitGpio(CURRENT_SENSOR_GPIO);
+
+  lastPressure = 0;
+  lastCurrentDraw = 0;
+  isPressurized = false;
+  isSupplying = false;
+  lastSampleTime = halTimeUs();
 }
 
-float readADC(uint channel)
+float readADC(unsigned int channel)
 {
-  adc_select_input(channel);
-  uint16_t raw = adc_read();
+  uint16_t raw = halAdcRead(channel);
   return (raw * 3.3f) / 4096.0f; // Convert ADC value to voltage assuming 3.3V reference
 }
 
@@ -70,64 +77,81 @@ float voltageToAmps(float voltage)
   return voltageContribution / 0.0264; // Adjusted sensitivity of 26.4mV/A, converted to V/A for the formula
 }
 
-void sensorTask(void *params)
+// Take one reading of both sensors and act on the changes
+void sensorTaskStep()
 {
-  const TickType_t xDelay = pdMS_TO_TICKS(500); // 1000 ms delay between readings
+  float voltage_pressure = readADC(PRESSURE_SENSOR_ADC_CHANNEL); // Adjust channel as needed
+  pressure = roundf(voltageToPsi(voltage_pressure) * 10.0f) / 10.0f;
 
-  static float lastPressure = 0;
-  static float lastCurrentDraw = 0;
-  bool isPressurized = false;
+  float voltage_current = readADC(CURRENT_SENSOR_ADC_CHANNEL); // Adjust channel as needed
+  currentDraw = roundf(voltageToAmps(voltage_current) * 10.0f) / 10.0f;
 
-  while (1)
+  if (currentDraw > 0 && lastCurrentDraw == 0)
   {
-    float voltage_pressure = readADC(PRESSURE_SENSOR_ADC_CHANNEL); // Adjust channel as needed
-    pressure = roundf(voltageToPsi(voltage_pressure) * 10.0f) / 10.0f;
+    recorderLog(RECORD_SENSOR, MOTOR_START, lroundf(currentDraw * 10.0f));
+    handleMotorStart();
+  }
+  else if (currentDraw == 0 && lastCurrentDraw > 0)
+  {
+    recorderLog(RECORD_SENSOR, MOTOR_STOP, lroundf(lastCurrentDraw * 10.0f));
+    handleMotorStop();
+  }
+  lastCurrentDraw = currentDraw;
 
-    float voltage_current = readADC(CURRENT_SENSOR_ADC_CHANNEL); // Adjust channel as needed
-    currentDraw = roundf(voltageToAmps(voltage_current) * 10.0f) / 10.0f;
+  uint64_t now = halTimeUs();
+  historyAddSample(now, pressure, currentDraw);
+  thermalUpdate((int)lroundf(currentDraw * 10.0f), (uint32_t)((now - lastSampleTime) / 1000));
+  lastSampleTime = now;
 
-    if (currentDraw > 0 && lastCurrentDraw == 0)
-    {
-      handleMotorStart();
-    }
-    else if (currentDraw == 0 && lastCurrentDraw > 0)
-    {
-      handleMotorStop();
-    }
-    lastCurrentDraw = currentDraw;
-
-    if (pressure != lastPressure)
-    {
-      sendPressureChangeInfo(pressure);
-    }
+  if (pressure != lastPressure)
+  {
+    sendPressureChangeInfo(pressure);
+  }
 
-    if (pressure > lastPressure)
+  if (pressure > lastPressure)
+  {
+    if (isPressurized)
     {
-      if (isPressurized)
+      if (isSupplying)
       {
-        handleSupplyStop();
+        recorderLog(RECORD_SENSOR, SUPPLY_STOP, lroundf(pressure * 10.0f));
+        isSupplying = false;
       }
+      handleSupplyStop();
     }
-    else if (lastPressure > pressure)
+  }
+  else if (lastPressure > pressure)
+  {
+    if (pressure == 0)
     {
-      if (pressure == 0)
-      {
-        isPressurized = false; // Reset pressurization status on shutdown
-      }
-      else if (isPressurized)
-      {
-        handleSupplyStart();
-      }
+      isPressurized = false; // Reset pressurization status on shutdown
+      isSupplying = false;
     }
-    else if (pressure == lastPressure && !isPressurized && pressure > 0)
+    else if (isPressurized)
     {
-      isPressurized = true; // Mark as pressurized when pressure stabilizes
+      if (!isSupplying)
+      {
+        recorderLog(RECORD_SENSOR, SUPPLY_START, lroundf(pressure * 10.0f));
+        isSupplying = true;
+      }
+      handleSupplyStart();
     }
+  }
+  else if (pressure == lastPressure && !isPressurized && pressure > 0)
+  {
+    isPressurized = true; // Mark as pressurized when pressure stabilizes
+  }
 
-    lastPressure = pressure;
+  lastPressure = pressure;
 
-    printf("Current Draw: %.2f A, Pressure: %.2f PSI\n", currentDraw, pressure);
+  printf("Current Draw: %.2f A, Pressure: %.2f PSI\n", currentDraw, pressure);
+}
 
-    vTaskDelay(xDelay); // Delay for a second
+void sensorTask(void *params)
+{
+  while (1)
+  {
+    sensorTaskStep();
+    halDelayMs(SENSOR_SAMPLE_INTERVAL_MS);
   }
 }
\ No newline at end of file
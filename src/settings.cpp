@@ -1,10 +1,8 @@
 #include "settings.h"
+#include "thermal.h"
+#include "hal.h"
 #include <stdio.h>
 #include <string.h>
-#include "pico/stdlib.h"
-#include "pico/flash.h"
-#include "hardware/flash.h"
-#include "hardware/structs/xip_ctrl.h"
 
 // Global settings variable
 volatile Settings currentSettings = {
@@ -15,48 +13,21 @@ volatile Settings currentSettings = {
     .supplyTimeout = 5,
     .motorTimeout = 2,
     .magic = SETTINGS_MAGIC,
+    .motorTemperatureLimit = THERMAL_DEFAULT_LIMIT_C,
+    .serverAddress = 0,
+    .serverPort = 0,
 };
 
 // Queue handle
-QueueHandle_t settingsQueue = NULL;
-
-// Utility: Invalidate XIP Cache
-static void invalidateXipCache()
-{
-  xip_ctrl_hw->flush = 1;
-  while (!(xip_ctrl_hw->stat & XIP_STAT_FLUSH_READY_BITS))
-  {
-    tight_loop_contents();
-  }
-  printf("XIP cache invalidated.\n");
-}
-
-// Flash erase helper
-static void callFlashRangeErase(void *param)
-{
-  uint32_t offset = (uint32_t)param;
-  flash_range_erase(offset, FLASH_SECTOR_SIZE);
-}
-
-// Flash program helper
-static void callFlashRangeProgram(void *param)
-{
-  uint32_t offset = ((uintptr_t *)param)[0];
-  const uint8_t *data = (const uint8_t *)((uintptr_t *)param)[1];
-  flash_range_program(offset, data, FLASH_SECTOR_SIZE);
-}
+HalQueueHandle settingsQueue = NULL;
 
 // Load settings from flash
 bool loadSettingsFromFlash(Settings *settings)
 {
-  const uint8_t *flashMemory = (const uint8_t *)(XIP_BASE + FLASH_TARGET_OFFSET);
-  const Settings *flashSettings = (const Settings *)flashMemory;
-
   printf("Reading settings from flash...\n");
 
-  if (flashSettings->magic == SETTINGS_MAGIC)
+  if (halStorageRead(settings, sizeof(Settings)) && settings->magic == SETTINGS_MAGIC)
   {
-    memcpy(settings, flashSettings, sizeof(Settings));
     printf("Loaded settings: SSID='%s', Auth Mode=%d\n", settings->ssid, settings->authMode);
     return true;
   }
@@ -70,34 +41,7 @@ void saveSettingsToFlash(const Settings *settings)
 {
   printf("Saving settings to flash: SSID='%s', Auth Mode=%d\n", settings->ssid, settings->authMode);
 
-  // Prepare buffer for writing
-  uint8_t buffer[sizeof(Settings)];
-  memcpy(buffer, settings, sizeof(Settings));
-
-  // Safely erase flash
-  int rc = flash_safe_execute(callFlashRangeErase, (void *)FLASH_TARGET_OFFSET, UINT32_MAX);
-  if (rc != PICO_OK)
-  {
-    printf("Error erasing flash sector: %d\n", rc);
-    return;
-  }
-
-  printf("Flash sector erased successfully.\n");
-
-  // Safely write to flash
-  uintptr_t params[] = {FLASH_TARGET_OFFSET, (uintptr_t)buffer};
-  rc = flash_safe_execute(callFlashRangeProgram, params, UINT32_MAX);
-  if (rc != PICO_OK)
-  {
-    printf("Error programming flash: %d\n", rc);
-    return;
-  }
-
-  printf("Settings saved successfully. Verifying...\n");
-
-  // Verify the written data
-  const uint8_t *flashMemory = (const uint8_t *)(XIP_BASE + FLASH_TARGET_OFFSET);
-  if (memcmp(buffer, flashMemory, sizeof(Settings)) == 0)
+  if (halStorageWrite(settings, sizeof(Settings)))
   {
     printf("Settings verification successful.\n");
   }
@@ -107,8 +51,8 @@ void saveSettingsToFlash(const Settings *settings)
   }
 }
 
-// Reset settings in flash
-void resetSettings()
+// Reset settings in flash, returning what was written
+void resetSettings(Settings *settings)
 {
   printf("Resetting settings in flash...\n");
 
@@ -121,9 +65,13 @@ void resetSettings()
       .supplyTimeout = currentSettings.supplyTimeout,           // DO NOT RESET
       .motorTimeout = currentSettings.motorTimeout,             // DO NOT RESET
       .magic = SETTINGS_MAGIC,
+      .motorTemperatureLimit = currentSettings.motorTemperatureLimit, // DO NOT RESET
+      .serverAddress = 0,
+      .serverPort = 0,
   };
 
   saveSettingsToFlash(&defaultSettings);
+  memcpy(settings, &defaultSettings, sizeof(Settings));
 }
 
 // Initialize settings
@@ -142,10 +90,22 @@ void initSettings()
     currentSettings.magic = SETTINGS_MAGIC;
   }
 
+  // Settings saved before the limit existed read back as erased flash
+  if (currentSettings.motorTemperatureLimit <= THERMAL_AMBIENT_C || currentSettings.motorTemperatureLimit > 200)
+  {
+    currentSettings.motorTemperatureLimit = THERMAL_DEFAULT_LIMIT_C;
+  }
+  // And so does the discovered server, in settings saved before discovery
+  if (currentSettings.serverPort == 0xFFFF || currentSettings.serverAddress == 0xFFFFFFFF)
+  {
+    currentSettings.serverAddress = 0;
+    currentSettings.serverPort = 0;
+  }
+
   printf("Current settings: SSID='%s', Auth Mode=%d\n", currentSettings.ssid, currentSettings.authMode);
 
   // Create the settings queue
-  settingsQueue = xQueueCreate(5, sizeof(SettingsCommand));
+  settingsQueue = halQueueCreate(5, sizeof(SettingsCommand));
   if (settingsQueue == NULL)
   {
     printf("Failed to create settings queue.\n");
@@ -161,7 +121,7 @@ void requestSettingsValidation()
 
   memcpy((Settings *)&command.data, (Settings *)&currentSettings, sizeof(Settings));
 
-  if (xQueueSend(settingsQueue, &command, portMAX_DELAY) != pdPASS)
+  if (!halQueueSend(settingsQueue, &command, HAL_WAIT_FOREVER))
   {
     printf("Settings validation request failed (queue full).\n");
   }
@@ -173,34 +133,43 @@ void requestSettingsReset()
   SettingsCommand command = {
       .type = SETTINGS_RESET,
   };
-  if (xQueueSend(settingsQueue, &command, portMAX_DELAY) != pdPASS)
+  if (!halQueueSend(settingsQueue, &command, HAL_WAIT_FOREVER))
   {
     printf("Settings reset request failed (queue full).\n");
   }
 }
 
-// Settings task
-void settingsTask(void *params)
+// Apply one queued settings command
+bool settingsTaskStep(uint32_t timeoutMs)
 {
   SettingsCommand command;
 
+  if (!halQueueReceive(settingsQueue, &command, timeoutMs))
+  {
+    return false;
+  }
+
+  if (command.type == SETTINGS_UPDATE)
+  {
+    printf("Processing settings update.\n");
+    saveSettingsToFlash(&command.data);
+    memcpy((Settings *)&currentSettings, &command.data, sizeof(Settings));
+  }
+  else if (command.type == SETTINGS_RESET)
+  {
+    printf("Processing settings reset.\n");
+    Settings defaultSettings;
+    resetSettings(&defaultSettings);
+    memcpy((Settings *)&currentSettings, &defaultSettings, sizeof(Settings));
+  }
+  return true;
+}
+
+// Settings task
+void settingsTask(void *params)
+{
   while (1)
   {
-    if (xQueueReceive(settingsQueue, &command, portMAX_DELAY))
-    {
-      if (command.type == SETTINGS_UPDATE)
-      {
-        printf("Processing settings update.\n");
-        saveSettingsToFlash(&command.data);
-        memcpy((Settings *)&currentSettings, &command.data, sizeof(Settings));
-      }
-      else if (command.type == SETTINGS_RESET)
-      {
-        printf("Processing settings reset.\n");
-        resetSettings();
-        memset((Settings *)&currentSettings, 0, sizeof(Settings));
-        currentSettings.magic = SETTINGS_MAGIC;
-      }
-    }
+    settingsTaskStep(HAL_WAIT_FOREVER);
   }
 }
@@ -0,0 +1,99 @@
+#include "stats.h"
+
+#include "clientqueue.h"
+#include "outbox.h"
+#include "reconnect.h"
+#include "tlsstats.h"
+
+#include "cJSON.h"
+
+static volatile bool reportRequested = false;
+
+void statsRequestReport()
+{
+  reportRequested = true;
+}
+
+bool statsTakeReportRequest()
+{
+  if (!reportRequested)
+  {
+    return false;
+  }
+  reportRequested = false;
+  return true;
+}
+
+std::string statsReportToString()
+{
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddStringToObject(json, "messageType", "STATS");
+
+  OutboxStats outboxStats;
+  outboxGetStats(&outboxStats);
+  cJSON *outbox = cJSON_AddObjectToObject(json, "outbox");
+  cJSON_AddNumberToObject(outbox, "flushes", outboxStats.flushes);
+  cJSON_AddNumberToObject(outbox, "messages", outboxStats.messages);
+  cJSON_AddNumberToObject(outbox, "bytes", (double)outboxStats.bytes);
+  cJSON_AddNumberToObject(outbox, "largestBatch", outboxStats.largestBatch);
+  cJSON_AddNumberToObject(outbox, "failures", outboxStats.failures);
+  cJSON_AddNumberToObject(outbox, "rejected", outboxStats.rejected);
+
+  ReconnectStats reconnectStats;
+  reconnectGetStats(&reconnectStats);
+  cJSON *connection = cJSON_AddObjectToObject(json, "connection");
+  cJSON_AddNumberToObject(connection, "disconnects", reconnectStats.disconnects);
+  cJSON_AddNumberToObject(connection, "reconnects", reconnectStats.reconnects);
+  cJSON_AddNumberToObject(connection, "heartbeatTimeouts", reconnectStats.heartbeatTimeouts);
+  cJSON_AddNumberToObject(connection, "lastReconnectMs", reconnectStats.lastReconnectMs);
+  cJSON_AddNumberToObject(connection, "maxReconnectMs", reconnectStats.maxReconnectMs);
+  cJSON_AddNumberToObject(connection, "meanReconnectMs",
+                          reconnectStats.reconnects > 0 ? (double)(reconnectStats.totalReconnectMs / reconnectStats.reconnects) : 0);
+
+  // Control server clients by slot, a closed slot keeps its last client's counts
+  ClientQueueStats clientStats[CLIENT_QUEUE_SLOTS];
+  clientQueueGetStats(clientStats);
+  cJSON *clients = cJSON_AddArrayToObject(json, "clients");
+  for (int slot = 0; slot < CLIENT_QUEUE_SLOTS; slot++)
+  {
+    cJSON *client = cJSON_CreateObject();
+    cJSON_AddBoolToObject(client, "connected", clientStats[slot].connected);
+    cJSON_AddNumberToObject(client, "depth", clientStats[slot].depth);
+    cJSON_AddNumberToObject(client, "highWater", clientStats[slot].highWater);
+    cJSON_AddNumberToObject(client, "sent", clientStats[slot].sent);
+    cJSON_AddNumberToObject(client, "dropped", clientStats[slot].dropped);
+    cJSON_AddItemToArray(clients, client);
+  }
+
+  // Zero throughout unless SOCKET_TLS is set
+  TlsStats tlsStats;
+  tlsGetStats(&tlsStats);
+  cJSON *tls = cJSON_AddObjectToObject(json, "tls");
+  cJSON_AddNumberToObject(tls, "handshakes", tlsStats.fullHandshakes);
+  cJSON_AddNumberToObject(tls, "resumed", tlsStats.resumedHandshakes);
+  cJSON_AddNumberToObject(tls, "failed", tlsStats.failedHandshakes);
+  cJSON_AddNumberToObject(tls, "lastHandshakeMs", tlsStats.lastHandshakeMs);
+  cJSON_AddNumberToObject(tls, "meanFullMs",
+                          tlsStats.fullHandshakes > 0 ? (double)(tlsStats.totalFullMs / tlsStats.fullHandshakes) : 0);
+  cJSON_AddNumberToObject(tls, "maxFullMs", tlsStats.maxFullMs);
+  cJSON_AddNumberToObject(tls, "meanResumedMs",
+                          tlsStats.resumedHandshakes > 0 ? (double)(tlsStats.totalResumedMs / tlsStats.resumedHandshakes) : 0);
+  cJSON_AddNumberToObject(tls, "heapNow", tlsStats.heapNow);
+  cJSON_AddNumberToObject(tls, "heapPeak", tlsStats.heapPeak);
+  cJSON_AddNumberToObject(tls, "writes", tlsStats.writes);
+  cJSON_AddNumberToObject(tls, "overheadPerWrite",
+                          tlsStats.writes > 0 ? (double)((tlsStats.wireBytes - tlsStats.plainBytes) / tlsStats.writes) : 0);
+
+  char *jsonString = cJSON_PrintUnformatted(json);
+  std::string result(jsonString);
+  cJSON_free(jsonString);
+  cJSON_Delete(json);
+  return result;
+}
+
+void statsReset()
+{
+  outboxResetStats();
+  reconnectResetStats();
+  tlsResetStats();
+}
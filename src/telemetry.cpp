@@ -0,0 +1,147 @@
+#include "telemetry.h"
+
+#include <string.h>
+
+static void writeShort(uint8_t *data, uint16_t value)
+{
+  data[0] = (uint8_t)(value >> 8);
+  data[1] = (uint8_t)value;
+}
+
+static void writeLong(uint8_t *data, uint32_t value)
+{
+  writeShort(data, (uint16_t)(value >> 16));
+  writeShort(data + 2, (uint16_t)value);
+}
+
+static uint16_t readShort(const uint8_t *data)
+{
+  return (uint16_t)(data[0] << 8 | data[1]);
+}
+
+static uint32_t readLong(const uint8_t *data)
+{
+  return (uint32_t)readShort(data) << 16 | readShort(data + 2);
+}
+
+static size_t blockLength(uint8_t channels, uint16_t samplesPerChannel)
+{
+  return TELEMETRY_HEADER + (size_t)channels * samplesPerChannel * 2;
+}
+
+bool telemetryBlockInit(TelemetryBlock &block, uint8_t channels, uint16_t samplesPerChannel, uint32_t intervalUs)
+{
+  memset(&block, 0, sizeof(block));
+  if (channels == 0 || samplesPerChannel == 0 || blockLength(channels, samplesPerChannel) > TELEMETRY_MAX_PACKET)
+  {
+    return false;
+  }
+  block.channels = channels;
+  block.samplesPerChannel = samplesPerChannel;
+  block.intervalUs = intervalUs;
+  return true;
+}
+
+bool telemetryBlockAdd(TelemetryBlock &block, const uint16_t *values, uint64_t timeUs)
+{
+  if (block.count == 0)
+  {
+    block.firstUs = timeUs;
+    block.length = 0;
+  }
+  // Straight into place, the packet is only finished off once full
+  for (uint8_t channel = 0; channel < block.channels; channel++)
+  {
+    writeShort(block.packet + TELEMETRY_HEADER + ((size_t)channel * block.samplesPerChannel + block.count) * 2,
+               values[channel]);
+  }
+  if (++block.count < block.samplesPerChannel)
+  {
+    return false;
+  }
+
+  uint8_t *header = block.packet;
+  header[0] = TELEMETRY_MAGIC_0;
+  header[1] = TELEMETRY_MAGIC_1;
+  header[2] = TELEMETRY_VERSION;
+  header[3] = block.channels;
+  writeShort(header + 4, block.samplesPerChannel);
+  writeLong(header + 6, block.sequence);
+  writeLong(header + 10, (uint32_t)(block.firstUs >> 32));
+  writeLong(header + 14, (uint32_t)block.firstUs);
+  writeLong(header + 18, block.intervalUs);
+  block.length = blockLength(block.channels, block.samplesPerChannel);
+
+  block.sequence++;
+  block.count = 0;
+  return true;
+}
+
+bool telemetryParseBlock(const uint8_t *packet, size_t length, TelemetryBlockView &view)
+{
+  if (length < TELEMETRY_HEADER || packet[0] != TELEMETRY_MAGIC_0 || packet[1] != TELEMETRY_MAGIC_1 ||
+      packet[2] != TELEMETRY_VERSION)
+  {
+    return false;
+  }
+  view.channels = packet[3];
+  view.samplesPerChannel = readShort(packet + 4);
+  if (view.channels == 0 || view.samplesPerChannel == 0 ||
+      length != blockLength(view.channels, view.samplesPerChannel))
+  {
+    return false;
+  }
+  view.sequence = readLong(packet + 6);
+  view.firstUs = (uint64_t)readLong(packet + 10) << 32 | readLong(packet + 14);
+  view.intervalUs = readLong(packet + 18);
+  view.samples = packet + TELEMETRY_HEADER;
+  return true;
+}
+
+uint16_t telemetrySample(const TelemetryBlockView &view, uint8_t channel, uint16_t index)
+{
+  return readShort(view.samples + ((size_t)channel * view.samplesPerChannel + index) * 2);
+}
+
+void telemetryLossInit(TelemetryLossCounter &counter)
+{
+  memset(&counter, 0, sizeof(counter));
+}
+
+// Serial arithmetic, so the count carries on across the sequence wrapping
+void telemetryLossRecord(TelemetryLossCounter &counter, uint32_t sequence)
+{
+  counter.received++;
+  if (!counter.started)
+  {
+    counter.started = true;
+    counter.expected = sequence + 1;
+    return;
+  }
+  int32_t ahead = (int32_t)(sequence - counter.expected);
+  if (ahead >= 0)
+  {
+    // Bit 0 becomes this block, the ones after it those it skipped
+    uint32_t shift = (uint32_t)ahead + 1;
+    counter.missing = shift >= 32 ? 0 : counter.missing << shift;
+    for (uint32_t bit = 1; bit <= (uint32_t)ahead && bit < 32; bit++)
+    {
+      counter.missing |= 1u << bit;
+    }
+    counter.lost += (uint32_t)ahead;
+    counter.expected = sequence + 1;
+    return;
+  }
+
+  uint32_t behind = counter.expected - 1 - sequence;
+  if (behind < 32 && (counter.missing & (1u << behind)))
+  {
+    counter.missing &= ~(1u << behind);
+    counter.lost--;
+    counter.late++;
+  }
+  else
+  {
+    counter.duplicates++; // Or too old to tell apart from one
+  }
+}
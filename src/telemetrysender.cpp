@@ -0,0 +1,96 @@
+#include "telemetrysender.h"
+#include "telemetry.h"
+#include "constants.h"
+#include "hal.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "lwip/sockets.h"
+
+static_assert(TELEMETRY_SAMPLE_RATE_HZ <= configTICK_RATE_HZ && configTICK_RATE_HZ % TELEMETRY_SAMPLE_RATE_HZ == 0,
+              "Telemetry is sampled on tick boundaries");
+static_assert(TELEMETRY_HEADER + TELEMETRY_CHANNELS * TELEMETRY_BLOCK_SAMPLES * 2 <= TELEMETRY_MAX_PACKET,
+              "A telemetry block must fit in one datagram");
+
+static TelemetryStats stats;
+static TelemetryBlock block;
+static bool started = false;
+
+static void count(uint32_t &counter)
+{
+  halEnterCritical();
+  counter++;
+  halExitCritical();
+}
+
+static void telemetryTask(void *params)
+{
+  int sock = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock < 0)
+  {
+    printf("Telemetry: failed to create socket\n");
+    vTaskDelete(NULL);
+    return;
+  }
+  struct sockaddr_in group;
+  memset(&group, 0, sizeof(group));
+  group.sin_family = AF_INET;
+  group.sin_port = htons(TELEMETRY_PORT);
+  inet_aton(TELEMETRY_GROUP, &group.sin_addr);
+
+  telemetryBlockInit(block, TELEMETRY_CHANNELS, TELEMETRY_BLOCK_SAMPLES, 1000000 / TELEMETRY_SAMPLE_RATE_HZ);
+  const TickType_t period = configTICK_RATE_HZ / TELEMETRY_SAMPLE_RATE_HZ;
+  TickType_t wake = xTaskGetTickCount();
+
+  while (true)
+  {
+    // Returns at once when a period was missed, the block timestamps stay nominal
+    if (xTaskDelayUntil(&wake, period) == pdFALSE)
+    {
+      count(stats.overrun);
+    }
+    uint16_t values[TELEMETRY_CHANNELS] = {
+        halAdcRead(PRESSURE_SENSOR_ADC_CHANNEL),
+        halAdcRead(CURRENT_SENSOR_ADC_CHANNEL),
+    };
+    if (!telemetryBlockAdd(block, values, halTimeUs()))
+    {
+      continue;
+    }
+    if (lwip_sendto(sock, block.packet, block.length, 0, (struct sockaddr *)&group, sizeof(group)) < 0)
+    {
+      count(stats.failed);
+    }
+    else
+    {
+      count(stats.sent);
+    }
+  }
+}
+
+void startTelemetryStream()
+{
+  if (started)
+  {
+    return;
+  }
+  // Above the sensor task, a late sample is worse than a late pressure update
+  if (xTaskCreate(telemetryTask, "TelemetryTask", 512, NULL, tskIDLE_PRIORITY + 2, NULL) != pdPASS)
+  {
+    printf("Failed to create telemetry task.\n");
+    return;
+  }
+  started = true;
+  printf("Telemetry: %d Hz to %s:%d\n", TELEMETRY_SAMPLE_RATE_HZ, TELEMETRY_GROUP, TELEMETRY_PORT);
+}
+
+void telemetryGetStats(TelemetryStats *out)
+{
+  halEnterCritical();
+  *out = stats;
+  halExitCritical();
+}
@@ -0,0 +1,113 @@
+#include "thermal.h"
+#include "control.h"
+#include "settings.h"
+#include "recorder.h"
+#include "hal.h"
+
+#include <stdio.h>
+#include <math.h>
+
+// First-order model of the winding rise above ambient:
+//   rise += (gain * I^2 - rise) * dt / tau
+// Driving it with I^2 means the filter integrates mean-square current, so the
+// estimate follows RMS heating. Everything per sample is integer arithmetic;
+// the rise is kept in micro-degrees so small steps do not stall the filter.
+
+// Steady-state rise per deci-amp squared, in micro-degrees
+static const int32_t riseGain = (int32_t)((int64_t)THERMAL_RATED_RISE_C * 1000000 / ((int64_t)THERMAL_RATED_CURRENT_DA * THERMAL_RATED_CURRENT_DA));
+
+// dt / tau per millisecond, Q32
+static const uint32_t alphaPerMs = (uint32_t)((1ULL << 32) / ((uint64_t)THERMAL_TIME_CONSTANT_S * 1000));
+
+volatile static int32_t riseMicroC = 0;
+volatile static bool overheated = false;
+static int32_t lastReportedMilliC = 0;
+
+static int32_t limitMilliC()
+{
+  return currentSettings.motorTemperatureLimit * 1000;
+}
+
+static int32_t restartMilliC()
+{
+  return limitMilliC() - THERMAL_RESTART_HYSTERESIS_C * 1000;
+}
+
+static int32_t temperatureMilliC()
+{
+  return THERMAL_AMBIENT_C * 1000 + riseMicroC / 1000;
+}
+
+void initThermal()
+{
+  riseMicroC = 0;
+  overheated = false;
+  lastReportedMilliC = temperatureMilliC();
+}
+
+void thermalUpdate(int currentDeciAmps, uint32_t elapsedMs)
+{
+  if (elapsedMs > THERMAL_TIME_CONSTANT_S * 1000)
+  {
+    elapsedMs = THERMAL_TIME_CONSTANT_S * 1000;
+  }
+
+  // Q16 fraction of the gap to close this step
+  int64_t alpha = ((uint64_t)elapsedMs * alphaPerMs) >> 16;
+  int64_t target = (int64_t)currentDeciAmps * currentDeciAmps * riseGain;
+  riseMicroC = riseMicroC + (int32_t)(((target - riseMicroC) * alpha) >> 16);
+
+  int32_t temperature = temperatureMilliC();
+
+  if (!overheated && temperature >= limitMilliC())
+  {
+    overheated = true;
+    printf("Motor overheated (%ld mC), stopping compressor.\n", (long)temperature);
+    recorderLog(RECORD_SENSOR, MOTOR_OVERHEAT, temperature / 100);
+    sendMotorOverheatInfo(temperature / 1000.0f);
+
+    Message msg = commandMessage(CommandType::OFF);
+    if (!halQueueSend(incommingMessageQueue, &msg, 100))
+    {
+      printf("Failed to enqueue overheat shutdown.\n");
+    }
+  }
+  else if (overheated && temperature <= restartMilliC())
+  {
+    overheated = false;
+    printf("Motor cooled down (%ld mC).\n", (long)temperature);
+  }
+
+  if (temperature - lastReportedMilliC >= THERMAL_REPORT_STEP_MC || lastReportedMilliC - temperature >= THERMAL_REPORT_STEP_MC)
+  {
+    lastReportedMilliC = temperature;
+    sendMotorTemperatureInfo(temperature / 1000.0f);
+  }
+}
+
+int thermalSecondsUntilStartAllowed()
+{
+  int32_t restartRise = restartMilliC() - THERMAL_AMBIENT_C * 1000;
+  int32_t rise = riseMicroC / 1000;
+
+  if (!overheated && rise <= restartRise)
+  {
+    return 0;
+  }
+  if (restartRise <= 0)
+  {
+    // Limit is at or below ambient, never cools enough; retry after a few time constants
+    return THERMAL_TIME_CONSTANT_S * 5;
+  }
+
+  // Motor off: rise decays as e^(-t/tau); only evaluated when a start is refused
+  float seconds = THERMAL_TIME_CONSTANT_S * logf((float)rise / (float)restartRise);
+  return seconds < 1.0f ? 1 : (int)ceilf(seconds);
+}
+
+void thermalGetState(ThermalState *state)
+{
+  state->temperatureMilliC = temperatureMilliC();
+  state->limitMilliC = limitMilliC();
+  state->overheated = overheated;
+}
@@ -0,0 +1,332 @@
+#include "tlsclient.h"
+#include "tlsstats.h"
+#include "constants.h"
+#include "hal.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+#include "lwip/sockets.h"
+
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/error.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/platform.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+
+static const char caPem[] = SOCKET_TLS_CA_PEM;
+
+static mbedtls_entropy_context entropy;
+static mbedtls_ctr_drbg_context drbg;
+static mbedtls_x509_crt ca;
+static mbedtls_ssl_config config;
+static mbedtls_ssl_context ssl;
+static mbedtls_ssl_session saved;
+static bool haveSaved = false;
+static bool configured = false;
+static bool active = false;
+
+static SemaphoreHandle_t lock = NULL;
+static int tlsSocket = -1;
+static size_t wireSent = 0;          // Bytes handed to lwIP, for the record overhead
+static bool certificateSeen = false; // Only a full handshake carries one
+
+static void printError(const char *what, int ret)
+{
+  char text[96];
+  mbedtls_strerror(ret, text, sizeof(text));
+  printf("TLS: %s failed: -0x%04x %s\n", what, (unsigned int)-ret, text);
+}
+
+static int bioSend(void *context, const unsigned char *data, size_t length)
+{
+  int sent = lwip_send(tlsSocket, data, length, 0);
+  if (sent < 0)
+  {
+    return errno == EWOULDBLOCK || errno == EAGAIN ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_SEND_FAILED;
+  }
+  wireSent += (size_t)sent;
+  return sent;
+}
+
+// Never blocks, waiting for data happens outside the session lock
+static int bioRecv(void *context, unsigned char *buffer, size_t length)
+{
+  int received = lwip_recv(tlsSocket, buffer, length, MSG_DONTWAIT);
+  if (received < 0)
+  {
+    return errno == EWOULDBLOCK || errno == EAGAIN ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_RECV_FAILED;
+  }
+  return received;
+}
+
+static int verifyCertificate(void *context, mbedtls_x509_crt *certificate, int depth, uint32_t *flags)
+{
+  certificateSeen = true;
+  return 0;
+}
+
+// True once the socket has data or was closed, false after timeoutMs
+static bool waitReadable(uint32_t timeoutMs)
+{
+  fd_set readable;
+  FD_ZERO(&readable);
+  FD_SET(tlsSocket, &readable);
+  struct timeval timeout = {(long)(timeoutMs / 1000), (long)(timeoutMs % 1000) * 1000};
+  return lwip_select(tlsSocket + 1, &readable, NULL, NULL, timeoutMs == HAL_WAIT_FOREVER ? NULL : &timeout) > 0;
+}
+
+// Undoes a configure() that failed part-way, so the next attempt starts clean
+static void freeConfiguration()
+{
+  mbedtls_ssl_session_free(&saved);
+  mbedtls_ssl_config_free(&config);
+  mbedtls_x509_crt_free(&ca);
+  mbedtls_ctr_drbg_free(&drbg);
+  mbedtls_entropy_free(&entropy);
+}
+
+static bool configure()
+{
+  if (configured)
+  {
+    return true;
+  }
+  if (sizeof(caPem) <= 1 && !SOCKET_TLS_INSECURE)
+  {
+    printf("TLS: no CA configured, set SOCKET_TLS_CA_PEM or SOCKET_TLS_INSECURE\n");
+    return false;
+  }
+  mbedtls_platform_set_calloc_free(tlsCalloc, tlsFree);
+  if (lock == NULL)
+  {
+    lock = xSemaphoreCreateMutex();
+    if (lock == NULL)
+    {
+      printf("TLS: failed to create lock.\n");
+      return false;
+    }
+  }
+
+  mbedtls_entropy_init(&entropy);
+  mbedtls_ctr_drbg_init(&drbg);
+  mbedtls_x509_crt_init(&ca);
+  mbedtls_ssl_config_init(&config);
+  mbedtls_ssl_session_init(&saved);
+
+  static const char personal[] = "compressor-control";
+  int ret = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy, (const unsigned char *)personal,
+                                  sizeof(personal) - 1);
+  if (ret != 0)
+  {
+    printError("seeding the generator", ret);
+    freeConfiguration();
+    return false;
+  }
+
+  ret = mbedtls_ssl_config_defaults(&config, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT);
+  if (ret != 0)
+  {
+    printError("configuring", ret);
+    freeConfiguration();
+    return false;
+  }
+  // Optional checks still parse the certificate, which is how a full handshake is told from a resumed one
+  if (sizeof(caPem) > 1)
+  {
+    ret = mbedtls_x509_crt_parse(&ca, (const unsigned char *)caPem, sizeof(caPem));
+    if (ret != 0)
+    {
+      printError("parsing the CA certificate", ret);
+      freeConfiguration();
+      return false;
+    }
+    mbedtls_ssl_conf_authmode(&config, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&config, &ca, NULL);
+  }
+  else
+  {
+    printf("TLS: SOCKET_TLS_INSECURE, the server certificate is not checked\n");
+    mbedtls_ssl_conf_authmode(&config, MBEDTLS_SSL_VERIFY_OPTIONAL);
+  }
+  mbedtls_ssl_conf_verify(&config, verifyCertificate, NULL);
+  mbedtls_ssl_conf_rng(&config, mbedtls_ctr_drbg_random, &drbg);
+  mbedtls_ssl_conf_session_tickets(&config, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+
+  configured = true;
+  return true;
+}
+
+bool tlsConnect(int socket)
+{
+  if (!configure())
+  {
+    return false;
+  }
+  tlsSocket = socket;
+  mbedtls_ssl_init(&ssl);
+  active = true;
+  int ret = mbedtls_ssl_setup(&ssl, &config);
+  if (ret == 0)
+  {
+    ret = mbedtls_ssl_set_hostname(&ssl, SOCKET_TLS_SERVER_NAME);
+  }
+  if (ret != 0)
+  {
+    printError("setting up the connection", ret);
+    tlsClose();
+    return false;
+  }
+  mbedtls_ssl_set_bio(&ssl, NULL, bioSend, bioRecv, NULL);
+  bool offered = haveSaved && mbedtls_ssl_set_session(&ssl, &saved) == 0;
+
+  uint64_t startUs = halTimeUs();
+  certificateSeen = false;
+  while ((ret = mbedtls_ssl_handshake(&ssl)) != 0)
+  {
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ && waitReadable(SOCKET_TLS_HANDSHAKE_TIMEOUT_MS))
+    {
+      continue;
+    }
+    if (ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+      continue;
+    }
+    break;
+  }
+  uint32_t elapsedUs = (uint32_t)(halTimeUs() - startUs);
+  if (ret != 0)
+  {
+    printError("handshake", ret);
+    tlsRecordHandshake(elapsedUs, false, false);
+    // The server may have forgotten the session, start the next one afresh
+    mbedtls_ssl_session_free(&saved);
+    mbedtls_ssl_session_init(&saved);
+    haveSaved = false;
+    tlsClose();
+    return false;
+  }
+
+  bool resumed = offered && !certificateSeen;
+  tlsRecordHandshake(elapsedUs, resumed, true);
+  printf("TLS: %s handshake in %lu ms, %s\n", resumed ? "resumed" : "full", (unsigned long)(elapsedUs / 1000),
+         mbedtls_ssl_get_ciphersuite(&ssl));
+
+  mbedtls_ssl_session_free(&saved);
+  mbedtls_ssl_session_init(&saved);
+  haveSaved = mbedtls_ssl_get_session(&ssl, &saved) == 0;
+  return true;
+}
+
+int tlsSend(const void *data, size_t length)
+{
+  const unsigned char *next = (const unsigned char *)data;
+  size_t left = length;
+  xSemaphoreTake(lock, portMAX_DELAY);
+  size_t wireBefore = wireSent;
+  uint64_t startUs = halTimeUs();
+  while (left > 0)
+  {
+    int ret = mbedtls_ssl_write(&ssl, next, left);
+    if (ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ)
+    {
+      // Waits without the lock, the receiver needs it to make progress
+      uint64_t waitedMs = (halTimeUs() - startUs) / 1000;
+      if (waitedMs >= (uint64_t)SOCKET_TLS_WRITE_TIMEOUT_MS)
+      {
+        xSemaphoreGive(lock);
+        printf("TLS: write timed out\n");
+        return -1;
+      }
+      xSemaphoreGive(lock);
+      if (ret == MBEDTLS_ERR_SSL_WANT_READ)
+      {
+        waitReadable(SOCKET_TLS_WRITE_TIMEOUT_MS - (uint32_t)waitedMs);
+      }
+      else
+      {
+        vTaskDelay(1);
+      }
+      xSemaphoreTake(lock, portMAX_DELAY);
+      if (!active)
+      {
+        xSemaphoreGive(lock);
+        return -1; // Closed while waiting
+      }
+      continue;
+    }
+    if (ret < 0)
+    {
+      xSemaphoreGive(lock);
+      printError("write", ret);
+      return -1;
+    }
+    next += ret;
+    left -= (size_t)ret;
+  }
+  size_t wireBytes = wireSent - wireBefore;
+  xSemaphoreGive(lock);
+  tlsRecordWrite(length, wireBytes);
+  return (int)length;
+}
+
+int tlsRecv(void *buffer, size_t length, uint32_t timeoutMs)
+{
+  while (true)
+  {
+    // Records already decrypted or buffered need no wait
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool pending = mbedtls_ssl_check_pending(&ssl) != 0;
+    xSemaphoreGive(lock);
+    if (!pending && !waitReadable(timeoutMs))
+    {
+      errno = EWOULDBLOCK;
+      return -1;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int ret = mbedtls_ssl_read(&ssl, (unsigned char *)buffer, length);
+    xSemaphoreGive(lock);
+    if (ret > 0)
+    {
+      return ret;
+    }
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+      continue; // Part of a record, or a record with nothing for us
+    }
+#ifdef MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET
+    if (ret == MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET)
+    {
+      continue;
+    }
+#endif
+    if (ret == 0 || ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY || ret == MBEDTLS_ERR_SSL_CONN_EOF)
+    {
+      return 0;
+    }
+    printError("read", ret);
+    return -1;
+  }
+}
+
+void tlsClose()
+{
+  if (!active)
+  {
+    return;
+  }
+  xSemaphoreTake(lock, portMAX_DELAY);
+  mbedtls_ssl_close_notify(&ssl);
+  mbedtls_ssl_free(&ssl);
+  active = false;
+  tlsSocket = -1;
+  xSemaphoreGive(lock);
+}
@@ -0,0 +1,107 @@
+#include "tlsstats.h"
+#include "hal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static TlsStats stats;
+
+// Each block starts with its size so a free can be counted, padded to keep
+// the caller's part aligned for anything
+typedef union
+{
+  size_t size;
+  max_align_t align;
+} AllocationHeader;
+
+void tlsRecordHandshake(uint32_t elapsedUs, bool resumed, bool succeeded)
+{
+  uint32_t elapsedMs = elapsedUs / 1000;
+
+  halEnterCritical();
+  if (!succeeded)
+  {
+    stats.failedHandshakes++;
+  }
+  else if (resumed)
+  {
+    stats.resumedHandshakes++;
+    stats.totalResumedMs += elapsedMs;
+    stats.lastHandshakeMs = elapsedMs;
+  }
+  else
+  {
+    stats.fullHandshakes++;
+    stats.totalFullMs += elapsedMs;
+    stats.lastHandshakeMs = elapsedMs;
+    if (elapsedMs > stats.maxFullMs)
+    {
+      stats.maxFullMs = elapsedMs;
+    }
+  }
+  halExitCritical();
+}
+
+void tlsRecordWrite(size_t plainBytes, size_t wireBytes)
+{
+  halEnterCritical();
+  stats.writes++;
+  stats.plainBytes += plainBytes;
+  stats.wireBytes += wireBytes;
+  halExitCritical();
+}
+
+void *tlsCalloc(size_t count, size_t size)
+{
+  if (size != 0 && count > (SIZE_MAX - sizeof(AllocationHeader)) / size)
+  {
+    return NULL;
+  }
+  size_t bytes = count * size;
+  AllocationHeader *header = (AllocationHeader *)calloc(1, sizeof(AllocationHeader) + bytes);
+  if (header == NULL)
+  {
+    return NULL;
+  }
+  header->size = bytes;
+
+  halEnterCritical();
+  stats.heapNow += (uint32_t)bytes;
+  if (stats.heapNow > stats.heapPeak)
+  {
+    stats.heapPeak = stats.heapNow;
+  }
+  halExitCritical();
+  return header + 1;
+}
+
+void tlsFree(void *pointer)
+{
+  if (pointer == NULL)
+  {
+    return;
+  }
+  AllocationHeader *header = (AllocationHeader *)pointer - 1;
+
+  halEnterCritical();
+  stats.heapNow -= (uint32_t)header->size;
+  halExitCritical();
+  free(header);
+}
+
+void tlsGetStats(TlsStats *out)
+{
+  halEnterCritical();
+  *out = stats;
+  halExitCritical();
+}
+
+void tlsResetStats()
+{
+  halEnterCritical();
+  uint32_t heapNow = stats.heapNow;
+  memset(&stats, 0, sizeof(stats));
+  stats.heapNow = heapNow;
+  stats.heapPeak = heapNow;
+  halExitCritical();
+}
@@ -0,0 +1,364 @@
+#include "websocket.h"
+
+#include <string.h>
+
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+// SHA-1 (FIPS 180-4), only ever run over the key and the GUID, about 60 bytes
+typedef struct
+{
+  uint32_t state[5];
+  uint64_t length;
+  uint8_t block[64];
+  size_t blockBytes;
+} Sha1;
+
+static uint32_t rotateLeft(uint32_t value, int bits)
+{
+  return (value << bits) | (value >> (32 - bits));
+}
+
+static void sha1Block(Sha1 &sha, const uint8_t *block)
+{
+  uint32_t w[80];
+  for (int i = 0; i < 16; i++)
+  {
+    w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 |
+           block[i * 4 + 3];
+  }
+  for (int i = 16; i < 80; i++)
+  {
+    w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+  }
+
+  uint32_t a = sha.state[0], b = sha.state[1], c = sha.state[2], d = sha.state[3], e = sha.state[4];
+  for (int i = 0; i < 80; i++)
+  {
+    uint32_t f, k;
+    if (i < 20)
+    {
+      f = (b & c) | (~b & d);
+      k = 0x5A827999;
+    }
+    else if (i < 40)
+    {
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1;
+    }
+    else if (i < 60)
+    {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDC;
+    }
+    else
+    {
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6;
+    }
+    uint32_t temp = rotateLeft(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = rotateLeft(b, 30);
+    b = a;
+    a = temp;
+  }
+  sha.state[0] += a;
+  sha.state[1] += b;
+  sha.state[2] += c;
+  sha.state[3] += d;
+  sha.state[4] += e;
+}
+
+static void sha1Init(Sha1 &sha)
+{
+  sha.state[0] = 0x67452301;
+  sha.state[1] = 0xEFCDAB89;
+  sha.state[2] = 0x98BADCFE;
+  sha.state[3] = 0x10325476;
+  sha.state[4] = 0xC3D2E1F0;
+  sha.length = 0;
+  sha.blockBytes = 0;
+}
+
+static void sha1Update(Sha1 &sha, const uint8_t *data, size_t length)
+{
+  sha.length += length;
+  for (size_t i = 0; i < length; i++)
+  {
+    sha.block[sha.blockBytes++] = data[i];
+    if (sha.blockBytes == sizeof(sha.block))
+    {
+      sha1Block(sha, sha.block);
+      sha.blockBytes = 0;
+    }
+  }
+}
+
+static void sha1Final(Sha1 &sha, uint8_t digest[20])
+{
+  uint64_t bits = sha.length * 8;
+  const uint8_t pad = 0x80;
+  sha1Update(sha, &pad, 1);
+  const uint8_t zero = 0;
+  while (sha.blockBytes != 56)
+  {
+    sha1Update(sha, &zero, 1);
+  }
+  uint8_t length[8];
+  for (int i = 0; i < 8; i++)
+  {
+    length[i] = (uint8_t)(bits >> (56 - i * 8));
+  }
+  sha1Update(sha, length, sizeof(length));
+  for (int i = 0; i < 20; i++)
+  {
+    digest[i] = (uint8_t)(sha.state[i / 4] >> (24 - (i % 4) * 8));
+  }
+}
+
+void websocketAcceptKey(const char *clientKey, size_t keyLength, char accept[WEBSOCKET_ACCEPT_LENGTH + 1])
+{
+  Sha1 sha;
+  sha1Init(sha);
+  sha1Update(sha, (const uint8_t *)clientKey, keyLength);
+  sha1Update(sha, (const uint8_t *)WEBSOCKET_GUID, sizeof(WEBSOCKET_GUID) - 1);
+  uint8_t digest[21];
+  sha1Final(sha, digest);
+  digest[20] = 0;
+
+  // 20 bytes are six full groups and one of two bytes, padded with one '='
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  char *out = accept;
+  for (int i = 0; i < 21; i += 3)
+  {
+    uint32_t group = (uint32_t)digest[i] << 16 | (uint32_t)digest[i + 1] << 8 | digest[i + 2];
+    *out++ = alphabet[(group >> 18) & 0x3F];
+    *out++ = alphabet[(group >> 12) & 0x3F];
+    *out++ = alphabet[(group >> 6) & 0x3F];
+    *out++ = alphabet[group & 0x3F];
+  }
+  accept[WEBSOCKET_ACCEPT_LENGTH - 1] = '=';
+  accept[WEBSOCKET_ACCEPT_LENGTH] = '\0';
+}
+
+void websocketDecoderInit(WebSocketDecoder &decoder)
+{
+  memset(&decoder, 0, sizeof(decoder));
+  decoder.state = WS_HEADER;
+}
+
+static bool isControl(WebSocketOpcode opcode)
+{
+  return opcode >= WEBSOCKET_CLOSE;
+}
+
+// Checks the two header bytes, false on anything a client may not send
+static bool startFrame(WebSocketDecoder &decoder)
+{
+  uint8_t first = decoder.header[0];
+  uint8_t second = decoder.header[1];
+  bool final = (first & 0x80) != 0;
+  WebSocketOpcode opcode = (WebSocketOpcode)(first & 0x0F);
+  uint8_t length = second & 0x7F;
+
+  // No extensions are negotiated, and client frames must be masked
+  if ((first & 0x70) != 0 || (second & 0x80) == 0)
+  {
+    return false;
+  }
+
+  switch (opcode)
+  {
+  case WEBSOCKET_CLOSE:
+  case WEBSOCKET_PING:
+  case WEBSOCKET_PONG:
+    if (!final || length > WEBSOCKET_MAX_CONTROL_PAYLOAD)
+    {
+      return false;
+    }
+    decoder.controlLength = 0;
+    break;
+  case WEBSOCKET_TEXT:
+  case WEBSOCKET_BINARY:
+    if (decoder.messageOpen)
+    {
+      return false;
+    }
+    decoder.messageOpcode = opcode;
+    decoder.messageOpen = true;
+    decoder.final = final;
+    break;
+  case WEBSOCKET_CONTINUATION:
+    if (!decoder.messageOpen)
+    {
+      return false;
+    }
+    decoder.final = final;
+    break;
+  default:
+    return false;
+  }
+
+  decoder.frameOpcode = opcode;
+  decoder.maskBytes = 0;
+  decoder.maskOffset = 0;
+  if (length == 126)
+  {
+    decoder.lengthBytes = 2;
+    decoder.remaining = 0;
+    decoder.state = WS_LENGTH;
+  }
+  else if (length == 127)
+  {
+    decoder.lengthBytes = 8;
+    decoder.remaining = 0;
+    decoder.state = WS_LENGTH;
+  }
+  else
+  {
+    decoder.remaining = length;
+    decoder.state = WS_MASK;
+  }
+  return true;
+}
+
+static void unmask(WebSocketDecoder &decoder, uint8_t *data, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+  {
+    data[i] ^= decoder.mask[(decoder.maskOffset + i) & 3];
+  }
+  decoder.maskOffset += length;
+}
+
+WebSocketResult websocketDecode(WebSocketDecoder &decoder, uint8_t *data, size_t length, size_t *consumed,
+                                WebSocketChunk *chunk)
+{
+  size_t position = 0;
+  while (true)
+  {
+    switch (decoder.state)
+    {
+    case WS_FAILED:
+      *consumed = position;
+      return WEBSOCKET_ERROR;
+
+    case WS_HEADER:
+      if (position == length)
+      {
+        *consumed = position;
+        return WEBSOCKET_NEED_MORE;
+      }
+      decoder.header[decoder.headerBytes++] = data[position++];
+      if (decoder.headerBytes == 2)
+      {
+        decoder.headerBytes = 0;
+        if (!startFrame(decoder))
+        {
+          decoder.state = WS_FAILED;
+        }
+      }
+      break;
+
+    case WS_LENGTH:
+      if (position == length)
+      {
+        *consumed = position;
+        return WEBSOCKET_NEED_MORE;
+      }
+      decoder.remaining = decoder.remaining << 8 | data[position++];
+      if (--decoder.lengthBytes == 0)
+      {
+        // The most significant bit of a 64-bit length must be 0
+        decoder.state = (decoder.remaining >> 63) != 0 ? WS_FAILED : WS_MASK;
+      }
+      break;
+
+    case WS_MASK:
+      if (position == length)
+      {
+        *consumed = position;
+        return WEBSOCKET_NEED_MORE;
+      }
+      decoder.mask[decoder.maskBytes++] = data[position++];
+      if (decoder.maskBytes == 4)
+      {
+        decoder.state = WS_PAYLOAD;
+      }
+      break;
+
+    case WS_PAYLOAD:
+    {
+      size_t available = length - position;
+      size_t take = decoder.remaining < available ? (size_t)decoder.remaining : available;
+      uint8_t *payload = data + position;
+      unmask(decoder, payload, take);
+      position += take;
+      decoder.remaining -= take;
+      bool frameEnd = decoder.remaining == 0;
+      if (frameEnd)
+      {
+        decoder.state = WS_HEADER;
+      }
+
+      if (isControl(decoder.frameOpcode))
+      {
+        memcpy(decoder.control + decoder.controlLength, payload, take);
+        decoder.controlLength += take;
+        if (frameEnd)
+        {
+          *consumed = position;
+          return WEBSOCKET_CONTROL;
+        }
+        *consumed = position;
+        return WEBSOCKET_NEED_MORE;
+      }
+
+      bool messageEnd = frameEnd && decoder.final;
+      if (messageEnd)
+      {
+        decoder.messageOpen = false;
+      }
+      // An empty frame only matters when it ends the message
+      if (take > 0 || messageEnd)
+      {
+        chunk->opcode = decoder.messageOpcode;
+        chunk->data = payload;
+        chunk->length = take;
+        chunk->messageEnd = messageEnd;
+        *consumed = position;
+        return WEBSOCKET_DATA;
+      }
+      if (!frameEnd)
+      {
+        *consumed = position;
+        return WEBSOCKET_NEED_MORE;
+      }
+      break;
+    }
+    }
+  }
+}
+
+size_t websocketFrameHeader(uint8_t *header, WebSocketOpcode opcode, size_t payloadLength)
+{
+  header[0] = 0x80 | opcode;
+  if (payloadLength < 126)
+  {
+    header[1] = (uint8_t)payloadLength;
+    return 2;
+  }
+  if (payloadLength <= 0xFFFF)
+  {
+    header[1] = 126;
+    header[2] = (uint8_t)(payloadLength >> 8);
+    header[3] = (uint8_t)payloadLength;
+    return 4;
+  }
+  header[1] = 127;
+  for (int i = 0; i < 8; i++)
+  {
+    header[2 + i] = (uint8_t)((uint64_t)payloadLength >> (56 - i * 8));
+  }
+  return WEBSOCKET_MAX_HEADER;
+}
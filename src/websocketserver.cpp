@@ -0,0 +1,479 @@
+#include "websocketserver.h"
+#include "websocket.h"
+#include "constants.h"
+#include "control.h"
+#include "framing.h"
+#include "latency.h"
+#include "messagewriter.h"
+#include "outbox.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "lwip/tcpip.h"
+#include "lwip/priv/tcpip_priv.h"
+
+#define WEBSOCKET_CLOSE_PROTOCOL_ERROR 1002
+#define WEBSOCKET_CLOSE_UNSUPPORTED_DATA 1003
+
+// Everything below except the batch is only touched in the lwIP thread
+typedef struct
+{
+  struct tcp_pcb *pcb; // NULL when the slot is free
+  WebSocketDecoder decoder;
+  FrameAssembler inbound; // Text messages as JSON lines
+} WebSocketClient;
+
+static WebSocketClient clients[WEBSOCKET_MAX_CLIENTS];
+static WebSocketStats stats;
+static bool started = false;
+
+// Info messages framed by the WebSocket task, written to every client in the lwIP thread
+typedef struct
+{
+  struct tcpip_api_call_data call;
+  uint8_t buffer[OUTBOX_BUFFER_SIZE];
+  size_t length;
+  size_t messages;
+} WebSocketBatch;
+
+static WebSocketBatch batch;
+
+static void countDropped(uint32_t messages)
+{
+  halEnterCritical();
+  stats.dropped += messages;
+  halExitCritical();
+}
+
+// ERR_ABRT if the pcb had to be aborted, a recv callback must then return it
+static err_t releaseClient(WebSocketClient *client)
+{
+  struct tcp_pcb *pcb = client->pcb;
+  if (pcb == NULL)
+  {
+    return ERR_OK;
+  }
+  client->pcb = NULL;
+  tcp_arg(pcb, NULL);
+  tcp_recv(pcb, NULL);
+  tcp_err(pcb, NULL);
+
+  halEnterCritical();
+  stats.connected--;
+  halExitCritical();
+  printf("WebSocket client disconnected\n");
+
+  if (tcp_close(pcb) != ERR_OK)
+  {
+    tcp_abort(pcb);
+    return ERR_ABRT;
+  }
+  return ERR_OK;
+}
+
+// A frame is written whole or not at all, in a single tcp_write(), so a full
+// send buffer or segment queue never leaves half a frame on the stream
+static bool sendFrame(WebSocketClient *client, WebSocketOpcode opcode, const void *payload, size_t length)
+{
+  // lwIP thread only, the STATE snapshot is the largest payload sent this way
+  static uint8_t frame[WEBSOCKET_MAX_HEADER + STATE_WRITER_MAX_LENGTH];
+  if (length > sizeof(frame) - WEBSOCKET_MAX_HEADER)
+  {
+    return false;
+  }
+  size_t frameLength = websocketFrameHeader(frame, opcode, length);
+  memcpy(frame + frameLength, payload, length);
+  frameLength += length;
+  if (tcp_sndbuf(client->pcb) < frameLength ||
+      tcp_write(client->pcb, frame, frameLength, TCP_WRITE_FLAG_COPY) != ERR_OK)
+  {
+    return false;
+  }
+  tcp_output(client->pcb);
+  return true;
+}
+
+static void sendClose(WebSocketClient *client, uint16_t code)
+{
+  uint8_t payload[2] = {(uint8_t)(code >> 8), (uint8_t)code};
+  sendFrame(client, WEBSOCKET_CLOSE, payload, sizeof(payload));
+}
+
+static void sendSnapshot(WebSocketClient *client)
+{
+  ControlSnapshot snapshot;
+  controlGetSnapshot(&snapshot);
+  char text[STATE_WRITER_MAX_LENGTH];
+  size_t length = controlSnapshotToBuffer(snapshot, text, sizeof(text));
+  if (length == 0 || !sendFrame(client, WEBSOCKET_TEXT, text, length))
+  {
+    countDropped(1);
+  }
+}
+
+static void handleText(WebSocketClient *client, const char *text, uint32_t receivedUs)
+{
+  Message msg = {};
+  if (!bufferToMessage(text, msg) || msg.messageType != MessageType::COMMAND)
+  {
+    printf("WebSocket: failed to convert buffer to Message\n");
+    return;
+  }
+  if (isCommand(msg, CommandType::GET_STATE))
+  {
+    sendSnapshot(client);
+    return;
+  }
+  if (isCommand(msg, CommandType::ACK) || isCommand(msg, CommandType::HEARTBEAT_ACK))
+  {
+    return;
+  }
+  if (isUpstreamQuery(msg))
+  {
+    printf("WebSocket: queries other than GET_STATE are answered upstream only, ignored\n");
+    return;
+  }
+
+  // Never wait in the lwIP thread
+  msg.receivedUs = receivedUs;
+  msg.enqueuedUs = latencyNowUs();
+  if (!halQueueSend(incommingMessageQueue, &msg, 0))
+  {
+    printf("WebSocket: failed to enqueue command.\n");
+  }
+}
+
+static void deliverLines(WebSocketClient *client, uint32_t receivedUs)
+{
+  uint8_t frame[FRAME_MAX_LENGTH];
+  size_t length;
+  FrameResult result;
+  while ((result = frameAssemblerNext(client->inbound, frame, sizeof(frame), &length)) != FRAME_NONE)
+  {
+    if (result == FRAME_READY)
+    {
+      handleText(client, (const char *)frame, receivedUs);
+    }
+    else
+    {
+      printf("WebSocket: dropped a message longer than %d bytes\n", FRAME_MAX_LENGTH);
+    }
+  }
+}
+
+// A message that arrived whole in one chunk is parsed where the decoder
+// unmasked it. The parser wants a NUL after the text: the next byte of the
+// segment stands in for it while it runs, and only a message that ends its
+// segment is copied once, as lwIP does not say whether the pbuf has room past
+// its length. False leaves the message to the line framer.
+static bool handleWhole(WebSocketClient *client, const WebSocketChunk &chunk, size_t following, uint32_t receivedUs)
+{
+  const FrameAssembler &inbound = client->inbound;
+  if (!chunk.messageEnd || inbound.head != inbound.tail || inbound.discarding || chunk.length >= FRAME_MAX_LENGTH ||
+      memchr(chunk.data, '\n', chunk.length) != NULL)
+  {
+    return false;
+  }
+  if (chunk.length == 0)
+  {
+    return true; // A blank line, as the framer skips it
+  }
+  if (following > 0)
+  {
+    uint8_t *end = (uint8_t *)chunk.data + chunk.length; // Still the pbuf given to websocketDecode()
+    uint8_t saved = *end;
+    *end = '\0';
+    handleText(client, (const char *)chunk.data, receivedUs);
+    *end = saved;
+    return true;
+  }
+  char text[FRAME_MAX_LENGTH];
+  memcpy(text, chunk.data, chunk.length);
+  text[chunk.length] = '\0';
+  handleText(client, text, receivedUs);
+  return true;
+}
+
+// Text payload goes to the line framer, the end of the message ends the line.
+// following is the number of bytes after the chunk in its segment.
+static void handleData(WebSocketClient *client, const WebSocketChunk &chunk, size_t following, uint32_t receivedUs)
+{
+  if (handleWhole(client, chunk, following, receivedUs))
+  {
+    return;
+  }
+
+  const uint8_t *data = chunk.data;
+  size_t length = chunk.length;
+  while (length > 0)
+  {
+    size_t pushed = frameAssemblerPush(client->inbound, data, length);
+    data += pushed;
+    length -= pushed;
+    deliverLines(client, receivedUs);
+  }
+  if (chunk.messageEnd)
+  {
+    // A full ring holding no line end is dropped by the framer, which makes room
+    while (frameAssemblerPush(client->inbound, "\n", 1) == 0)
+    {
+      deliverLines(client, receivedUs);
+    }
+    deliverLines(client, receivedUs);
+  }
+}
+
+// False once the connection is being closed
+static bool handleControl(WebSocketClient *client)
+{
+  WebSocketDecoder &decoder = client->decoder;
+  switch (decoder.frameOpcode)
+  {
+  case WEBSOCKET_PING:
+    sendFrame(client, WEBSOCKET_PONG, decoder.control, decoder.controlLength);
+    return true;
+  case WEBSOCKET_CLOSE:
+    // Echo the status code, then the TCP close ends it
+    sendFrame(client, WEBSOCKET_CLOSE, decoder.control, decoder.controlLength >= 2 ? 2 : 0);
+    return false;
+  default:
+    return true;
+  }
+}
+
+static err_t websocketRecv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  WebSocketClient *client = (WebSocketClient *)arg;
+  if (p == NULL || client == NULL)
+  {
+    if (p != NULL)
+    {
+      tcp_recved(pcb, p->tot_len);
+      pbuf_free(p);
+    }
+    return client != NULL ? releaseClient(client) : ERR_OK;
+  }
+
+  uint32_t receivedUs = latencyNowUs();
+  bool open = true;
+  for (struct pbuf *segment = p; segment != NULL && open; segment = segment->next)
+  {
+    uint8_t *data = (uint8_t *)segment->payload;
+    size_t length = segment->len;
+    while (open)
+    {
+      size_t consumed;
+      WebSocketChunk chunk;
+      WebSocketResult result = websocketDecode(client->decoder, data, length, &consumed, &chunk);
+      data += consumed;
+      length -= consumed;
+      if (result == WEBSOCKET_NEED_MORE)
+      {
+        break;
+      }
+      if (result == WEBSOCKET_ERROR)
+      {
+        printf("WebSocket: protocol error, closing.\n");
+        sendClose(client, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+        open = false;
+      }
+      else if (result == WEBSOCKET_CONTROL)
+      {
+        open = handleControl(client);
+      }
+      else if (chunk.opcode != WEBSOCKET_TEXT)
+      {
+        printf("WebSocket: binary messages are not supported, closing.\n");
+        sendClose(client, WEBSOCKET_CLOSE_UNSUPPORTED_DATA);
+        open = false;
+      }
+      else
+      {
+        handleData(client, chunk, length, receivedUs);
+      }
+    }
+  }
+
+  tcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+  if (!open)
+  {
+    return releaseClient(client);
+  }
+  return ERR_OK;
+}
+
+// The pcb is already freed when this is called
+static void websocketError(void *arg, err_t err)
+{
+  WebSocketClient *client = (WebSocketClient *)arg;
+  if (client != NULL && client->pcb != NULL)
+  {
+    client->pcb = NULL;
+    halEnterCritical();
+    stats.connected--;
+    halExitCritical();
+    printf("WebSocket client failed: %d\n", err);
+  }
+}
+
+bool websocketUpgrade(struct tcp_pcb *pcb, const char *key, size_t keyLength)
+{
+  WebSocketClient *client = NULL;
+  for (WebSocketClient &slot : clients)
+  {
+    if (slot.pcb == NULL)
+    {
+      client = &slot;
+      break;
+    }
+  }
+  if (client == NULL)
+  {
+    halEnterCritical();
+    stats.refused++;
+    halExitCritical();
+    return false;
+  }
+
+  char accept[WEBSOCKET_ACCEPT_LENGTH + 1];
+  websocketAcceptKey(key, keyLength, accept);
+  char response[160];
+  int length = snprintf(response, sizeof(response),
+                        "HTTP/1.1 101 Switching Protocols\r\n"
+                        "Upgrade: websocket\r\n"
+                        "Connection: Upgrade\r\n"
+                        "Sec-WebSocket-Accept: %s\r\n"
+                        "\r\n",
+                        accept);
+  if (tcp_write(pcb, response, length, TCP_WRITE_FLAG_COPY) != ERR_OK)
+  {
+    return false;
+  }
+
+  client->pcb = pcb;
+  websocketDecoderInit(client->decoder);
+  frameAssemblerInit(client->inbound, WIRE_JSON);
+  tcp_arg(pcb, client);
+  tcp_recv(pcb, websocketRecv);
+  tcp_err(pcb, websocketError);
+
+  halEnterCritical();
+  stats.connected++;
+  stats.accepted++;
+  halExitCritical();
+  printf("WebSocket client connected\n");
+
+  sendSnapshot(client);
+  return true;
+}
+
+// Runs in the lwIP thread, the WebSocket task waits for it
+static err_t broadcastBatch(struct tcpip_api_call_data *call)
+{
+  WebSocketBatch *pending = (WebSocketBatch *)call;
+  for (WebSocketClient &client : clients)
+  {
+    if (client.pcb == NULL)
+    {
+      continue;
+    }
+    if (tcp_sndbuf(client.pcb) < pending->length ||
+        tcp_write(client.pcb, pending->buffer, pending->length, TCP_WRITE_FLAG_COPY) != ERR_OK)
+    {
+      countDropped(pending->messages);
+      continue;
+    }
+    tcp_output(client.pcb);
+  }
+  return ERR_OK;
+}
+
+static bool appendMessage(WebSocketBatch &pending, const Message &msg)
+{
+  char text[MESSAGE_WRITER_MAX_LENGTH];
+  size_t length = messageToBuffer(msg, text, sizeof(text));
+  if (length == 0)
+  {
+    return true; // Nothing to send for it, go on
+  }
+  if (sizeof(pending.buffer) - pending.length < WEBSOCKET_MAX_HEADER + length)
+  {
+    return false;
+  }
+  pending.length += websocketFrameHeader(pending.buffer + pending.length, WEBSOCKET_TEXT, length);
+  memcpy(pending.buffer + pending.length, text, length);
+  pending.length += length;
+  pending.messages++;
+  return true;
+}
+
+// Frames the local copies of info messages and hands each batch to the lwIP
+// thread, which writes it to every client in one go
+static void websocketTask(void *params)
+{
+  HalQueueHandle queue = (HalQueueHandle)params;
+  Message msg;
+  bool held = false; // msg did not fit the last batch
+  while (true)
+  {
+    if (!held && !halQueueReceive(queue, &msg, HAL_WAIT_FOREVER))
+    {
+      continue;
+    }
+    held = false;
+    batch.length = 0;
+    batch.messages = 0;
+    do
+    {
+      if (!appendMessage(batch, msg))
+      {
+        held = true;
+        break;
+      }
+    } while (batch.messages < (size_t)SOCKET_MAX_BATCH && halQueueReceive(queue, &msg, 0));
+
+    halEnterCritical();
+    bool anyone = stats.connected > 0;
+    halExitCritical();
+    if (anyone && batch.length > 0)
+    {
+      tcpip_api_call(broadcastBatch, &batch.call);
+    }
+  }
+}
+
+void startWebSocketServer()
+{
+  if (started)
+  {
+    return;
+  }
+  HalQueueHandle queue = halQueueCreate(WEBSOCKET_QUEUE_LENGTH, sizeof(Message));
+  if (queue == NULL)
+  {
+    printf("Failed to create WebSocket message queue.\n");
+    return;
+  }
+  if (xTaskCreate(websocketTask, "WebSocketTask", 1024, queue, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
+  {
+    printf("Failed to create WebSocket task.\n");
+    halQueueDelete(queue);
+    return;
+  }
+  // Control only copies info messages here once the task draining it exists
+  localMessageQueue = queue;
+  started = true;
+  printf("WebSocket server ready on %s\n", WEBSOCKET_PATH);
+}
+
+void websocketGetStats(WebSocketStats *out)
+{
+  halEnterCritical();
+  *out = stats;
+  halExitCritical();
+}
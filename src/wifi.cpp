@@ -2,8 +2,24 @@
 #include "constants.h"
 #include "dhcpserver.h"
 #include "httpserver.h"
+#include "websocketserver.h"
+#include "controlserver.h"
+#include "mqttclient.h"
+#include "discovery.h"
+#include "telemetrysender.h"
 #include "settings.h"
 #include "control.h"
+#include "messagewriter.h"
+#include "messagebinary.h"
+#include "framing.h"
+#include "outbox.h"
+#include "retransmit.h"
+#include "recorder.h"
+#include "history.h"
+#include "latency.h"
+#include "stats.h"
+#include "reconnect.h"
+#include "tlsclient.h"
 #include "ws2812.pio.h"
 
 #include <cstdio>
@@ -28,6 +44,7 @@
 #define WIFI_CONNECTION_FAILED_BIT (1 << 2)
 #define CONFIGURED_BIT (1 << 3)
 #define SOCKET_DISCONNECTED_BIT (1 << 4)
+#define SOCKET_SENDER_STOPPED_BIT (1 << 5)
 
 EventGroupHandle_t eventGroup;
 
@@ -43,9 +60,7 @@ volatile bool isStaModeActive = false;
 volatile bool isSocketActive = false;
 volatile bool isConnectedToSocketServer = false;
 
-QueueHandle_t outgoingMessageQueue = NULL;
 static int clientSocket = -1;
-volatile static int socketRetryDelay = 5000;
 volatile static int wifiRetryDelay = 1000;
 volatile bool isFlashing = false;
 
@@ -233,6 +248,7 @@ void checkWifiConnection()
     printf("WiFi connection dropped.\n");
     // Attempt reconnection or other handling logic
     isConnectedToWifi = false;
+    advertisingLinkLost();
   }
   else
   {
@@ -323,37 +339,24 @@ bool connectToWifiWithCredentials()
   return connectToWiFi((const char *)currentSettings.ssid, (const char *)currentSettings.password, currentSettings.authMode);
 }
 
-bool sendMessage(const std::string &message)
-{
-  if (outgoingMessageQueue == NULL)
-  {
-    printf("Message queue is not initialized.\n");
-    return false;
-  }
-
-  if (xQueueSend(outgoingMessageQueue, &message, pdMS_TO_TICKS(100)) == pdPASS)
-  {
-    printf("Message queued: %s\n", message.c_str());
-    return true;
-  }
-  else
-  {
-    printf("Failed to queue message: %s\n", message.c_str());
-    return false;
-  }
-}
-
 void initSocket()
 {
   if (!isSocketActive)
   {
     Message msg;
     // flush queues
-    while (xQueueReceive(incommingMessageQueue, &msg, 0) == pdTRUE)
+    while (halQueueReceive(incommingMessageQueue, &msg, 0))
       ;
-    while (xQueueReceive(outgoingMessageQueue, &msg, 0) == pdTRUE)
+    while (halQueueReceive(outgoingMessageQueue, &msg, 0))
       ;
-    xTaskCreate(socketTask, "SocketTask", 4096, NULL, tskIDLE_PRIORITY + 1, NULL);
+    if (CONTROL_OVER_MQTT)
+    {
+      xTaskCreate(mqttTask, "MqttTask", 4096, NULL, tskIDLE_PRIORITY + 1, NULL);
+    }
+    else
+    {
+      xTaskCreate(socketTask, "SocketTask", 4096, NULL, tskIDLE_PRIORITY + 1, NULL);
+    }
     isSocketActive = true;
   }
 }
@@ -364,9 +367,9 @@ void deInitSocket()
   {
     Message msg;
     // flush queues
-    while (xQueueReceive(incommingMessageQueue, &msg, 0) == pdTRUE)
+    while (halQueueReceive(incommingMessageQueue, &msg, 0))
       ;
-    while (xQueueReceive(outgoingMessageQueue, &msg, 0) == pdTRUE)
+    while (halQueueReceive(outgoingMessageQueue, &msg, 0))
       ;
     isSocketActive = false;
   }
@@ -389,7 +392,7 @@ void initAPMode()
     printf("Pico W IP Address: %lu.%lu.%lu.%lu\n", ip_addr & 0xFF, (ip_addr >> 8) & 0xFF, (ip_addr >> 16) & 0xFF, ip_addr >> 24);
 
     // Start HTTP server for Wi-Fi configuration
-    startHttpServer();
+    startHttpServer(true);
     isAppModeActive = true;
   }
 }
@@ -422,6 +425,7 @@ void deInitSTAMode()
   {
     cyw43_arch_disable_sta_mode();
     isStaModeActive = false;
+    advertisingLinkLost();
   }
 }
 
@@ -438,6 +442,272 @@ void credentialsTask(void *params)
   }
 }
 
+// Hands a received command to the control task, timing the parse and enqueue
+// stages. Acknowledgements only concern the socket and are handled here.
+void enqueueCommand(Message &msg, uint32_t receivedUs)
+{
+  if (isCommand(msg, CommandType::ACK))
+  {
+    retransmitAcknowledge(msg.sequence);
+    return;
+  }
+  if (isCommand(msg, CommandType::HEARTBEAT_ACK))
+  {
+    return; // Receiving it was the point
+  }
+
+  uint32_t parsedUs = latencyNowUs();
+  latencyRecord(LATENCY_PARSE, parsedUs - receivedUs);
+
+  msg.receivedUs = receivedUs;
+  msg.enqueuedUs = parsedUs;
+  if (!halQueueSend(incommingMessageQueue, &msg, 100))
+  {
+    printf("Failed to enqueue info message.\n");
+  }
+  else
+  {
+    latencyRecord(LATENCY_ENQUEUE, latencyNowUs() - parsedUs);
+  }
+}
+
+// Plain or through TLS, the rest of the connection code does not care which
+static int socketSend(const void *data, size_t length)
+{
+  return SOCKET_TLS ? tlsSend(data, length) : lwip_send(clientSocket, data, length, 0);
+}
+
+// Returns -1 with errno EWOULDBLOCK once the receive timeout passes without data
+static int socketRecv(void *buffer, size_t length)
+{
+  if (SOCKET_TLS)
+  {
+    return tlsRecv(buffer, length, SOCKET_HEARTBEAT_TIMEOUT_MS > 0 ? SOCKET_HEARTBEAT_INTERVAL_MS : HAL_WAIT_FOREVER);
+  }
+  return lwip_recv(clientSocket, buffer, length, 0);
+}
+
+// Sends a JSON document as a line, or as a text frame once the connection has switched to binary
+static bool sendText(WireEncoding encoding, const char *text, size_t length)
+{
+  if (encoding == WIRE_BINARY)
+  {
+    uint8_t header[MESSAGE_BINARY_HEADER];
+    binaryTextHeader(header, length);
+    if (socketSend(header, sizeof(header)) < 0)
+    {
+      return false;
+    }
+    return socketSend(text, length) >= 0;
+  }
+  return socketSend(text, length) >= 0 && socketSend("\n", 1) >= 0;
+}
+
+static FrameAssembler inbound;
+static Outbox outbox;
+
+// The receiver records the encoding the server picked, the sender switches to it at its next batch
+static volatile WireEncoding agreedEncoding = WIRE_JSON;
+static WireEncoding sendEncoding = WIRE_JSON;
+static volatile bool socketClosing = false;
+
+// The sender writes lastSentMs and the receiver lastHeardMs, each a single word
+static Heartbeat heartbeat;
+static Backoff socketBackoff;
+static bool socketBackoffReady = false;
+
+static uint32_t nowMs()
+{
+  return (uint32_t)(halTimeUs() / 1000);
+}
+
+static bool flushOutbox()
+{
+  if (outbox.length == 0)
+  {
+    return true;
+  }
+  bool sent = socketSend(outbox.buffer, outbox.length) >= 0;
+  outboxRecordFlush(outbox, sent);
+  outboxClear(outbox);
+  return sent;
+}
+
+// Adds a JSON document to the outbox, flushing first if it is full. A document
+// larger than the whole outbox is sent on its own.
+static bool queueText(const std::string &text)
+{
+  if (outboxAppendText(outbox, sendEncoding, text.c_str(), text.length()))
+  {
+    return true;
+  }
+  if (!flushOutbox())
+  {
+    return false;
+  }
+  if (outboxAppendText(outbox, sendEncoding, text.c_str(), text.length()))
+  {
+    return true;
+  }
+  return sendText(sendEncoding, text.c_str(), text.length());
+}
+
+static void handleFrame(const uint8_t *frame, size_t length, uint32_t receivedUs)
+{
+  Message msg = {};
+  if (inbound.encoding == WIRE_BINARY)
+  {
+    if (binaryToMessage(frame, length, msg))
+    {
+      enqueueCommand(msg, receivedUs);
+    }
+    return;
+  }
+
+  const char *text = (const char *)frame;
+  printf("Received: %s\n", text);
+
+  WireEncoding encoding;
+  if (bufferToHello(text, encoding))
+  {
+    // Everything after the reply line is in the new encoding
+    frameAssemblerSetEncoding(inbound, encoding);
+    agreedEncoding = encoding;
+    halSignalGive(outgoingMessageSignal);
+    printf("Server selected %s encoding\n", encoding == WIRE_BINARY ? "binary" : "JSON");
+  }
+  else if (bufferToMessage(text, msg))
+  {
+    enqueueCommand(msg, receivedUs);
+  }
+  else
+  {
+    printf("Failed to convert buffer to Message\n");
+  }
+}
+
+// Sending half of the connection. Sleeps until control signals something to
+// send or a heartbeat is due, then sends everything pending in a single socketSend().
+static void socketSendTask(void *params)
+{
+  uint32_t waitMs = SOCKET_HEARTBEAT_TIMEOUT_MS > 0 ? SOCKET_HEARTBEAT_INTERVAL_MS : HAL_WAIT_FOREVER;
+  while (true)
+  {
+    halSignalWait(outgoingMessageSignal, waitMs);
+    if (socketClosing)
+    {
+      break;
+    }
+
+    outboxClear(outbox);
+    bool sendFailed = false;
+    if (agreedEncoding == WIRE_BINARY && sendEncoding != WIRE_BINARY)
+    {
+      // Tells the server where the JSON lines end
+      sendFailed = !outboxAppendText(outbox, WIRE_JSON, WIRE_HELLO_BINARY_ACK, sizeof(WIRE_HELLO_BINARY_ACK) - 1);
+      sendEncoding = WIRE_BINARY;
+    }
+
+    // Ahead of the queued info messages, replaying those over it ends in the same state
+    ControlSnapshot snapshot;
+    if (!sendFailed && controlTakeStateSnapshot(&snapshot) && !outboxAppendSnapshot(outbox, sendEncoding, snapshot) &&
+        !(flushOutbox() && outboxAppendSnapshot(outbox, sendEncoding, snapshot)))
+    {
+      printf("Failed to send state.\n");
+      sendFailed = true;
+    }
+
+    // Critical events not yet sent on this connection, then the best-effort queue
+    Message event;
+    bool eventsLeft = false;
+    while (!sendFailed && (eventsLeft = retransmitPeek(&event)) && outboxAppendMessage(outbox, sendEncoding, event))
+    {
+      retransmitAdvance();
+    }
+
+    // Left queued for the next connection once this one has failed
+    bool limitReached = false;
+    if (!sendFailed)
+    {
+      outboxDrainQueue(outbox, outgoingMessageQueue, sendEncoding, SOCKET_MAX_BATCH, &limitReached);
+    }
+
+    // Rides along with the batch, so a busy connection pays nothing extra for it
+    if (!sendFailed && heartbeatDue(heartbeat, nowMs()))
+    {
+      Message beat = infoMessage(InfoType::HEARTBEAT);
+      if (outboxAppendMessage(outbox, sendEncoding, beat) || (flushOutbox() && outboxAppendMessage(outbox, sendEncoding, beat)))
+      {
+        heartbeatSent(heartbeat, nowMs());
+      }
+      else
+      {
+        sendFailed = true;
+      }
+    }
+
+    // A slice of a requested recorder dump
+    RecorderEntry entry;
+    bool dumpEnd = false;
+    int dumped = 0;
+    while (!sendFailed && dumped < RECORDER_DUMP_BATCH && !dumpEnd && recorderNextDumpEntry(&entry, &dumpEnd))
+    {
+      std::string recordString = dumpEnd ? recorderEndToString() : recorderEntryToString(entry);
+      if (!queueText(recordString))
+      {
+        printf("Failed to send record: %s\n", recordString.c_str());
+        sendFailed = true;
+      }
+      dumped++;
+    }
+
+    // One bounded chunk of a history reply per pass, however long the range
+    HistoryChunk chunk;
+    bool historyEnd = true;
+    if (!sendFailed && historyNextChunk(chunk))
+    {
+      historyEnd = chunk.done;
+      if (!outboxAppendHistory(outbox, sendEncoding, chunk) &&
+          !(flushOutbox() && outboxAppendHistory(outbox, sendEncoding, chunk)))
+      {
+        printf("Failed to send history.\n");
+        sendFailed = true;
+      }
+    }
+
+    if (!sendFailed && latencyTakeReportRequest() && !queueText(latencyReportToString()))
+    {
+      printf("Failed to send latency report.\n");
+      sendFailed = true;
+    }
+
+    if (!sendFailed && statsTakeReportRequest() && !queueText(statsReportToString()))
+    {
+      printf("Failed to send stats report.\n");
+      sendFailed = true;
+    }
+
+    if (sendFailed || !flushOutbox())
+    {
+      printf("Failed to send messages. Closing connection.\n");
+      break;
+    }
+
+    // Come straight back for whatever the batch limits left behind
+    if (limitReached || eventsLeft || (dumped == RECORDER_DUMP_BATCH && !dumpEnd) || !historyEnd)
+    {
+      halSignalGive(outgoingMessageSignal);
+    }
+  }
+
+  // Wakes the receiver if it is still waiting for data
+  lwip_shutdown(clientSocket, SHUT_RDWR);
+  xEventGroupSetBits(eventGroup, SOCKET_SENDER_STOPPED_BIT);
+  vTaskDelete(NULL);
+}
+
+// Receiving half of the connection. Blocks in socketRecv() so commands are
+// handled as soon as they arrive, and owns the socket's lifetime.
 void socketTask(void *params)
 {
   struct sockaddr_in serverAddr;
@@ -450,14 +720,23 @@ void socketTask(void *params)
     return;
   }
 
-  memset(&serverAddr, 0, sizeof(serverAddr));
-  serverAddr.sin_family = AF_INET;
-  serverAddr.sin_port = htons(SOCKET_SERVER_PORT);
-  inet_aton(SOCKET_SERVER_IP, &serverAddr.sin_addr);
+  discoveryServerEndpoint(&serverAddr);
 
   if (lwip_connect(clientSocket, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0)
   {
     printf("Failed to connect to server.\n");
+    discoveryConnectFailed();
+    lwip_close(clientSocket);
+    clientSocket = -1;
+    xEventGroupSetBits(eventGroup, SOCKET_DISCONNECTED_BIT);
+    vTaskDelete(NULL);
+    return;
+  }
+
+  // A failed handshake is retried like a failed connect
+  if (SOCKET_TLS && !tlsConnect(clientSocket))
+  {
+    discoveryConnectFailed();
     lwip_close(clientSocket);
     clientSocket = -1;
     xEventGroupSetBits(eventGroup, SOCKET_DISCONNECTED_BIT);
@@ -466,60 +745,145 @@ void socketTask(void *params)
   }
 
   printf("Connected to server.\n");
-  socketRetryDelay = 5000;
-  char buffer[1024];
+  discoveryConnected();
+  notifySocketConnected();
+
+  // TCP keepalive finds a peer that vanished while nothing was being sent
+  int on = 1;
+  int idle = SOCKET_KEEPALIVE_IDLE_S;
+  int interval = SOCKET_KEEPALIVE_INTERVAL_S;
+  int probes = SOCKET_KEEPALIVE_COUNT;
+  lwip_setsockopt(clientSocket, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+  lwip_setsockopt(clientSocket, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+  lwip_setsockopt(clientSocket, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+  lwip_setsockopt(clientSocket, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+
+  // The heartbeat notices sooner, and also a server that is up but stuck
+  heartbeatInit(heartbeat, SOCKET_HEARTBEAT_INTERVAL_MS, SOCKET_HEARTBEAT_TIMEOUT_MS, nowMs());
+  if (SOCKET_HEARTBEAT_TIMEOUT_MS > 0)
+  {
+    struct timeval receiveTimeout = {SOCKET_HEARTBEAT_INTERVAL_MS / 1000, (SOCKET_HEARTBEAT_INTERVAL_MS % 1000) * 1000};
+    lwip_setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &receiveTimeout, sizeof(receiveTimeout));
+  }
+  bool heartbeatTimedOut = false;
+  uint8_t frame[FRAME_MAX_LENGTH];
+
+  // JSON until the server answers the HELLO asking for binary
+  frameAssemblerInit(inbound, WIRE_JSON);
+  agreedEncoding = WIRE_JSON;
+  sendEncoding = WIRE_JSON;
+  socketClosing = false;
+  if (socketSend(WIRE_HELLO "\n", sizeof(WIRE_HELLO "\n") - 1) < 0)
+  {
+    printf("Failed to send hello.\n");
+  }
 
-  while (true)
+  // Whatever the last connection left unacknowledged goes out again first
+  retransmitRewind();
+
+  xEventGroupClearBits(eventGroup, SOCKET_SENDER_STOPPED_BIT);
+  if (xTaskCreate(socketSendTask, "SocketSendTask", 4096, NULL, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
   {
-    // Check for incoming messages
-    int bytesRead = lwip_recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-    if (bytesRead > 0)
+    printf("Failed to create socket send task.\n");
+    if (SOCKET_TLS)
     {
-      buffer[bytesRead] = '\0';
-      printf("Received: %s\n", buffer);
+      tlsClose();
+    }
+    lwip_close(clientSocket);
+    clientSocket = -1;
+    xEventGroupSetBits(eventGroup, SOCKET_DISCONNECTED_BIT);
+    vTaskDelete(NULL);
+    return;
+  }
+  // Anything queued while connecting
+  halSignalGive(outgoingMessageSignal);
 
-      Message msg;
-      if (bufferToMessage(buffer, msg))
-      {
-        if (xQueueSend(incommingMessageQueue, &msg, pdMS_TO_TICKS(100)) != pdPASS)
-        {
-          printf("Failed to enqueue info message.\n");
-        }
-      }
-      else
+  // Brings the server up to date, the control task answers with a snapshot
+  Message getState = commandMessage(CommandType::GET_STATE);
+  if (!halQueueSend(incommingMessageQueue, &getState, 100))
+  {
+    printf("Failed to request state snapshot.\n");
+  }
+
+  while (true)
+  {
+    // Received straight into the frame ring
+    size_t space;
+    uint8_t *receiveBuffer = frameAssemblerWritePointer(inbound, &space);
+    int bytesRead = socketRecv(receiveBuffer, space);
+    if (bytesRead == 0)
+    {
+      printf("Server closed the connection.\n");
+      break;
+    }
+    if (bytesRead < 0 && (errno == EWOULDBLOCK || errno == EAGAIN))
+    {
+      // Receive timeout, a quiet connection is fine until the heartbeat runs out
+      if (heartbeatExpired(heartbeat, nowMs()))
       {
-        printf("Failed to convert buffer to Message\n");
+        printf("Nothing from the server for %d ms. Closing connection.\n", SOCKET_HEARTBEAT_TIMEOUT_MS);
+        heartbeatTimedOut = true;
+        break;
       }
+      continue;
     }
-    else if (bytesRead < 0)
+    if (bytesRead < 0)
     {
       printf("Error reading from socket. Closing connection.\n");
       break;
     }
 
-    // Check for outgoing messages
-    Message msg;
-    if (xQueueReceive(outgoingMessageQueue, &msg, 0)) // Non-blocking check for messages
+    uint32_t receivedUs = latencyNowUs();
+    heartbeatHeard(heartbeat, nowMs());
+    frameAssemblerCommit(inbound, (size_t)bytesRead);
+
+    FrameResult result;
+    size_t frameLength;
+    while ((result = frameAssemblerNext(inbound, frame, sizeof(frame), &frameLength)) == FRAME_READY ||
+           result == FRAME_DROPPED)
     {
-      std::string messageString = messageToString(msg);
-      if (lwip_send(clientSocket, messageString.c_str(), messageString.length(), 0) < 0)
+      if (result == FRAME_DROPPED)
       {
-        printf("Failed to send message: %s\n", messageString.c_str());
-        break;
+        printf("Dropped a line longer than %d bytes\n", FRAME_MAX_LENGTH);
+        continue;
       }
+      handleFrame(frame, frameLength, receivedUs);
+    }
+    if (result == FRAME_CORRUPT)
+    {
+      printf("Corrupt binary frame. Closing connection.\n");
+      break;
     }
-
-    // Yield CPU to other tasks
-    vTaskDelay(pdMS_TO_TICKS(100));
   }
 
+  // The sender must be gone before the socket is closed under it
+  socketClosing = true;
+  halSignalGive(outgoingMessageSignal);
+  xEventGroupWaitBits(eventGroup, SOCKET_SENDER_STOPPED_BIT, pdTRUE, pdFALSE, portMAX_DELAY);
+
   printf("Socket task shutting down.\n");
+  reconnectRecordDisconnect(halTimeUs(), heartbeatTimedOut);
+  if (SOCKET_TLS)
+  {
+    tlsClose();
+  }
   lwip_close(clientSocket);
   clientSocket = -1;
   xEventGroupSetBits(eventGroup, SOCKET_DISCONNECTED_BIT);
   vTaskDelete(NULL);
 }
 
+void notifySocketConnected()
+{
+  backoffReset(socketBackoff);
+  reconnectRecordConnect(halTimeUs());
+}
+
+void notifySocketDisconnected()
+{
+  xEventGroupSetBits(eventGroup, SOCKET_DISCONNECTED_BIT);
+}
+
 void handleStartup()
 {
   initSTAMode();
@@ -563,6 +927,18 @@ void handleConfigured()
 
 void handleWifiConnected()
 {
+  // Browsers on the LAN reach /ws, the setup pages stay off
+  startHttpServer(false);
+  startWebSocketServer();
+  if (CONTROL_SERVER)
+  {
+    startControlServer();
+  }
+  startAdvertising();
+  if (TELEMETRY_STREAM)
+  {
+    startTelemetryStream();
+  }
   initSocket();
 }
 
@@ -579,12 +955,17 @@ void handleSocketDisconnected()
   }
   else
   {
-    printf("Waiting\n");
-    vTaskDelay(pdMS_TO_TICKS(socketRetryDelay));
-    if (socketRetryDelay < 120000)
+    if (!socketBackoffReady)
     {
-      socketRetryDelay += 5000;
+      // Units powered up together still draw different delays
+      const uint8_t *mac = cyw43_state.mac;
+      uint32_t seed = ((uint32_t)mac[2] << 24 | mac[3] << 16 | mac[4] << 8 | mac[5]) ^ (uint32_t)halTimeUs();
+      backoffInit(socketBackoff, SOCKET_RETRY_BASE_MS, SOCKET_RETRY_MAX_MS, seed);
+      socketBackoffReady = true;
     }
+    uint32_t delayMs = backoffNextDelay(socketBackoff);
+    printf("Waiting %lu ms\n", (unsigned long)delayMs);
+    vTaskDelay(pdMS_TO_TICKS(delayMs));
     printf("Re initialising\n");
     xEventGroupSetBits(eventGroup, WIFI_CONNECTED_BIT);
   }
@@ -634,16 +1015,6 @@ void initWifi()
   pio_sm_set_enabled(pio, sm, true);   // Enable the state machine
 
   eventGroup = xEventGroupCreate();
-  incommingMessageQueue = xQueueCreate(5, sizeof(Message));
-  if (incommingMessageQueue == NULL)
-  {
-    printf("Failed to create incoming message queue.\n");
-  }
-  outgoingMessageQueue = xQueueCreate(5, sizeof(Message));
-  if (outgoingMessageQueue == NULL)
-  {
-    printf("Failed to create outgoing message queue.\n");
-  }
 }
 
 void wifiTask(void *params)
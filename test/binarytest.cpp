@@ -0,0 +1,216 @@
+// Binary wire format: round trips, agreement with the JSON writer, rejections
+#include "control.h"
+#include "messagebinary.h"
+#include "messageschema.h"
+#include "messagewriter.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+static std::string json(const Message &msg)
+{
+  char buffer[MESSAGE_WRITER_MAX_LENGTH];
+  return std::string(buffer, messageToBuffer(msg, buffer, sizeof(buffer)));
+}
+
+static Message randomMessage(MessageType messageType, int type)
+{
+  Message msg = messageType == MessageType::COMMAND ? commandMessage((CommandType)type) : infoMessage((InfoType)type);
+  const MessageSchema *schema = messageSchemaFind(messageType, type);
+  // Half the messages carry a sequence, the rest must not grow a tag
+  msg.sequence = nextRandom() % 2 ? (uint16_t)nextRandom() : 0;
+  char *base = (char *)&msg;
+  for (size_t i = 0; i < schema->fieldCount; i++)
+  {
+    const SchemaField &field = schema->fields[i];
+    switch (field.kind)
+    {
+    case FIELD_INT:
+      *(int *)(base + field.offset) = (int)nextRandom();
+      break;
+    case FIELD_FLOAT:
+      *(float *)(base + field.offset) = (float)(int)nextRandom() / 1000.0f;
+      break;
+    case FIELD_ACTION:
+    case FIELD_MODE:
+      *(uint8_t *)(base + field.offset) = (uint8_t)(nextRandom() % 3);
+      break;
+    }
+  }
+  return msg;
+}
+
+// Every schema entry survives the binary round trip with the fields the JSON carries
+static void testRoundTrip()
+{
+  static const MessageType messageTypes[] = {MessageType::COMMAND, MessageType::INFO};
+  int entries = 0;
+  for (MessageType messageType : messageTypes)
+  {
+    for (int type = 0; messageSchemaFind(messageType, type) != NULL; type++)
+    {
+      entries++;
+      for (int round = 0; round < 100; round++)
+      {
+        Message msg = randomMessage(messageType, type);
+        uint8_t frame[MESSAGE_BINARY_MAX_LENGTH];
+        size_t length = messageToBinary(msg, frame, sizeof(frame));
+        CHECK(length > MESSAGE_BINARY_HEADER && length <= sizeof(frame));
+        CHECK(binaryFrameLength(frame, length) == length);
+
+        Message decoded;
+        CHECK(binaryToMessage(frame, length, decoded));
+        CHECK(decoded.messageType == messageType);
+        CHECK(json(decoded) == json(msg));
+        CHECK(memcmp(&decoded, &msg, sizeof(Message)) == 0);
+      }
+    }
+  }
+  CHECK(entries == CommandType::RESET_STATS + 1 + InfoType::HEARTBEAT + 1);
+
+  Message pressure = pressureInfo(31.4f);
+  uint8_t frame[MESSAGE_BINARY_MAX_LENGTH];
+  CHECK(messageToBinary(pressure, frame, sizeof(frame)) == 10);
+  CHECK(messageToBinary(pressure, frame, 9) == 0);
+
+  Message unknown = commandMessage((CommandType)99);
+  CHECK(messageToBinary(unknown, frame, sizeof(frame)) == 0);
+}
+
+static Message untouched()
+{
+  Message msg;
+  memset(&msg, 0xA5, sizeof(msg));
+  return msg;
+}
+
+static bool rejected(const uint8_t *frame, size_t length)
+{
+  Message msg = untouched();
+  Message before = msg;
+  return !binaryToMessage(frame, length, msg) && memcmp(&msg, &before, sizeof(msg)) == 0;
+}
+
+static void testRejections()
+{
+  // SCHEDULE id=7 action=OFF_RELEASE mode=DAILY time=3600
+  const uint8_t schedule[] = {20, 0, MessageType::COMMAND, CommandType::SCHEDULE,
+                              TAG_ID, 4, 7, 0, 0, 0,
+                              TAG_ACTION, 1, CommandType::OFF_RELEASE,
+                              TAG_MODE, 1, ScheduleMode::SCHEDULE_DAILY,
+                              TAG_TIME, 4, 0x10, 0x0E, 0, 0};
+  CHECK(sizeof(schedule) == 22);
+  uint8_t frame[sizeof(schedule)];
+  memcpy(frame, schedule, sizeof(schedule));
+
+  Message msg = {};
+  CHECK(binaryToMessage(frame, sizeof(schedule), msg));
+  Message expected = scheduleCommand(7, CommandType::OFF_RELEASE, ScheduleMode::SCHEDULE_DAILY, 3600);
+  CHECK(memcmp(&msg, &expected, sizeof(Message)) == 0);
+
+  // Every truncation, whether or not the length byte follows it
+  for (size_t length = 0; length < sizeof(schedule); length++)
+  {
+    CHECK(rejected(frame, length));
+    uint8_t truncated[sizeof(schedule)];
+    memcpy(truncated, frame, length);
+    if (length >= 2)
+    {
+      truncated[0] = (uint8_t)(length - 2);
+      CHECK(rejected(truncated, length));
+    }
+  }
+
+  // Missing required field: drop the mode
+  uint8_t noMode[sizeof(schedule)];
+  memcpy(noMode, frame, 13);
+  memcpy(noMode + 13, frame + 16, sizeof(schedule) - 16);
+  noMode[0] = sizeof(schedule) - 3 - 2;
+  CHECK(rejected(noMode, sizeof(schedule) - 3));
+
+  // Unknown tags are skipped
+  uint8_t extended[sizeof(schedule) + 4];
+  memcpy(extended, frame, sizeof(schedule));
+  const uint8_t extra[] = {200, 2, 1, 2};
+  memcpy(extended + sizeof(schedule), extra, sizeof(extra));
+  extended[0] = sizeof(extended) - 2;
+  CHECK(binaryToMessage(extended, sizeof(extended), msg));
+
+  uint8_t bad[sizeof(schedule)];
+  memcpy(bad, frame, sizeof(schedule));
+  bad[12] = CommandType::SCHEDULE; // Action that cannot be scheduled
+  CHECK(rejected(bad, sizeof(bad)));
+  memcpy(bad, frame, sizeof(schedule));
+  bad[15] = 3; // Mode out of range
+  CHECK(rejected(bad, sizeof(bad)));
+  memcpy(bad, frame, sizeof(schedule));
+  bad[3] = 99; // Unknown command
+  CHECK(rejected(bad, sizeof(bad)));
+  memcpy(bad, frame, sizeof(schedule));
+  bad[2] = MESSAGE_BINARY_TEXT;
+  CHECK(rejected(bad, sizeof(bad)));
+
+  // Random corruption never crashes and never half-writes msg
+  for (int i = 0; i < 100000; i++)
+  {
+    memcpy(bad, frame, sizeof(schedule));
+    int flips = 1 + nextRandom() % 3;
+    for (int f = 0; f < flips; f++)
+    {
+      bad[nextRandom() % sizeof(bad)] = (uint8_t)nextRandom();
+    }
+    Message corrupt = untouched();
+    Message before = corrupt;
+    if (!binaryToMessage(bad, sizeof(bad), corrupt))
+    {
+      CHECK(memcmp(&corrupt, &before, sizeof(corrupt)) == 0);
+    }
+  }
+}
+
+static void testTextFrames()
+{
+  uint8_t header[MESSAGE_BINARY_HEADER];
+  binaryTextHeader(header, 600);
+  CHECK(header[2] == MESSAGE_BINARY_TEXT);
+  CHECK(binaryFrameLength(header, sizeof(header)) == MESSAGE_BINARY_HEADER + 600);
+  CHECK(binaryFrameLength(header, 1) == 0);
+}
+
+static void testHello()
+{
+  WireEncoding encoding = WIRE_BINARY;
+  CHECK(bufferToHello("{\"messageType\":\"HELLO\",\"encoding\":\"JSON\"}", encoding) && encoding == WIRE_JSON);
+  CHECK(bufferToHello("{\"messageType\":\"HELLO\",\"encoding\":\"BINARY\"}", encoding) && encoding == WIRE_BINARY);
+  CHECK(bufferToHello("{\"messageType\":\"HELLO\"}", encoding) && encoding == WIRE_JSON);
+  CHECK(bufferToHello("{\"messageType\":\"HELLO\",\"encoding\":\"CBOR\"}", encoding) && encoding == WIRE_JSON);
+  CHECK(!bufferToHello("{\"messageType\":\"COMMAND\",\"commandType\":\"ON\"}", encoding));
+  CHECK(!bufferToHello("{\"messageType\":\"HELLO\"", encoding));
+  CHECK(bufferToHello(WIRE_HELLO, encoding));
+  CHECK(bufferToHello(WIRE_HELLO_BINARY_ACK, encoding) && encoding == WIRE_BINARY);
+
+  // A HELLO is not a command
+  Message msg = untouched();
+  Message before = msg;
+  CHECK(!bufferToMessage("{\"messageType\":\"HELLO\",\"encoding\":\"BINARY\"}", msg));
+  CHECK(memcmp(&msg, &before, sizeof(msg)) == 0);
+}
+
+int main()
+{
+  seedRandom(0x2545F491u);
+  if (freopen("/dev/null", "w", stdout) == NULL)
+  {
+    fprintf(stderr, "Could not silence stdout\n");
+  }
+
+  testRoundTrip();
+  testRejections();
+  testTextFrames();
+  testHello();
+
+  return checkSummary("binary");
+}
@@ -0,0 +1,52 @@
+// check.h
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Shared by the host tests. CHECK records a failure and carries on, so a run
+// reports every broken expectation. Failures go to stderr because some tests
+// silence the firmware's chatter on stdout.
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do                                                                           \
+  {                                                                            \
+    if (!(condition))                                                          \
+    {                                                                          \
+      fprintf(stderr, "FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+// xorshift32, so a failing random case replays the same on every run
+static uint32_t randomState = 0x2545F491u;
+
+static inline void seedRandom(uint32_t seed)
+{
+  randomState = seed;
+}
+
+static inline uint32_t nextRandom()
+{
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+// Summary line and exit status for main()
+static inline int checkSummary(const char *name)
+{
+  if (failures > 0)
+  {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  fprintf(stderr, "All %s tests passed\n", name);
+  return 0;
+}
+
+#endif // CHECK_H
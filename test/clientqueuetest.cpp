@@ -0,0 +1,144 @@
+// Per-client queues: order, drop-oldest when full, and the per-slot counters
+#include "clientqueue.h"
+#include "check.h"
+
+#include <stdio.h>
+
+static Message numbered(uint16_t number)
+{
+  Message msg = infoMessage(InfoType::TURNED_ON);
+  msg.sequence = number;
+  return msg;
+}
+
+static ClientQueue queues[CLIENT_QUEUE_SLOTS];
+
+static void testOrder()
+{
+  ClientQueue &queue = queues[0];
+  clientQueueInit(queue, 0);
+  CHECK(clientQueuePeek(queue) == NULL);
+  for (uint16_t number = 1; number <= 5; number++)
+  {
+    CHECK(clientQueuePush(queue, numbered(number)));
+  }
+  for (uint16_t number = 1; number <= 5; number++)
+  {
+    const Message *msg = clientQueuePeek(queue);
+    CHECK(msg != NULL && msg->sequence == number);
+    clientQueuePop(queue);
+  }
+  CHECK(clientQueuePeek(queue) == NULL);
+  clientQueuePop(queue); // Nothing to pop is not a send
+
+  ClientQueueStats stats[CLIENT_QUEUE_SLOTS];
+  clientQueueGetStats(stats);
+  CHECK(stats[0].connected && stats[0].queued == 5 && stats[0].sent == 5);
+  CHECK(stats[0].depth == 0 && stats[0].highWater == 5 && stats[0].dropped == 0);
+}
+
+static void testDropOldest()
+{
+  ClientQueue &queue = queues[1];
+  clientQueueInit(queue, 1);
+  for (uint16_t number = 1; number <= CLIENT_QUEUE_LENGTH; number++)
+  {
+    CHECK(clientQueuePush(queue, numbered(number)));
+  }
+  CHECK(!clientQueuePush(queue, numbered(CLIENT_QUEUE_LENGTH + 1)));
+  CHECK(!clientQueuePush(queue, numbered(CLIENT_QUEUE_LENGTH + 2)));
+
+  // The two oldest made way, the newest is last
+  const Message *msg = clientQueuePeek(queue);
+  CHECK(msg != NULL && msg->sequence == 3);
+  ClientQueueStats stats[CLIENT_QUEUE_SLOTS];
+  clientQueueGetStats(stats);
+  CHECK(stats[1].dropped == 2 && stats[1].depth == CLIENT_QUEUE_LENGTH && stats[1].highWater == CLIENT_QUEUE_LENGTH);
+
+  uint16_t last = 0;
+  while ((msg = clientQueuePeek(queue)) != NULL)
+  {
+    last = msg->sequence;
+    clientQueuePop(queue);
+  }
+  CHECK(last == CLIENT_QUEUE_LENGTH + 2);
+
+  // Another slot's counters are its own
+  clientQueueGetStats(stats);
+  CHECK(stats[0].dropped == 0 && stats[0].sent == 5);
+
+  // Closing keeps the counters for a look afterwards, a new client starts them over
+  clientQueuePush(queue, numbered(1));
+  clientQueueClose(queue);
+  clientQueueGetStats(stats);
+  CHECK(!stats[1].connected && stats[1].depth == 0 && stats[1].dropped == 2);
+  CHECK(clientQueuePeek(queue) == NULL);
+  clientQueueInit(queue, 1);
+  clientQueueGetStats(stats);
+  CHECK(stats[1].connected && stats[1].dropped == 0 && stats[1].queued == 0);
+}
+
+// Fast and slow readers fed the same stream: each ends up with an in-order
+// subsequence, and what it is missing is exactly what it was told it dropped
+static void testFanOut()
+{
+  const int clients = CLIENT_QUEUE_SLOTS;
+  const uint32_t readChance[clients] = {100, 90, 30, 0};
+  for (int slot = 0; slot < clients; slot++)
+  {
+    clientQueueInit(queues[slot], slot);
+  }
+
+  uint16_t lastSeen[clients] = {};
+  uint32_t received[clients] = {};
+  bool ordered = true;
+  const uint16_t total = 20000;
+  for (uint16_t number = 1; number <= total; number++)
+  {
+    for (int slot = 0; slot < clients; slot++)
+    {
+      clientQueuePush(queues[slot], numbered(number));
+    }
+    for (int slot = 0; slot < clients; slot++)
+    {
+      int reads = 0;
+      while (reads < 2 && nextRandom() % 100 < readChance[slot])
+      {
+        const Message *msg = clientQueuePeek(queues[slot]);
+        if (msg == NULL)
+        {
+          break;
+        }
+        ordered = ordered && msg->sequence > lastSeen[slot];
+        lastSeen[slot] = msg->sequence;
+        received[slot]++;
+        clientQueuePop(queues[slot]);
+        reads++;
+      }
+    }
+  }
+  CHECK(ordered);
+
+  ClientQueueStats stats[CLIENT_QUEUE_SLOTS];
+  clientQueueGetStats(stats);
+  for (int slot = 0; slot < clients; slot++)
+  {
+    CHECK(stats[slot].queued == total);
+    CHECK(stats[slot].sent == received[slot]);
+    CHECK(stats[slot].sent + stats[slot].dropped + stats[slot].depth == total);
+    CHECK(stats[slot].depth <= CLIENT_QUEUE_LENGTH);
+  }
+  CHECK(stats[0].dropped == 0);
+  CHECK(stats[3].sent == 0 && stats[3].depth == CLIENT_QUEUE_LENGTH);
+  CHECK(stats[2].dropped > 0 && stats[2].sent > 0);
+}
+
+int main()
+{
+  seedRandom(0x6A09E667u);
+  testOrder();
+  testDropOldest();
+  testFanOut();
+
+  return checkSummary("client queue");
+}
@@ -0,0 +1,220 @@
+// Codec throughput: messages/s, bytes/s and heap allocations per message for
+// JSON parse and write and binary decode and encode, over one of each message
+// the schema knows. Not a test, run it before and after a codec change:
+//   codec-bench [iterations]
+#include "control.h"
+#include "messagebinary.h"
+#include "messageschema.h"
+#include "messagewriter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define BENCH_DEFAULT_ITERATIONS 20000 // Passes over the message set per codec
+
+// Every allocation in the process is counted, whoever makes it. glibc lets the
+// real allocator be called under its internal name.
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+
+static volatile size_t allocations = 0;
+
+extern "C" void *malloc(size_t size)
+{
+  allocations++;
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+  allocations++;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+  allocations++;
+  return __libc_realloc(pointer, size);
+}
+#define ALLOCATIONS_COUNTED true
+#else
+static size_t allocations = 0;
+#define ALLOCATIONS_COUNTED false
+#endif
+
+typedef struct
+{
+  std::vector<Message> messages;
+  std::vector<std::string> json;
+  std::vector<std::vector<uint8_t>> binary;
+  size_t jsonBytes;
+  size_t binaryBytes;
+} Workload;
+
+// Fills every schema field of each known type with a plausible value
+static Workload buildWorkload()
+{
+  static const MessageType messageTypes[] = {MessageType::COMMAND, MessageType::INFO};
+  Workload workload = {};
+  for (MessageType messageType : messageTypes)
+  {
+    for (int type = 0; messageSchemaFind(messageType, type) != NULL; type++)
+    {
+      Message msg = messageType == MessageType::COMMAND ? commandMessage((CommandType)type) : infoMessage((InfoType)type);
+      const MessageSchema *schema = messageSchemaFind(messageType, type);
+      char *base = (char *)&msg;
+      for (size_t i = 0; i < schema->fieldCount; i++)
+      {
+        const SchemaField &field = schema->fields[i];
+        switch (field.kind)
+        {
+        case FIELD_INT:
+          *(int *)(base + field.offset) = 3600;
+          break;
+        case FIELD_FLOAT:
+          *(float *)(base + field.offset) = 31.4f;
+          break;
+        case FIELD_ACTION:
+        case FIELD_MODE:
+          *(uint8_t *)(base + field.offset) = 1;
+          break;
+        }
+      }
+      if (isCommand(msg, CommandType::ACK))
+      {
+        msg.sequence = 1234;
+      }
+
+      char json[MESSAGE_WRITER_MAX_LENGTH];
+      size_t jsonLength = messageToBuffer(msg, json, sizeof(json));
+      uint8_t binary[MESSAGE_BINARY_MAX_LENGTH];
+      size_t binaryLength = messageToBinary(msg, binary, sizeof(binary));
+      if (jsonLength == 0 || binaryLength == 0)
+      {
+        continue;
+      }
+      workload.messages.push_back(msg);
+      workload.json.push_back(std::string(json, jsonLength));
+      workload.binary.push_back(std::vector<uint8_t>(binary, binary + binaryLength));
+      workload.jsonBytes += jsonLength;
+      workload.binaryBytes += binaryLength;
+    }
+  }
+  return workload;
+}
+
+typedef struct
+{
+  const char *name;
+  size_t messages;
+  size_t bytes;
+  double seconds;
+  size_t allocations;
+  size_t failures;
+} BenchResult;
+
+template <typename Pass>
+static BenchResult run(const char *name, size_t messagesPerPass, size_t bytesPerPass, int iterations, Pass pass)
+{
+  BenchResult result = {name, 0, 0, 0.0, 0, 0};
+  size_t allocationsBefore = allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++)
+  {
+    result.failures += pass();
+  }
+  auto end = std::chrono::steady_clock::now();
+  result.allocations = allocations - allocationsBefore;
+  result.seconds = std::chrono::duration<double>(end - start).count();
+  result.messages = messagesPerPass * iterations;
+  result.bytes = bytesPerPass * iterations;
+  return result;
+}
+
+static void report(const BenchResult &result)
+{
+  printf("%-14s %12.0f %14.0f %12.3f", result.name, result.messages / result.seconds,
+         result.bytes / result.seconds, (double)result.allocations / result.messages);
+  if (result.failures > 0)
+  {
+    printf("  (%zu failed)", result.failures);
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+  int iterations = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_ITERATIONS;
+  if (iterations <= 0)
+  {
+    fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  Workload workload = buildWorkload();
+  size_t count = workload.messages.size();
+  printf("%zu messages, %zu JSON bytes and %zu binary bytes per pass, %d passes\n", count, workload.jsonBytes,
+         workload.binaryBytes, iterations);
+  if (!ALLOCATIONS_COUNTED)
+  {
+    printf("Allocations are only counted on glibc\n");
+  }
+
+  std::vector<BenchResult> results;
+
+  results.push_back(run("json parse", count, workload.jsonBytes, iterations, [&]() {
+    size_t failed = 0;
+    for (const std::string &json : workload.json)
+    {
+      Message msg = {};
+      failed += !bufferToMessage(json.c_str(), msg);
+    }
+    return failed;
+  }));
+
+  results.push_back(run("json write", count, workload.jsonBytes, iterations, [&]() {
+    size_t failed = 0;
+    char buffer[MESSAGE_WRITER_MAX_LENGTH];
+    for (const Message &msg : workload.messages)
+    {
+      failed += messageToBuffer(msg, buffer, sizeof(buffer)) == 0;
+    }
+    return failed;
+  }));
+
+  results.push_back(run("binary decode", count, workload.binaryBytes, iterations, [&]() {
+    size_t failed = 0;
+    for (const std::vector<uint8_t> &frame : workload.binary)
+    {
+      Message msg = {};
+      failed += !binaryToMessage(frame.data(), frame.size(), msg);
+    }
+    return failed;
+  }));
+
+  results.push_back(run("binary encode", count, workload.binaryBytes, iterations, [&]() {
+    size_t failed = 0;
+    uint8_t buffer[MESSAGE_BINARY_MAX_LENGTH];
+    for (const Message &msg : workload.messages)
+    {
+      failed += messageToBinary(msg, buffer, sizeof(buffer)) == 0;
+    }
+    return failed;
+  }));
+
+  printf("%-14s %12s %14s %12s\n", "codec", "messages/s", "bytes/s", "allocs/msg");
+  size_t failures = 0;
+  for (const BenchResult &result : results)
+  {
+    report(result);
+    failures += result.failures;
+  }
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+// Codec fuzz target: untrusted socket bytes through the framer, the JSON
+// parser and the binary decoder. Built against libFuzzer with
+// -DCODEC_FUZZER=ON (Clang only); otherwise main() replays the files named on
+// the command line, or the seeds below and mutations of them.
+//
+// Invariants checked on every input, besides the sanitizers' own:
+//  - an accepted message has a type the schema knows, a rejected one is untouched
+//  - an accepted JSON command writes, reparses, and writes the same text again
+//  - an accepted binary frame re-encodes and decodes to the same Message
+//  - the framer never hands out more than it was asked for
+#include "control.h"
+#include "framing.h"
+#include "messagebinary.h"
+#include "messageschema.h"
+#include "messagewriter.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#define FUZZ_MAX_INPUT 4096 // Longer inputs only repeat what shorter ones cover
+
+static void require(bool condition, const char *what)
+{
+  if (!condition)
+  {
+    fprintf(stderr, "Invariant failed: %s\n", what);
+    abort();
+  }
+}
+
+// Filled with a pattern no field takes by default, so a parser that forgets
+// to set the type, or writes before it rejects, is caught
+static Message poisoned()
+{
+  Message msg;
+  memset(&msg, 0xA5, sizeof(msg));
+  return msg;
+}
+
+static void checkVerdict(bool accepted, const Message &msg)
+{
+  Message poison = poisoned();
+  if (accepted)
+  {
+    require(messageSchemaFor(msg) != NULL, "accepted message has a known type");
+  }
+  else
+  {
+    require(memcmp(&msg, &poison, sizeof(Message)) == 0, "rejected message is untouched");
+  }
+}
+
+static void fuzzJson(const uint8_t *data, size_t size)
+{
+  std::string text((const char *)data, size);
+  Message msg = poisoned();
+  bool accepted = bufferToMessage(text.c_str(), msg);
+  checkVerdict(accepted, msg);
+  if (!accepted)
+  {
+    WireEncoding encoding;
+    bufferToHello(text.c_str(), encoding);
+    return;
+  }
+
+  // Only commands come in; the parser recognises just the three info types
+  // the old server sent, and writes RELEASE_COUNTDOWN_UPDATE under another name
+  char written[MESSAGE_WRITER_MAX_LENGTH];
+  if (msg.messageType != MessageType::COMMAND || messageToBuffer(msg, written, sizeof(written)) == 0)
+  {
+    return;
+  }
+  Message reparsed = {};
+  require(bufferToMessage(written, reparsed), "written JSON parses");
+  char rewritten[MESSAGE_WRITER_MAX_LENGTH];
+  require(messageToBuffer(reparsed, rewritten, sizeof(rewritten)) > 0, "reparsed message writes");
+  require(strcmp(written, rewritten) == 0, "JSON round trip is stable");
+}
+
+static void fuzzBinary(const uint8_t *data, size_t size)
+{
+  Message msg = poisoned();
+  bool accepted = binaryToMessage(data, size, msg);
+  checkVerdict(accepted, msg);
+  if (!accepted)
+  {
+    return;
+  }
+  require(binaryFrameLength(data, size) == size, "accepted frame is exactly one frame");
+
+  uint8_t encoded[MESSAGE_BINARY_MAX_LENGTH];
+  size_t length = messageToBinary(msg, encoded, sizeof(encoded));
+  require(length > 0, "decoded message encodes");
+  Message decoded = {};
+  require(binaryToMessage(encoded, length, decoded), "encoded frame decodes");
+  require(memcmp(&msg, &decoded, sizeof(Message)) == 0, "binary round trip is exact");
+}
+
+// The first byte picks the encoding and the read size, as TCP would cut the stream
+static void fuzzFraming(const uint8_t *data, size_t size)
+{
+  if (size == 0)
+  {
+    return;
+  }
+  static FrameAssembler assembler;
+  frameAssemblerInit(assembler, data[0] & 1 ? WIRE_BINARY : WIRE_JSON);
+  size_t chunk = 1 + (data[0] >> 1);
+  data++;
+  size--;
+
+  uint8_t frame[FRAME_MAX_LENGTH];
+  while (size > 0)
+  {
+    size_t pushed = frameAssemblerPush(assembler, data, size < chunk ? size : chunk);
+    data += pushed;
+    size -= pushed;
+
+    size_t length;
+    FrameResult result;
+    while ((result = frameAssemblerNext(assembler, frame, sizeof(frame), &length)) != FRAME_NONE)
+    {
+      if (result == FRAME_CORRUPT)
+      {
+        return;
+      }
+      if (result == FRAME_READY)
+      {
+        require(length < sizeof(frame), "frame fits the buffer");
+        if (assembler.encoding == WIRE_JSON)
+        {
+          require(frame[length] == '\0', "JSON frame is terminated");
+          fuzzJson(frame, length);
+        }
+        else
+        {
+          fuzzBinary(frame, length);
+        }
+      }
+    }
+    if (pushed == 0)
+    {
+      return; // Full ring and no frame to take, the socket would drop the connection
+    }
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  if (size > FUZZ_MAX_INPUT)
+  {
+    return 0;
+  }
+  fuzzJson(data, size);
+  fuzzBinary(data, size);
+  fuzzFraming(data, size);
+  return 0;
+}
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+  (void)argc;
+  (void)argv;
+  // Both decoders print on rejection
+  if (freopen("/dev/null", "w", stdout) == NULL)
+  {
+    fprintf(stderr, "Could not silence stdout\n");
+  }
+  return 0;
+}
+
+#ifndef CODEC_FUZZER
+
+#define SEED(literal) std::string(literal, sizeof(literal) - 1)
+
+// SCHEDULE id=7 action=OFF_RELEASE mode=DAILY time=3600 as a binary frame
+#define SCHEDULE_FRAME "\x14\x00\x00\x06\x02\x04\x07\x00\x00\x00\x03\x01\x02\x04\x01\x02\x05\x04\x10\x0e\x00\x00"
+
+static const std::string seeds[] = {
+    SEED("{\"messageType\":\"COMMAND\",\"commandType\":\"ON\"}"),
+    SEED("{\"messageType\":\"COMMAND\",\"commandType\":\"SET_COMPRESSION_TIMEOUT\",\"timeout\":30}"),
+    SEED("{\"messageType\":\"COMMAND\",\"commandType\":\"SCHEDULE\",\"id\":3,\"action\":\"ON\",\"mode\":\"DAILY\",\"time\":25200}"),
+    SEED("{\"messageType\":\"COMMAND\",\"commandType\":\"GET_RECORDER\",\"since\":12}"),
+    SEED("{\"messageType\":\"COMMAND\",\"commandType\":\"GET_HISTORY\",\"from\":-3600,\"resolution\":60}"),
+    SEED("{\"messageType\":\"COMMAND\",\"commandType\":\"ACK\",\"seq\":42}"),
+    SEED("{\"messageType\":\"INFO\",\"infoType\":\"PRESSURE_CHANGE\",\"pressure\":31.4}"),
+    SEED("{\"messageType\":\"INFO\",\"infoType\":\"RELEASE_COUNTDOWN_UPDATED\",\"timeout\":7}"),
+    SEED("{\"messageType\":\"HELLO\",\"encoding\":\"BINARY\"}"),
+    SEED("{\"a\":[1,{\"b\":[null,true,false]},\"\\ud83d\\ude00\"],\"messageType\":\"COMMAND\",\"commandType\":\"OFF\"}"),
+    SEED(SCHEDULE_FRAME),
+    SEED("\x00{\"messageType\":\"COMMAND\",\"commandType\":\"ON\"}\r\n\n{\"messageType\":\"COMMAND\""),
+    SEED("\x01" SCHEDULE_FRAME SCHEDULE_FRAME),
+};
+
+static std::string mutate(std::string input)
+{
+  int mutations = 1 + nextRandom() % 8;
+  for (int i = 0; i < mutations; i++)
+  {
+    size_t position = input.empty() ? 0 : nextRandom() % (input.size() + 1);
+    switch (nextRandom() % 3)
+    {
+    case 0:
+      if (position < input.size())
+      {
+        input[position] = (char)nextRandom();
+      }
+      break;
+    case 1:
+      input.insert(position, 1, (char)nextRandom());
+      break;
+    default:
+      input.erase(position, nextRandom() % 4);
+      break;
+    }
+  }
+  return input;
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &contents)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    fprintf(stderr, "Could not open %s\n", path);
+    return false;
+  }
+  uint8_t buffer[4096];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+  {
+    contents.insert(contents.end(), buffer, buffer + count);
+  }
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  LLVMFuzzerInitialize(&argc, &argv);
+  seedRandom(0xC0DEC0DEu);
+
+  if (argc > 1)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      std::vector<uint8_t> contents;
+      if (!readFile(argv[i], contents))
+      {
+        return 1;
+      }
+      LLVMFuzzerTestOneInput(contents.data(), contents.size());
+    }
+    fprintf(stderr, "Replayed %d input(s)\n", argc - 1);
+    return 0;
+  }
+
+  int runs = 0;
+  for (const std::string &seed : seeds)
+  {
+    LLVMFuzzerTestOneInput((const uint8_t *)seed.data(), seed.size());
+    runs++;
+  }
+  for (int i = 0; i < 100000; i++)
+  {
+    std::string input = mutate(seeds[nextRandom() % (sizeof(seeds) / sizeof(seeds[0]))]);
+    LLVMFuzzerTestOneInput((const uint8_t *)input.data(), input.size());
+    runs++;
+  }
+  fprintf(stderr, "All %d codec fuzz inputs passed\n", runs);
+  return 0;
+}
+
+#endif // CODEC_FUZZER
@@ -0,0 +1,557 @@
+// Host tests for the control logic, driven on simulated time
+#include "control.h"
+#include "constants.h"
+#include "settings.h"
+#include "sensors.h"
+#include "scheduler.h"
+#include "thermal.h"
+#include "recorder.h"
+#include "latency.h"
+#include "outbox.h"
+#include "stats.h"
+#include "messagewriter.h"
+#include "messagebinary.h"
+#include "messageschema.h"
+#include "retransmit.h"
+#include "hallinux.h"
+#include "check.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+static void setUp()
+{
+  halSimReset();
+  recorderClear();
+  initRecorder();
+  initSettings();
+  currentSettings.compressionTimeout = 2;
+  currentSettings.supplyTimeout = 1;
+  currentSettings.motorTimeout = 2;
+  currentSettings.motorTemperatureLimit = THERMAL_DEFAULT_LIMIT_C;
+  initControl();
+  initScheduler();
+  initThermal();
+  initSensors();
+
+  // Room for everything a test produces between drains
+  outgoingMessageQueue = halQueueCreate(64, sizeof(Message));
+}
+
+// Critical events from the retransmit ring, acknowledged as a server would,
+// then the best-effort queue
+static std::vector<Message> drainOutgoing()
+{
+  std::vector<Message> messages;
+  Message msg;
+  while (retransmitPeek(&msg))
+  {
+    retransmitAdvance();
+    retransmitAcknowledge(msg.sequence);
+    messages.push_back(msg);
+  }
+  while (halQueueReceive(outgoingMessageQueue, &msg, 0))
+  {
+    messages.push_back(msg);
+  }
+  return messages;
+}
+
+static bool containsInfo(const std::vector<Message> &messages, InfoType infoType)
+{
+  for (const Message &msg : messages)
+  {
+    if (isInfo(msg, infoType))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void runControl()
+{
+  while (controlTaskStep(0))
+  {
+  }
+}
+
+static Message command(CommandType commandType)
+{
+  return commandMessage(commandType);
+}
+
+static void testOnOff()
+{
+  setUp();
+
+  handleMessage(command(CommandType::ON));
+  CHECK(halGpioGet(RELAY_GPIO));
+  CHECK(!halGpioGet(SOLENOID_GPIO));
+  CHECK(containsInfo(drainOutgoing(), TURNED_ON));
+
+  handleMessage(command(CommandType::OFF));
+  CHECK(!halGpioGet(RELAY_GPIO));
+  CHECK(containsInfo(drainOutgoing(), TURNED_OFF));
+}
+
+static void testCompressionTimeoutReleases()
+{
+  setUp();
+
+  handleMessage(command(CommandType::ON));
+  drainOutgoing();
+
+  halSimAdvanceMs(60 * 1000);
+  std::vector<Message> messages = drainOutgoing();
+  CHECK(containsInfo(messages, COMPRESSION_COUNTDOWN_UPDATED));
+  CHECK(halGpioGet(RELAY_GPIO));
+
+  // Expiry switches the relay off and holds the solenoid open for the release
+  halSimAdvanceMs(60 * 1000);
+  messages = drainOutgoing();
+  CHECK(containsInfo(messages, COMPRESSION_COUNTOWN_END));
+  CHECK(containsInfo(messages, RELEASING));
+  CHECK(containsInfo(messages, RELEASED));
+  CHECK(!halGpioGet(RELAY_GPIO));
+  CHECK(!halGpioGet(SOLENOID_GPIO));
+  CHECK(halTimeUs() >= 140ULL * 1000 * 1000);
+}
+
+static void testShutDownButton()
+{
+  setUp();
+
+  handleMessage(command(CommandType::ON));
+  drainOutgoing();
+
+  halSimSetInput(SHUT_DOWN_BUTTON_GPIO, 1);
+  halSimSetInput(SHUT_DOWN_BUTTON_GPIO, 0);
+  halSimSetInput(SHUT_DOWN_BUTTON_GPIO, 1);
+  CHECK(interactionTaskStep(0));
+  CHECK(!halGpioGet(RELAY_GPIO));
+  CHECK(containsInfo(drainOutgoing(), RELEASED));
+}
+
+static void testScheduledCommands()
+{
+  setUp();
+
+  CHECK(schedulerAdd(1, CommandType::ON, SCHEDULE_IN, 30));
+  CHECK(!schedulerAdd(2, CommandType::OFF, SCHEDULE_DAILY, 3600)); // No clock yet
+  CHECK(schedulerSecondsUntilNext() == 30);
+
+  halSimAdvanceMs(29 * 1000);
+  CHECK(schedulerRunDue() == 0);
+  halSimAdvanceMs(1000);
+  CHECK(schedulerRunDue() == 1);
+  runControl();
+  CHECK(halGpioGet(RELAY_GPIO));
+  CHECK(schedulerCount() == 0);
+
+  schedulerSetClock(8 * 3600);
+  CHECK(schedulerAdd(2, CommandType::OFF, SCHEDULE_DAILY, 8 * 3600 + 60));
+  halSimAdvanceMs(60 * 1000);
+  CHECK(schedulerRunDue() == 1);
+  runControl();
+  CHECK(!halGpioGet(RELAY_GPIO));
+  CHECK(containsInfo(drainOutgoing(), SCHEDULE_TRIGGERED));
+
+  // Recurring entries come back a day later
+  CHECK(schedulerCount() == 1);
+  CHECK(schedulerSecondsUntilNext() == SECONDS_PER_DAY);
+  CHECK(schedulerRemove(2));
+  CHECK(schedulerCount() == 0);
+
+  // A full queue keeps the entry due until its command goes in
+  CHECK(schedulerAdd(3, CommandType::ON, SCHEDULE_IN, 10));
+  halSimAdvanceMs(10 * 1000);
+  Message filler = command(CommandType::GET_STATE);
+  while (halQueueSend(incommingMessageQueue, &filler, 0))
+  {
+  }
+  CHECK(schedulerRunDue() == 0);
+  CHECK(schedulerCount() == 1 && schedulerSecondsUntilNext() == 0);
+  runControl();
+  CHECK(schedulerRunDue() == 1);
+  CHECK(schedulerCount() == 0);
+  runControl();
+  CHECK(halGpioGet(RELAY_GPIO));
+
+  // Ids are not truncated to 16 bits
+  CHECK(schedulerAdd(70000, CommandType::OFF, SCHEDULE_IN, 60));
+  CHECK(schedulerAdd(70000 - 65536, CommandType::OFF, SCHEDULE_IN, 60));
+  CHECK(schedulerCount() == 2);
+  CHECK(schedulerRemove(70000) && schedulerRemove(70000 - 65536));
+}
+
+static void testThermalLimit()
+{
+  setUp();
+
+  // Twice the rated current heats well past the limit
+  for (int i = 0; i < 600 && halSimQueueCount(incommingMessageQueue) == 0; i++)
+  {
+    thermalUpdate(2 * THERMAL_RATED_CURRENT_DA, 1000);
+  }
+
+  ThermalState state;
+  thermalGetState(&state);
+  CHECK(state.overheated);
+  CHECK(state.temperatureMilliC >= state.limitMilliC);
+  CHECK(containsInfo(drainOutgoing(), MOTOR_OVERHEAT));
+
+  // The model queued an OFF, and a new start is deferred until cool
+  Message queued;
+  CHECK(halQueueReceive(incommingMessageQueue, &queued, 0));
+  CHECK(isCommand(queued, CommandType::OFF));
+
+  handleMessage(command(CommandType::ON));
+  CHECK(!halGpioGet(RELAY_GPIO));
+  CHECK(containsInfo(drainOutgoing(), MOTOR_START_BLOCKED));
+  CHECK(schedulerCount() == 1);
+  int coolDown = thermalSecondsUntilStartAllowed();
+  CHECK(coolDown > 0);
+
+  // Cooling with the motor off clears the lockout in about the predicted time
+  for (int i = 0; i < coolDown + 5; i++)
+  {
+    thermalUpdate(0, 1000);
+  }
+  CHECK(thermalSecondsUntilStartAllowed() == 0);
+}
+
+static void testSensorThresholds()
+{
+  setUp();
+
+  halSimSetAdc(PRESSURE_SENSOR_ADC_CHANNEL, 2000);
+  halSimSetAdc(CURRENT_SENSOR_ADC_CHANNEL, 2500);
+  sensorTaskStep();
+
+  std::vector<Message> messages = drainOutgoing();
+  CHECK(containsInfo(messages, PRESSURE_CHANGE));
+  CHECK(containsInfo(messages, MOTOR_START));
+  CHECK(pressure > 0.0f);
+  CHECK(currentDraw > 0.0f);
+
+  halSimSetAdc(CURRENT_SENSOR_ADC_CHANNEL, 2048);
+  halSimAdvanceMs(SENSOR_SAMPLE_INTERVAL_MS);
+  sensorTaskStep();
+  CHECK(containsInfo(drainOutgoing(), MOTOR_STOP));
+}
+
+static bool findRecord(uint32_t from, RecorderEvent event, uint8_t code, RecorderEntry *found)
+{
+  RecorderEntry entry;
+  while (recorderRead(from, &entry))
+  {
+    if (entry.event == event && entry.code == code)
+    {
+      *found = entry;
+      return true;
+    }
+    from = entry.sequence + 1;
+  }
+  return false;
+}
+
+static void testRecorder()
+{
+  setUp();
+  uint32_t start = recorderNextSequence();
+
+  Message on = command(CommandType::ON);
+  halSimAdvanceMs(1000);
+  handleMessage(on);
+
+  RecorderEntry entry;
+  CHECK(findRecord(start, RECORD_COMMAND, CommandType::ON, &entry));
+  CHECK(entry.timeUs == 1000000);
+  CHECK(findRecord(start, RECORD_GPIO, RELAY_GPIO, &entry));
+  CHECK(entry.value == 1);
+  CHECK(findRecord(start, RECORD_TRANSITION, TURNED_ON, &entry));
+
+  // Timer expiry and the release it causes, in order
+  halSimAdvanceMs(currentSettings.compressionTimeout * 60 * 1000);
+  RecorderEntry timer, released;
+  CHECK(findRecord(start, RECORD_TIMER, RECORDER_TIMER_COMPRESSION, &timer));
+  CHECK(findRecord(start, RECORD_TRANSITION, RELEASED, &released));
+  CHECK(released.sequence > timer.sequence);
+  CHECK(released.timeUs - timer.timeUs == 20000000);
+
+  // A soft reset keeps the ring and continues the numbering
+  uint32_t beforeReset = recorderNextSequence();
+  initRecorder();
+  CHECK(recorderRead(beforeReset, &entry));
+  CHECK(entry.event == RECORD_BOOT);
+  CHECK(entry.value == 2);
+  CHECK(recorderRead(start, &entry) && entry.sequence == start);
+
+  // Wrapping drops the oldest entries
+  for (int i = 0; i < RECORDER_ENTRIES; i++)
+  {
+    recorderLog(RECORD_GPIO, 0, i);
+  }
+  CHECK(recorderRead(start, &entry));
+  CHECK(entry.sequence == recorderNextSequence() - RECORDER_ENTRIES);
+
+  // A dump walks from the requested sequence to the end marker
+  handleMessage(recorderCommand(recorderNextSequence() - 3));
+  int records = 0;
+  bool end = false;
+  while (recorderNextDumpEntry(&entry, &end) && !end)
+  {
+    records++;
+  }
+  CHECK(end);
+  CHECK(records == 4); // Includes the GET_RECORDER command itself
+  CHECK(!recorderNextDumpEntry(&entry, &end));
+  CHECK(recorderEntryToString(entry).find("\"messageType\":\"RECORD\"") != std::string::npos);
+}
+
+static void testLatency()
+{
+  setUp();
+  latencyReset();
+
+  // A command stamped as the socket task would, 300 us after it arrived
+  halSimAdvanceMs(5);
+  Message on = command(CommandType::ON);
+  on.receivedUs = latencyNowUs() - 300;
+  on.enqueuedUs = latencyNowUs();
+  CHECK(halQueueSend(incommingMessageQueue, &on, 0));
+
+  halSimAdvanceMs(2);
+  CHECK(controlTaskStep(0));
+  CHECK(halGpioGet(RELAY_GPIO));
+
+  LatencyHistogram histogram;
+  latencyGetStage(LATENCY_QUEUE, &histogram);
+  CHECK(histogram.count == 1);
+  CHECK(histogram.maxUs == 2000);
+  CHECK(histogram.buckets[10] == 1); // 1024..2047 us
+  latencyGetStage(LATENCY_ACTUATE, &histogram);
+  CHECK(histogram.count == 1);
+  latencyGetStage(LATENCY_TOTAL, &histogram);
+  CHECK(histogram.count == 1);
+  CHECK(histogram.maxUs == 2300);
+
+  // Local commands are not timed, and a command without a GPIO write only
+  // counts its queueing
+  handleMessage(command(CommandType::OFF));
+  Message get = command(CommandType::GET_LATENCY);
+  get.receivedUs = latencyNowUs();
+  get.enqueuedUs = latencyNowUs();
+  CHECK(halQueueSend(incommingMessageQueue, &get, 0));
+  CHECK(controlTaskStep(0));
+  latencyGetStage(LATENCY_TOTAL, &histogram);
+  CHECK(histogram.count == 1);
+  latencyGetStage(LATENCY_QUEUE, &histogram);
+  CHECK(histogram.count == 2);
+
+  CHECK(latencyTakeReportRequest());
+  CHECK(!latencyTakeReportRequest());
+  CHECK(latencyReportToString().find("\"stage\":\"TOTAL\",\"count\":1") != std::string::npos);
+  CHECK(latencyReportToString().find("\"outbox\"") == std::string::npos);
+
+  handleMessage(command(CommandType::RESET_LATENCY));
+  latencyGetStage(LATENCY_TOTAL, &histogram);
+  CHECK(histogram.count == 0);
+}
+
+static Outbox outbox;
+
+static void testStats()
+{
+  setUp();
+  halSignalWait(outgoingMessageSignal, 0);
+  statsReset();
+  outboxClear(outbox);
+  outboxRecordFlush(outbox, true);
+  latencyRecord(LATENCY_TOTAL, 500);
+
+  handleMessage(command(CommandType::GET_STATS));
+  CHECK(halSignalWait(outgoingMessageSignal, 0));
+  CHECK(statsTakeReportRequest());
+  CHECK(!statsTakeReportRequest());
+  std::string report = statsReportToString();
+  CHECK(report.find("{\"messageType\":\"STATS\",\"outbox\":{\"flushes\":1,") == 0);
+  CHECK(report.find("\"connection\":{") != std::string::npos && report.find("\"clients\":[") != std::string::npos);
+  CHECK(report.find("\"tls\":{") != std::string::npos && report.find("\"stages\"") == std::string::npos);
+
+  // Each reset only clears its own report
+  OutboxStats outboxStats;
+  LatencyHistogram histogram;
+  handleMessage(command(CommandType::RESET_LATENCY));
+  outboxGetStats(&outboxStats);
+  CHECK(outboxStats.flushes == 1);
+  latencyRecord(LATENCY_TOTAL, 500);
+  handleMessage(command(CommandType::RESET_STATS));
+  outboxGetStats(&outboxStats);
+  CHECK(outboxStats.flushes == 0);
+  latencyGetStage(LATENCY_TOTAL, &histogram);
+  CHECK(histogram.count == 1);
+}
+
+static void testOutgoingSignal()
+{
+  setUp();
+  halSignalWait(outgoingMessageSignal, 0);
+
+  // The socket sender sleeps until control has something for it
+  handleMessage(command(CommandType::ON));
+  CHECK(halSignalWait(outgoingMessageSignal, 0));
+  drainOutgoing();
+  CHECK(!halSignalWait(outgoingMessageSignal, 0));
+
+  // Reports built by the sender itself wake it too
+  handleMessage(command(CommandType::GET_LATENCY));
+  CHECK(halSignalWait(outgoingMessageSignal, 0));
+  CHECK(latencyTakeReportRequest());
+  handleMessage(command(CommandType::GET_RECORDER));
+  CHECK(halSignalWait(outgoingMessageSignal, 0));
+}
+
+static void testCriticalEvents()
+{
+  setUp();
+
+  // State transitions are sequenced and held for acknowledgement, not queued
+  handleMessage(command(CommandType::ON));
+  Message msg;
+  bool queued = false;
+  while (halQueueReceive(outgoingMessageQueue, &msg, 0))
+  {
+    queued = queued || isInfo(msg, TURNED_ON);
+  }
+  CHECK(!queued);
+  CHECK(retransmitPeek(&msg));
+  CHECK(isInfo(msg, TURNED_ON) && msg.sequence != 0);
+  CHECK(retransmitPending() == 1);
+
+  // Unacknowledged events survive a reconnect
+  retransmitAdvance();
+  retransmitRewind();
+  Message again;
+  CHECK(retransmitPeek(&again) && again.sequence == msg.sequence);
+
+  Message ack = {};
+  CHECK(bufferToMessage("{\"messageType\":\"COMMAND\",\"commandType\":\"ACK\",\"seq\":1}", ack));
+  retransmitAcknowledge(ack.sequence);
+  CHECK(retransmitPending() == 0);
+  CHECK(!retransmitPeek(&again));
+}
+
+static void testStateSnapshot()
+{
+  setUp();
+  halSignalWait(outgoingMessageSignal, 0);
+
+  handleMessage(command(CommandType::ON));
+  halSimAdvanceMs(30000);
+  drainOutgoing();
+
+  Message get = {};
+  CHECK(bufferToMessage("{\"messageType\":\"COMMAND\",\"commandType\":\"GET_STATE\"}", get));
+  CHECK(isCommand(get, CommandType::GET_STATE));
+  CHECK(halQueueSend(incommingMessageQueue, &get, 0));
+  CHECK(controlTaskStep(0));
+  CHECK(halSignalWait(outgoingMessageSignal, 0));
+
+  ControlSnapshot snapshot;
+  CHECK(controlTakeStateSnapshot(&snapshot));
+  CHECK(!controlTakeStateSnapshot(&snapshot));
+  CHECK(snapshot.state == CONTROL_COMPRESSING);
+  CHECK(snapshot.relay && !snapshot.solenoid);
+  CHECK(snapshot.compressionRemaining == 2 * 60 - 30);
+  CHECK(snapshot.supplyRemaining == 0);
+  CHECK(snapshot.compressionTimeout == 2 && snapshot.motorTemperatureLimit == THERMAL_DEFAULT_LIMIT_C);
+
+  char text[STATE_WRITER_MAX_LENGTH];
+  snapshot.pressure = 6.5f;
+  snapshot.current = 3.25f;
+  snapshot.motorTemperature = 41.5f;
+  CHECK(controlSnapshotToBuffer(snapshot, text, sizeof(text)) > 0);
+  char expected[STATE_WRITER_MAX_LENGTH];
+  snprintf(expected, sizeof(expected),
+           "{\"messageType\":\"STATE\",\"state\":\"COMPRESSING\",\"relay\":true,\"solenoid\":false,"
+           "\"pressure\":6.5,\"current\":3.25,\"motorTemperature\":41.5,"
+           "\"countdowns\":{\"compression\":90,\"supply\":0,\"motor\":0},"
+           "\"settings\":{\"compressionTimeout\":2,\"supplyTimeout\":%d,\"motorTimeout\":%d,"
+           "\"motorTemperatureLimit\":%d}}",
+           snapshot.supplyTimeout, snapshot.motorTimeout, snapshot.motorTemperatureLimit);
+  CHECK(strcmp(text, expected) == 0);
+  CHECK(controlSnapshotToBuffer(snapshot, text, strlen(expected)) == 0 && text[0] == '\0');
+
+  // The longest a STATE can get still fits
+  ControlSnapshot longest = snapshot;
+  longest.state = CONTROL_COMPRESSING;
+  longest.pressure = longest.current = longest.motorTemperature = -1.17549435e-38f;
+  longest.compressionRemaining = longest.supplyRemaining = longest.motorRemaining = 2147483647u;
+  longest.compressionTimeout = longest.supplyTimeout = longest.motorTimeout = longest.motorTemperatureLimit = INT32_MIN;
+  CHECK(controlSnapshotToBuffer(longest, text, sizeof(text)) > 0);
+
+  // Binary: fixed length, no type byte, fields in schema order
+  uint8_t frame[MESSAGE_BINARY_STATE_LENGTH];
+  CHECK(controlSnapshotToBinary(snapshot, frame, sizeof(frame)) == MESSAGE_BINARY_STATE_LENGTH);
+  CHECK(binaryFrameLength(frame, sizeof(frame)) == MESSAGE_BINARY_STATE_LENGTH);
+  CHECK(frame[2] == MESSAGE_BINARY_STATE);
+  CHECK(frame[3] == TAG_STATE && frame[4] == 1 && frame[5] == CONTROL_COMPRESSING);
+  CHECK(frame[6] == TAG_RELAY && frame[8] == 1 && frame[9] == TAG_SOLENOID && frame[11] == 0);
+  float pressure;
+  CHECK(frame[12] == TAG_PRESSURE && frame[13] == 4);
+  memcpy(&pressure, frame + 14, sizeof(pressure));
+  CHECK(pressure == 6.5f);
+  CHECK(frame[30] == TAG_COMPRESSION_REMAINING && frame[32] == 90);
+  CHECK(frame[MESSAGE_BINARY_STATE_LENGTH - 6] == TAG_LIMIT);
+  CHECK(controlSnapshotToBinary(snapshot, frame, sizeof(frame) - 1) == 0);
+
+  // Nothing is queued for a snapshot, the sender builds it
+  CHECK(drainOutgoing().empty());
+
+  handleMessage(command(CommandType::OFF));
+  controlGetSnapshot(&snapshot);
+  CHECK(snapshot.state == CONTROL_IDLE && !snapshot.relay && snapshot.compressionRemaining == 0);
+}
+
+static void testMessageRoundTrip()
+{
+  Message msg = scheduleCommand(7, CommandType::OFF_RELEASE, SCHEDULE_DAILY, 3600);
+
+  char json[MESSAGE_WRITER_MAX_LENGTH];
+  CHECK(messageToBuffer(msg, json, sizeof(json)) > 0);
+  Message parsed = {};
+  CHECK(bufferToMessage(json, parsed));
+  CHECK(isCommand(parsed, CommandType::SCHEDULE));
+  CHECK(parsed.payload.schedule.id == 7);
+  CHECK(parsed.payload.schedule.action == CommandType::OFF_RELEASE);
+  CHECK(parsed.payload.schedule.mode == SCHEDULE_DAILY);
+  CHECK(parsed.payload.schedule.time == 3600);
+  CHECK(memcmp(&parsed, &msg, sizeof(Message)) == 0);
+
+  CHECK(!bufferToMessage("{\"messageType\":\"COMMAND\",\"commandType\":\"SCHEDULE\",\"id\":1}", parsed));
+  CHECK(!bufferToMessage("not json", parsed));
+}
+
+int main()
+{
+  testOnOff();
+  testCompressionTimeoutReleases();
+  testShutDownButton();
+  testScheduledCommands();
+  testThermalLimit();
+  testSensorThresholds();
+  testRecorder();
+  testLatency();
+  testStats();
+  testOutgoingSignal();
+  testCriticalEvents();
+  testStateSnapshot();
+  testMessageRoundTrip();
+
+  return checkSummary("control");
+}
@@ -0,0 +1,286 @@
+// DNS-SD queries, and resolving a service from responses however they are laid out
+#include "dnssd.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <string>
+#include <vector>
+
+#define SERVICE "_compressor-server._tcp.local"
+#define INSTANCE "Workshop._compressor-server._tcp.local"
+#define HOST "server.local"
+
+// Builds a response the way responders do, names compressed against earlier ones
+class Response
+{
+public:
+  std::vector<uint8_t> bytes;
+
+  Response(uint16_t id = 0)
+  {
+    bytes = {(uint8_t)(id >> 8), (uint8_t)id, 0x84, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  }
+
+  void question(const std::string &name, uint16_t type)
+  {
+    writeName(name);
+    writeShort(type);
+    writeShort(1);
+    bump(4);
+  }
+
+  void ptr(const std::string &name, const std::string &target)
+  {
+    size_t data = record(name, DNS_TYPE_PTR);
+    writeName(target);
+    finish(data);
+  }
+
+  void srv(const std::string &name, uint16_t port, const std::string &target)
+  {
+    size_t data = record(name, DNS_TYPE_SRV);
+    writeShort(0);
+    writeShort(0);
+    writeShort(port);
+    writeName(target);
+    finish(data);
+  }
+
+  void txt(const std::string &name, const std::string &text)
+  {
+    size_t data = record(name, 16);
+    bytes.push_back((uint8_t)text.size());
+    bytes.insert(bytes.end(), text.begin(), text.end());
+    finish(data);
+  }
+
+  void a(const std::string &name, uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+  {
+    size_t data = record(name, DNS_TYPE_A);
+    bytes.insert(bytes.end(), {a, b, c, d});
+    finish(data);
+  }
+
+private:
+  std::vector<std::pair<std::string, size_t>> written;
+
+  void writeShort(uint16_t value)
+  {
+    bytes.push_back((uint8_t)(value >> 8));
+    bytes.push_back((uint8_t)value);
+  }
+
+  void bump(size_t countOffset)
+  {
+    uint16_t count = (uint16_t)(bytes[countOffset] << 8 | bytes[countOffset + 1]) + 1;
+    bytes[countOffset] = (uint8_t)(count >> 8);
+    bytes[countOffset + 1] = (uint8_t)count;
+  }
+
+  // Labels until a suffix already in the message, then a pointer to it
+  void writeName(const std::string &name)
+  {
+    std::string rest = name;
+    while (!rest.empty())
+    {
+      for (const auto &entry : written)
+      {
+        if (strcasecmp(entry.first.c_str(), rest.c_str()) == 0)
+        {
+          writeShort((uint16_t)(0xC000 | entry.second));
+          return;
+        }
+      }
+      written.push_back({rest, bytes.size()});
+      size_t dot = rest.find('.');
+      std::string label = rest.substr(0, dot);
+      bytes.push_back((uint8_t)label.size());
+      bytes.insert(bytes.end(), label.begin(), label.end());
+      rest = dot == std::string::npos ? "" : rest.substr(dot + 1);
+    }
+    bytes.push_back(0);
+  }
+
+  // Answers until the first record a responder would put in the additional section
+  size_t record(const std::string &name, uint16_t type)
+  {
+    bump(type == DNS_TYPE_PTR ? 6 : 10);
+    writeName(name);
+    writeShort(type);
+    writeShort(0x8001); // IN with the cache-flush bit
+    bytes.insert(bytes.end(), {0, 0, 0x11, 0x94});
+    writeShort(0);
+    return bytes.size();
+  }
+
+  void finish(size_t data)
+  {
+    size_t length = bytes.size() - data;
+    bytes[data - 2] = (uint8_t)(length >> 8);
+    bytes[data - 1] = (uint8_t)length;
+  }
+};
+
+static bool parse(const std::vector<uint8_t> &bytes, DnssdService &service)
+{
+  return dnssdParseResponse(bytes.data(), bytes.size(), SERVICE, service);
+}
+
+static uint32_t address(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+  uint8_t bytes[4] = {a, b, c, d};
+  uint32_t value;
+  memcpy(&value, bytes, 4);
+  return value;
+}
+
+static void testQuery()
+{
+  uint8_t buffer[DNSSD_MAX_MESSAGE];
+  size_t length = dnssdQuery(buffer, sizeof(buffer), 0x1234, "_a._tcp.local", DNS_TYPE_PTR);
+  const uint8_t expected[] = {0x12, 0x34, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 2, '_', 'a', 4, '_', 't', 'c', 'p',
+                              5, 'l', 'o', 'c', 'a', 'l', 0, 0, 12, 0, 1};
+  CHECK(length == sizeof(expected) && memcmp(buffer, expected, length) == 0);
+
+  CHECK(dnssdQuery(buffer, sizeof(expected) - 1, 1, "_a._tcp.local", DNS_TYPE_PTR) == 0);
+  CHECK(dnssdQuery(buffer, sizeof(buffer), 1, "", DNS_TYPE_A) == 0);
+  CHECK(dnssdQuery(buffer, sizeof(buffer), 1, "a..local", DNS_TYPE_A) == 0);
+  CHECK(dnssdQuery(buffer, sizeof(buffer), 1, (std::string(64, 'x') + ".local").c_str(), DNS_TYPE_A) == 0);
+  CHECK(dnssdQuery(buffer, sizeof(buffer), 1, (std::string(63, 'x') + ".local").c_str(), DNS_TYPE_A) != 0);
+}
+
+// The usual legacy unicast reply: the PTR answer with everything else additional
+static void testWholeResponse()
+{
+  Response response(0x4242);
+  response.question(SERVICE, DNS_TYPE_PTR);
+  response.ptr(SERVICE, INSTANCE);
+  response.srv(INSTANCE, 3000, HOST);
+  response.txt(INSTANCE, "v=1");
+  response.a(HOST, 192, 168, 10, 44);
+
+  DnssdService service;
+  dnssdServiceInit(service);
+  CHECK(!dnssdResolved(service));
+  CHECK(parse(response.bytes, service));
+  CHECK(dnssdResolved(service));
+  CHECK(strcmp(service.instance, INSTANCE) == 0);
+  CHECK(strcmp(service.host, HOST) == 0);
+  CHECK(service.port == 3000);
+  CHECK(service.address == address(192, 168, 10, 44));
+}
+
+static void testAnyOrder()
+{
+  Response response;
+  response.a("SERVER.local", 10, 0, 0, 7);
+  response.srv(INSTANCE, 3001, HOST);
+  response.ptr("_Compressor-Server._TCP.local", INSTANCE);
+
+  DnssdService service;
+  dnssdServiceInit(service);
+  CHECK(parse(response.bytes, service) && dnssdResolved(service));
+  CHECK(service.port == 3001 && service.address == address(10, 0, 0, 7));
+}
+
+// One link per response, as the device's follow-up queries get them
+static void testAcrossResponses()
+{
+  DnssdService service;
+  dnssdServiceInit(service);
+
+  Response first;
+  first.ptr("_other._tcp.local", "Printer._other._tcp.local");
+  first.ptr(SERVICE, INSTANCE);
+  CHECK(parse(first.bytes, service));
+  CHECK(strcmp(service.instance, INSTANCE) == 0 && service.port == 0);
+
+  // A second instance does not replace the first
+  Response other;
+  other.ptr(SERVICE, "Garage._compressor-server._tcp.local");
+  CHECK(parse(other.bytes, service) && strcmp(service.instance, INSTANCE) == 0);
+
+  Response second;
+  second.srv("Garage._compressor-server._tcp.local", 9999, "garage.local");
+  second.srv(INSTANCE, 3000, HOST);
+  CHECK(parse(second.bytes, service));
+  CHECK(service.port == 3000 && strcmp(service.host, HOST) == 0 && !dnssdResolved(service));
+
+  Response third;
+  third.a("garage.local", 10, 0, 0, 9);
+  third.a(HOST, 10, 0, 0, 8);
+  CHECK(parse(third.bytes, service) && dnssdResolved(service));
+  CHECK(service.address == address(10, 0, 0, 8));
+}
+
+static void testMalformed()
+{
+  Response response;
+  response.ptr(SERVICE, INSTANCE);
+  response.srv(INSTANCE, 3000, HOST);
+  response.a(HOST, 10, 0, 0, 1);
+
+  DnssdService service;
+  // Every truncation is refused
+  for (size_t length = 0; length < response.bytes.size(); length++)
+  {
+    dnssdServiceInit(service);
+    CHECK(!dnssdParseResponse(response.bytes.data(), length, SERVICE, service) || !dnssdResolved(service));
+  }
+
+  // A query is not a response
+  std::vector<uint8_t> query = response.bytes;
+  query[2] = 0;
+  dnssdServiceInit(service);
+  CHECK(!parse(query, service));
+
+  // A pointer to itself
+  std::vector<uint8_t> loop = {0, 0, 0x84, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0xC0, 12, 0, 12, 0, 1, 0, 0, 0, 0, 0, 0};
+  dnssdServiceInit(service);
+  CHECK(!parse(loop, service));
+
+  // A data length past the end
+  std::vector<uint8_t> overrun = response.bytes;
+  size_t dataLength = 12 + strlen(SERVICE) + 2 + 8;
+  overrun[dataLength] = 0x7F;
+  dnssdServiceInit(service);
+  CHECK(!parse(overrun, service));
+
+  // A name too long for the service fields
+  Response longName;
+  std::string label(63, 'n');
+  longName.ptr(SERVICE, label + "." + label + "." + label + "._compressor-server._tcp.local");
+  dnssdServiceInit(service);
+  CHECK(!parse(longName.bytes, service));
+
+  // Random bytes after a valid header are refused or parsed within bounds
+  for (int round = 0; round < 20000; round++)
+  {
+    std::vector<uint8_t> bytes = response.bytes;
+    int flips = 1 + nextRandom() % 4;
+    for (int i = 0; i < flips; i++)
+    {
+      bytes[12 + nextRandom() % (bytes.size() - 12)] = (uint8_t)nextRandom();
+    }
+    dnssdServiceInit(service);
+    if (parse(bytes, service))
+    {
+      CHECK(strlen(service.instance) < DNSSD_NAME_MAX && strlen(service.host) < DNSSD_NAME_MAX);
+    }
+  }
+}
+
+int main()
+{
+  seedRandom(0xA54FF53Au);
+  testQuery();
+  testWholeResponse();
+  testAnyOrder();
+  testAcrossResponses();
+  testMalformed();
+
+  return checkSummary("dnssd");
+}
@@ -0,0 +1,220 @@
+// Stream framing: any split of the byte stream gives back the same frames
+#include "framing.h"
+#include "messagebinary.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+typedef struct
+{
+  std::vector<std::string> frames;
+  int dropped;
+  bool corrupt;
+} Drained;
+
+static void drain(FrameAssembler &assembler, Drained &drained)
+{
+  uint8_t frame[FRAME_MAX_LENGTH];
+  size_t length;
+  FrameResult result;
+  while ((result = frameAssemblerNext(assembler, frame, sizeof(frame), &length)) != FRAME_NONE)
+  {
+    if (result == FRAME_CORRUPT)
+    {
+      drained.corrupt = true;
+      return;
+    }
+    if (result == FRAME_DROPPED)
+    {
+      drained.dropped++;
+      continue;
+    }
+    if (assembler.encoding == WIRE_JSON)
+    {
+      CHECK(frame[length] == '\0' && strlen((const char *)frame) == length);
+    }
+    drained.frames.push_back(std::string((const char *)frame, length));
+  }
+}
+
+// Feeds the stream in random sized reads, half through Push and half received in place
+static Drained feed(const std::string &stream, WireEncoding encoding, size_t maxRead)
+{
+  static FrameAssembler assembler;
+  frameAssemblerInit(assembler, encoding);
+  Drained drained = {};
+
+  size_t position = 0;
+  while (position < stream.size() && !drained.corrupt)
+  {
+    size_t read = 1 + nextRandom() % maxRead;
+    if (read > stream.size() - position)
+    {
+      read = stream.size() - position;
+    }
+    if (nextRandom() % 2 == 0)
+    {
+      position += frameAssemblerPush(assembler, stream.data() + position, read);
+    }
+    else
+    {
+      size_t space;
+      uint8_t *destination = frameAssemblerWritePointer(assembler, &space);
+      if (read > space)
+      {
+        read = space;
+      }
+      memcpy(destination, stream.data() + position, read);
+      frameAssemblerCommit(assembler, read);
+      position += read;
+    }
+    drain(assembler, drained);
+  }
+  return drained;
+}
+
+static std::string jsonLine(int i)
+{
+  std::string line = "{\"messageType\":\"COMMAND\",\"commandType\":\"SET_CLOCK\",\"time\":" + std::to_string(i) + "}";
+  line += std::string(nextRandom() % 200, ' ');
+  return line;
+}
+
+static void testJsonLines()
+{
+  for (int round = 0; round < 200; round++)
+  {
+    std::vector<std::string> expected;
+    std::string stream;
+    for (int i = 0; i < 50; i++)
+    {
+      std::string line = jsonLine(i);
+      expected.push_back(line);
+      stream += line;
+      stream += nextRandom() % 4 == 0 ? "\r\n" : "\n";
+      if (nextRandom() % 8 == 0)
+      {
+        stream += "\n"; // Blank lines are skipped
+      }
+    }
+
+    Drained drained = feed(stream, WIRE_JSON, round < 100 ? 8 : 700);
+    CHECK(drained.dropped == 0 && !drained.corrupt);
+    CHECK(drained.frames == expected);
+  }
+}
+
+static void testBinaryFrames()
+{
+  for (int round = 0; round < 200; round++)
+  {
+    std::vector<std::string> expected;
+    std::string stream;
+    for (int i = 0; i < 50; i++)
+    {
+      std::string frame;
+      if (nextRandom() % 3 == 0)
+      {
+        std::string text = jsonLine(i);
+        uint8_t header[MESSAGE_BINARY_HEADER];
+        binaryTextHeader(header, text.size());
+        frame = std::string((const char *)header, sizeof(header)) + text;
+      }
+      else
+      {
+        Message msg = timeoutCommand(CommandType::SET_COMPRESSION_TIMEOUT, (int)nextRandom()); // Includes '\n' bytes
+        uint8_t binary[MESSAGE_BINARY_MAX_LENGTH];
+        frame = std::string((const char *)binary, messageToBinary(msg, binary, sizeof(binary)));
+      }
+      expected.push_back(frame);
+      stream += frame;
+    }
+
+    Drained drained = feed(stream, WIRE_BINARY, round < 100 ? 3 : 900);
+    CHECK(drained.dropped == 0 && !drained.corrupt);
+    CHECK(drained.frames == expected);
+  }
+}
+
+// The HELLO reply and the first binary frames arrive in one read
+static void testEncodingSwitch()
+{
+  static FrameAssembler assembler;
+  frameAssemblerInit(assembler, WIRE_JSON);
+
+  Message msg = commandMessage(CommandType::ON);
+  uint8_t binary[MESSAGE_BINARY_MAX_LENGTH];
+  size_t binaryLength = messageToBinary(msg, binary, sizeof(binary));
+
+  std::string stream = "{\"messageType\":\"HELLO\",\"encoding\":\"BINARY\"}\n";
+  stream += std::string((const char *)binary, binaryLength);
+  stream += std::string((const char *)binary, binaryLength);
+  CHECK(frameAssemblerPush(assembler, stream.data(), stream.size()) == stream.size());
+
+  uint8_t frame[FRAME_MAX_LENGTH];
+  size_t length;
+  CHECK(frameAssemblerNext(assembler, frame, sizeof(frame), &length) == FRAME_READY);
+  WireEncoding encoding;
+  CHECK(bufferToHello((const char *)frame, encoding) && encoding == WIRE_BINARY);
+  frameAssemblerSetEncoding(assembler, encoding);
+
+  for (int i = 0; i < 2; i++)
+  {
+    Message decoded = {};
+    CHECK(frameAssemblerNext(assembler, frame, sizeof(frame), &length) == FRAME_READY);
+    CHECK(binaryToMessage(frame, length, decoded) && isCommand(decoded, CommandType::ON));
+  }
+  CHECK(frameAssemblerNext(assembler, frame, sizeof(frame), &length) == FRAME_NONE);
+}
+
+static void testOverlongLines()
+{
+  // Longer than a frame but fits the ring, then longer than the ring
+  std::string stream = jsonLine(1) + "\n" + std::string(FRAME_MAX_LENGTH + 10, 'x') + "\n" + jsonLine(2) + "\n" +
+                       std::string(3 * FRAME_BUFFER_SIZE, 'y') + "\n" + jsonLine(3) + "\n";
+  for (int round = 0; round < 20; round++)
+  {
+    Drained drained = feed(stream, WIRE_JSON, 1 + round * 50);
+    CHECK(drained.dropped == 2);
+    CHECK(drained.frames.size() == 3);
+  }
+
+  // An exactly full frame still fits once the NUL is counted
+  std::string exact(FRAME_MAX_LENGTH - 1, 'z');
+  Drained drained = feed(exact + "\n" + exact + "x\n", WIRE_JSON, 64);
+  CHECK(drained.frames.size() == 1 && drained.frames[0] == exact);
+  CHECK(drained.dropped == 1);
+}
+
+static void testCorruptBinary()
+{
+  const char stream[] = {(char)0xFF, (char)0xFF, 0, 0};
+  Drained drained = feed(std::string(stream, sizeof(stream)), WIRE_BINARY, 4);
+  CHECK(drained.corrupt);
+
+  static FrameAssembler assembler;
+  frameAssemblerInit(assembler, WIRE_BINARY);
+  std::string fill(FRAME_BUFFER_SIZE + 10, 'a');
+  CHECK(frameAssemblerPush(assembler, fill.data(), fill.size()) == FRAME_BUFFER_SIZE);
+}
+
+int main()
+{
+  seedRandom(0x9E3779B9u);
+  if (freopen("/dev/null", "w", stdout) == NULL)
+  {
+    fprintf(stderr, "Could not silence stdout\n");
+  }
+
+  testJsonLines();
+  testBinaryFrames();
+  testEncodingSwitch();
+  testOverlongLines();
+  testCorruptBinary();
+
+  return checkSummary("framing");
+}
@@ -0,0 +1,281 @@
+// Retained history: slot reduction, bucket merging, retention, and chunked replies that resume
+#include "history.h"
+#include "hallinux.h"
+#include "messagewriter.h"
+
+#include "cJSON.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Two readings a second, as the sensor task takes them
+static void feed(uint32_t fromS, uint32_t toS, float (*pressureAt)(uint32_t halfSeconds))
+{
+  for (uint32_t half = fromS * 2; half < toS * 2; half++)
+  {
+    historyAddSample((uint64_t)half * 500000, pressureAt(half), 1.0f + (half % 2));
+  }
+}
+
+static float ramp(uint32_t halfSeconds)
+{
+  return halfSeconds / 10.0f; // 0.1 PSI per reading
+}
+
+static float steady(uint32_t)
+{
+  return 50.0f;
+}
+
+static void testBuckets()
+{
+  historyClear();
+  feed(0, 100, ramp);
+
+  HistoryQuery query;
+  historyQueryInit(query, 0, 100, 10, 100);
+  HistoryBucket bucket;
+  int buckets = 0;
+  while (historyNextBucket(query, bucket))
+  {
+    // Readings 20k .. 20k+19 of 0.1 PSI
+    CHECK(bucket.start == (uint32_t)buckets * 10 && bucket.seconds == 10 && bucket.samples == 20);
+    CHECK(bucket.pressureMin == buckets * 20 && bucket.pressureMax == buckets * 20 + 19);
+    CHECK(bucket.pressureMean == buckets * 20 + 9);
+    CHECK(bucket.currentMean == 15 && bucket.currentMax == 20);
+    buckets++;
+  }
+  CHECK(buckets == 10);
+
+  // Coarser buckets merge slots, the last one is cut at the end of the range
+  historyQueryInit(query, 0, 100, 60, 100);
+  CHECK(historyNextBucket(query, bucket));
+  CHECK(bucket.start == 0 && bucket.seconds == 60 && bucket.samples == 120);
+  CHECK(bucket.pressureMin == 0 && bucket.pressureMax == 119 && bucket.pressureMean == 59);
+  CHECK(historyNextBucket(query, bucket));
+  CHECK(bucket.start == 60 && bucket.seconds == 40 && bucket.samples == 80);
+  CHECK(bucket.pressureMin == 120 && bucket.pressureMax == 199);
+  CHECK(!historyNextBucket(query, bucket));
+}
+
+static void testQueryShape()
+{
+  HistoryQuery query;
+  historyQueryInit(query, 0, 0, 0, 1000);
+  CHECK(query.resolution == HISTORY_PERIOD_S && query.next == 0 && query.to == 1000);
+  historyQueryInit(query, 0, 0, 15, 1000);
+  CHECK(query.resolution == 20);
+  historyQueryInit(query, 0, 0, 1 << 30, 1000);
+  CHECK(query.resolution == HISTORY_MAX_RESOLUTION_S);
+
+  // Relative to now, and aligned down to a period
+  historyQueryInit(query, -35, -10, 10, 1000);
+  CHECK(query.next == 960 && query.to == 990);
+
+  // Nothing past the slot being filled, nothing before the oldest held
+  historyQueryInit(query, 500, 2000000000, 10, 1000);
+  CHECK(query.to == 1010);
+  uint32_t now = HISTORY_SLOTS * HISTORY_PERIOD_S * 3 + 5;
+  historyQueryInit(query, 0, 0, 10, now);
+  CHECK(query.next == now / HISTORY_PERIOD_S * HISTORY_PERIOD_S - (HISTORY_SLOTS - 1) * HISTORY_PERIOD_S);
+
+  // An empty or backwards range ends at once
+  historyQueryInit(query, 500, 400, 10, 1000);
+  HistoryBucket bucket;
+  CHECK(!historyNextBucket(query, bucket));
+}
+
+static void testGapsAndRetention()
+{
+  historyClear();
+  feed(0, 10, steady);
+  feed(500, 510, steady);
+  HistoryQuery query;
+  historyQueryInit(query, 0, 0, 10, 600);
+  HistoryBucket bucket;
+  CHECK(historyNextBucket(query, bucket) && bucket.start == 0);
+  CHECK(historyNextBucket(query, bucket) && bucket.start == 500);
+  CHECK(!historyNextBucket(query, bucket));
+
+  // A slot written a lap ago is not read as this lap's
+  historyClear();
+  feed(0, 10, steady);
+  uint32_t lap = HISTORY_SLOTS * HISTORY_PERIOD_S;
+  feed(lap + 100, lap + 110, steady);
+  historyQueryInit(query, 0, 0, 10, lap + 110);
+  int buckets = 0;
+  while (historyNextBucket(query, bucket))
+  {
+    CHECK(bucket.start == lap + 100);
+    buckets++;
+  }
+  CHECK(buckets == 1);
+}
+
+static int rowsIn(cJSON *json, uint32_t *starts, int room)
+{
+  cJSON *buckets = cJSON_GetObjectItem(json, "buckets");
+  int count = 0;
+  cJSON *row;
+  cJSON_ArrayForEach(row, buckets)
+  {
+    CHECK(cJSON_GetArraySize(row) == 7);
+    if (count < room)
+    {
+      starts[count] = (uint32_t)cJSON_GetArrayItem(row, 0)->valuedouble;
+    }
+    count++;
+  }
+  return count;
+}
+
+static void testChunks()
+{
+  halSimReset();
+  historyClear();
+  const uint32_t seconds = 3000;
+  for (uint32_t half = 0; half < seconds * 2; half++)
+  {
+    // Some stretches with the sensor task stopped
+    if (half % 700 < 600)
+    {
+      historyAddSample((uint64_t)half * 500000, (float)(nextRandom() % 1000) / 10.0f, 0.0f);
+    }
+  }
+  halSimAdvanceMs(seconds * 1000);
+
+  // What a direct walk gives
+  static uint32_t expected[400];
+  int expectedCount = 0;
+  HistoryQuery query;
+  historyQueryInit(query, 0, 0, 10, seconds);
+  HistoryBucket bucket;
+  while (historyNextBucket(query, bucket) && expectedCount < 400)
+  {
+    expected[expectedCount++] = bucket.start;
+  }
+  CHECK(expectedCount > 200);
+
+  // Streamed in bounded chunks
+  historyRequest(0, 0, 10);
+  static uint32_t streamed[400];
+  int streamedCount = 0;
+  int chunks = 0;
+  HistoryChunk chunk;
+  chunk.done = false;
+  char text[HISTORY_WRITER_MAX_LENGTH];
+  uint32_t resumeAt = 0;
+  uint32_t resumeTo = 0;
+  while (!chunk.done && historyNextChunk(chunk))
+  {
+    size_t length = historyChunkToBuffer(chunk, text, sizeof(text));
+    CHECK(length > 0 && length < 1024);
+    cJSON *json = cJSON_Parse(text);
+    CHECK(json != NULL);
+    if (json == NULL)
+    {
+      break;
+    }
+    CHECK(strcmp(cJSON_GetObjectItem(json, "messageType")->valuestring, "HISTORY") == 0);
+    CHECK(cJSON_GetObjectItem(json, "now")->valuedouble == seconds);
+    CHECK(cJSON_GetObjectItem(json, "to")->valuedouble == chunk.to && chunk.to == seconds);
+    int rows = rowsIn(json, streamed + streamedCount, 400 - streamedCount);
+    CHECK(rows <= HISTORY_CHUNK_BUCKETS && (size_t)rows == chunk.count);
+    streamedCount += rows;
+    CHECK(chunk.done == cJSON_IsTrue(cJSON_GetObjectItem(json, "done")));
+    cJSON *next = cJSON_GetObjectItem(json, "next");
+    CHECK(chunk.done == (next == NULL));
+    if (chunks == 3 && next != NULL)
+    {
+      resumeAt = (uint32_t)next->valuedouble;
+      resumeTo = (uint32_t)cJSON_GetObjectItem(json, "to")->valuedouble;
+    }
+    cJSON_Delete(json);
+    chunks++;
+  }
+  CHECK(chunk.done);
+  CHECK(chunks >= expectedCount / HISTORY_CHUNK_BUCKETS);
+  CHECK(streamedCount == expectedCount && memcmp(streamed, expected, expectedCount * sizeof(uint32_t)) == 0);
+  CHECK(!historyNextChunk(chunk));
+
+  // Resuming from a chunk's token gives what came after it and ends where the
+  // interrupted reply would have, though now has moved on and more was kept
+  CHECK(resumeAt > 0);
+  for (uint32_t half = (seconds + HISTORY_PERIOD_S) * 2; half < (seconds + 200) * 2; half++)
+  {
+    historyAddSample((uint64_t)half * 500000, 50.0f, 0.0f);
+  }
+  halSimAdvanceMs(200 * 1000);
+  historyRequest((int)resumeAt, (int)resumeTo, 10);
+  static uint32_t resumed[400];
+  int resumedCount = 0;
+  chunk.done = false;
+  while (!chunk.done && historyNextChunk(chunk))
+  {
+    CHECK(chunk.to == resumeTo);
+    CHECK(historyChunkToBuffer(chunk, text, sizeof(text)) > 0);
+    cJSON *json = cJSON_Parse(text);
+    resumedCount += rowsIn(json, resumed + resumedCount, 400 - resumedCount);
+    cJSON_Delete(json);
+  }
+  CHECK(resumedCount == streamedCount - 4 * HISTORY_CHUNK_BUCKETS);
+  CHECK(memcmp(resumed, streamed + 4 * HISTORY_CHUNK_BUCKETS, resumedCount * sizeof(uint32_t)) == 0);
+
+  // A new request replaces the reply in progress
+  historyRequest(-20, 0, 10);
+  CHECK(historyNextChunk(chunk) && chunk.done);
+  CHECK(historyChunkToBuffer(chunk, text, sizeof(text)) > 0);
+  cJSON *json = cJSON_Parse(text);
+  uint32_t last[2];
+  CHECK(rowsIn(json, last, 2) <= 2);
+  cJSON_Delete(json);
+}
+
+// Readings print as cJSON printed the tenths divided by ten, the widest
+// chunk fits the writer's bound and one byte less is refused whole
+static void testWriter()
+{
+  HistoryChunk chunk = {};
+  chunk.now = 1234;
+  chunk.resolution = 10;
+  chunk.to = 1240;
+  chunk.done = true;
+  chunk.count = 1;
+  chunk.buckets[0] = {1230, 10, 20, -5, 500, 123, 0, -32768};
+  char text[HISTORY_WRITER_MAX_LENGTH];
+  size_t length = historyChunkToBuffer(chunk, text, sizeof(text));
+  const char expected[] =
+      "{\"messageType\":\"HISTORY\",\"now\":1234,\"resolution\":10,\"to\":1240,\"buckets\":[[1230,20,-0.5,50,12.3,0,-3276.8]],"
+      "\"done\":true}";
+  CHECK(length == sizeof(expected) - 1 && strcmp(text, expected) == 0);
+
+  chunk.now = UINT32_MAX;
+  chunk.resolution = HISTORY_MAX_RESOLUTION_S;
+  chunk.to = UINT32_MAX;
+  chunk.done = false;
+  chunk.next = UINT32_MAX;
+  chunk.count = HISTORY_CHUNK_BUCKETS;
+  for (size_t i = 0; i < HISTORY_CHUNK_BUCKETS; i++)
+  {
+    chunk.buckets[i] = {UINT32_MAX, UINT32_MAX, UINT32_MAX, INT16_MIN, INT16_MIN, INT16_MIN, INT16_MIN, INT16_MIN};
+  }
+  length = historyChunkToBuffer(chunk, text, sizeof(text));
+  CHECK(length > 0 && length < HISTORY_WRITER_MAX_LENGTH);
+  cJSON *json = cJSON_Parse(text);
+  CHECK(json != NULL && cJSON_GetObjectItem(json, "next")->valuedouble == UINT32_MAX);
+  cJSON_Delete(json);
+  CHECK(historyChunkToBuffer(chunk, text, length) == 0 && text[0] == '\0');
+}
+
+int main()
+{
+  seedRandom(0xBB67AE85u);
+  testBuckets();
+  testQueryShape();
+  testGapsAndRetention();
+  testChunks();
+  testWriter();
+
+  return checkSummary("history");
+}
@@ -0,0 +1,229 @@
+// HTTP request parsing over any split of the stream, and the limits on what a request may hold
+#include "httpparser.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+static const char postRequest[] = "POST /configure HTTP/1.1\r\n"
+                                  "Host: 192.168.4.1\r\n"
+                                  "Content-Type: application/json\r\n"
+                                  "content-length: 52\r\n"
+                                  "\r\n"
+                                  "{\"ssid\":\"workshop\",\"password\":\"secret\",\"authMode\":4}";
+
+// Feeds text in the given segment sizes, as a pbuf chain would hand it over
+static HttpResult feed(HttpParser &parser, const std::string &text, const std::vector<size_t> &segments,
+                       size_t *total)
+{
+  HttpResult result = HTTP_NEED_MORE;
+  size_t offset = 0;
+  *total = 0;
+  for (size_t segment : segments)
+  {
+    size_t consumed;
+    result = httpParse(parser, (const uint8_t *)text.data() + offset, segment, &consumed);
+    *total += consumed;
+    offset += segment;
+    if (result != HTTP_NEED_MORE)
+    {
+      break;
+    }
+  }
+  return result;
+}
+
+static HttpResult parseWhole(HttpParser &parser, const std::string &text)
+{
+  httpParserInit(parser);
+  size_t consumed;
+  return feed(parser, text, {text.size()}, &consumed);
+}
+
+static void testGet()
+{
+  HttpParser parser;
+  std::string text = "GET /scan.json HTTP/1.1\r\nHost: x\r\n\r\n";
+  httpParserInit(parser);
+  size_t consumed;
+  CHECK(httpParse(parser, (const uint8_t *)text.data(), text.size(), &consumed) == HTTP_COMPLETE);
+  CHECK(consumed == text.size());
+  CHECK(strcmp(parser.method, "GET") == 0 && strcmp(parser.path, "/scan.json") == 0);
+  CHECK(!parser.hasContentLength && parser.bodyLength == 0 && !parser.closeRequested);
+
+  // Once complete it takes nothing more until it is reset
+  CHECK(httpParse(parser, (const uint8_t *)"GET", 3, &consumed) == HTTP_COMPLETE && consumed == 0);
+
+  // Blank lines ahead of a request and bare LF line ends are tolerated
+  CHECK(parseWhole(parser, "\r\n\nGET / HTTP/1.0\nHost: x\n\n") == HTTP_COMPLETE);
+  CHECK(strcmp(parser.path, "/") == 0 && parser.closeRequested);
+}
+
+static void testSplits()
+{
+  std::string text = postRequest;
+  HttpParser whole;
+  CHECK(parseWhole(whole, text) == HTTP_COMPLETE);
+  CHECK(strcmp(whole.method, "POST") == 0 && strcmp(whole.path, "/configure") == 0);
+  CHECK(whole.contentLength == 52 && whole.bodyLength == 52);
+  CHECK(strcmp(whole.body, text.c_str() + text.size() - 52) == 0);
+
+  // Every two-segment split, the request line, headers or body cut anywhere
+  for (size_t split = 0; split <= text.size(); split++)
+  {
+    HttpParser parser;
+    httpParserInit(parser);
+    size_t consumed;
+    HttpResult result = feed(parser, text, {split, text.size() - split}, &consumed);
+    CHECK(result == HTTP_COMPLETE && consumed == text.size());
+    CHECK(strcmp(parser.body, whole.body) == 0 && strcmp(parser.path, whole.path) == 0);
+  }
+
+  // Random chains of short segments
+  for (int round = 0; round < 500; round++)
+  {
+    std::vector<size_t> segments;
+    size_t left = text.size();
+    while (left > 0)
+    {
+      size_t segment = 1 + nextRandom() % 16;
+      segment = segment < left ? segment : left;
+      segments.push_back(segment);
+      left -= segment;
+    }
+    HttpParser parser;
+    httpParserInit(parser);
+    size_t consumed;
+    CHECK(feed(parser, text, segments, &consumed) == HTTP_COMPLETE && consumed == text.size());
+    CHECK(parser.bodyLength == 52 && memcmp(parser.body, whole.body, 53) == 0);
+  }
+
+  // Pipelined requests: the first stops at its own end, the rest parses after a reset
+  std::string pipelined = text + "GET /ws HTTP/1.1\r\nUpgrade: websocket\r\n\r\n";
+  HttpParser parser;
+  httpParserInit(parser);
+  size_t consumed;
+  CHECK(httpParse(parser, (const uint8_t *)pipelined.data(), pipelined.size(), &consumed) == HTTP_COMPLETE);
+  CHECK(consumed == text.size());
+  httpParserInit(parser);
+  size_t rest;
+  CHECK(httpParse(parser, (const uint8_t *)pipelined.data() + consumed, pipelined.size() - consumed, &rest) ==
+        HTTP_COMPLETE);
+  CHECK(consumed + rest == pipelined.size() && strcmp(parser.path, "/ws") == 0 && parser.upgradeWebSocket);
+}
+
+static void testHeaders()
+{
+  HttpParser parser;
+  CHECK(parseWhole(parser, "GET /ws HTTP/1.1\r\n"
+                           "UPGRADE: WebSocket\r\n"
+                           "Connection: keep-alive, Upgrade\r\n"
+                           "sec-websocket-key:   dGhlIHNhbXBsZSBub25jZQ==  \r\n"
+                           "\r\n") == HTTP_COMPLETE);
+  CHECK(parser.upgradeWebSocket && !parser.closeRequested);
+  CHECK(strcmp(parser.websocketKey, "dGhlIHNhbXBsZSBub25jZQ==") == 0);
+
+  CHECK(parseWhole(parser, "GET / HTTP/1.1\r\nConnection: Close\r\n\r\n") == HTTP_COMPLETE);
+  CHECK(parser.closeRequested && !parser.upgradeWebSocket && parser.websocketKey[0] == '\0');
+
+  // Content-Length of zero, or repeated with the same value, is fine
+  CHECK(parseWhole(parser, "POST /configure HTTP/1.1\r\nContent-Length: 0\r\n\r\n") == HTTP_COMPLETE);
+  CHECK(parseWhole(parser, "POST /configure HTTP/1.1\r\nContent-Length: 2\r\nContent-Length: 2\r\n\r\nok") ==
+        HTTP_COMPLETE);
+  CHECK(strcmp(parser.body, "ok") == 0);
+}
+
+static void checkError(const std::string &text, int status)
+{
+  HttpParser parser;
+  HttpResult result = parseWhole(parser, text);
+  CHECK(result == HTTP_ERROR);
+  CHECK(parser.errorStatus == status);
+  if (result != HTTP_ERROR || parser.errorStatus != status)
+  {
+    fprintf(stderr, "  request: %.60s status %d\n", text.c_str(), parser.errorStatus);
+  }
+  // Stays failed
+  size_t consumed;
+  CHECK(httpParse(parser, (const uint8_t *)"\r\n\r\n", 4, &consumed) == HTTP_ERROR);
+}
+
+static void testErrors()
+{
+  checkError("GET\r\n\r\n", 400);
+  checkError("GET /\r\n\r\n", 400);
+  checkError("GET / HTTP/1.1\r\nNo colon here\r\n\r\n", 400);
+  checkError("GET / HTTP/1.1\r\nHost : x\r\n\r\n", 400);
+  checkError("GET / HTTP/1.1\r\nHost: x\r\n folded\r\n\r\n", 400);
+  checkError("GET / HTTP/2.0\r\n\r\n", 505);
+  checkError("GET / FTP/1.1\r\n\r\n", 400);
+  checkError("PROPPATCH / HTTP/1.1\r\n\r\n", 501);
+  checkError("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n", 501);
+  checkError("POST / HTTP/1.1\r\nContent-Length: 12a\r\n\r\n", 400);
+  checkError("POST / HTTP/1.1\r\nContent-Length: 2\r\nContent-Length: 3\r\n\r\n", 400);
+  checkError("POST / HTTP/1.1\r\nContent-Length: 513\r\n\r\n", 413);
+  checkError("POST / HTTP/1.1\r\nContent-Length: 99999999999999999999999999\r\n\r\n", 413);
+  checkError("GET /ws HTTP/1.1\r\nSec-WebSocket-Key: " + std::string(HTTP_KEY_MAX + 1, 'k') + "\r\n\r\n", 400);
+
+  checkError("GET /" + std::string(HTTP_PATH_MAX, 'p') + " HTTP/1.1\r\n\r\n", 414);
+  checkError("GET /" + std::string(HTTP_LINE_MAX, 'p') + " HTTP/1.1\r\n\r\n", 414);
+  checkError("GET / HTTP/1.1\r\nCookie: " + std::string(HTTP_LINE_MAX, 'c') + "\r\n\r\n", 431);
+}
+
+static void testHeaderBudget()
+{
+  // Short headers, each within the line limit, run out the budget together
+  std::string request = "GET / HTTP/1.1\r\n";
+  while (request.size() <= HTTP_HEADER_BUDGET)
+  {
+    request += "X-Padding: 0123456789\r\n";
+  }
+  checkError(request + "\r\n", 431);
+
+  // The budget fails a request as soon as it is spent, even mid-line and without an end in sight
+  HttpParser parser;
+  httpParserInit(parser);
+  std::string endless(HTTP_HEADER_BUDGET * 4, 'a');
+  size_t consumed;
+  CHECK(httpParse(parser, (const uint8_t *)endless.data(), endless.size(), &consumed) == HTTP_ERROR);
+  CHECK(consumed == HTTP_HEADER_BUDGET + 1 && parser.errorStatus == 431);
+
+  // Exactly at the budget is still fine
+  request = "GET / HTTP/1.1\r\n";
+  while (request.size() + 200 <= HTTP_HEADER_BUDGET - 8)
+  {
+    request += "X-Fill: " + std::string(190, 'f') + "\r\n";
+  }
+  request += "A: " + std::string(HTTP_HEADER_BUDGET - request.size() - 7, 'b') + "\r\n\r\n";
+  CHECK(request.size() == HTTP_HEADER_BUDGET);
+  CHECK(parseWhole(parser, request) == HTTP_COMPLETE);
+  checkError(request.substr(0, request.size() - 4) + "b\r\n\r\n", 431);
+
+  // The body does not count against the header budget
+  std::string body(HTTP_BODY_MAX, 'b');
+  std::string post = "POST /configure HTTP/1.1\r\nContent-Length: " + std::to_string(HTTP_BODY_MAX) + "\r\n\r\n" + body;
+  CHECK(parseWhole(parser, post) == HTTP_COMPLETE && parser.bodyLength == HTTP_BODY_MAX);
+}
+
+static void testReasons()
+{
+  CHECK(strcmp(httpReason(404), "Not Found") == 0);
+  CHECK(strcmp(httpReason(431), "Request Header Fields Too Large") == 0);
+  CHECK(strcmp(httpReason(999), "Error") == 0);
+}
+
+int main()
+{
+  seedRandom(0xBB67AE85u);
+  testGet();
+  testSplits();
+  testHeaders();
+  testErrors();
+  testHeaderBudget();
+  testReasons();
+
+  return checkSummary("HTTP parser");
+}
@@ -0,0 +1,209 @@
+// MQTT packet encoding and parsing, and the QoS 1 in-flight window
+#include "mqtt.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+static bool bytesEqual(const uint8_t *buffer, size_t length, const std::vector<uint8_t> &expected)
+{
+  return length == expected.size() && memcmp(buffer, expected.data(), length) == 0;
+}
+
+static void testEncoders()
+{
+  uint8_t buffer[256];
+
+  size_t length = mqttConnect(buffer, sizeof(buffer), "pico", 30);
+  CHECK(bytesEqual(buffer, length, {0x10, 16, 0, 4, 'M', 'Q', 'T', 'T', 4, 0x02, 0, 30, 0, 4, 'p', 'i', 'c', 'o'}));
+
+  length = mqttPublish(buffer, sizeof(buffer), "a/b", "hi", 2, 0, 0, false);
+  CHECK(bytesEqual(buffer, length, {0x30, 7, 0, 3, 'a', '/', 'b', 'h', 'i'}));
+  length = mqttPublish(buffer, sizeof(buffer), "a/b", "hi", 2, 1, 0x1234, true);
+  CHECK(bytesEqual(buffer, length, {0x33, 9, 0, 3, 'a', '/', 'b', 0x12, 0x34, 'h', 'i'}));
+
+  length = mqttSubscribe(buffer, sizeof(buffer), 7, "c/d", 1);
+  CHECK(bytesEqual(buffer, length, {0x82, 8, 0, 7, 0, 3, 'c', '/', 'd', 1}));
+
+  length = mqttPubAck(buffer, sizeof(buffer), 0xBEEF);
+  CHECK(bytesEqual(buffer, length, {0x40, 2, 0xBE, 0xEF}));
+  length = mqttPingReq(buffer, sizeof(buffer));
+  CHECK(bytesEqual(buffer, length, {0xC0, 0}));
+  length = mqttDisconnect(buffer, sizeof(buffer));
+  CHECK(bytesEqual(buffer, length, {0xE0, 0}));
+
+  // Nothing is written past the end, a packet that does not fit is refused
+  length = mqttPublish(buffer, 8, "a/b", "hi", 2, 0, 0, false);
+  CHECK(length == 0);
+  CHECK(mqttPublish(buffer, 9, "a/b", "hi", 2, 0, 0, false) == 9);
+  CHECK(mqttPubAck(buffer, 3, 1) == 0);
+  CHECK(mqttPingReq(buffer, 1) == 0);
+}
+
+// Lengths at the boundaries of the one, two and three byte encodings
+static void testRemainingLength()
+{
+  const size_t payloads[] = {0, 1, 120, 121, 122, 16376, 16377, 16378, 70000};
+  for (size_t payloadLength : payloads)
+  {
+    std::vector<uint8_t> payload(payloadLength, 'p');
+    std::vector<uint8_t> buffer(payloadLength + 16);
+    size_t length = mqttPublish(buffer.data(), buffer.size(), "topic", payload.data(), payload.size(), 0, 0, false);
+    size_t remaining = 7 + payloadLength;
+    size_t lengthBytes = remaining < 128 ? 1 : remaining < 16384 ? 2 : 3;
+    CHECK(length == 1 + lengthBytes + remaining);
+    for (size_t available = 0; available <= 1 + lengthBytes; available++)
+    {
+      size_t found = mqttPacketLength(buffer.data(), available);
+      CHECK(available <= lengthBytes ? found == 0 : found == length);
+    }
+  }
+
+  const uint8_t edges[][5] = {{0x30, 0x7F}, {0x30, 0x80, 0x01}, {0x30, 0xFF, 0x7F}, {0x30, 0x80, 0x80, 0x01}};
+  CHECK(mqttPacketLength(edges[0], 2) == 2 + 127);
+  CHECK(mqttPacketLength(edges[1], 3) == 3 + 128);
+  CHECK(mqttPacketLength(edges[2], 3) == 3 + 16383);
+  CHECK(mqttPacketLength(edges[3], 4) == 4 + 16384);
+
+  // A continuation bit on the fourth length byte
+  const uint8_t malformed[] = {0x30, 0xFF, 0xFF, 0xFF, 0xFF, 0x01};
+  CHECK(mqttPacketLength(malformed, sizeof(malformed)) == MQTT_MALFORMED);
+}
+
+static bool parse(const std::vector<uint8_t> &bytes, MqttPacket *packet)
+{
+  return mqttParse(bytes.data(), bytes.size(), packet);
+}
+
+static void testParse()
+{
+  MqttPacket packet;
+
+  CHECK(parse({0x20, 2, 0x01, 0x00}, &packet) && packet.type == MQTT_CONNACK && packet.sessionPresent &&
+        packet.returnCode == 0);
+  CHECK(parse({0x20, 2, 0x00, 0x05}, &packet) && !packet.sessionPresent && packet.returnCode == 5);
+  CHECK(!parse({0x20, 2, 0x02, 0x00}, &packet)); // Reserved acknowledge flag
+  CHECK(!parse({0x20, 3, 0x00, 0x00, 0x00}, &packet));
+
+  // The packet points into the bytes, which must outlive it
+  std::vector<uint8_t> publish = {0x30, 7, 0, 3, 'a', '/', 'b', 'h', 'i'};
+  CHECK(parse(publish, &packet));
+  CHECK(packet.type == MQTT_PUBLISH && packet.qos == 0 && !packet.retain && packet.packetId == 0);
+  CHECK(std::string(packet.topic, packet.topicLength) == "a/b");
+  CHECK(std::string((const char *)packet.payload, packet.payloadLength) == "hi");
+
+  publish = {0x33, 9, 0, 3, 'a', '/', 'b', 0x12, 0x34, 'h', 'i'};
+  CHECK(parse(publish, &packet));
+  CHECK(packet.qos == 1 && packet.retain && packet.packetId == 0x1234);
+  CHECK(std::string((const char *)packet.payload, packet.payloadLength) == "hi");
+
+  CHECK(parse({0x32, 7, 0, 3, 'a', '/', 'b', 0, 1}, &packet) && packet.payloadLength == 0);
+  CHECK(!parse({0x32, 7, 0, 3, 'a', '/', 'b', 0, 0}, &packet)); // Packet identifier 0
+  CHECK(!parse({0x34, 7, 0, 3, 'a', '/', 'b', 0, 1}, &packet)); // QoS 2 was never subscribed to
+  CHECK(!parse({0x30, 4, 0, 3, 'a', '/'}, &packet));            // Topic runs past the packet
+  CHECK(!parse({0x30, 2, 0, 0}, &packet));                      // Empty topic
+  CHECK(!parse({0x32, 5, 0, 3, 'a', '/', 'b'}, &packet));       // No room for the identifier
+
+  CHECK(parse({0x40, 2, 0xBE, 0xEF}, &packet) && packet.type == MQTT_PUBACK && packet.packetId == 0xBEEF);
+  CHECK(!parse({0x40, 3, 0, 1, 0}, &packet));
+  CHECK(parse({0x90, 3, 0, 7, 0x01}, &packet) && packet.type == MQTT_SUBACK && packet.packetId == 7 &&
+        packet.returnCode == 1);
+  CHECK(parse({0x90, 3, 0, 7, 0x80}, &packet) && packet.returnCode == 0x80);
+  CHECK(parse({0xD0, 0}, &packet) && packet.type == MQTT_PINGRESP);
+  CHECK(!parse({0xD0, 1, 0}, &packet));
+
+  // Types a broker never sends, and lengths that disagree with the buffer
+  CHECK(!parse({0x10, 0}, &packet));
+  CHECK(!parse({0xC0, 0}, &packet));
+  CHECK(!parse({0x40, 2, 0}, &packet));
+  CHECK(!parse({0x40, 2, 0, 1, 0}, &packet));
+  CHECK(!parse({0x40}, &packet));
+
+  // Random bytes are refused or parsed without reading past the end
+  for (int round = 0; round < 20000; round++)
+  {
+    std::vector<uint8_t> bytes(1 + nextRandom() % 12);
+    for (uint8_t &byte : bytes)
+    {
+      byte = (uint8_t)nextRandom();
+    }
+    bytes[1 % bytes.size()] = (uint8_t)(bytes.size() - 2 < 128 ? bytes.size() - 2 : 0);
+    if (parse(bytes, &packet) && packet.type == MQTT_PUBLISH)
+    {
+      CHECK((const uint8_t *)packet.topic + packet.topicLength <= bytes.data() + bytes.size());
+      CHECK(packet.payload + packet.payloadLength == bytes.data() + bytes.size());
+    }
+  }
+}
+
+static void testWindow()
+{
+  MqttWindow window;
+  mqttWindowInit(window);
+  CHECK(!mqttWindowFull(window));
+
+  uint16_t ids[MQTT_INFLIGHT_WINDOW];
+  for (int i = 0; i < MQTT_INFLIGHT_WINDOW; i++)
+  {
+    ids[i] = mqttWindowAdd(window, (uint16_t)(100 + i));
+    CHECK(ids[i] != 0);
+  }
+  CHECK(mqttWindowFull(window));
+  for (int i = 1; i < MQTT_INFLIGHT_WINDOW; i++)
+  {
+    CHECK(ids[i] != ids[i - 1]);
+  }
+
+  // Out of order: nothing moves until the oldest is acknowledged
+  uint16_t sequence = 0;
+  CHECK(!mqttWindowAck(window, ids[1], &sequence));
+  CHECK(!mqttWindowAck(window, ids[2], &sequence));
+  CHECK(mqttWindowFull(window));
+  CHECK(mqttWindowAck(window, ids[0], &sequence) && sequence == 102);
+  CHECK(window.count == MQTT_INFLIGHT_WINDOW - 3);
+
+  // An unknown or repeated acknowledgement changes nothing
+  CHECK(!mqttWindowAck(window, ids[0], &sequence));
+  CHECK(!mqttWindowAck(window, 0x7777, &sequence));
+  CHECK(window.count == MQTT_INFLIGHT_WINDOW - 3);
+
+  for (int i = 3; i < MQTT_INFLIGHT_WINDOW; i++)
+  {
+    CHECK(mqttWindowAck(window, ids[i], &sequence) && sequence == 100 + i);
+  }
+  CHECK(window.count == 0);
+
+  // Identifiers wrap past 0 and skip those still in flight
+  mqttWindowInit(window);
+  window.nextPacketId = 0xFFFF;
+  uint16_t held = mqttWindowAdd(window, 1);
+  CHECK(held == 0xFFFF);
+  CHECK(mqttWindowAdd(window, 2) == 1);
+  window.nextPacketId = 0xFFFF;
+  CHECK(mqttNextPacketId(window) == 2);
+
+  // An identifier taken for a publish that was never written holds no slot,
+  // the one recorded after it is acknowledged on its own
+  mqttWindowInit(window);
+  uint16_t unused = mqttNextPacketId(window);
+  uint16_t written = mqttNextPacketId(window);
+  CHECK(unused != written);
+  mqttWindowRecord(window, written, 7);
+  CHECK(window.count == 1);
+  CHECK(!mqttWindowAck(window, unused, &sequence));
+  CHECK(mqttWindowAck(window, written, &sequence) && sequence == 7 && window.count == 0);
+}
+
+int main()
+{
+  seedRandom(0x3C6EF372u);
+  testEncoders();
+  testRemainingLength();
+  testParse();
+  testWindow();
+
+  return checkSummary("mqtt");
+}
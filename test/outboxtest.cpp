@@ -0,0 +1,176 @@
+// Outbox batching: what one socket wake-up sends
+#include "control.h"
+#include "framing.h"
+#include "messagewriter.h"
+#include "outbox.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+static Outbox outbox;
+static FrameAssembler assembler;
+
+static Message countdown(int timeout)
+{
+  return timeoutInfo(InfoType::COMPRESSION_COUNTDOWN_UPDATED, timeout);
+}
+
+static HalQueueHandle queueWith(int count)
+{
+  HalQueueHandle queue = halQueueCreate(64, sizeof(Message));
+  for (int i = 0; i < count; i++)
+  {
+    Message msg = countdown(i);
+    halQueueSend(queue, &msg, 0);
+  }
+  return queue;
+}
+
+// The outbox bytes split back into the messages that went in, in order
+static int framesIn(WireEncoding encoding, int firstTimeout)
+{
+  frameAssemblerInit(assembler, encoding);
+
+  uint8_t frame[FRAME_MAX_LENGTH];
+  size_t length;
+  size_t pushed = 0;
+  int frames = 0;
+  while (pushed < outbox.length)
+  {
+    pushed += frameAssemblerPush(assembler, outbox.buffer + pushed, outbox.length - pushed);
+    while (frameAssemblerNext(assembler, frame, sizeof(frame), &length) == FRAME_READY)
+    {
+      Message msg = {};
+      if (encoding == WIRE_BINARY)
+      {
+        CHECK(binaryToMessage(frame, length, msg));
+        CHECK(msg.payload.timeout == firstTimeout + frames);
+      }
+      else
+      {
+        char expected[MESSAGE_WRITER_MAX_LENGTH];
+        Message original = countdown(firstTimeout + frames);
+        messageToBuffer(original, expected, sizeof(expected));
+        CHECK(strcmp((const char *)frame, expected) == 0);
+      }
+      frames++;
+    }
+  }
+  return frames;
+}
+
+static void testDrainBatch()
+{
+  static const WireEncoding encodings[] = {WIRE_JSON, WIRE_BINARY};
+  for (WireEncoding encoding : encodings)
+  {
+    HalQueueHandle queue = queueWith(20);
+
+    bool limitReached = false;
+    outboxClear(outbox);
+    CHECK(outboxDrainQueue(outbox, queue, encoding, 16, &limitReached) == 16);
+    CHECK(limitReached);
+    CHECK(outbox.messages == 16);
+    CHECK(framesIn(encoding, 0) == 16);
+
+    // The rest is still queued for the next wake-up
+    outboxClear(outbox);
+    CHECK(outboxDrainQueue(outbox, queue, encoding, 16, &limitReached) == 4);
+    CHECK(!limitReached);
+    CHECK(framesIn(encoding, 16) == 4);
+
+    outboxClear(outbox);
+    CHECK(outboxDrainQueue(outbox, queue, encoding, 16, &limitReached) == 0);
+    CHECK(!limitReached);
+    CHECK(outbox.length == 0);
+  }
+}
+
+// A long batch stops while the largest message would still fit
+static void testBufferLimit()
+{
+  HalQueueHandle queue = queueWith(64);
+  bool limitReached = false;
+  outboxClear(outbox);
+  size_t moved = outboxDrainQueue(outbox, queue, WIRE_JSON, 64, &limitReached);
+  CHECK(moved > 0 && moved < 64);
+  CHECK(limitReached);
+  CHECK(OUTBOX_BUFFER_SIZE - outbox.length < MESSAGE_WRITER_MAX_LENGTH);
+  CHECK(framesIn(WIRE_JSON, 0) == (int)moved);
+
+  outboxClear(outbox);
+  CHECK(outboxDrainQueue(outbox, queue, WIRE_JSON, 64, &limitReached) > 0);
+  CHECK(framesIn(WIRE_JSON, (int)moved) == (int)outbox.messages);
+}
+
+static void testText()
+{
+  std::string text = "{\"messageType\":\"LATENCY\"}";
+
+  outboxClear(outbox);
+  CHECK(outboxAppendText(outbox, WIRE_JSON, text.c_str(), text.size()));
+  CHECK(std::string((const char *)outbox.buffer, outbox.length) == text + "\n");
+
+  outboxClear(outbox);
+  CHECK(outboxAppendText(outbox, WIRE_BINARY, text.c_str(), text.size()));
+  CHECK(outbox.length == text.size() + MESSAGE_BINARY_HEADER);
+  CHECK(outbox.buffer[2] == MESSAGE_BINARY_TEXT);
+  CHECK(binaryFrameLength(outbox.buffer, outbox.length) == outbox.length);
+
+  std::string large(OUTBOX_BUFFER_SIZE, 'x');
+  outboxClear(outbox);
+  CHECK(!outboxAppendText(outbox, WIRE_JSON, large.c_str(), large.size()));
+  CHECK(outboxAppendText(outbox, WIRE_JSON, large.c_str(), large.size() - 1));
+  CHECK(outbox.length == OUTBOX_BUFFER_SIZE);
+}
+
+static void testStats()
+{
+  outboxResetStats();
+  HalQueueHandle queue = queueWith(10);
+  outboxClear(outbox);
+  bool limitReached;
+  outboxDrainQueue(outbox, queue, WIRE_JSON, 16, &limitReached);
+  outboxRecordFlush(outbox, true);
+  size_t bytes = outbox.length;
+  outboxRecordFlush(outbox, false);
+
+  OutboxStats stats;
+  outboxGetStats(&stats);
+  CHECK(stats.flushes == 2);
+  CHECK(stats.failures == 1);
+  CHECK(stats.messages == 10);
+  CHECK(stats.bytes == bytes);
+  CHECK(stats.largestBatch == 10);
+  CHECK(stats.rejected == 0);
+
+  // A message the binary encoder has no schema for is dropped, counted, and not moved
+  queue = queueWith(2);
+  Message unknown = countdown(0);
+  unknown.type = 200;
+  halQueueSend(queue, &unknown, 0);
+  Message last = countdown(2);
+  halQueueSend(queue, &last, 0);
+  outboxClear(outbox);
+  CHECK(outboxDrainQueue(outbox, queue, WIRE_BINARY, 16, &limitReached) == 3);
+  CHECK(outbox.messages == 3 && framesIn(WIRE_BINARY, 0) == 3);
+  outboxGetStats(&stats);
+  CHECK(stats.rejected == 1);
+
+  outboxResetStats();
+  outboxGetStats(&stats);
+  CHECK(stats.flushes == 0 && stats.messages == 0);
+}
+
+int main()
+{
+  testDrainBatch();
+  testBufferLimit();
+  testText();
+  testStats();
+
+  return checkSummary("outbox");
+}
@@ -0,0 +1,596 @@
+// Differential test: bufferToMessage() against the cJSON parser it replaced
+#include "control.h"
+#include "messageparser.h"
+#include "messageschema.h"
+#include "messagewriter.h"
+
+#include "cJSON.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+static bool parseScheduledCommand(const char *value, CommandType &command)
+{
+  if (strcmp(value, "ON") == 0)
+  {
+    command = CommandType::ON;
+  }
+  else if (strcmp(value, "OFF") == 0)
+  {
+    command = CommandType::OFF;
+  }
+  else if (strcmp(value, "OFF_RELEASE") == 0)
+  {
+    command = CommandType::OFF_RELEASE;
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+static bool parseScheduleMode(const char *value, ScheduleMode &mode)
+{
+  if (strcmp(value, "IN") == 0)
+  {
+    mode = ScheduleMode::SCHEDULE_IN;
+  }
+  else if (strcmp(value, "AT") == 0)
+  {
+    mode = ScheduleMode::SCHEDULE_AT;
+  }
+  else if (strcmp(value, "DAILY") == 0)
+  {
+    mode = ScheduleMode::SCHEDULE_DAILY;
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+// The cJSON implementation bufferToMessage() replaced, kept as the oracle
+static bool referenceBufferToMessage(const char *buffer, Message &msg)
+{
+  // Parse JSON
+  cJSON *json = cJSON_Parse(buffer);
+  if (!json)
+  {
+    printf("Failed to parse JSON: %s\n", buffer);
+    return false;
+  }
+
+  // Parse messageType
+  cJSON *messageType = cJSON_GetObjectItem(json, "messageType");
+  if (cJSON_IsString(messageType))
+  {
+    if (strcmp(messageType->valuestring, "COMMAND") == 0)
+    {
+      msg.messageType = MessageType::COMMAND;
+
+      // Parse commandType
+      cJSON *commandType = cJSON_GetObjectItem(json, "commandType");
+      if (cJSON_IsString(commandType))
+      {
+        bool known = true;
+        if (strcmp(commandType->valuestring, "ON") == 0)
+        {
+          msg.type = CommandType::ON;
+        }
+        else if (strcmp(commandType->valuestring, "OFF") == 0)
+        {
+          msg.type = CommandType::OFF;
+        }
+        else if (strcmp(commandType->valuestring, "OFF_RELEASE") == 0)
+        {
+          msg.type = CommandType::OFF_RELEASE;
+        }
+        else if (strcmp(commandType->valuestring, "SET_COMPRESSION_TIMEOUT") == 0)
+        {
+          msg.type = CommandType::SET_COMPRESSION_TIMEOUT;
+
+          // Parse timeout
+          cJSON *timeout = cJSON_GetObjectItem(json, "timeout");
+          if (cJSON_IsNumber(timeout))
+          {
+            msg.payload.timeout = timeout->valueint;
+          }
+        }
+        else if (strcmp(commandType->valuestring, "SET_RELEASE_TIMEOUT") == 0)
+        {
+          msg.type = CommandType::SET_RELEASE_TIMEOUT;
+
+          // Parse timeout
+          cJSON *timeout = cJSON_GetObjectItem(json, "timeout");
+          if (cJSON_IsNumber(timeout))
+          {
+            msg.payload.timeout = timeout->valueint;
+          }
+        }
+        else if (strcmp(commandType->valuestring, "SET_MOTOR_TIMEOUT") == 0)
+        {
+          msg.type = CommandType::SET_MOTOR_TIMEOUT;
+
+          // Parse timeout
+          cJSON *timeout = cJSON_GetObjectItem(json, "timeout");
+          if (cJSON_IsNumber(timeout))
+          {
+            msg.payload.timeout = timeout->valueint;
+          }
+        }
+        else if (strcmp(commandType->valuestring, "SCHEDULE") == 0)
+        {
+          msg.type = CommandType::SCHEDULE;
+
+          // Parse schedule fields, rejecting anything incomplete
+          cJSON *id = cJSON_GetObjectItem(json, "id");
+          cJSON *action = cJSON_GetObjectItem(json, "action");
+          cJSON *mode = cJSON_GetObjectItem(json, "mode");
+          cJSON *time = cJSON_GetObjectItem(json, "time");
+          CommandType scheduledCommand;
+          ScheduleMode scheduleMode;
+          if (!cJSON_IsNumber(id) || !cJSON_IsString(action) || !cJSON_IsString(mode) || !cJSON_IsNumber(time) ||
+              !parseScheduledCommand(action->valuestring, scheduledCommand) ||
+              !parseScheduleMode(mode->valuestring, scheduleMode))
+          {
+            printf("Invalid SCHEDULE command: %s\n", buffer);
+            cJSON_Delete(json);
+            return false;
+          }
+          msg.payload.schedule.action = (uint8_t)scheduledCommand;
+          msg.payload.schedule.mode = (uint8_t)scheduleMode;
+          msg.payload.schedule.id = id->valueint;
+          msg.payload.schedule.time = time->valueint;
+        }
+        else if (strcmp(commandType->valuestring, "UNSCHEDULE") == 0)
+        {
+          msg.type = CommandType::UNSCHEDULE;
+
+          // Parse id
+          cJSON *id = cJSON_GetObjectItem(json, "id");
+          if (cJSON_IsNumber(id))
+          {
+            msg.payload.scheduleId = id->valueint;
+          }
+        }
+        else if (strcmp(commandType->valuestring, "SET_MOTOR_TEMPERATURE_LIMIT") == 0)
+        {
+          msg.type = CommandType::SET_MOTOR_TEMPERATURE_LIMIT;
+
+          // Parse limit
+          cJSON *limit = cJSON_GetObjectItem(json, "limit");
+          if (cJSON_IsNumber(limit))
+          {
+            msg.payload.limit = limit->valueint;
+          }
+        }
+        else if (strcmp(commandType->valuestring, "GET_RECORDER") == 0)
+        {
+          msg.type = CommandType::GET_RECORDER;
+
+          // Parse since, everything still held if absent
+          cJSON *since = cJSON_GetObjectItem(json, "since");
+          msg.payload.since = cJSON_IsNumber(since) ? since->valueint : 0;
+        }
+        else if (strcmp(commandType->valuestring, "GET_LATENCY") == 0)
+        {
+          msg.type = CommandType::GET_LATENCY;
+        }
+        else if (strcmp(commandType->valuestring, "RESET_LATENCY") == 0)
+        {
+          msg.type = CommandType::RESET_LATENCY;
+        }
+        else if (strcmp(commandType->valuestring, "GET_STATE") == 0)
+        {
+          msg.type = CommandType::GET_STATE;
+        }
+        else if (strcmp(commandType->valuestring, "ACK") == 0)
+        {
+          msg.type = CommandType::ACK;
+
+          // An acknowledgement means nothing without its sequence
+          if (!cJSON_IsNumber(cJSON_GetObjectItem(json, "seq")))
+          {
+            printf("Invalid ACK command: %s\n", buffer);
+            cJSON_Delete(json);
+            return false;
+          }
+        }
+        else if (strcmp(commandType->valuestring, "HEARTBEAT_ACK") == 0)
+        {
+          msg.type = CommandType::HEARTBEAT_ACK;
+        }
+        else if (strcmp(commandType->valuestring, "GET_HISTORY") == 0)
+        {
+          msg.type = CommandType::GET_HISTORY;
+
+          // Parse the range, zero for what is absent
+          cJSON *from = cJSON_GetObjectItem(json, "from");
+          cJSON *to = cJSON_GetObjectItem(json, "to");
+          cJSON *resolution = cJSON_GetObjectItem(json, "resolution");
+          if (cJSON_IsNumber(from))
+          {
+            msg.payload.history.from = from->valueint;
+          }
+          if (cJSON_IsNumber(to))
+          {
+            msg.payload.history.to = to->valueint;
+          }
+          if (cJSON_IsNumber(resolution))
+          {
+            msg.payload.history.resolution = resolution->valueint;
+          }
+        }
+        else if (strcmp(commandType->valuestring, "GET_STATS") == 0)
+        {
+          msg.type = CommandType::GET_STATS;
+        }
+        else if (strcmp(commandType->valuestring, "RESET_STATS") == 0)
+        {
+          msg.type = CommandType::RESET_STATS;
+        }
+        else if (strcmp(commandType->valuestring, "SET_CLOCK") == 0)
+        {
+          msg.type = CommandType::SET_CLOCK;
+
+          // Parse time
+          cJSON *time = cJSON_GetObjectItem(json, "time");
+          if (cJSON_IsNumber(time))
+          {
+            msg.payload.time = time->valueint;
+          }
+        }
+        else
+        {
+          known = false;
+        }
+
+        // Parse seq, any known command may carry one
+        cJSON *seq = cJSON_GetObjectItem(json, "seq");
+        if (known && cJSON_IsNumber(seq))
+        {
+          msg.sequence = (uint16_t)seq->valueint;
+        }
+      }
+    }
+    else if (strcmp(messageType->valuestring, "INFO") == 0)
+    {
+      msg.messageType = MessageType::INFO;
+
+      // Parse infoType
+      cJSON *infoType = cJSON_GetObjectItem(json, "infoType");
+      if (cJSON_IsString(infoType))
+      {
+        if (strcmp(infoType->valuestring, "PRESSURE_CHANGE") == 0)
+        {
+          msg.type = InfoType::PRESSURE_CHANGE;
+
+          // Parse pressure
+          cJSON *pressure = cJSON_GetObjectItem(json, "pressure");
+          if (cJSON_IsNumber(pressure))
+          {
+            msg.payload.pressure = static_cast<float>(pressure->valuedouble);
+          }
+        }
+        else if (strcmp(infoType->valuestring, "COMPRESSION_COUNTDOWN_UPDATED") == 0)
+        {
+          msg.type = InfoType::COMPRESSION_COUNTDOWN_UPDATED;
+
+          // Parse timeout
+          cJSON *timeout = cJSON_GetObjectItem(json, "timeout");
+          if (cJSON_IsNumber(timeout))
+          {
+            msg.payload.timeout = timeout->valueint;
+          }
+        }
+        else if (strcmp(infoType->valuestring, "RELEASE_COUNTDOWN_UPDATED") == 0)
+        {
+          msg.type = InfoType::RELEASE_COUNTDOWN_UPDATE;
+
+          // Parse timeout
+          cJSON *timeout = cJSON_GetObjectItem(json, "timeout");
+          if (cJSON_IsNumber(timeout))
+          {
+            msg.payload.timeout = timeout->valueint;
+          }
+        }
+        else if (strcmp(infoType->valuestring, "RELEASE_COUNTDOWN_UPDATED") == 0)
+        {
+          msg.type = InfoType::MOTOR_COUNTDOWN_UPDATE;
+
+          // Parse timeout
+          cJSON *timeout = cJSON_GetObjectItem(json, "timeout");
+          if (cJSON_IsNumber(timeout))
+          {
+            msg.payload.timeout = timeout->valueint;
+          }
+        }
+      }
+    }
+  }
+
+  cJSON_Delete(json); // Free the JSON object
+  return true;
+}
+
+static const char *corpus[] = {
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"ON\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"OFF\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"OFF_RELEASE\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"SET_COMPRESSION_TIMEOUT\",\"timeout\":30}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"SET_RELEASE_TIMEOUT\",\"timeout\":5}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"SET_MOTOR_TIMEOUT\",\"timeout\":2.9}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"SCHEDULE\",\"id\":3,\"action\":\"ON\",\"mode\":\"DAILY\",\"time\":25200}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"SCHEDULE\",\"id\":4,\"action\":\"OFF_RELEASE\",\"mode\":\"IN\",\"time\":60}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"SCHEDULE\",\"id\":4,\"action\":\"OFF\",\"mode\":\"AT\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"UNSCHEDULE\",\"id\":3}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"SET_CLOCK\",\"time\":3600}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"SET_MOTOR_TEMPERATURE_LIMIT\",\"limit\":95}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"GET_RECORDER\",\"since\":12}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"GET_RECORDER\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"GET_LATENCY\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"RESET_LATENCY\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"GET_STATS\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"RESET_STATS\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"GET_STATE\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"ACK\",\"seq\":42}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"ACK\",\"seq\":70000}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"ACK\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"ACK\",\"seq\":\"1\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"HEARTBEAT_ACK\"}",
+    "{\"commandType\":\"HEARTBEAT_ACK\",\"messageType\":\"COMMAND\",\"seq\":3}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"GET_HISTORY\",\"from\":-3600,\"to\":0,\"resolution\":60}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"GET_HISTORY\",\"resolution\":300}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"GET_HISTORY\",\"from\":1200,\"to\":\"now\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"ON\",\"seq\":5}",
+    "{\"messageType\":\"INFO\",\"infoType\":\"PRESSURE_CHANGE\",\"pressure\":31.4}",
+    "{\"messageType\":\"INFO\",\"infoType\":\"COMPRESSION_COUNTDOWN_UPDATED\",\"timeout\":12}",
+    "{\"messageType\":\"INFO\",\"infoType\":\"RELEASE_COUNTDOWN_UPDATED\",\"timeout\":7}",
+    "{ \"MESSAGETYPE\" : \"COMMAND\" , \"commandtype\" : \"ON\" }\r\n",
+    "{\"messageType\":\"COMMAND\",\"messageType\":\"INFO\",\"commandType\":\"OFF\"}",
+    "{\"timeout\":\"x\",\"messageType\":\"COMMAND\",\"commandType\":\"SET_MOTOR_TIMEOUT\",\"timeout\":4}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"SET_MOTOR_TIMEOUT\",\"timeout\":1e99}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"SET_MOTOR_TIMEOUT\",\"timeout\":-1e99}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"SET_MOTOR_TIMEOUT\",\"timeout\":-0.5}",
+    "{\"message\\u0054ype\":\"COMMAND\",\"commandType\":\"O\\u004e\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"ON\\u0000junk\"}",
+    "{\"messageType\\u0000x\":\"COMMAND\",\"commandType\":\"OFF\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"\\uZZZZ\"}",
+    "{\"a\":[1,{\"b\":[null,true,false]},\"\\ud83d\\ude00\"],\"messageType\":\"COMMAND\",\"commandType\":\"ON\"}",
+    "{\"a\":\"\\ud83d\"}",
+    "{\"a\":\"\\q\"}",
+    "\xEF\xBB\xBF{\"messageType\":\"COMMAND\",\"commandType\":\"ON\"}",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"ON\"} trailing garbage",
+    "{\"messageType\":\"COMMAND\",\"commandType\":\"ON\",}",
+    "{\"messageType\":\"COMMAND\" \"commandType\":\"ON\"}",
+    "{\"timeout\":01,\"x\":1-2}",
+    "{\"timeout\":-}",
+    "[1,2,3]",
+    "42",
+    "\"string\"",
+    "nullx",
+    "",
+    "   ",
+    "not json",
+    "{}",
+    "[]",
+    "{\"messageType\":\"COMMAND\"",
+};
+
+static const char mutationAlphabet[] = "{}[]\":,\\u0123456789eE.+-tnfrl aAZ\x01\x7f\xc3";
+
+static std::string mutate(std::string text)
+{
+  int mutations = 1 + nextRandom() % 4;
+  for (int i = 0; i < mutations; i++)
+  {
+    size_t position = text.empty() ? 0 : nextRandom() % (text.size() + 1);
+    char c = (nextRandom() % 4 == 0) ? (char)(1 + nextRandom() % 255)
+                                     : mutationAlphabet[nextRandom() % (sizeof(mutationAlphabet) - 1)];
+    switch (nextRandom() % 5)
+    {
+    case 0:
+      if (position < text.size())
+      {
+        text[position] = c;
+      }
+      break;
+    case 1:
+      text.insert(position, 1, c);
+      break;
+    case 2:
+      if (position < text.size())
+      {
+        text.erase(position, 1 + nextRandom() % 4);
+      }
+      break;
+    case 3:
+      text = text.substr(0, position);
+      break;
+    default:
+    {
+      size_t length = nextRandom() % 12;
+      if (position + length <= text.size())
+      {
+        text.insert(nextRandom() % (text.size() + 1), text.substr(position, length));
+      }
+      break;
+    }
+    }
+  }
+  return text;
+}
+
+// Same verdict, on acceptance the same fields written, on rejection nothing
+static bool sameResult(const char *text)
+{
+  Message expected, actual, poison;
+  memset(&expected, 0xA5, sizeof(expected));
+  memset(&actual, 0xA5, sizeof(actual));
+  memset(&poison, 0xA5, sizeof(poison));
+
+  // Where the cJSON version left the type unset, bufferToMessage() rejects
+  bool expectedOk = referenceBufferToMessage(text, expected) && messageSchemaFor(expected) != NULL;
+  bool actualOk = bufferToMessage(text, actual);
+  if (expectedOk != actualOk)
+  {
+    fprintf(stderr, "Verdict differs (%d vs %d): %s\n", expectedOk, actualOk, text);
+    return false;
+  }
+  if (actualOk && memcmp(&expected, &actual, sizeof(Message)) != 0)
+  {
+    fprintf(stderr, "Fields differ: %s\n", text);
+    return false;
+  }
+  if (!actualOk && memcmp(&poison, &actual, sizeof(Message)) != 0)
+  {
+    fprintf(stderr, "Rejected but written: %s\n", text);
+    return false;
+  }
+  return true;
+}
+
+static void testCorpus()
+{
+  for (const char *text : corpus)
+  {
+    CHECK(sameResult(text));
+  }
+}
+
+static void testSemantics()
+{
+  Message msg = {};
+  CHECK(bufferToMessage("{\"MessageType\":\"COMMAND\",\"COMMANDTYPE\":\"OFF_RELEASE\"} junk", msg));
+  CHECK(isCommand(msg, CommandType::OFF_RELEASE));
+
+  CHECK(bufferToMessage("{\"messageType\":\"COMMAND\",\"commandType\":\"SET_MOTOR_TIMEOUT\",\"timeout\":1e12}", msg));
+  CHECK(msg.payload.timeout == 2147483647);
+
+  CHECK(!bufferToMessage("{\"messageType\":\"COMMAND\",\"commandType\":\"SCHEDULE\",\"id\":1}", msg));
+  CHECK(!bufferToMessage("{\"messageType\":\"COMMAND\",\"commandType\":\"ON\"", msg));
+
+  msg = {};
+  CHECK(bufferToMessage("{\"messageType\":\"COMMAND\",\"commandType\":\"ACK\",\"seq\":65535}", msg));
+  CHECK(isCommand(msg, CommandType::ACK) && msg.sequence == 65535);
+  CHECK(!bufferToMessage("{\"messageType\":\"COMMAND\",\"commandType\":\"ACK\"}", msg));
+
+  // Nothing without a type the schema knows
+  CHECK(!bufferToMessage("{}", msg));
+  CHECK(!bufferToMessage("{\"messageType\":\"COMMAND\"}", msg));
+  CHECK(!bufferToMessage("{\"messageType\":\"COMMAND\",\"commandType\":\"REBOOT\"}", msg));
+  CHECK(!bufferToMessage("{\"messageType\":\"INFO\",\"infoType\":\"TURNED_ON\"}", msg));
+  CHECK(!bufferToMessage("{\"messageType\":\"STATE\",\"commandType\":\"ON\"}", msg));
+  CHECK(isCommand(msg, CommandType::ACK) && msg.sequence == 65535);
+}
+
+// The parser has its own key table, this catches a schema entry or field it was not taught
+static void testSchemaCoverage()
+{
+  for (int type = 0;; type++)
+  {
+    const MessageSchema *schema = messageSchemaFind(MessageType::COMMAND, type);
+    if (schema == NULL)
+    {
+      break;
+    }
+    Message msg = {};
+    msg.messageType = MessageType::COMMAND;
+    msg.type = (uint8_t)type;
+    msg.sequence = 41;
+    for (int i = 0; i < schema->fieldCount; i++)
+    {
+      const SchemaField &field = schema->fields[i];
+      uint8_t *member = (uint8_t *)&msg + field.offset;
+      switch (field.kind)
+      {
+      case FIELD_INT:
+        *(int *)member = 1000 + i;
+        break;
+      case FIELD_FLOAT:
+        *(float *)member = 2.5f + i;
+        break;
+      case FIELD_ACTION:
+        *member = (uint8_t)CommandType::OFF_RELEASE;
+        break;
+      case FIELD_MODE:
+        *member = (uint8_t)ScheduleMode::SCHEDULE_DAILY;
+        break;
+      }
+    }
+
+    char text[MESSAGE_WRITER_MAX_LENGTH];
+    CHECK(messageToBuffer(msg, text, sizeof(text)) > 0);
+    Message parsed = {};
+    bool accepted = bufferToMessage(text, parsed);
+    CHECK(accepted);
+    CHECK(memcmp(&parsed, &msg, sizeof(Message)) == 0);
+    if (!accepted || memcmp(&parsed, &msg, sizeof(Message)) != 0)
+    {
+      fprintf(stderr, "  not parsed back: %s\n", text);
+    }
+  }
+}
+
+// An ON command whose extra member nests depth containers deep in all
+static std::string nestedCommand(int depth)
+{
+  std::string objects = "{\"messageType\":\"COMMAND\",\"commandType\":\"ON\",\"x\":";
+  for (int i = 1; i < depth; i++)
+  {
+    objects += "{\"a\":";
+  }
+  return objects + "0" + std::string(depth, '}');
+}
+
+static void testNestingLimit()
+{
+  for (int depth : {MESSAGE_PARSER_NESTING_LIMIT - 1, MESSAGE_PARSER_NESTING_LIMIT, MESSAGE_PARSER_NESTING_LIMIT + 1})
+  {
+    std::string arrays = std::string(depth, '[') + std::string(depth, ']');
+    CHECK(sameResult(arrays.c_str()));
+    CHECK(sameResult(nestedCommand(depth).c_str()));
+  }
+
+  Message msg = {};
+  CHECK(bufferToMessage(nestedCommand(MESSAGE_PARSER_NESTING_LIMIT).c_str(), msg));
+  CHECK(isCommand(msg, CommandType::ON));
+  CHECK(!bufferToMessage(nestedCommand(MESSAGE_PARSER_NESTING_LIMIT + 1).c_str(), msg));
+}
+
+static void testMutations()
+{
+  int mismatches = 0;
+  for (int i = 0; i < 200000 && mismatches < 10; i++)
+  {
+    std::string text = mutate(corpus[nextRandom() % (sizeof(corpus) / sizeof(corpus[0]))]);
+    if (!sameResult(text.c_str()))
+    {
+      mismatches++;
+    }
+  }
+  CHECK(mismatches == 0);
+}
+
+int main()
+{
+  seedRandom(12345);
+  if (freopen("/dev/null", "w", stdout) == NULL)
+  {
+    fprintf(stderr, "Could not silence stdout\n");
+  }
+
+  testCorpus();
+  testSemantics();
+  testSchemaCoverage();
+  testNestingLimit();
+  testMutations();
+
+  return checkSummary("parser");
+}
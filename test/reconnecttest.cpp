@@ -0,0 +1,130 @@
+// Connection upkeep: heartbeat liveness, jittered backoff bounds, and reconnect timing
+#include "reconnect.h"
+#include "check.h"
+
+#include <stdio.h>
+
+static void testHeartbeat()
+{
+  Heartbeat heartbeat;
+  heartbeatInit(heartbeat, 5000, 15000, 1000);
+  CHECK(!heartbeatDue(heartbeat, 5999));
+  CHECK(heartbeatDue(heartbeat, 6000));
+  heartbeatSent(heartbeat, 6000);
+  CHECK(!heartbeatDue(heartbeat, 6001));
+
+  CHECK(!heartbeatExpired(heartbeat, 15999));
+  CHECK(heartbeatExpired(heartbeat, 16000));
+  heartbeatHeard(heartbeat, 15000);
+  CHECK(!heartbeatExpired(heartbeat, 16000));
+  CHECK(heartbeatExpired(heartbeat, 30000));
+
+  // Across the wrap of the millisecond clock
+  heartbeatInit(heartbeat, 5000, 15000, 0xFFFFF000u);
+  CHECK(!heartbeatDue(heartbeat, 0x00000100u));
+  CHECK(heartbeatDue(heartbeat, 0x00001000u));
+  CHECK(!heartbeatExpired(heartbeat, 0x00001000u));
+  CHECK(heartbeatExpired(heartbeat, 0x00002A98u));
+
+  // A zero timeout turns it all off
+  heartbeatInit(heartbeat, 5000, 0, 0);
+  CHECK(!heartbeatDue(heartbeat, 100000));
+  CHECK(!heartbeatExpired(heartbeat, 100000));
+}
+
+static void testBackoffBounds()
+{
+  Backoff backoff;
+  backoffInit(backoff, 1000, 60000, 12345);
+  uint32_t ceiling = 1000;
+  for (int attempt = 0; attempt < 40; attempt++)
+  {
+    uint32_t delay = backoffNextDelay(backoff);
+    CHECK(delay >= ceiling / 2 && delay <= ceiling);
+    ceiling = ceiling * 2 > 60000 ? 60000 : ceiling * 2;
+  }
+  CHECK(backoff.attempts == 40);
+
+  backoffReset(backoff);
+  uint32_t delay = backoffNextDelay(backoff);
+  CHECK(delay >= 500 && delay <= 1000);
+
+  // A zero seed still jitters
+  backoffInit(backoff, 1000, 60000, 0);
+  CHECK(backoff.randomState != 0);
+
+  // Equal base and cap, and a cap that is not a power-of-two multiple
+  backoffInit(backoff, 4000, 4000, 1);
+  for (int attempt = 0; attempt < 10; attempt++)
+  {
+    delay = backoffNextDelay(backoff);
+    CHECK(delay >= 2000 && delay <= 4000);
+  }
+  backoffInit(backoff, 1000, 0xF0000000u, 7);
+  for (int attempt = 0; attempt < 64; attempt++)
+  {
+    delay = backoffNextDelay(backoff);
+    CHECK(delay <= 0xF0000000u);
+  }
+  CHECK(delay >= 0x78000000u);
+}
+
+static void testBackoffSpread()
+{
+  // Units that lost the server at once should not retry in step
+  const int units = 64;
+  Backoff backoffs[units];
+  for (int unit = 0; unit < units; unit++)
+  {
+    backoffInit(backoffs[unit], 1000, 60000, 0x1000u + (uint32_t)unit * 2654435761u);
+  }
+  for (int attempt = 0; attempt < 8; attempt++)
+  {
+    uint32_t lowest = UINT32_MAX;
+    uint32_t highest = 0;
+    for (int unit = 0; unit < units; unit++)
+    {
+      uint32_t delay = backoffNextDelay(backoffs[unit]);
+      lowest = delay < lowest ? delay : lowest;
+      highest = delay > highest ? delay : highest;
+    }
+    uint32_t ceiling = (1000u << attempt) > 60000 ? 60000 : (1000u << attempt);
+    CHECK(highest - lowest >= ceiling / 4);
+  }
+}
+
+static void testStats()
+{
+  reconnectResetStats();
+  ReconnectStats stats;
+
+  // Connecting the first time is not a reconnect
+  reconnectRecordConnect(1000000);
+  reconnectGetStats(&stats);
+  CHECK(stats.reconnects == 0);
+
+  // Failed attempts during one outage do not restart its clock
+  reconnectRecordDisconnect(10000000, true);
+  reconnectRecordDisconnect(11000000, false);
+  reconnectRecordDisconnect(13000000, false);
+  reconnectRecordConnect(14500000);
+  reconnectGetStats(&stats);
+  CHECK(stats.disconnects == 3 && stats.heartbeatTimeouts == 1);
+  CHECK(stats.reconnects == 1 && stats.lastReconnectMs == 4500 && stats.maxReconnectMs == 4500);
+
+  reconnectRecordDisconnect(20000000, false);
+  reconnectRecordConnect(21000000);
+  reconnectGetStats(&stats);
+  CHECK(stats.reconnects == 2 && stats.lastReconnectMs == 1000 && stats.maxReconnectMs == 4500);
+  CHECK(stats.totalReconnectMs == 5500);
+}
+
+int main()
+{
+  testHeartbeat();
+  testBackoffBounds();
+  testBackoffSpread();
+  testStats();
+
+  return checkSummary("reconnect");
+}
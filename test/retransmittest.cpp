@@ -0,0 +1,167 @@
+// Retransmit ring: sequencing, acknowledgement and replay of critical events
+#include "retransmit.h"
+#include "check.h"
+
+#include <stdio.h>
+
+static uint16_t append(InfoType infoType)
+{
+  Message msg = infoMessage(infoType);
+  return retransmitAppend(msg);
+}
+
+// Sends everything pending on this connection, returns how many went out
+static int sendAll(uint16_t *lastSequence)
+{
+  int sent = 0;
+  Message msg;
+  while (retransmitPeek(&msg))
+  {
+    retransmitAdvance();
+    *lastSequence = msg.sequence;
+    sent++;
+  }
+  return sent;
+}
+
+static void testAppendPeekAdvance()
+{
+  retransmitClear();
+  Message msg;
+  CHECK(!retransmitPeek(&msg));
+
+  CHECK(append(TURNED_ON) == 1);
+  CHECK(append(MOTOR_START) == 2);
+  CHECK(retransmitPending() == 2);
+
+  CHECK(retransmitPeek(&msg) && isInfo(msg, TURNED_ON) && msg.sequence == 1);
+  // Peeking again without advancing gives the same event
+  CHECK(retransmitPeek(&msg) && msg.sequence == 1);
+  retransmitAdvance();
+  CHECK(retransmitPeek(&msg) && isInfo(msg, MOTOR_START) && msg.sequence == 2);
+  retransmitAdvance();
+  CHECK(!retransmitPeek(&msg));
+
+  // Sent but not acknowledged
+  CHECK(retransmitPending() == 2);
+}
+
+static void testCumulativeAck()
+{
+  retransmitClear();
+  for (int i = 0; i < 5; i++)
+  {
+    append(TURNED_ON);
+  }
+  uint16_t last = 0;
+  CHECK(sendAll(&last) == 5 && last == 5);
+
+  retransmitAcknowledge(3);
+  CHECK(retransmitPending() == 2);
+  // A stale acknowledgement changes nothing
+  retransmitAcknowledge(1);
+  CHECK(retransmitPending() == 2);
+  retransmitAcknowledge(5);
+  CHECK(retransmitPending() == 0);
+
+  // Acknowledging what was never sent does not skip ahead of head
+  retransmitAcknowledge(100);
+  CHECK(append(TURNED_OFF) == 6);
+  CHECK(retransmitPending() == 1);
+
+  RetransmitStats stats;
+  retransmitGetStats(&stats);
+  CHECK(stats.appended == 6 && stats.acknowledged == 5 && stats.lost == 0);
+}
+
+static void testRewindReplays()
+{
+  retransmitClear();
+  for (int i = 0; i < 4; i++)
+  {
+    append(RELEASING);
+  }
+  uint16_t last = 0;
+  sendAll(&last);
+  retransmitAcknowledge(2);
+
+  // The connection drops before 3 and 4 are acknowledged
+  retransmitRewind();
+  append(RELEASED);
+  Message msg;
+  CHECK(retransmitPeek(&msg) && msg.sequence == 3);
+  CHECK(sendAll(&last) == 3 && last == 5);
+
+  RetransmitStats stats;
+  retransmitGetStats(&stats);
+  CHECK(stats.resent == 2);
+
+  // Rewinding twice without new sends replays the same events, counted again
+  retransmitRewind();
+  CHECK(sendAll(&last) == 3);
+  retransmitGetStats(&stats);
+  CHECK(stats.resent == 5);
+}
+
+static void testOverflowLosesOldest()
+{
+  retransmitClear();
+  for (int i = 0; i < RETRANSMIT_ENTRIES + 3; i++)
+  {
+    append(MOTOR_STOP);
+  }
+  CHECK(retransmitPending() == RETRANSMIT_ENTRIES);
+
+  RetransmitStats stats;
+  retransmitGetStats(&stats);
+  CHECK(stats.lost == 3);
+
+  Message msg;
+  CHECK(retransmitPeek(&msg) && msg.sequence == 4);
+  uint16_t last = 0;
+  CHECK(sendAll(&last) == RETRANSMIT_ENTRIES && last == RETRANSMIT_ENTRIES + 3);
+}
+
+static void testSequenceWrap()
+{
+  retransmitClear();
+  uint16_t last = 0;
+  // Keep the ring acknowledged so nothing is lost on the way to the wrap
+  for (uint32_t i = 0; i < 65534; i++)
+  {
+    last = append(TURNED_ON);
+    retransmitAcknowledge(last);
+  }
+  CHECK(last == 65534);
+
+  CHECK(append(TURNED_ON) == 65535);
+  // 0 means not sequenced and is never handed out
+  CHECK(append(TURNED_OFF) == 1);
+  CHECK(retransmitPending() == 2);
+
+  // Serial comparison: 1 comes after 65535, so acknowledging it covers both
+  retransmitAcknowledge(1);
+  CHECK(retransmitPending() == 0);
+}
+
+static void testCriticalTypes()
+{
+  CHECK(retransmitIsCritical(TURNED_ON));
+  CHECK(retransmitIsCritical(MOTOR_OVERHEAT));
+  CHECK(retransmitIsCritical(COMPRESSION_COUNTOWN_END));
+  CHECK(!retransmitIsCritical(PRESSURE_CHANGE));
+  CHECK(!retransmitIsCritical(MOTOR_TEMPERATURE));
+  CHECK(!retransmitIsCritical(COMPRESSION_COUNTDOWN_UPDATED));
+}
+
+int main()
+{
+  testAppendPeekAdvance();
+  testCumulativeAck();
+  testRewindReplays();
+  testOverflowLosesOldest();
+  testSequenceWrap();
+  testCriticalTypes();
+
+  return checkSummary("retransmit");
+}
@@ -0,0 +1,93 @@
+// Settings in flash: records saved by earlier firmware still load after an upgrade
+#include "settings.h"
+#include "thermal.h"
+#include "hallinux.h"
+
+#include "check.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// The record as the first release saved it
+typedef struct
+{
+  char ssid[32];
+  char password[64];
+  int authMode;
+  int compressionTimeout;
+  int supplyTimeout;
+  int motorTimeout;
+  uint32_t magic;
+} FirstReleaseSettings;
+
+// Saved with the temperature limit, before the discovered server was kept
+typedef struct
+{
+  FirstReleaseSettings first;
+  int motorTemperatureLimit;
+} LimitSettings;
+
+static void testFirstReleaseRecord()
+{
+  halSimReset();
+  FirstReleaseSettings saved = {"workshop", "secret", 3, 45, 7, 4, SETTINGS_MAGIC};
+  CHECK(halStorageWrite(&saved, sizeof(saved)));
+
+  initSettings();
+  CHECK(strcmp((const char *)currentSettings.ssid, "workshop") == 0);
+  CHECK(strcmp((const char *)currentSettings.password, "secret") == 0);
+  CHECK(currentSettings.authMode == 3);
+  CHECK(currentSettings.compressionTimeout == 45 && currentSettings.supplyTimeout == 7 &&
+        currentSettings.motorTimeout == 4);
+  // Fields it did not have read back as erased flash and get their defaults
+  CHECK(currentSettings.motorTemperatureLimit == THERMAL_DEFAULT_LIMIT_C);
+  CHECK(currentSettings.serverAddress == 0 && currentSettings.serverPort == 0);
+}
+
+static void testRecordBeforeDiscovery()
+{
+  halSimReset();
+  LimitSettings saved = {{"workshop", "secret", 3, 45, 7, 4, SETTINGS_MAGIC}, 110};
+  CHECK(halStorageWrite(&saved, sizeof(saved)));
+
+  initSettings();
+  CHECK(strcmp((const char *)currentSettings.ssid, "workshop") == 0);
+  CHECK(currentSettings.motorTemperatureLimit == 110);
+  CHECK(currentSettings.serverAddress == 0 && currentSettings.serverPort == 0);
+}
+
+static void testRoundTrip()
+{
+  halSimReset();
+  initSettings();
+  currentSettings.compressionTimeout = 30;
+  currentSettings.motorTemperatureLimit = 95;
+  currentSettings.serverAddress = 0x2C0AA8C0;
+  currentSettings.serverPort = 3000;
+  requestSettingsValidation();
+  CHECK(settingsTaskStep(0));
+
+  memset((Settings *)&currentSettings, 0, sizeof(Settings));
+  initSettings();
+  CHECK(currentSettings.compressionTimeout == 30 && currentSettings.motorTemperatureLimit == 95);
+  CHECK(currentSettings.serverAddress == 0x2C0AA8C0 && currentSettings.serverPort == 3000);
+}
+
+static void testErasedFlash()
+{
+  halSimReset();
+  initSettings();
+  CHECK(currentSettings.magic == SETTINGS_MAGIC);
+  CHECK(currentSettings.ssid[0] == '\0');
+  CHECK(currentSettings.motorTemperatureLimit == THERMAL_DEFAULT_LIMIT_C);
+}
+
+int main()
+{
+  testFirstReleaseRecord();
+  testRecordBeforeDiscovery();
+  testRoundTrip();
+  testErasedFlash();
+
+  return checkSummary("settings");
+}
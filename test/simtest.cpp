@@ -0,0 +1,168 @@
+// Closed-loop host test: the control logic runs a simulated day against the
+// tank and compressor model
+#include "control.h"
+#include "constants.h"
+#include "settings.h"
+#include "sensors.h"
+#include "scheduler.h"
+#include "thermal.h"
+#include "retransmit.h"
+#include "hallinux.h"
+#include "tanksim.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#define SIM_STEP_MS SENSOR_SAMPLE_INTERVAL_MS
+#define SHIFT_START (7 * 3600)
+#define SHIFT_END (18 * 3600)
+#define SHIFT_RUNS 6
+#define CONSUMER_LITRES_PER_S 0.3f
+
+static int infoCounts[MOTOR_START_BLOCKED + 1];
+
+static void setUp(TankSim *sim)
+{
+  halSimReset();
+  initSettings();
+  currentSettings.compressionTimeout = 60;
+  currentSettings.supplyTimeout = 30;
+  currentSettings.motorTimeout = 10;
+  currentSettings.motorTemperatureLimit = THERMAL_DEFAULT_LIMIT_C;
+  initControl();
+  initScheduler();
+  initThermal();
+  initSensors();
+  outgoingMessageQueue = halQueueCreate(64, sizeof(Message));
+
+  TankSimConfig config = tankSimDefaultConfig();
+  tankSimInit(sim, &config);
+  tankSimAttach(sim);
+}
+
+static void drainOutgoing()
+{
+  Message msg;
+  while (retransmitPeek(&msg))
+  {
+    retransmitAdvance();
+    retransmitAcknowledge(msg.sequence);
+    infoCounts[msg.type]++;
+  }
+  while (halQueueReceive(outgoingMessageQueue, &msg, 0))
+  {
+    if (msg.messageType == MessageType::INFO && msg.type <= MOTOR_START_BLOCKED)
+    {
+      infoCounts[msg.type]++;
+    }
+  }
+}
+
+// One sensor period of every task, in the order they would wake
+static void stepTasks()
+{
+  halSimAdvanceMs(SIM_STEP_MS);
+  schedulerRunDue();
+  while (controlTaskStep(0))
+  {
+  }
+  while (settingsTaskStep(0))
+  {
+  }
+  sensorTaskStep();
+  drainOutgoing();
+}
+
+static void testPlantFillsAndReleases()
+{
+  TankSim sim;
+  setUp(&sim);
+
+  handleMessage(commandMessage(CommandType::ON));
+
+  // Fills to the pressure switch well inside the motor timeout
+  for (int i = 0; i < 10 * 60 * 1000 / SIM_STEP_MS && sim.switchClosed; i++)
+  {
+    stepTasks();
+  }
+  CHECK(!sim.switchClosed);
+  CHECK(sim.motorRunSeconds < currentSettings.motorTimeout * 60);
+  CHECK(pressure >= sim.config.cutOutPsi - 1.0f);
+  CHECK(infoCounts[MOTOR_START] == 1);
+  CHECK(infoCounts[MOTOR_STOP] == 1);
+
+  // Release empties the tank
+  handleMessage(commandMessage(CommandType::OFF_RELEASE));
+  stepTasks();
+  CHECK(!halGpioGet(SOLENOID_GPIO));
+  CHECK(sim.pressurePsi < 0.1f * sim.config.cutOutPsi);
+}
+
+static void testSimulatedDay()
+{
+  TankSim sim;
+  setUp(&sim);
+  for (int &count : infoCounts)
+  {
+    count = 0;
+  }
+
+  // Run for the compression timeout every two hours through the shift
+  schedulerSetClock(0);
+  for (int i = 0; i < SHIFT_RUNS; i++)
+  {
+    CHECK(schedulerAdd(i + 1, CommandType::ON, SCHEDULE_DAILY, SHIFT_START + i * 2 * 3600));
+  }
+
+  clock_t started = clock();
+  float peakTemperature = 0.0f;
+  for (uint32_t ms = 0; ms < SECONDS_PER_DAY * 1000U; ms += SIM_STEP_MS)
+  {
+    uint32_t second = ms / 1000;
+    sim.consumerLitresPerS = second >= SHIFT_START && second < SHIFT_END ? CONSUMER_LITRES_PER_S : 0.0f;
+    stepTasks();
+
+    ThermalState thermal;
+    thermalGetState(&thermal);
+    if (thermal.temperatureMilliC / 1000.0f > peakTemperature)
+    {
+      peakTemperature = thermal.temperatureMilliC / 1000.0f;
+    }
+  }
+  double wallSeconds = (double)(clock() - started) / CLOCKS_PER_SEC;
+
+  fprintf(stderr, "Simulated day: %u motor starts, %.0f s running, peak %.1f psi, peak %.1f C, %.2f s wall clock\n",
+          (unsigned)sim.motorStarts, sim.motorRunSeconds, sim.peakPressurePsi, peakTemperature, wallSeconds);
+
+  // Every run ends in a timed release and the pressure switch does the cycling
+  CHECK(infoCounts[SCHEDULE_TRIGGERED] == SHIFT_RUNS);
+  CHECK(infoCounts[COMPRESSION_COUNTOWN_END] == SHIFT_RUNS);
+  // The supply timer is not stopped when the consumer empties the tank after
+  // a release, so it times out and releases once more
+  CHECK(infoCounts[RELEASED] == infoCounts[COMPRESSION_COUNTOWN_END] + infoCounts[RELEASE_COUNTDOWN_END]);
+  CHECK(sim.motorStarts > SHIFT_RUNS);
+  CHECK(infoCounts[MOTOR_START] == (int)sim.motorStarts);
+
+  // The tank stays below cut-out plus one sample of overshoot and the motor cool
+  CHECK(sim.peakPressurePsi < sim.config.cutOutPsi + 1.0f);
+  CHECK(infoCounts[MOTOR_OVERHEAT] == 0);
+  CHECK(infoCounts[MOTOR_COUNTDOWN_END] == 0);
+
+  CHECK(!halGpioGet(RELAY_GPIO));
+  CHECK(sim.pressurePsi < 1.0f);
+  CHECK(schedulerCount() == SHIFT_RUNS);
+}
+
+int main()
+{
+  if (freopen("/dev/null", "w", stdout) == NULL)
+  {
+    fprintf(stderr, "Could not silence stdout\n");
+  }
+
+  testPlantFillsAndReleases();
+  testSimulatedDay();
+
+  return checkSummary("simulation");
+}
@@ -0,0 +1,193 @@
+// Telemetry sample blocks: layout, round trip, and loss accounting from sequence gaps
+#include "telemetry.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static TelemetryBlock block;
+
+static void testLayout()
+{
+  CHECK(telemetryBlockInit(block, 2, 3, 1000));
+  uint16_t first[2] = {0x0102, 0x0A0B};
+  uint16_t second[2] = {0x0304, 0x0C0D};
+  uint16_t third[2] = {0x0506, 0x0E0F};
+  CHECK(!telemetryBlockAdd(block, first, 0x1122334455667788ull));
+  CHECK(!telemetryBlockAdd(block, second, 0x1122334455667788ull + 1000));
+  CHECK(telemetryBlockAdd(block, third, 0x1122334455667788ull + 2000));
+
+  const uint8_t expected[] = {'C', 'T', 1, 2, 0, 3, 0, 0, 0, 0, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88,
+                              0, 0, 0x03, 0xE8, 1, 2, 3, 4, 5, 6, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F};
+  CHECK(block.length == sizeof(expected) && memcmp(block.packet, expected, sizeof(expected)) == 0);
+
+  // The next block carries the next sequence and its own first time
+  CHECK(!telemetryBlockAdd(block, first, 5));
+  CHECK(block.length == 0);
+  CHECK(!telemetryBlockAdd(block, second, 6));
+  CHECK(telemetryBlockAdd(block, third, 7));
+  TelemetryBlockView view;
+  CHECK(telemetryParseBlock(block.packet, block.length, view));
+  CHECK(view.sequence == 1 && view.firstUs == 5 && view.intervalUs == 1000);
+}
+
+static void testShapes()
+{
+  CHECK(!telemetryBlockInit(block, 0, 10, 1000));
+  CHECK(!telemetryBlockInit(block, 2, 0, 1000));
+  CHECK(telemetryBlockInit(block, 2, (TELEMETRY_MAX_PACKET - TELEMETRY_HEADER) / 4, 1000));
+  CHECK(!telemetryBlockInit(block, 2, (TELEMETRY_MAX_PACKET - TELEMETRY_HEADER) / 4 + 1, 1000));
+}
+
+static void testRoundTrip()
+{
+  const uint8_t channels = 3;
+  const uint16_t perChannel = 100;
+  CHECK(telemetryBlockInit(block, channels, perChannel, 250));
+  static uint16_t taken[10][perChannel][channels];
+  int blocks = 0;
+  for (int sample = 0; blocks < 10; sample++)
+  {
+    uint16_t values[channels];
+    for (uint8_t channel = 0; channel < channels; channel++)
+    {
+      values[channel] = (uint16_t)nextRandom();
+      taken[blocks][sample % perChannel][channel] = values[channel];
+    }
+    if (!telemetryBlockAdd(block, values, 1000000 + (uint64_t)sample * 250))
+    {
+      continue;
+    }
+    TelemetryBlockView view;
+    CHECK(telemetryParseBlock(block.packet, block.length, view));
+    CHECK(view.channels == channels && view.samplesPerChannel == perChannel);
+    CHECK(view.sequence == (uint32_t)blocks);
+    CHECK(view.firstUs == 1000000 + (uint64_t)blocks * perChannel * 250);
+    int mismatches = 0;
+    for (uint16_t index = 0; index < perChannel; index++)
+    {
+      for (uint8_t channel = 0; channel < channels; channel++)
+      {
+        mismatches += telemetrySample(view, channel, index) != taken[blocks][index][channel];
+      }
+    }
+    CHECK(mismatches == 0);
+    blocks++;
+  }
+}
+
+static void testParseRejects()
+{
+  CHECK(telemetryBlockInit(block, 1, 2, 1000));
+  uint16_t value = 7;
+  telemetryBlockAdd(block, &value, 0);
+  CHECK(telemetryBlockAdd(block, &value, 1000));
+
+  TelemetryBlockView view;
+  CHECK(telemetryParseBlock(block.packet, block.length, view));
+  CHECK(!telemetryParseBlock(block.packet, block.length - 1, view));
+  CHECK(!telemetryParseBlock(block.packet, TELEMETRY_HEADER - 1, view));
+
+  uint8_t packet[TELEMETRY_MAX_PACKET];
+  memcpy(packet, block.packet, block.length);
+  packet[0] = 'X';
+  CHECK(!telemetryParseBlock(packet, block.length, view));
+  memcpy(packet, block.packet, block.length);
+  packet[2] = TELEMETRY_VERSION + 1;
+  CHECK(!telemetryParseBlock(packet, block.length, view));
+  memcpy(packet, block.packet, block.length);
+  packet[5] = 3; // Claims more samples than it carries
+  CHECK(!telemetryParseBlock(packet, block.length, view));
+}
+
+static void testLoss()
+{
+  TelemetryLossCounter counter;
+  telemetryLossInit(counter);
+  telemetryLossRecord(counter, 100);
+  telemetryLossRecord(counter, 101);
+  CHECK(counter.lost == 0 && counter.received == 2);
+
+  // 102 and 103 lost, then 103 turns up late
+  telemetryLossRecord(counter, 104);
+  CHECK(counter.lost == 2);
+  telemetryLossRecord(counter, 103);
+  CHECK(counter.lost == 1 && counter.late == 1);
+  // Seen twice is not a loss recovered
+  telemetryLossRecord(counter, 103);
+  telemetryLossRecord(counter, 104);
+  CHECK(counter.lost == 1 && counter.duplicates == 2);
+
+  // Across the wrap
+  telemetryLossInit(counter);
+  telemetryLossRecord(counter, 0xFFFFFFFE);
+  telemetryLossRecord(counter, 0xFFFFFFFF);
+  telemetryLossRecord(counter, 1);
+  CHECK(counter.lost == 1);
+  telemetryLossRecord(counter, 0);
+  CHECK(counter.lost == 0 && counter.late == 1);
+
+  // A long outage, then one from before it is too old to tell
+  telemetryLossInit(counter);
+  telemetryLossRecord(counter, 10);
+  telemetryLossRecord(counter, 60);
+  CHECK(counter.lost == 49);
+  telemetryLossRecord(counter, 11);
+  CHECK(counter.lost == 49 && counter.duplicates == 1);
+  telemetryLossRecord(counter, 59);
+  CHECK(counter.lost == 48 && counter.late == 1);
+
+  // A random lossy, reordering channel: what is lost is what never arrived
+  telemetryLossInit(counter);
+  const uint32_t total = 20000;
+  static bool delivered[total];
+  memset(delivered, 0, sizeof(delivered));
+  uint32_t held = UINT32_MAX;
+  for (uint32_t sequence = 0; sequence < total; sequence++)
+  {
+    uint32_t roll = nextRandom() % 100;
+    if (roll < 5)
+    {
+      continue; // Dropped
+    }
+    if (roll < 10 && held == UINT32_MAX && sequence > 0 && sequence < total - 1)
+    {
+      held = sequence; // Delivered after the next one
+      continue;
+    }
+    telemetryLossRecord(counter, sequence);
+    delivered[sequence] = true;
+    if (held != UINT32_MAX)
+    {
+      telemetryLossRecord(counter, held);
+      delivered[held] = true;
+      held = UINT32_MAX;
+    }
+  }
+  uint32_t neverArrived = 0;
+  for (uint32_t sequence = 0; sequence < total; sequence++)
+  {
+    neverArrived += !delivered[sequence];
+  }
+  // Drops after the last delivered block are not visible yet
+  uint32_t last = total - 1;
+  while (!delivered[last])
+  {
+    neverArrived--;
+    last--;
+  }
+  CHECK(counter.lost == neverArrived);
+  CHECK(counter.duplicates == 0);
+}
+
+int main()
+{
+  seedRandom(0x510E527Fu);
+  testLayout();
+  testShapes();
+  testRoundTrip();
+  testParseRejects();
+  testLoss();
+
+  return checkSummary("telemetry");
+}
@@ -0,0 +1,116 @@
+// TLS cost accounting: the counting allocator, handshake timing, and record overhead
+#include "tlsstats.h"
+#include "check.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+static void testAllocator()
+{
+  tlsResetStats();
+  TlsStats stats;
+
+  uint8_t *block = (uint8_t *)tlsCalloc(10, 100);
+  CHECK(block != NULL);
+  CHECK(((uintptr_t)block % alignof(max_align_t)) == 0);
+  int nonZero = 0;
+  for (int i = 0; i < 1000; i++)
+  {
+    nonZero += block[i] != 0;
+    block[i] = 0xA5;
+  }
+  CHECK(nonZero == 0);
+  void *other = tlsCalloc(1, 24);
+  tlsGetStats(&stats);
+  CHECK(stats.heapNow == 1024 && stats.heapPeak == 1024);
+
+  tlsFree(block);
+  tlsFree(NULL);
+  tlsGetStats(&stats);
+  CHECK(stats.heapNow == 24 && stats.heapPeak == 1024);
+
+  // A size that overflows is refused, not wrapped
+  CHECK(tlsCalloc(SIZE_MAX / 2, 4) == NULL);
+  CHECK(tlsCalloc(SIZE_MAX, 1) == NULL);
+  tlsGetStats(&stats);
+  CHECK(stats.heapNow == 24);
+
+  // Reset keeps what is still held and measures the peak from there
+  tlsResetStats();
+  tlsGetStats(&stats);
+  CHECK(stats.heapNow == 24 && stats.heapPeak == 24);
+  tlsFree(other);
+  tlsGetStats(&stats);
+  CHECK(stats.heapNow == 0 && stats.heapPeak == 24);
+
+  // Random churn ends where it started, the peak is the most live at once
+  void *live[64] = {};
+  size_t sizes[64] = {};
+  uint32_t now = 0;
+  uint32_t peak = 0;
+  for (int step = 0; step < 5000; step++)
+  {
+    int slot = nextRandom() % 64;
+    if (live[slot] != NULL)
+    {
+      tlsFree(live[slot]);
+      now -= (uint32_t)sizes[slot];
+      live[slot] = NULL;
+    }
+    else
+    {
+      sizes[slot] = 1 + nextRandom() % 2000;
+      live[slot] = tlsCalloc(1, sizes[slot]);
+      now += (uint32_t)sizes[slot];
+      peak = now > peak ? now : peak;
+    }
+  }
+  tlsGetStats(&stats);
+  CHECK(stats.heapNow == now && stats.heapPeak == peak);
+  for (int slot = 0; slot < 64; slot++)
+  {
+    tlsFree(live[slot]);
+  }
+  tlsGetStats(&stats);
+  CHECK(stats.heapNow == 0);
+}
+
+static void testHandshakes()
+{
+  tlsResetStats();
+  tlsRecordHandshake(850000, false, true);
+  tlsRecordHandshake(1250000, false, true);
+  tlsRecordHandshake(60000, true, true);
+  tlsRecordHandshake(40000, true, true);
+  tlsRecordHandshake(3000000, false, false);
+
+  TlsStats stats;
+  tlsGetStats(&stats);
+  CHECK(stats.fullHandshakes == 2 && stats.resumedHandshakes == 2 && stats.failedHandshakes == 1);
+  CHECK(stats.maxFullMs == 1250 && stats.totalFullMs == 2100 && stats.totalResumedMs == 100);
+  CHECK(stats.lastHandshakeMs == 40); // A failure does not count as the last handshake
+}
+
+static void testOverhead()
+{
+  tlsResetStats();
+  // AES-GCM: 5 header, 8 explicit nonce, 16 tag
+  for (int write = 0; write < 10; write++)
+  {
+    tlsRecordWrite(100 + write, 100 + write + 29);
+  }
+  TlsStats stats;
+  tlsGetStats(&stats);
+  CHECK(stats.writes == 10 && stats.plainBytes == 1045 && stats.wireBytes == 1335);
+  CHECK((stats.wireBytes - stats.plainBytes) / stats.writes == 29);
+}
+
+int main()
+{
+  seedRandom(0x3C6EF372u);
+  testAllocator();
+  testHandshakes();
+  testOverhead();
+
+  return checkSummary("TLS stats");
+}
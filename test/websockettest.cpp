@@ -0,0 +1,257 @@
+// WebSocket handshake key and frame decoding, over any split of the stream
+#include "websocket.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+// A masked frame as a browser sends it; first is FIN, RSV and opcode
+static std::vector<uint8_t> clientFrame(uint8_t first, const std::string &payload)
+{
+  std::vector<uint8_t> frame;
+  frame.push_back(first);
+  size_t length = payload.size();
+  if (length < 126)
+  {
+    frame.push_back(0x80 | (uint8_t)length);
+  }
+  else if (length <= 0xFFFF)
+  {
+    frame.push_back(0x80 | 126);
+    frame.push_back((uint8_t)(length >> 8));
+    frame.push_back((uint8_t)length);
+  }
+  else
+  {
+    frame.push_back(0x80 | 127);
+    for (int i = 7; i >= 0; i--)
+    {
+      frame.push_back((uint8_t)((uint64_t)length >> (i * 8)));
+    }
+  }
+  uint8_t mask[4];
+  for (uint8_t &byte : mask)
+  {
+    byte = (uint8_t)nextRandom();
+    frame.push_back(byte);
+  }
+  for (size_t i = 0; i < length; i++)
+  {
+    frame.push_back((uint8_t)payload[i] ^ mask[i & 3]);
+  }
+  return frame;
+}
+
+static void append(std::vector<uint8_t> &stream, const std::vector<uint8_t> &frame)
+{
+  stream.insert(stream.end(), frame.begin(), frame.end());
+}
+
+typedef struct
+{
+  std::vector<std::string> messages;
+  std::vector<std::string> controls; // Opcode as a digit, then the payload
+  bool error;
+} Decoded;
+
+// Feeds stream to a fresh decoder in segments cut at the given points
+static Decoded decode(std::vector<uint8_t> stream, const std::vector<size_t> &cuts)
+{
+  Decoded decoded = {};
+  WebSocketDecoder decoder;
+  websocketDecoderInit(decoder);
+  std::string message;
+
+  size_t start = 0;
+  for (size_t i = 0; i <= cuts.size() && !decoded.error; i++)
+  {
+    size_t end = i < cuts.size() ? cuts[i] : stream.size();
+    uint8_t *data = stream.data() + start;
+    size_t length = end - start;
+    start = end;
+    while (true)
+    {
+      size_t consumed;
+      WebSocketChunk chunk;
+      WebSocketResult result = websocketDecode(decoder, data, length, &consumed, &chunk);
+      CHECK(consumed <= length);
+      data += consumed;
+      length -= consumed;
+      if (result == WEBSOCKET_NEED_MORE)
+      {
+        CHECK(length == 0);
+        break;
+      }
+      if (result == WEBSOCKET_ERROR)
+      {
+        decoded.error = true;
+        break;
+      }
+      if (result == WEBSOCKET_CONTROL)
+      {
+        decoded.controls.push_back(std::to_string(decoder.frameOpcode) +
+                                   std::string((const char *)decoder.control, decoder.controlLength));
+        continue;
+      }
+      CHECK(chunk.data >= stream.data() && chunk.data + chunk.length <= stream.data() + stream.size());
+      message.append((const char *)chunk.data, chunk.length);
+      if (chunk.messageEnd)
+      {
+        decoded.messages.push_back((chunk.opcode == WEBSOCKET_TEXT ? "T" : "B") + message);
+        message.clear();
+      }
+    }
+  }
+  return decoded;
+}
+
+static Decoded decodeWhole(const std::vector<uint8_t> &stream)
+{
+  return decode(stream, {});
+}
+
+static void testAcceptKey()
+{
+  // RFC 6455 section 1.3
+  const char *key = "dGhlIHNhbXBsZSBub25jZQ==";
+  char accept[WEBSOCKET_ACCEPT_LENGTH + 1];
+  websocketAcceptKey(key, strlen(key), accept);
+  CHECK(strcmp(accept, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") == 0);
+
+  const char *other = "x3JJHMbDL1EzLkh9GBhXDw==";
+  websocketAcceptKey(other, strlen(other), accept);
+  CHECK(strcmp(accept, "HSmrc0sMlYUkAGmm5OPpG2HaGWk=") == 0);
+}
+
+static void testRfcExamples()
+{
+  // A single-frame masked text message
+  const uint8_t hello[] = {0x81, 0x85, 0x37, 0xfa, 0x21, 0x3d, 0x7f, 0x9f, 0x4d, 0x51, 0x58};
+  Decoded decoded = decodeWhole(std::vector<uint8_t>(hello, hello + sizeof(hello)));
+  CHECK(!decoded.error && decoded.messages.size() == 1 && decoded.messages[0] == "THello");
+
+  // Fragmented, with a ping between the fragments
+  std::vector<uint8_t> stream;
+  append(stream, clientFrame(0x01, "Hel"));
+  append(stream, clientFrame(0x89, "are you there"));
+  append(stream, clientFrame(0x80, "lo"));
+  decoded = decodeWhole(stream);
+  CHECK(!decoded.error);
+  CHECK(decoded.messages.size() == 1 && decoded.messages[0] == "THello");
+  CHECK(decoded.controls.size() == 1 && decoded.controls[0] == "9are you there");
+}
+
+// Every way TCP could cut a stream gives the same messages
+static void testSplits()
+{
+  std::vector<uint8_t> stream;
+  append(stream, clientFrame(0x81, "{\"messageType\":\"COMMAND\",\"commandType\":\"ON\"}"));
+  append(stream, clientFrame(0x82, std::string("\x00\x01\x02", 3)));
+  append(stream, clientFrame(0x81, std::string(300, 'x')));
+  append(stream, clientFrame(0x01, ""));
+  append(stream, clientFrame(0x8A, ""));
+  append(stream, clientFrame(0x80, ""));
+  append(stream, clientFrame(0x88, "\x03\xe8"));
+  Decoded whole = decodeWhole(stream);
+  CHECK(!whole.error && whole.messages.size() == 4 && whole.controls.size() == 2);
+  CHECK(whole.messages[2] == "T" + std::string(300, 'x'));
+  CHECK(whole.messages[3] == "T");
+  CHECK(whole.controls[1] == "8\x03\xe8");
+
+  int mismatches = 0;
+  for (size_t cut = 0; cut <= stream.size(); cut++)
+  {
+    Decoded split = decode(stream, {cut});
+    mismatches += split.messages != whole.messages || split.controls != whole.controls || split.error;
+  }
+  for (int round = 0; round < 2000; round++)
+  {
+    std::vector<size_t> cuts;
+    size_t position = 0;
+    while (true)
+    {
+      position += nextRandom() % 8;
+      if (position >= stream.size())
+      {
+        break;
+      }
+      cuts.push_back(position);
+    }
+    Decoded split = decode(stream, cuts);
+    mismatches += split.messages != whole.messages || split.controls != whole.controls || split.error;
+  }
+  CHECK(mismatches == 0);
+}
+
+static void testLongLengths()
+{
+  std::string large(70000, 'y');
+  Decoded decoded = decodeWhole(clientFrame(0x82, large));
+  CHECK(!decoded.error && decoded.messages.size() == 1 && decoded.messages[0] == "B" + large);
+
+  // The top bit of a 64-bit length must be clear
+  const uint8_t huge[] = {0x82, 0xFF, 0x80, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4};
+  CHECK(decodeWhole(std::vector<uint8_t>(huge, huge + sizeof(huge))).error);
+}
+
+static void testProtocolErrors()
+{
+  // Unmasked client frame
+  const uint8_t unmasked[] = {0x81, 0x02, 'h', 'i'};
+  CHECK(decodeWhole(std::vector<uint8_t>(unmasked, unmasked + sizeof(unmasked))).error);
+
+  // Reserved bit set without an extension
+  CHECK(decodeWhole(clientFrame(0xC1, "hi")).error);
+  // Unknown opcode
+  CHECK(decodeWhole(clientFrame(0x83, "hi")).error);
+  // Fragmented control frame
+  CHECK(decodeWhole(clientFrame(0x09, "hi")).error);
+  // Control payload over 125 bytes
+  CHECK(decodeWhole(clientFrame(0x89, std::string(126, 'p'))).error);
+  // Continuation with no message open
+  CHECK(decodeWhole(clientFrame(0x80, "hi")).error);
+
+  // A new message while one is still open
+  std::vector<uint8_t> stream;
+  append(stream, clientFrame(0x01, "a"));
+  append(stream, clientFrame(0x81, "b"));
+  CHECK(decodeWhole(stream).error);
+
+  // Once failed, always failed
+  WebSocketDecoder decoder;
+  websocketDecoderInit(decoder);
+  std::vector<uint8_t> bad = clientFrame(0x83, "");
+  std::vector<uint8_t> good = clientFrame(0x81, "ok");
+  size_t consumed;
+  WebSocketChunk chunk;
+  CHECK(websocketDecode(decoder, bad.data(), bad.size(), &consumed, &chunk) == WEBSOCKET_ERROR);
+  CHECK(websocketDecode(decoder, good.data(), good.size(), &consumed, &chunk) == WEBSOCKET_ERROR);
+}
+
+static void testFrameHeader()
+{
+  uint8_t header[WEBSOCKET_MAX_HEADER];
+  CHECK(websocketFrameHeader(header, WEBSOCKET_TEXT, 0) == 2 && header[0] == 0x81 && header[1] == 0);
+  CHECK(websocketFrameHeader(header, WEBSOCKET_TEXT, 125) == 2 && header[1] == 125);
+  CHECK(websocketFrameHeader(header, WEBSOCKET_PONG, 126) == 4 && header[0] == 0x8A && header[1] == 126 &&
+        header[2] == 0 && header[3] == 126);
+  CHECK(websocketFrameHeader(header, WEBSOCKET_BINARY, 65535) == 4 && header[2] == 0xFF && header[3] == 0xFF);
+  CHECK(websocketFrameHeader(header, WEBSOCKET_BINARY, 65536) == 10 && header[1] == 127 && header[7] == 1 &&
+        header[8] == 0 && header[9] == 0);
+}
+
+int main()
+{
+  seedRandom(0x6A09E667u);
+  testAcceptKey();
+  testRfcExamples();
+  testSplits();
+  testLongLengths();
+  testProtocolErrors();
+  testFrameHeader();
+
+  return checkSummary("websocket");
+}
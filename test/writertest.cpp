@@ -0,0 +1,399 @@
+// Differential test: messageToBuffer() against the cJSON writer it replaced
+#include "control.h"
+#include "messagewriter.h"
+
+#include "cJSON.h"
+#include "check.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+static const char *scheduledCommandName(CommandType command)
+{
+  switch (command)
+  {
+  case CommandType::ON:
+    return "ON";
+  case CommandType::OFF:
+    return "OFF";
+  case CommandType::OFF_RELEASE:
+    return "OFF_RELEASE";
+  default:
+    return "";
+  }
+}
+
+static const char *scheduleModeName(ScheduleMode mode)
+{
+  switch (mode)
+  {
+  case ScheduleMode::SCHEDULE_IN:
+    return "IN";
+  case ScheduleMode::SCHEDULE_AT:
+    return "AT";
+  case ScheduleMode::SCHEDULE_DAILY:
+    return "DAILY";
+  default:
+    return "";
+  }
+}
+
+// The cJSON implementation messageToBuffer() replaced, kept as the oracle
+static std::string referenceMessageToString(const Message &msg)
+{
+  cJSON *json = cJSON_CreateObject();
+
+  // Add messageType
+  if (msg.messageType == MessageType::COMMAND)
+  {
+    cJSON_AddStringToObject(json, "messageType", "COMMAND");
+
+    // Add commandType
+    switch (commandTypeOf(msg))
+    {
+    case CommandType::ON:
+      cJSON_AddStringToObject(json, "commandType", "ON");
+      break;
+    case CommandType::OFF:
+      cJSON_AddStringToObject(json, "commandType", "OFF");
+      break;
+    case CommandType::OFF_RELEASE:
+      cJSON_AddStringToObject(json, "commandType", "OFF_RELEASE");
+      break;
+    case CommandType::SET_COMPRESSION_TIMEOUT:
+      cJSON_AddStringToObject(json, "commandType", "SET_COMPRESSION_TIMEOUT");
+      cJSON_AddNumberToObject(json, "timeout", msg.payload.timeout);
+      break;
+    case CommandType::SET_RELEASE_TIMEOUT:
+      cJSON_AddStringToObject(json, "commandType", "SET_RELEASE_TIMEOUT");
+      cJSON_AddNumberToObject(json, "timeout", msg.payload.timeout);
+      break;
+    case CommandType::SET_MOTOR_TIMEOUT:
+      cJSON_AddStringToObject(json, "commandType", "SET_MOTOR_TIMEOUT");
+      cJSON_AddNumberToObject(json, "timeout", msg.payload.timeout);
+      break;
+    case CommandType::SCHEDULE:
+      cJSON_AddStringToObject(json, "commandType", "SCHEDULE");
+      cJSON_AddNumberToObject(json, "id", msg.payload.schedule.id);
+      cJSON_AddStringToObject(json, "action", scheduledCommandName((CommandType)msg.payload.schedule.action));
+      cJSON_AddStringToObject(json, "mode", scheduleModeName((ScheduleMode)msg.payload.schedule.mode));
+      cJSON_AddNumberToObject(json, "time", msg.payload.schedule.time);
+      break;
+    case CommandType::UNSCHEDULE:
+      cJSON_AddStringToObject(json, "commandType", "UNSCHEDULE");
+      cJSON_AddNumberToObject(json, "id", msg.payload.scheduleId);
+      break;
+    case CommandType::SET_CLOCK:
+      cJSON_AddStringToObject(json, "commandType", "SET_CLOCK");
+      cJSON_AddNumberToObject(json, "time", msg.payload.time);
+      break;
+    case CommandType::SET_MOTOR_TEMPERATURE_LIMIT:
+      cJSON_AddStringToObject(json, "commandType", "SET_MOTOR_TEMPERATURE_LIMIT");
+      cJSON_AddNumberToObject(json, "limit", msg.payload.limit);
+      break;
+    case CommandType::GET_RECORDER:
+      cJSON_AddStringToObject(json, "commandType", "GET_RECORDER");
+      cJSON_AddNumberToObject(json, "since", msg.payload.since);
+      break;
+    case CommandType::GET_LATENCY:
+      cJSON_AddStringToObject(json, "commandType", "GET_LATENCY");
+      break;
+    case CommandType::RESET_LATENCY:
+      cJSON_AddStringToObject(json, "commandType", "RESET_LATENCY");
+      break;
+    case CommandType::GET_STATE:
+      cJSON_AddStringToObject(json, "commandType", "GET_STATE");
+      break;
+    case CommandType::ACK:
+      cJSON_AddStringToObject(json, "commandType", "ACK");
+      break;
+    case CommandType::HEARTBEAT_ACK:
+      cJSON_AddStringToObject(json, "commandType", "HEARTBEAT_ACK");
+      break;
+    case CommandType::GET_HISTORY:
+      cJSON_AddStringToObject(json, "commandType", "GET_HISTORY");
+      cJSON_AddNumberToObject(json, "from", msg.payload.history.from);
+      cJSON_AddNumberToObject(json, "to", msg.payload.history.to);
+      cJSON_AddNumberToObject(json, "resolution", msg.payload.history.resolution);
+      break;
+    case CommandType::GET_STATS:
+      cJSON_AddStringToObject(json, "commandType", "GET_STATS");
+      break;
+    case CommandType::RESET_STATS:
+      cJSON_AddStringToObject(json, "commandType", "RESET_STATS");
+      break;
+    default:
+      break;
+    }
+  }
+  else if (msg.messageType == MessageType::INFO)
+  {
+    cJSON_AddStringToObject(json, "messageType", "INFO");
+
+    // Add infoType
+    switch (infoTypeOf(msg))
+    {
+    case InfoType::PRESSURE_CHANGE:
+      cJSON_AddStringToObject(json, "infoType", "PRESSURE_CHANGE");
+      cJSON_AddNumberToObject(json, "pressure", msg.payload.pressure);
+      break;
+    case InfoType::COMPRESSION_COUNTDOWN_UPDATED:
+      cJSON_AddStringToObject(json, "infoType", "COMPRESSION_COUNTDOWN_UPDATED");
+      cJSON_AddNumberToObject(json, "timeout", msg.payload.timeout);
+      break;
+    case InfoType::RELEASE_COUNTDOWN_UPDATE:
+      cJSON_AddStringToObject(json, "infoType", "RELEASE_COUNTDOWN_UPDATE");
+      cJSON_AddNumberToObject(json, "timeout", msg.payload.timeout);
+      break;
+    case InfoType::MOTOR_COUNTDOWN_UPDATE:
+      cJSON_AddStringToObject(json, "infoType", "MOTOR_COUNTDOWN_UPDATE");
+      cJSON_AddNumberToObject(json, "timeout", msg.payload.timeout);
+      break;
+    case InfoType::SCHEDULE_TRIGGERED:
+      cJSON_AddStringToObject(json, "infoType", "SCHEDULE_TRIGGERED");
+      cJSON_AddNumberToObject(json, "id", msg.payload.scheduleId);
+      break;
+    case InfoType::MOTOR_TEMPERATURE:
+      cJSON_AddStringToObject(json, "infoType", "MOTOR_TEMPERATURE");
+      cJSON_AddNumberToObject(json, "temperature", msg.payload.temperature);
+      break;
+    case InfoType::MOTOR_OVERHEAT:
+      cJSON_AddStringToObject(json, "infoType", "MOTOR_OVERHEAT");
+      cJSON_AddNumberToObject(json, "temperature", msg.payload.temperature);
+      break;
+    case InfoType::MOTOR_START_BLOCKED:
+      cJSON_AddStringToObject(json, "infoType", "MOTOR_START_BLOCKED");
+      cJSON_AddNumberToObject(json, "timeout", msg.payload.timeout);
+      break;
+    case InfoType::HEARTBEAT:
+      cJSON_AddStringToObject(json, "infoType", "HEARTBEAT");
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Convert JSON to string
+  char *jsonString = cJSON_PrintUnformatted(json);
+  std::string result(jsonString);
+  cJSON_free(jsonString);
+  cJSON_Delete(json); // Free the JSON object
+
+  return result;
+}
+
+static std::string write(const Message &msg)
+{
+  char buffer[MESSAGE_WRITER_MAX_LENGTH];
+  size_t length = messageToBuffer(msg, buffer, sizeof(buffer));
+  CHECK(length == strlen(buffer));
+  return std::string(buffer, length);
+}
+
+// The old writer gave INFO types without fields no infoType, the schema names them all
+static const char *const unnamedInfoTypes[] = {
+    "TURNED_ON", "TURNED_OFF", "RELEASING", "RELEASED", NULL, "MOTOR_START", "MOTOR_STOP",
+    "COMPRESSION_COUNTDOWN_END", "RELEASE_COUNTDOWN_END", "MOTOR_COUNTDOWN_END", NULL, NULL, NULL,
+    "SUPPLY_START", "SUPPLY_STOP"};
+
+static std::string expectedJson(const Message &msg)
+{
+  std::string reference = referenceMessageToString(msg);
+  if (msg.messageType == MessageType::INFO && msg.type < sizeof(unnamedInfoTypes) / sizeof(unnamedInfoTypes[0]) &&
+      unnamedInfoTypes[msg.type] != NULL)
+  {
+    CHECK(reference == "{\"messageType\":\"INFO\"}");
+    return std::string("{\"messageType\":\"INFO\",\"infoType\":\"") + unnamedInfoTypes[msg.type] + "\"}";
+  }
+  return reference;
+}
+
+static const int interestingIntegers[] = {0, 1, -1, 42, 3600, 86399, INT_MAX, INT_MIN};
+
+// The single integer payloads share timeout's storage
+static void fillIntegers(Message &msg, int value)
+{
+  msg.payload.schedule.id = value;
+  msg.payload.schedule.time = value;
+  CHECK(msg.payload.timeout == value && msg.payload.since == value);
+}
+
+// Every message without a float field prints byte for byte as before, apart
+// from the infoType added to the ones the old writer left unnamed
+static void testIntegerMessages()
+{
+  int mismatches = 0;
+  for (int round = 0; round < 64; round++)
+  {
+    int value = round < 8 ? interestingIntegers[round] : (int)nextRandom();
+
+    for (int type = 0; type <= CommandType::RESET_STATS + 1; type++)
+    {
+      Message msg = commandMessage((CommandType)type);
+      msg.payload.schedule.action = (uint8_t)(round % 4);
+      msg.payload.schedule.mode = (uint8_t)(round % 4);
+      fillIntegers(msg, value);
+      if (write(msg) != referenceMessageToString(msg))
+      {
+        fprintf(stderr, "command %d: %s != %s\n", type, write(msg).c_str(), referenceMessageToString(msg).c_str());
+        mismatches++;
+      }
+    }
+
+    for (int type = 0; type <= InfoType::HEARTBEAT + 1; type++)
+    {
+      if (type == InfoType::PRESSURE_CHANGE || type == InfoType::MOTOR_TEMPERATURE || type == InfoType::MOTOR_OVERHEAT)
+      {
+        continue;
+      }
+      Message msg = infoMessage((InfoType)type);
+      fillIntegers(msg, value);
+      if (write(msg) != expectedJson(msg))
+      {
+        fprintf(stderr, "info %d: %s != %s\n", type, write(msg).c_str(), expectedJson(msg).c_str());
+        mismatches++;
+      }
+    }
+  }
+
+  Message unknown = {};
+  unknown.messageType = 2;
+  CHECK(write(unknown) == referenceMessageToString(unknown));
+  CHECK(mismatches == 0);
+}
+
+// Same keys and strings in the same order, numbers equal once read back as float
+static bool sameDocument(const std::string &text, const std::string &reference)
+{
+  cJSON *json = cJSON_Parse(text.c_str());
+  cJSON *expected = cJSON_Parse(reference.c_str());
+  bool same = json != NULL && expected != NULL;
+
+  cJSON *item = same ? json->child : NULL;
+  cJSON *expectedItem = same ? expected->child : NULL;
+  while (same && (item != NULL || expectedItem != NULL))
+  {
+    same = item != NULL && expectedItem != NULL && strcmp(item->string, expectedItem->string) == 0 &&
+           item->type == expectedItem->type;
+    if (same && cJSON_IsString(item))
+    {
+      same = strcmp(item->valuestring, expectedItem->valuestring) == 0;
+    }
+    else if (same && cJSON_IsNumber(item))
+    {
+      same = (float)item->valuedouble == (float)expectedItem->valuedouble;
+    }
+    item = same ? item->next : NULL;
+    expectedItem = same ? expectedItem->next : NULL;
+  }
+
+  cJSON_Delete(json);
+  cJSON_Delete(expected);
+  return same;
+}
+
+static Message floatMessage(InfoType type, float value)
+{
+  return type == InfoType::PRESSURE_CHANGE ? pressureInfo(value) : temperatureInfo(type, value);
+}
+
+static void testFloatMessages()
+{
+  static const InfoType types[] = {InfoType::PRESSURE_CHANGE, InfoType::MOTOR_TEMPERATURE, InfoType::MOTOR_OVERHEAT};
+  int mismatches = 0;
+
+  // Every pressure the sensor task can report, rounded to 0.1 psi as sensors.cpp does
+  for (int tenths = 0; tenths <= 600; tenths++)
+  {
+    Message msg = floatMessage(InfoType::PRESSURE_CHANGE, roundf(tenths * 0.1f * 10.0f) / 10.0f);
+    std::string text = write(msg);
+    if (!sameDocument(text, referenceMessageToString(msg)))
+    {
+      fprintf(stderr, "%s != %s\n", text.c_str(), referenceMessageToString(msg).c_str());
+      mismatches++;
+    }
+  }
+
+  // Arbitrary bit patterns, including NaN, infinities, denormals and huge values
+  // that take the exponent form
+  for (int i = 0; i < 200000; i++)
+  {
+    uint32_t bits = nextRandom();
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    Message msg = floatMessage(types[i % 3], value);
+    if (!sameDocument(write(msg), referenceMessageToString(msg)))
+    {
+      if (mismatches < 10)
+      {
+        fprintf(stderr, "%s != %s\n", write(msg).c_str(), referenceMessageToString(msg).c_str());
+      }
+      mismatches++;
+    }
+  }
+  CHECK(mismatches == 0);
+
+  CHECK(write(floatMessage(InfoType::PRESSURE_CHANGE, 31.4f)) == "{\"messageType\":\"INFO\",\"infoType\":\"PRESSURE_CHANGE\",\"pressure\":31.4}");
+  CHECK(write(floatMessage(InfoType::PRESSURE_CHANGE, 0.1f)) == "{\"messageType\":\"INFO\",\"infoType\":\"PRESSURE_CHANGE\",\"pressure\":0.1}");
+  CHECK(write(floatMessage(InfoType::PRESSURE_CHANGE, 38.0f)) == "{\"messageType\":\"INFO\",\"infoType\":\"PRESSURE_CHANGE\",\"pressure\":38}");
+  CHECK(write(floatMessage(InfoType::MOTOR_TEMPERATURE, -2.25f)) == "{\"messageType\":\"INFO\",\"infoType\":\"MOTOR_TEMPERATURE\",\"temperature\":-2.25}");
+  CHECK(write(floatMessage(InfoType::MOTOR_OVERHEAT, NAN)) == "{\"messageType\":\"INFO\",\"infoType\":\"MOTOR_OVERHEAT\",\"temperature\":null}");
+  CHECK(write(floatMessage(InfoType::MOTOR_TEMPERATURE, 1e-12f)) == "{\"messageType\":\"INFO\",\"infoType\":\"MOTOR_TEMPERATURE\",\"temperature\":1e-12}");
+  CHECK(write(floatMessage(InfoType::MOTOR_TEMPERATURE, -3.5e20f)) == "{\"messageType\":\"INFO\",\"infoType\":\"MOTOR_TEMPERATURE\",\"temperature\":-3.5e20}");
+  CHECK(write(floatMessage(InfoType::MOTOR_OVERHEAT, -0.0f)) == referenceMessageToString(floatMessage(InfoType::MOTOR_OVERHEAT, -0.0f)));
+}
+
+// A short buffer gets an empty string and nothing past its end is touched
+static void testBufferTooSmall()
+{
+  Message msg = scheduleCommand(INT_MIN, CommandType::OFF_RELEASE, ScheduleMode::SCHEDULE_DAILY, INT_MIN);
+  std::string expected = referenceMessageToString(msg);
+  CHECK(expected.size() < MESSAGE_WRITER_MAX_LENGTH);
+
+  char buffer[MESSAGE_WRITER_MAX_LENGTH + 8];
+  for (size_t size = 0; size <= expected.size(); size++)
+  {
+    memset(buffer, 0x5A, sizeof(buffer));
+    CHECK(messageToBuffer(msg, buffer, size) == 0);
+    CHECK(size == 0 || buffer[0] == '\0');
+    for (size_t i = size; i < sizeof(buffer); i++)
+    {
+      CHECK(buffer[i] == 0x5A);
+    }
+  }
+  CHECK(messageToBuffer(msg, buffer, expected.size() + 1) == expected.size());
+  CHECK(expected == buffer);
+}
+
+static void testSequence()
+{
+  Message msg = infoMessage(InfoType::TURNED_OFF);
+  msg.sequence = 7;
+  char buffer[MESSAGE_WRITER_MAX_LENGTH];
+  CHECK(messageToBuffer(msg, buffer, sizeof(buffer)) > 0);
+  CHECK(strcmp(buffer, "{\"messageType\":\"INFO\",\"infoType\":\"TURNED_OFF\",\"seq\":7}") == 0);
+
+  msg = scheduleTriggeredInfo(3);
+  msg.sequence = 65535;
+  CHECK(messageToBuffer(msg, buffer, sizeof(buffer)) > 0);
+  CHECK(strcmp(buffer, "{\"messageType\":\"INFO\",\"infoType\":\"SCHEDULE_TRIGGERED\",\"id\":3,\"seq\":65535}") == 0);
+
+  msg = ackCommand(12);
+  CHECK(messageToBuffer(msg, buffer, sizeof(buffer)) > 0);
+  CHECK(strcmp(buffer, "{\"messageType\":\"COMMAND\",\"commandType\":\"ACK\",\"seq\":12}") == 0);
+}
+
+int main()
+{
+  seedRandom(0x1234567u);
+  testIntegerMessages();
+  testFloatMessages();
+  testBufferTooSmall();
+  testSequence();
+
+  return checkSummary("writer");
+}